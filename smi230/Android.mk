@@ -40,16 +40,56 @@ LOCAL_MULTILIB := first
 
 LOCAL_SRC_FILES :=\
 	sensord/axis_remap.c\
+	sensord/axis_remap_xyz.cpp\
 	sensord/sensord_hwcntl.cpp\
 	sensord/sensord_hwcntl_implement.cpp\
 	sensord/util_misc.c\
 	sensord/sensord_pltf.c\
 	sensord/sensord_cfg.cpp\
 	sensord/sensord_algo.cpp\
+	sensord/sensord_convert.cpp\
+	sensord/sensord_merge.cpp\
+	sensord/sensord_resample.cpp\
+	sensord/sensord_fusion.cpp\
+	sensord/sensord_gyrocal.cpp\
+	sensord/sensord_acccal.cpp\
+	sensord/sensord_step.cpp\
+	sensord/sensord_state.cpp\
+	sensord/sensord_arbiter.cpp\
+	sensord/sensord_wmctl.cpp\
+	sensord/sensord_input_frame.cpp\
+	sensord/sensord_iio_buffer.cpp\
+	sensord/sensord_uring.cpp\
 	sensord/sensord.cpp\
 	sensord/boschsimple_list.cpp\
+	sensord/boschsample_ring.cpp\
+	sensord/boschsample_pool.cpp\
 	hal/sensors.cpp\
-	hal/BoschSensor.cpp
+	hal/BoschSensor.cpp\
+	hal/BoschEventRing.cpp\
+	hal/BoschDirectChannel.cpp\
+	hal/BoschBatchStore.cpp
+
+ifeq ($(LOCAL_UNIT_TEST),true)
+LOCAL_SRC_FILES +=\
+	hal/unit_test_acccal.cpp\
+	hal/unit_test_batch.cpp\
+	hal/unit_test_converge.cpp\
+	hal/unit_test_convert.cpp\
+	hal/unit_test_direct.cpp\
+	hal/unit_test_event.cpp\
+	hal/unit_test_fusion.cpp\
+	hal/unit_test_iio.cpp\
+	hal/unit_test_input.cpp\
+	hal/unit_test_merge.cpp\
+	hal/unit_test_remap.cpp\
+	hal/unit_test_resample.cpp\
+	hal/unit_test_sample.cpp\
+	hal/unit_test_state.cpp\
+	hal/unit_test_step.cpp\
+	hal/unit_test_uring.cpp\
+	hal/unit_test_wmctl.cpp
+endif
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/hal\
 		$(LOCAL_PATH)/sensord/bsx/inc\
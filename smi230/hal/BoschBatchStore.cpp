@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "BoschBatchStore.h"
+#include "sensord_pltf.h"
+#include "util_misc.h"
+
+BoschBatchStore::BoschBatchStore()
+{
+    pthread_mutex_init(&mutex, NULL);
+    memset(slots, 0, sizeof(slots));
+    next_deadline_ns = INT64_MAX;
+    next_wake_deadline_ns = INT64_MAX;
+}
+
+BoschBatchStore::~BoschBatchStore()
+{
+    int i;
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        free(slots[i].p_events);
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
+/**
+ * slot memory is allocated on first batching request and kept afterwards
+ * @param latency_ns max_report_latency of poll path, 0 to stop holding events
+ * @param capacity most events held, 0 disables holding as well
+ * @param wakeup 1 for a wakeup sensor
+ * @return 0 on success, -ENOMEM if slot can't be allocated, the handle then reports at once
+ */
+int BoschBatchStore::configure(int handle, int64_t latency_ns, uint32_t capacity, int wakeup)
+{
+    BATCH_STORE_SLOT *p_slot;
+
+    if (handle < 0 || handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        return -EINVAL;
+    }
+
+    p_slot = &slots[handle];
+
+    if (latency_ns > 0 && capacity > 0 && (NULL == p_slot->p_events || capacity > p_slot->capacity))
+    {
+        /*held events are delivered by caller before capacity grows*/
+        free(p_slot->p_events);
+        clear(handle, 0);
+        p_slot->p_events = (sensors_event_t *) calloc(capacity, sizeof(sensors_event_t));
+        if (NULL == p_slot->p_events)
+        {
+            PERR("calloc batch store of %u events fail for handle %d", capacity, handle);
+            p_slot->latency_ns = 0;
+            p_slot->capacity = 0;
+            return -ENOMEM;
+        }
+        p_slot->capacity = capacity;
+    }
+
+    if (NULL == p_slot->p_events || 0 == capacity)
+    {
+        latency_ns = 0;
+    }
+
+    p_slot->latency_ns = latency_ns;
+    p_slot->wakeup = wakeup;
+    if (p_slot->count)
+    {
+        p_slot->deadline_ns = p_slot->p_events[0].timestamp + latency_ns;
+    }
+    update_next_deadline();
+
+    return 0;
+}
+
+int BoschBatchStore::is_batching(int handle) const
+{
+    if (handle < 0 || handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        return 0;
+    }
+
+    return slots[handle].latency_ns > 0;
+}
+
+int BoschBatchStore::is_full(int handle) const
+{
+    return slots[handle].count >= slots[handle].capacity;
+}
+
+/**
+ * caller checked is_batching() and is_full() for the event's handle
+ */
+void BoschBatchStore::put(const sensors_event_t *p_event)
+{
+    BATCH_STORE_SLOT *p_slot = &slots[p_event->sensor];
+
+    if (0 == p_slot->count)
+    {
+        p_slot->deadline_ns = p_event->timestamp + p_slot->latency_ns;
+        if (p_slot->deadline_ns < next_deadline_ns)
+        {
+            next_deadline_ns = p_slot->deadline_ns;
+        }
+        if (p_slot->wakeup && p_slot->deadline_ns < next_wake_deadline_ns)
+        {
+            next_wake_deadline_ns = p_slot->deadline_ns;
+        }
+    }
+
+    p_slot->p_events[p_slot->count++] = *p_event;
+}
+
+/**
+ * @param now_ns the time by which held events have to be out
+ * @return 1 if the handle holds events due at now_ns
+ */
+int BoschBatchStore::is_due(int handle, int64_t now_ns) const
+{
+    if (handle < 0 || handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        return 0;
+    }
+
+    return slots[handle].count && slots[handle].deadline_ns <= now_ns;
+}
+
+/**
+ * @return earliest deadline of held events, INT64_MAX when nothing is held
+ */
+int64_t BoschBatchStore::get_next_deadline() const
+{
+    return next_deadline_ns;
+}
+
+/**
+ * @return earliest deadline of events held for wakeup handles, INT64_MAX when none
+ */
+int64_t BoschBatchStore::get_next_wake_deadline() const
+{
+    return next_wake_deadline_ns;
+}
+
+void BoschBatchStore::update_next_deadline()
+{
+    int i;
+
+    next_deadline_ns = INT64_MAX;
+    next_wake_deadline_ns = INT64_MAX;
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (0 == slots[i].count)
+        {
+            continue;
+        }
+        if (slots[i].deadline_ns < next_deadline_ns)
+        {
+            next_deadline_ns = slots[i].deadline_ns;
+        }
+        if (slots[i].wakeup && slots[i].deadline_ns < next_wake_deadline_ns)
+        {
+            next_wake_deadline_ns = slots[i].deadline_ns;
+        }
+    }
+}
+
+/**
+ * @return number of held events of the handle at *pp_events, valid until clear()
+ */
+uint32_t BoschBatchStore::get_events(int handle, const sensors_event_t **pp_events) const
+{
+    if (handle < 0 || handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        *pp_events = NULL;
+        return 0;
+    }
+
+    *pp_events = slots[handle].p_events;
+
+    return slots[handle].count;
+}
+
+/**
+ * @param now_ns when held events went up, counted as deadline miss if later than deadline
+ */
+void BoschBatchStore::clear(int handle, int64_t now_ns)
+{
+    if (handle < 0 || handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        return;
+    }
+
+    if (slots[handle].count)
+    {
+        if (now_ns > slots[handle].deadline_ns)
+        {
+            slots[handle].miss_count++;
+        }
+        slots[handle].count = 0;
+        update_next_deadline();
+    }
+}
+
+uint64_t BoschBatchStore::get_miss_count(int handle) const
+{
+    if (handle < 0 || handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        return 0;
+    }
+
+    return slots[handle].miss_count;
+}
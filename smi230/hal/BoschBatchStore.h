@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BST_BATCH_STORE_H
+#define ANDROID_BST_BATCH_STORE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#if !defined(PLTF_LINUX_ENABLED)
+#include <hardware/sensors.h>
+#else
+#include "sensors.h"
+#endif
+#include "BoschDirectChannel.h"
+
+typedef struct
+{
+    int64_t latency_ns;     /*0 means events of the handle are not held*/
+    int wakeup;             /*held events have to wake the AP by their deadline*/
+    uint32_t capacity;      /*fifoMaxEventCount of the sensor*/
+    uint32_t count;
+    int64_t deadline_ns;    /*first held event timestamp + latency_ns*/
+    uint64_t miss_count;    /*deliveries later than deadline_ns*/
+    sensors_event_t *p_events;
+} BATCH_STORE_SLOT;
+
+/**
+ * HAL side batch FIFO per handle for poll path events.
+ *
+ * Events of a handle with max_report_latency are held until the oldest of them
+ * is due, until a slot is full, or until flush() of the handle, then all held
+ * events go up in one burst. Configured from framework thread, filled by
+ * sensord thread, every access is under mutex. Earliest deadline of all
+ * handles is what the delivery timer is armed for, earliest deadline of
+ * wakeup handles what the alarm timer is armed for.
+ */
+class BoschBatchStore
+{
+public:
+    BoschBatchStore();
+    ~BoschBatchStore();
+
+    void lock() { pthread_mutex_lock(&mutex); }
+    void unlock() { pthread_mutex_unlock(&mutex); }
+
+    /*mutex must be held by caller for all below*/
+    int configure(int handle, int64_t latency_ns, uint32_t capacity, int wakeup);
+    int is_batching(int handle) const;
+    int is_full(int handle) const;
+    void put(const sensors_event_t *p_event);
+    int is_due(int handle, int64_t now_ns) const;
+    int64_t get_next_deadline() const;
+    int64_t get_next_wake_deadline() const;
+    uint32_t get_events(int handle, const sensors_event_t **pp_events) const;
+    void clear(int handle, int64_t now_ns);
+    uint64_t get_miss_count(int handle) const;
+
+private:
+    BoschBatchStore(const BoschBatchStore & other); //for cppcheck "noCopyConstructor"
+    BoschBatchStore &operator=(const BoschBatchStore & other);
+
+    void update_next_deadline();
+
+    pthread_mutex_t mutex;
+    /*earliest deadline of all held events, INT64_MAX when nothing is held*/
+    int64_t next_deadline_ns;
+    /*same over wakeup handles only*/
+    int64_t next_wake_deadline_ns;
+    BATCH_STORE_SLOT slots[HAL_SENSOR_HANDLE_MAX];
+};
+
+#endif  // ANDROID_BST_BATCH_STORE_H
@@ -0,0 +1,368 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "BoschDirectChannel.h"
+#include "sensord_pltf.h"
+
+/*nominal rates of SENSOR_DIRECT_RATE_NORMAL/FAST/VERY_FAST*/
+#define DIRECT_RATE_NORMAL_NS      (1000000000LL / 50)
+#define DIRECT_RATE_FAST_NS        (1000000000LL / 200)
+#define DIRECT_RATE_VERY_FAST_NS   (1000000000LL / 800)
+
+static int64_t direct_rate_to_period(int rate_level)
+{
+    switch (rate_level)
+    {
+        case SENSOR_DIRECT_RATE_NORMAL:
+            return DIRECT_RATE_NORMAL_NS;
+        case SENSOR_DIRECT_RATE_FAST:
+            return DIRECT_RATE_FAST_NS;
+        case SENSOR_DIRECT_RATE_VERY_FAST:
+            return DIRECT_RATE_VERY_FAST_NS;
+        default:
+            return 0;
+    }
+}
+
+BoschDirectChannel::BoschDirectChannel()
+{
+    pthread_mutex_init(&mutex, NULL);
+    memset(channels, 0, sizeof(channels));
+    next_handle = 1;
+}
+
+BoschDirectChannel::~BoschDirectChannel()
+{
+    uint32_t i;
+
+    for (i = 0; i < DIRECT_CHANNEL_MAX; ++i)
+    {
+        if (channels[i].handle)
+        {
+            munmap(channels[i].p_mem, channels[i].size);
+        }
+    }
+
+    pthread_mutex_destroy(&mutex);
+}
+
+/**
+ * mutex held
+ */
+DIRECT_CHANNEL *BoschDirectChannel::find_channel(int channel_handle)
+{
+    uint32_t i;
+
+    if (channel_handle <= 0)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < DIRECT_CHANNEL_MAX; ++i)
+    {
+        if (channel_handle == channels[i].handle)
+        {
+            return &channels[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @param mem
+ * @return channel handle > 0, or negative errno
+ */
+int BoschDirectChannel::register_channel(const struct sensors_direct_mem_t *mem)
+{
+    DIRECT_CHANNEL *p_chn = NULL;
+    void *p_mem;
+    uint32_t i;
+    int ret;
+
+    if (SENSOR_DIRECT_MEM_TYPE_ASHMEM != mem->type ||
+            SENSOR_DIRECT_FMT_SENSORS_EVENT != mem->format ||
+            mem->size < sizeof(sensors_event_t) ||
+            NULL == mem->handle || mem->handle->numFds < 1)
+    {
+        PWARN("unsupported direct mem: type %d, format %d, size %zu", mem->type, mem->format, mem->size);
+        return -EINVAL;
+    }
+
+    p_mem = mmap(NULL, mem->size, PROT_READ | PROT_WRITE, MAP_SHARED, mem->handle->data[0], 0);
+    if (MAP_FAILED == p_mem)
+    {
+        PERR("mmap direct mem fail, errno = %d(%s)", errno, strerror(errno));
+        return -errno;
+    }
+    /*content must be initialized before returning*/
+    memset(p_mem, 0, mem->size);
+
+    pthread_mutex_lock(&mutex);
+
+    for (i = 0; i < DIRECT_CHANNEL_MAX; ++i)
+    {
+        if (0 == channels[i].handle)
+        {
+            p_chn = &channels[i];
+            break;
+        }
+    }
+
+    if (NULL == p_chn)
+    {
+        pthread_mutex_unlock(&mutex);
+        munmap(p_mem, mem->size);
+        PWARN("no free direct channel");
+        return -ENOMEM;
+    }
+
+    memset(p_chn, 0, sizeof(DIRECT_CHANNEL));
+    p_chn->p_mem = (uint8_t *) p_mem;
+    p_chn->size = mem->size;
+    p_chn->event_cap = mem->size / sizeof(sensors_event_t);
+    p_chn->handle = next_handle++;
+    if (next_handle <= 0)
+    {
+        next_handle = 1;
+    }
+    ret = p_chn->handle;
+
+    pthread_mutex_unlock(&mutex);
+
+    PINFO("direct channel %d registered, %u events", ret, p_chn->event_cap);
+
+    return ret;
+}
+
+/**
+ * @param channel_handle
+ * @return 0, also for unknown handle
+ */
+int BoschDirectChannel::unregister_channel(int channel_handle)
+{
+    DIRECT_CHANNEL *p_chn;
+
+    pthread_mutex_lock(&mutex);
+
+    p_chn = find_channel(channel_handle);
+    if (p_chn)
+    {
+        munmap(p_chn->p_mem, p_chn->size);
+        memset(p_chn, 0, sizeof(DIRECT_CHANNEL));
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return 0;
+}
+
+/**
+ * @param sensor_handle -1 together with SENSOR_DIRECT_RATE_STOP stops all sensors of the channel
+ * @param channel_handle
+ * @param rate_level
+ * @return report token (the sensor handle) when started, 0 when stopped, negative errno on error
+ */
+int BoschDirectChannel::config_report(int sensor_handle, int channel_handle, int rate_level)
+{
+    DIRECT_CHANNEL *p_chn;
+    int64_t period_ns;
+    int ret;
+
+    if (rate_level < SENSOR_DIRECT_RATE_STOP || rate_level > SENSOR_DIRECT_RATE_VERY_FAST)
+    {
+        return -EINVAL;
+    }
+
+    if (-1 == sensor_handle)
+    {
+        if (SENSOR_DIRECT_RATE_STOP != rate_level)
+        {
+            return -EINVAL;
+        }
+    }
+    else if (sensor_handle < 0 || sensor_handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        return -EINVAL;
+    }
+
+    period_ns = direct_rate_to_period(rate_level);
+
+    pthread_mutex_lock(&mutex);
+
+    p_chn = find_channel(channel_handle);
+    if (NULL == p_chn)
+    {
+        pthread_mutex_unlock(&mutex);
+        return -EINVAL;
+    }
+
+    if (-1 == sensor_handle)
+    {
+        memset(p_chn->period_ns, 0, sizeof(p_chn->period_ns));
+        ret = 0;
+    }
+    else
+    {
+        p_chn->period_ns[sensor_handle] = period_ns;
+        p_chn->last_ts[sensor_handle] = 0;
+        p_chn->last_in_ts[sensor_handle] = 0;
+        ret = period_ns ? sensor_handle : 0;
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return ret;
+}
+
+/**
+ * @param sensor_handle
+ * @return shortest period requested by any channel, 0 if none
+ */
+int64_t BoschDirectChannel::get_period_ns(int sensor_handle)
+{
+    int64_t period_ns = 0;
+    uint32_t i;
+
+    if (sensor_handle < 0 || sensor_handle >= HAL_SENSOR_HANDLE_MAX)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    for (i = 0; i < DIRECT_CHANNEL_MAX; ++i)
+    {
+        if (channels[i].handle && channels[i].period_ns[sensor_handle])
+        {
+            if (0 == period_ns || channels[i].period_ns[sensor_handle] < period_ns)
+            {
+                period_ns = channels[i].period_ns[sensor_handle];
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return period_ns;
+}
+
+/**
+ * mutex held. Payload is written first, the atomic counter in reserved0 last,
+ * so a reader seeing a new counter value also sees the complete event.
+ */
+void BoschDirectChannel::write_event(DIRECT_CHANNEL *p_chn, const sensors_event_t *p_event)
+{
+    sensors_event_t *p_dst;
+
+    p_dst = ((sensors_event_t *) p_chn->p_mem) + p_chn->write_pos;
+    p_chn->write_pos = (p_chn->write_pos + 1) % p_chn->event_cap;
+
+    /*counter starts from 1 and skips 0 on wrap, 0 means never written*/
+    p_chn->counter++;
+    if (0 == p_chn->counter)
+    {
+        p_chn->counter = 1;
+    }
+
+    /*report token returned by config_report() is the sensor handle itself*/
+    memcpy(&p_dst->timestamp, &p_event->timestamp,
+            sizeof(sensors_event_t) - offsetof(sensors_event_t, timestamp));
+    p_dst->version = sizeof(sensors_event_t);
+    p_dst->sensor = p_event->sensor;
+    p_dst->type = p_event->type;
+    __atomic_store_n(&p_dst->reserved0, p_chn->counter, __ATOMIC_RELEASE);
+
+    return;
+}
+
+/**
+ * sensord thread, decimates each sensor to the rate level of each channel
+ * @param p_events
+ * @param count
+ */
+void BoschDirectChannel::post(const sensors_event_t *p_events, uint32_t count)
+{
+    DIRECT_CHANNEL *p_chn;
+    int64_t period_ns;
+    int64_t in_period_ns;
+    uint32_t i;
+    uint32_t j;
+    int h;
+
+    pthread_mutex_lock(&mutex);
+
+    for (j = 0; j < DIRECT_CHANNEL_MAX; ++j)
+    {
+        p_chn = &channels[j];
+        if (0 == p_chn->handle)
+        {
+            continue;
+        }
+
+        for (i = 0; i < count; ++i)
+        {
+            h = p_events[i].sensor;
+            if (h < 0 || h >= HAL_SENSOR_HANDLE_MAX)
+            {
+                continue;
+            }
+
+            period_ns = p_chn->period_ns[h];
+            if (0 == period_ns)
+            {
+                continue;
+            }
+
+            in_period_ns = 0;
+            if (p_chn->last_in_ts[h] && p_events[i].timestamp > p_chn->last_in_ts[h])
+            {
+                in_period_ns = p_events[i].timestamp - p_chn->last_in_ts[h];
+            }
+            p_chn->last_in_ts[h] = p_events[i].timestamp;
+
+            /*take the input sample nearest to the next point of the grid*/
+            if (p_chn->last_ts[h] &&
+                    p_events[i].timestamp - p_chn->last_ts[h] + (in_period_ns >> 1) < period_ns)
+            {
+                continue;
+            }
+
+            /*advance on the nominal grid so the average rate does not drift above the level*/
+            if (p_chn->last_ts[h] && p_events[i].timestamp - p_chn->last_ts[h] < 2 * period_ns)
+            {
+                p_chn->last_ts[h] += period_ns;
+            }
+            else
+            {
+                p_chn->last_ts[h] = p_events[i].timestamp;
+            }
+            write_event(p_chn, &p_events[i]);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return;
+}
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BST_DIRECT_CHANNEL_H
+#define ANDROID_BST_DIRECT_CHANNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#if !defined(PLTF_LINUX_ENABLED)
+#include <cutils/native_handle.h>
+#include <hardware/sensors.h>
+#else
+#include "sensors.h"
+/*minimal layout of cutils native_handle, only data[0] (the fd) is used*/
+typedef struct native_handle
+{
+    int version;
+    int numFds;
+    int numInts;
+    int data[0];
+} native_handle_t;
+#endif
+
+/*sensor handles are BSX sensor ids, all below this value*/
+#define HAL_SENSOR_HANDLE_MAX 64
+
+#define DIRECT_CHANNEL_MAX 8
+
+/*flags for sensor_t of sensors which can be reported in ashmem direct channel*/
+#define SENSOR_FLAG_DIRECT_REPORT_ASHMEM \
+    (SENSOR_FLAG_DIRECT_CHANNEL_ASHMEM | \
+    ((uint32_t)SENSOR_DIRECT_RATE_VERY_FAST << SENSOR_FLAG_SHIFT_DIRECT_REPORT))
+
+typedef struct
+{
+    int handle; /*0 means free slot*/
+    uint8_t *p_mem;
+    size_t size;
+    uint32_t event_cap;
+    uint32_t write_pos;
+    int32_t counter;
+    int64_t period_ns[HAL_SENSOR_HANDLE_MAX];
+    int64_t last_ts[HAL_SENSOR_HANDLE_MAX];
+    int64_t last_in_ts[HAL_SENSOR_HANDLE_MAX];
+} DIRECT_CHANNEL;
+
+/**
+ * Direct report channels over ashmem/memfd in SENSOR_DIRECT_FMT_SENSORS_EVENT format.
+ * Configured from framework thread, written by sensord thread.
+ */
+class BoschDirectChannel
+{
+public:
+    BoschDirectChannel();
+    ~BoschDirectChannel();
+
+    int register_channel(const struct sensors_direct_mem_t *mem);
+    int unregister_channel(int channel_handle);
+    int config_report(int sensor_handle, int channel_handle, int rate_level);
+    int64_t get_period_ns(int sensor_handle);
+    void post(const sensors_event_t *p_events, uint32_t count);
+
+private:
+    BoschDirectChannel(const BoschDirectChannel & other); //for cppcheck "noCopyConstructor"
+    BoschDirectChannel &operator=(const BoschDirectChannel & other);
+
+    DIRECT_CHANNEL *find_channel(int channel_handle);
+    void write_event(DIRECT_CHANNEL *p_chn, const sensors_event_t *p_event);
+
+    pthread_mutex_t mutex;
+    DIRECT_CHANNEL channels[DIRECT_CHANNEL_MAX];
+    int next_handle;
+};
+
+#endif  // ANDROID_BST_DIRECT_CHANNEL_H
@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+
+#include "BoschEventRing.h"
+#include "sensord_pltf.h"
+#include "util_misc.h"
+
+static_assert(0 == (EVENT_RING_CAPACITY & (EVENT_RING_CAPACITY - 1)), "event ring must be power of 2");
+
+BoschEventRing::BoschEventRing()
+{
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    writer_waiting.store(0, std::memory_order_relaxed);
+    pthread_mutex_init(&wr_mutex, NULL);
+    slots = NULL;
+    evt_fd = -1;
+    space_fd = -1;
+}
+
+BoschEventRing::~BoschEventRing()
+{
+    if (evt_fd >= 0)
+    {
+        close(evt_fd);
+    }
+    if (space_fd >= 0)
+    {
+        close(space_fd);
+    }
+    free(slots);
+    pthread_mutex_destroy(&wr_mutex);
+}
+
+/**
+ * @return 0 on success, negative errno if caller should fall back to pipe
+ */
+int BoschEventRing::init()
+{
+    slots = (sensors_event_t *) calloc(EVENT_RING_CAPACITY, sizeof(sensors_event_t));
+    if (NULL == slots)
+    {
+        PERR("calloc event ring fail");
+        return -ENOMEM;
+    }
+
+    evt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (evt_fd < 0)
+    {
+        PERR("create event ring eventfd fail, errno = %d(%s)", errno, strerror(errno));
+        free(slots);
+        slots = NULL;
+        return -errno;
+    }
+
+    /*blocking, the writer sleeps on it while the ring is full*/
+    space_fd = eventfd(0, EFD_CLOEXEC);
+    if (space_fd < 0)
+    {
+        PERR("create event ring space eventfd fail, errno = %d(%s)", errno, strerror(errno));
+        close(evt_fd);
+        evt_fd = -1;
+        free(slots);
+        slots = NULL;
+        return -errno;
+    }
+
+    return 0;
+}
+
+/**
+ * writer side, wr_mutex held
+ * @return number of events copied
+ */
+uint32_t BoschEventRing::copy_in(const sensors_event_t *p_events, uint32_t count)
+{
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    uint32_t space = EVENT_RING_CAPACITY - (t - h);
+    uint32_t pos;
+    uint32_t first;
+
+    count = MIN(count, space);
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    pos = t & (EVENT_RING_CAPACITY - 1);
+    first = MIN(count, EVENT_RING_CAPACITY - pos);
+    memcpy(&slots[pos], p_events, first * sizeof(sensors_event_t));
+    memcpy(&slots[0], p_events + first, (count - first) * sizeof(sensors_event_t));
+
+    tail.store(t + count, std::memory_order_release);
+
+    return count;
+}
+
+/**
+ * any thread, blocks while the ring is full like a pipe write does
+ * @param p_events
+ * @param count
+ * @return 0 on success
+ */
+int BoschEventRing::write(const sensors_event_t *p_events, uint32_t count)
+{
+    uint32_t done = 0;
+    uint32_t n;
+    uint64_t cnt = 1;
+    int ret;
+
+    pthread_mutex_lock(&wr_mutex);
+
+    while (1)
+    {
+        n = copy_in(p_events + done, count - done);
+        done += n;
+        if (n)
+        {
+            /*wake reader on what is already in, it has to make room for the rest*/
+            ret = ::write(evt_fd, &cnt, sizeof(cnt));
+            if (ret < 0 && EAGAIN != errno)
+            {
+                PERR("write event ring eventfd fail, errno = %d(%s)", errno, strerror(errno));
+            }
+        }
+
+        if (done == count)
+        {
+            break;
+        }
+
+        /*sleep until the reader makes room, it checks the flag after moving head*/
+        writer_waiting.store(1, std::memory_order_seq_cst);
+        if (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_seq_cst) >= EVENT_RING_CAPACITY)
+        {
+            ret = ::read(space_fd, &cnt, sizeof(cnt));
+            (void) ret;
+        }
+        writer_waiting.store(0, std::memory_order_relaxed);
+        cnt = 1;
+    }
+
+    pthread_mutex_unlock(&wr_mutex);
+
+    return 0;
+}
+
+/**
+ * single reader, never blocks
+ * @param p_events
+ * @param count
+ * @return number of events copied out
+ */
+int BoschEventRing::read(sensors_event_t *p_events, uint32_t count)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t t = tail.load(std::memory_order_acquire);
+    uint32_t pos;
+    uint32_t first;
+    uint64_t cnt = 1;
+    int ret;
+
+    count = MIN(count, t - h);
+    if (count)
+    {
+        pos = h & (EVENT_RING_CAPACITY - 1);
+        first = MIN(count, EVENT_RING_CAPACITY - pos);
+        memcpy(p_events, &slots[pos], first * sizeof(sensors_event_t));
+        memcpy(p_events + first, &slots[0], (count - first) * sizeof(sensors_event_t));
+
+        head.store(h + count, std::memory_order_seq_cst);
+        if (writer_waiting.load(std::memory_order_seq_cst))
+        {
+            ret = ::write(space_fd, &cnt, sizeof(cnt));
+            (void) ret;
+        }
+    }
+
+    /*only clear the wakeup once drained, re-arm if a writer raced in meanwhile*/
+    if (h + count == t)
+    {
+        ret = ::read(evt_fd, &cnt, sizeof(cnt));
+        (void) ret;
+        if (tail.load(std::memory_order_acquire) != h + count)
+        {
+            cnt = 1;
+            ret = ::write(evt_fd, &cnt, sizeof(cnt));
+        }
+    }
+
+    return count;
+}
+
+uint32_t event_pipe_write(int fd, const sensors_event_t *p_events, uint32_t count, uint32_t *p_writes)
+{
+    int32_t ret;
+    uint32_t pos = 0;
+    uint32_t chunk;
+
+    *p_writes = 0;
+
+    while (pos < count)
+    {
+        chunk = MIN(count - pos, (uint32_t)EVENTS_PER_PIPE_WRITE);
+
+        ret = ::write(fd, &p_events[pos], chunk * sizeof(sensors_event_t));
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            PERR("deliver event fail, errno = %d(%s)", errno, strerror(errno));
+            break;
+        }
+
+        (*p_writes)++;
+        pos += chunk;
+    }
+
+    return pos;
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BST_EVENT_RING_H
+#define ANDROID_BST_EVENT_RING_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <limits.h>
+#include <atomic>
+#if !defined(PLTF_LINUX_ENABLED)
+#include <hardware/sensors.h>
+#else
+#include "sensors.h"
+#endif
+
+/*events held between sensord and pollEvents, must be power of 2*/
+#define EVENT_RING_CAPACITY 1024
+
+/*pipe writes up to PIPE_BUF are atomic, so a reader never sees a torn event*/
+#define EVENTS_PER_PIPE_WRITE (PIPE_BUF / sizeof(sensors_event_t))
+
+/**
+ * User space ring of sensors_event_t replacing the HAL pipe.
+ *
+ * Writers (sensord batches and flush echoes from framework thread) are
+ * serialized by a mutex taken once per batch, the single reader in pollEvents
+ * runs lock free. eventfds are only used to sleep and wake the reader, and a
+ * writer waiting for room in a full ring.
+ */
+class BoschEventRing
+{
+public:
+    BoschEventRing();
+    ~BoschEventRing();
+
+    int init();
+    int get_fd() const { return evt_fd; }
+    int write(const sensors_event_t *p_events, uint32_t count);
+    int read(sensors_event_t *p_events, uint32_t count);
+
+private:
+    BoschEventRing(const BoschEventRing & other); //for cppcheck "noCopyConstructor"
+    BoschEventRing &operator=(const BoschEventRing & other);
+
+    uint32_t copy_in(const sensors_event_t *p_events, uint32_t count);
+
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> writer_waiting;
+
+    pthread_mutex_t wr_mutex;
+    sensors_event_t *slots;
+    int evt_fd;
+    int space_fd;
+};
+
+/**
+ * HAL pipe used where the ring is not available, one write per EVENTS_PER_PIPE_WRITE events
+ * @param p_writes number of write calls made
+ * @return number of events written
+ */
+extern uint32_t event_pipe_write(int fd, const sensors_event_t *p_events, uint32_t count, uint32_t *p_writes);
+
+#endif  // ANDROID_BST_EVENT_RING_H
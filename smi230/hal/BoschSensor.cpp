@@ -26,6 +26,8 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 #include "BoschSensor.h"
 #include "bsx_android.h"
@@ -69,6 +71,32 @@ BoschSensor::BoschSensor()
     pfun_get_sensorlist = NULL;
     pfun_hw_deliver_sensordata = NULL;
 
+    event_batch_len = 0;
+    stat_pipe_writes = 0;
+    stat_pipe_events = 0;
+    stat_report_ns = 0;
+
+    poll_active_mask = 0;
+    memset(poll_period_ns, 0, sizeof(poll_period_ns));
+    memset(poll_latency_ns, 0, sizeof(poll_latency_ns));
+    direct_channel = new BoschDirectChannel();
+    wakeup_handle_mask = 0;
+    pthread_mutex_init(&wake_mutex, NULL);
+    wake_hold_seq = 0;
+    wake_held = 0;
+    wake_lock_fd = -1;
+    wake_unlock_fd = -1;
+    batch_store = new BoschBatchStore();
+    armed_deadline_ns = INT64_MAX;
+    armed_wake_deadline_ns = INT64_MAX;
+    wakeup_pending = 0;
+    deliver_timer_fd = -1;
+    wake_timer_fd = -1;
+    flush_evtfd = -1;
+    memset(flush_requested, 0, sizeof(flush_requested));
+    memset(flush_drained, 0, sizeof(flush_drained));
+    memset(flush_taken, 0, sizeof(flush_taken));
+
     sensord_pltf_init();
 
     sensord_sigact_enable();
@@ -82,17 +110,58 @@ BoschSensor::BoschSensor()
     }
     fcntl(HALpipe_fd[0], F_SETFL, O_NONBLOCK);
 
-    shmem_hwcntl.p_list = new BoschSimpleList();
-    pthread_mutex_init(&shmem_hwcntl.mutex, NULL);
-    pthread_cond_init(&shmem_hwcntl.cond, NULL);
+    event_ring = NULL;
+#if defined(HAL_EVENT_RING)
+    event_ring = new BoschEventRing();
+    if (event_ring->init())
+    {
+        PWARN("event ring not available, fall back to HAL pipe");
+        delete event_ring;
+        event_ring = NULL;
+    }
+#endif
+
+    sample_pool = new BoschSamplePool();
+    ring_acclraw = new BoschSampleRing();
+    ring_gyroraw = new BoschSampleRing();
+    ring_magnraw = new BoschSampleRing();
 
-    tmplist_sensord_acclraw = new BoschSimpleList();
-    tmplist_sensord_gyroraw = new BoschSimpleList();
-    tmplist_sensord_magnraw = new BoschSimpleList();
+    rawdata_evtfd = eventfd(0, EFD_CLOEXEC);
+    if(rawdata_evtfd < 0){
+        PERR("create rawdata eventfd fail, errno = %d(%s)!", errno, strerror(errno));
+        return;
+    }
 
-    tmplist_hwcntl_acclraw = new BoschSimpleList();
-    tmplist_hwcntl_gyroraw = new BoschSimpleList();
-    tmplist_hwcntl_magnraw = new BoschSimpleList();
+    wake_lock_fd = open(WAKE_LOCK_PATH, O_WRONLY | O_CLOEXEC);
+    wake_unlock_fd = open(WAKE_UNLOCK_PATH, O_WRONLY | O_CLOEXEC);
+    if (wake_lock_fd < 0 || wake_unlock_fd < 0)
+    {
+        PWARN("open %s fail, errno = %d(%s), AP may suspend before wakeup events are delivered",
+                WAKE_LOCK_PATH, errno, strerror(errno));
+    }
+
+    /*batch deadlines are event timestamps, so same clock as sensord_get_tmstmp_ns()*/
+    deliver_timer_fd = timerfd_create(CLOCK_BOOTTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (deliver_timer_fd < 0)
+    {
+        PWARN("create delivery timer fail, errno = %d(%s), batches only go up with raw data",
+                errno, strerror(errno));
+    }
+
+    /*needs CAP_WAKE_ALARM, without it held wakeup events wait for the AP to resume*/
+    wake_timer_fd = timerfd_create(CLOCK_BOOTTIME_ALARM, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (wake_timer_fd < 0)
+    {
+        PWARN("create wakeup delivery timer fail, errno = %d(%s), batch deadlines don't wake AP",
+                errno, strerror(errno));
+    }
+
+    flush_evtfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (flush_evtfd < 0)
+    {
+        PWARN("create flush eventfd fail, errno = %d(%s), flush completes without draining",
+                errno, strerror(errno));
+    }
 
     /**
      * Because hwcntl will also call algo library interface,
@@ -100,6 +169,7 @@ BoschSensor::BoschSensor()
      * BSX Lib initialization
      * */
     sensord_bsx_init();
+    sensord_algo_load_state();
 
     pthread_create(&thread_sensord, NULL, sensord_main, this);
 
@@ -109,6 +179,8 @@ BoschSensor::BoschSensor()
         return;
     }
 
+    init_wakeup_handle_mask();
+
     pthread_create(&thread_hwcntl, NULL, hwcntl_main, this);
 
     return;
@@ -125,20 +197,70 @@ BoschSensor::BoschSensor(const BoschSensor & other)
 
 BoschSensor::~BoschSensor()
 {
+    int i;
+
+    /*framework threads waiting on a command must not wait for a dead thread*/
+    hwcntl_shutdown();
     pthread_kill(thread_sensord, SIGTERM);
     pthread_kill(thread_hwcntl, SIGTERM);
 
     pthread_join(thread_sensord, NULL);
     pthread_join(thread_hwcntl, NULL);
 
+    /*saves what the last whole sensord pass published, not the calibration the kill cut into*/
+    sensord_algo_save_state();
+
     sigaction(SIGTERM, &oldact, NULL);
 
-    pthread_mutex_destroy(&shmem_hwcntl.mutex);
-    pthread_cond_destroy(&shmem_hwcntl.cond);
-    delete shmem_hwcntl.p_list;
+    close(rawdata_evtfd);
+    if (deliver_timer_fd >= 0)
+    {
+        close(deliver_timer_fd);
+    }
+    if (wake_timer_fd >= 0)
+    {
+        close(wake_timer_fd);
+    }
+    if (flush_evtfd >= 0)
+    {
+        close(flush_evtfd);
+    }
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (batch_store->get_miss_count(i))
+        {
+            PINFO("handle %d: %llu batch deadlines missed", i,
+                    (unsigned long long)batch_store->get_miss_count(i));
+        }
+    }
+
+    if (wake_held)
+    {
+        wake_lock_write(wake_unlock_fd);
+    }
+    if (wake_lock_fd >= 0)
+    {
+        close(wake_lock_fd);
+    }
+    if (wake_unlock_fd >= 0)
+    {
+        close(wake_unlock_fd);
+    }
+    pthread_mutex_destroy(&wake_mutex);
+
+    if (stat_pipe_writes)
+    {
+        PINFO("HAL pipe: %llu events in %llu writes, %.1f events per syscall",
+                (unsigned long long)stat_pipe_events, (unsigned long long)stat_pipe_writes,
+                (double)stat_pipe_events / (double)stat_pipe_writes);
+    }
 
     close(HALpipe_fd[0]);
     close(HALpipe_fd[1]);
+    delete event_ring;
+    delete direct_channel;
+    delete batch_store;
 
     sensord_pltf_clearup();
     if (bosch_sensorlist.list)
@@ -151,13 +273,15 @@ BoschSensor::~BoschSensor()
         free(bosch_sensorlist.bsx_list_index);
     }
 
-    delete tmplist_sensord_acclraw;
-    delete tmplist_sensord_gyroraw;
-    delete tmplist_sensord_magnraw;
+    PINFO("sample pool: capacity %u, high water %u, exhausted %llu",
+            sample_pool->get_capacity(), sample_pool->get_high_water(),
+            (unsigned long long)sample_pool->get_exhausted_count());
 
-    delete tmplist_hwcntl_acclraw;
-    delete tmplist_hwcntl_gyroraw;
-    delete tmplist_hwcntl_magnraw;
+    /*samples left in rings belong to the pool slab*/
+    delete ring_acclraw;
+    delete ring_gyroraw;
+    delete ring_magnraw;
+    delete sample_pool;
 }
 
 BoschSensor *BoschSensor::instance = NULL;
@@ -194,6 +318,77 @@ uint32_t BoschSensor::get_sensorlist(struct sensor_t const** p_sSensorList)
     }
 }
 
+/**
+ * handles of wakeup sensors, their events are delivered under a wake lock
+ */
+void BoschSensor::init_wakeup_handle_mask()
+{
+    struct sensor_t const *p_list = NULL;
+    uint32_t list_len;
+    uint32_t i;
+
+    list_len = get_sensorlist(&p_list);
+    for (i = 0; i < list_len; ++i)
+    {
+        if ((p_list[i].flags & SENSOR_FLAG_WAKE_UP) &&
+                p_list[i].handle >= 0 && p_list[i].handle < HAL_SENSOR_HANDLE_MAX)
+        {
+            wakeup_handle_mask |= 1ULL << p_list[i].handle;
+        }
+    }
+
+    return;
+}
+
+/**
+ * combine poll request and direct channel request of one sensor and send it down
+ * @param handle
+ * @return
+ */
+int BoschSensor::apply_sensor_config(int handle)
+{
+    int64_t direct_ns;
+    int64_t period_ns;
+    int poll_on;
+    int ret;
+
+    if (NULL == pfun_batch || NULL == pfun_activate)
+    {
+        return 0;
+    }
+
+    direct_ns = direct_channel->get_period_ns(handle);
+    poll_on = (__atomic_load_n(&poll_active_mask, __ATOMIC_RELAXED) >> handle) & 0x1;
+
+    if (0 == direct_ns)
+    {
+        if (poll_on)
+        {
+            ret = pfun_batch(handle, 0, poll_period_ns[handle], poll_latency_ns[handle]);
+            if (ret)
+            {
+                return ret;
+            }
+        }
+        return pfun_activate(handle, poll_on);
+    }
+
+    /*direct channel needs events right away, so no batching latency*/
+    period_ns = direct_ns;
+    if (poll_on && poll_period_ns[handle] && poll_period_ns[handle] < period_ns)
+    {
+        period_ns = poll_period_ns[handle];
+    }
+
+    ret = pfun_batch(handle, 0, period_ns, 0);
+    if (ret)
+    {
+        return ret;
+    }
+
+    return pfun_activate(handle, 1);
+}
+
 /**
  *
  * @param handle
@@ -202,11 +397,35 @@ uint32_t BoschSensor::get_sensorlist(struct sensor_t const** p_sSensorList)
  */
 int BoschSensor::activate(int handle, int enabled)
 {
-    if(pfun_activate){
-        return pfun_activate(handle, enabled);
-    }else{
+    if(NULL == pfun_activate){
         return 0;
     }
+
+    if (handle >= 0 && handle < HAL_SENSOR_HANDLE_MAX)
+    {
+        if (enabled)
+        {
+            __atomic_fetch_or(&poll_active_mask, 1ULL << handle, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            __atomic_fetch_and(&poll_active_mask, ~(1ULL << handle), __ATOMIC_RELAXED);
+
+            /*events held before deactivation were still sampled on request*/
+            batch_store->lock();
+            deliver_batch_store(handle);
+            batch_store->configure(handle, 0, 0, 0);
+            arm_deliver_timer();
+            batch_store->unlock();
+        }
+
+        if (direct_channel->get_period_ns(handle))
+        {
+            return apply_sensor_config(handle);
+        }
+    }
+
+    return pfun_activate(handle, enabled);
 }
 
 /**
@@ -219,11 +438,49 @@ int BoschSensor::activate(int handle, int enabled)
  */
 int BoschSensor::batch(int handle, int flags, int64_t sampling_period_ns, int64_t max_report_latency_ns)
 {
-    if(pfun_batch){
-        return pfun_batch(handle, flags, sampling_period_ns, max_report_latency_ns);
-    }else{
+    struct sensor_t const *p_list = NULL;
+    uint32_t list_len;
+    uint32_t capacity = 0;
+    uint32_t i;
+
+    if(NULL == pfun_batch){
         return 0;
     }
+
+    if (handle >= 0 && handle < HAL_SENSOR_HANDLE_MAX)
+    {
+        poll_period_ns[handle] = sampling_period_ns;
+        poll_latency_ns[handle] = max_report_latency_ns;
+
+        /*sensors advertising no FIFO report continuously whatever latency is asked*/
+        list_len = get_sensorlist(&p_list);
+        for (i = 0; i < list_len; ++i)
+        {
+            if (handle == p_list[i].handle)
+            {
+                capacity = p_list[i].fifoMaxEventCount;
+                break;
+            }
+        }
+
+        /*events held under old latency go up first, the new one applies to what follows*/
+        batch_store->lock();
+        deliver_batch_store(handle);
+        if (batch_store->configure(handle, max_report_latency_ns, capacity,
+                (int)((wakeup_handle_mask >> handle) & 0x1)))
+        {
+            PWARN("handle %d reports continuously, no HAL batch store", handle);
+        }
+        arm_deliver_timer();
+        batch_store->unlock();
+
+        if (direct_channel->get_period_ns(handle))
+        {
+            return apply_sensor_config(handle);
+        }
+    }
+
+    return pfun_batch(handle, flags, sampling_period_ns, max_report_latency_ns);
 }
 
 /**
@@ -255,12 +512,145 @@ int BoschSensor::flush(int handle)
 #if defined(SENSORS_DEVICE_API_VERSION_1_4)
 int BoschSensor::inject_sensor_data(const sensors_event_t *data)
 {
-    (void)data;
+    if (data && SENSOR_TYPE_BOSCH_ACC_CAL_CMD == data->type)
+    {
+        return sensord_algo_acc_cal_command((int)data->data[0]);
+    }
+
+    return 0;
+}
+
+/**
+ * snapshot direct rates of all listed sensors
+ * @param list
+ * @param len
+ * @param p_period_ns
+ */
+static void direct_period_snapshot(BoschDirectChannel *direct_channel,
+        struct sensor_t const* list, uint32_t len, int64_t *p_period_ns)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; ++i)
+    {
+        if (list[i].handle >= 0 && list[i].handle < HAL_SENSOR_HANDLE_MAX)
+        {
+            p_period_ns[list[i].handle] = direct_channel->get_period_ns(list[i].handle);
+        }
+    }
+}
+
+/**
+ *
+ * @param mem NULL to unregister channel_handle
+ * @param channel_handle
+ * @return
+ */
+int BoschSensor::register_direct_channel(const struct sensors_direct_mem_t *mem, int channel_handle)
+{
+    struct sensor_t const* list;
+    uint32_t len;
+    uint32_t i;
+    int64_t before_ns[HAL_SENSOR_HANDLE_MAX];
+    int64_t after_ns[HAL_SENSOR_HANDLE_MAX];
+
+    if (mem)
+    {
+        return direct_channel->register_channel(mem);
+    }
+
+    memset(before_ns, 0, sizeof(before_ns));
+    memset(after_ns, 0, sizeof(after_ns));
+    len = get_sensorlist(&list);
+
+    direct_period_snapshot(direct_channel, list, len, before_ns);
+    direct_channel->unregister_channel(channel_handle);
+    direct_period_snapshot(direct_channel, list, len, after_ns);
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (before_ns[i] != after_ns[i])
+        {
+            (void) apply_sensor_config(i);
+        }
+    }
+
     return 0;
 }
+
+/**
+ *
+ * @param sensor_handle -1 to stop all sensors in channel
+ * @param channel_handle
+ * @param config
+ * @return report token when started, 0 when stopped, negative errno on failure
+ */
+int BoschSensor::config_direct_report(int sensor_handle, int channel_handle, const struct sensors_direct_cfg_t *config)
+{
+    struct sensor_t const* list;
+    uint32_t len;
+    uint32_t i;
+    int ret;
+    int64_t before_ns[HAL_SENSOR_HANDLE_MAX];
+    int64_t after_ns[HAL_SENSOR_HANDLE_MAX];
+
+    len = get_sensorlist(&list);
+
+    if (-1 != sensor_handle)
+    {
+        for (i = 0; i < len; ++i)
+        {
+            if (sensor_handle == list[i].handle)
+            {
+                break;
+            }
+        }
+
+        if (i == len || 0 == (list[i].flags & SENSOR_FLAG_MASK_DIRECT_REPORT))
+        {
+            PWARN("sensor %d does not support direct report", sensor_handle);
+            return -EINVAL;
+        }
+    }
+
+    memset(before_ns, 0, sizeof(before_ns));
+    memset(after_ns, 0, sizeof(after_ns));
+
+    direct_period_snapshot(direct_channel, list, len, before_ns);
+    ret = direct_channel->config_report(sensor_handle, channel_handle, config->rate_level);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    direct_period_snapshot(direct_channel, list, len, after_ns);
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (before_ns[i] != after_ns[i])
+        {
+            (void) apply_sensor_config(i);
+        }
+    }
+
+    return ret;
+}
 #endif
 
 
+/**
+ *
+ * @return fd pollEvents waits on for POLLIN
+ */
+int BoschSensor::get_poll_fd()
+{
+    if (event_ring)
+    {
+        return event_ring->get_fd();
+    }
+
+    return HALpipe_fd[0];
+}
+
 /**
  *
  * @param data
@@ -271,6 +661,11 @@ int BoschSensor::read_events(sensors_event_t* data, int count)
 {
     int ret;
 
+    if (event_ring)
+    {
+        return event_ring->read(data, count);
+    }
+
     ret = read(HALpipe_fd[0], data, count*sizeof(sensors_event_t));
     if(ret < 0)
     {
@@ -280,4 +675,3 @@ int BoschSensor::read_events(sensors_event_t* data, int count)
 
     return (ret / sizeof(sensors_event_t));
 }
-
@@ -25,20 +25,32 @@
 #include <sys/cdefs.h>
 #include <signal.h>
 #include <pthread.h>
+#include <limits.h>
 #if !defined(PLTF_LINUX_ENABLED)
 #include <hardware/sensors.h>
 #else
 #include "sensors.h"
 #endif
 #include "sensord_def.h"
-#include "boschsimple_list.h"
+#include "boschsample_ring.h"
+#include "boschsample_pool.h"
+#include "BoschEventRing.h"
+#include "BoschDirectChannel.h"
+#include "BoschBatchStore.h"
 
-typedef struct
-{
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
-    BoschSimpleList *p_list;
-} SENSORD_SHARED_MEM;
+/*events filled in place by sensord thread before going to HAL pipe*/
+#define EVENT_BATCH_LEN (2 * EVENTS_PER_PIPE_WRITE)
+
+/*kernel wakelock interface, same as libhardware_legacy acquire_wake_lock()*/
+#define WAKE_LOCK_PATH "/sys/power/wake_lock"
+#define WAKE_UNLOCK_PATH "/sys/power/wake_unlock"
+#define WAKE_LOCK_NAME "bosch_sensord"
+
+/*test app prints the pipe write statistics this often, and once more on close*/
+#define STAT_REPORT_INTERVAL_NS 10000000000LL
+
+/*delivery timer fires this much ahead of a batch deadline to cover wakeup and pipe write*/
+#define DELIVER_TIMER_SLACK_NS 2000000LL
 
 class BoschSensor
 {
@@ -49,16 +61,24 @@ public:
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
     int read_events(sensors_event_t* data, int count);
+    int get_poll_fd();
     int batch(int handle, int flags, int64_t sampling_period_ns, int64_t max_report_latency_ns);
     int flush(int handle);
 #if defined(SENSORS_DEVICE_API_VERSION_1_4)
     int inject_sensor_data(const sensors_event_t *data);
+    int register_direct_channel(const struct sensors_direct_mem_t *mem, int channel_handle);
+    int config_direct_report(int sensor_handle, int channel_handle, const struct sensors_direct_cfg_t *config);
 #endif
     uint32_t get_sensorlist(struct sensor_t const** p_sSensorList);
     void sensord_read_rawdata();
+    sensors_event_t *sensord_event_slot();
     void sensord_deliver_event(sensors_event_t *p_event);
+    void sensord_flush_events();
 
     int send_flush_event(int32_t sensor_id);
+    int request_flush(int32_t sensor_id);
+    void hwcntl_flush_drained();
+    void sensord_complete_flush();
 
     int (*pfun_activate)(int handle, int enabled);
     int (*pfun_batch)(int handle, int flags, int64_t sampling_period_ns, int64_t max_report_latency_ns);
@@ -66,16 +86,30 @@ public:
     uint32_t (*pfun_get_sensorlist)(struct sensor_t const** p_sSensorList);
     uint32_t (*pfun_hw_deliver_sensordata)(BoschSensor *boschsensor);
 
-    BoschSimpleList *tmplist_hwcntl_acclraw;
-    BoschSimpleList *tmplist_hwcntl_gyroraw;
-    BoschSimpleList *tmplist_hwcntl_magnraw;
+    void sensord_notify_rawdata();
+    void hwcntl_wake_hold(int force);
+    uint32_t sensord_wake_seq();
+    void sensord_wake_release(uint32_t seq);
+
+    void sensord_notify_wakeup();
 
-    BoschSimpleList *tmplist_sensord_acclraw;
-    BoschSimpleList *tmplist_sensord_gyroraw;
-    BoschSimpleList *tmplist_sensord_magnraw;
+    /*hwcntl thread produces, sensord thread consumes*/
+    BoschSamplePool *sample_pool;
+    BoschSampleRing *ring_acclraw;
+    BoschSampleRing *ring_gyroraw;
+    BoschSampleRing *ring_magnraw;
+    int rawdata_evtfd;
+    /*armed by sensord for earliest batch deadline, polled by hwcntl with the input fds*/
+    int deliver_timer_fd;
+    /*CLOCK_BOOTTIME_ALARM twin armed for wakeup handles only, resumes a suspended AP*/
+    int wake_timer_fd;
+    /*written by flush(), polled by hwcntl to drain input fds*/
+    int flush_evtfd;
 
-    SENSORD_SHARED_MEM shmem_hwcntl;
     int HALpipe_fd[2];
+    /*NULL when events go through HAL pipe*/
+    BoschEventRing *event_ring;
+    BoschDirectChannel *direct_channel;
 
 private:
     BoschSensor();
@@ -84,6 +118,49 @@ private:
 
     static BoschSensor *instance;
     void sensord_cfg_init();
+    void hal_deliver_events(const sensors_event_t *p_events, uint32_t count);
+    int apply_sensor_config(int handle);
+    void init_wakeup_handle_mask();
+    void wake_lock_write(int fd);
+    void deliver_batch_store(int handle);
+    void deliver_due_batches(int64_t now_ns);
+    void arm_deliver_timer();
+
+    /*what framework asked through poll interface, direct channels are added on top.
+     mask is read by sensord thread, so only accessed with __atomic builtins*/
+    uint64_t poll_active_mask;
+    int64_t poll_period_ns[HAL_SENSOR_HANDLE_MAX];
+    int64_t poll_latency_ns[HAL_SENSOR_HANDLE_MAX];
+    /*poll events held for max_report_latency, armed_deadline_ns is under its lock*/
+    BoschBatchStore *batch_store;
+    int64_t armed_deadline_ns;
+    int64_t armed_wake_deadline_ns;
+    /*set by hwcntl on delivery timer expiry or drained flush, __atomic builtins only*/
+    int wakeup_pending;
+
+    /*flush() calls per handle, requested by framework, drained by hwcntl,
+     taken by sensord before it pops the rings. First two are handed between
+     threads with __atomic builtins, flush_taken is sensord thread only*/
+    uint32_t flush_requested[HAL_SENSOR_HANDLE_MAX];
+    uint32_t flush_drained[HAL_SENSOR_HANDLE_MAX];
+    uint32_t flush_taken[HAL_SENSOR_HANDLE_MAX];
+
+    /*keeps the AP up from a wakeup handle's read in hwcntl until sensord has
+     written its events. hwcntl bumps wake_hold_seq on each hold, sensord only
+     releases if nothing was held since the pass it finished began*/
+    uint64_t wakeup_handle_mask;
+    pthread_mutex_t wake_mutex;
+    uint32_t wake_hold_seq;
+    int wake_held;
+    int wake_lock_fd;
+    int wake_unlock_fd;
+
+    /*sensord thread only*/
+    sensors_event_t event_batch[EVENT_BATCH_LEN];
+    uint32_t event_batch_len;
+    uint64_t stat_pipe_writes;
+    uint64_t stat_pipe_events;
+    int64_t stat_report_ns;
 
     pthread_t thread_sensord;
     pthread_t thread_hwcntl;
@@ -17,7 +17,40 @@
  * limitations under the License.
  */
 
-int main()
+#include <string.h>
+
+#include "unit_test.h"
+
+typedef struct
+{
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+} UNIT_TEST;
+
+static const UNIT_TEST unit_tests[] = {
+        { "acccal", unit_test_acccal },
+        { "batch", unit_test_batch },
+        { "converge", unit_test_converge },
+        { "convert", unit_test_convert },
+        { "direct", unit_test_direct },
+        { "event", unit_test_event },
+        { "fusion", unit_test_fusion },
+        { "iio", unit_test_iio },
+        { "input", unit_test_input },
+        { "merge", unit_test_merge },
+        { "remap", unit_test_remap },
+        { "resample", unit_test_resample },
+        { "sample", unit_test_sample },
+        { "state", unit_test_state },
+        { "step", unit_test_step },
+        { "uring", unit_test_uring },
+        { "wmctl", unit_test_wmctl },
+};
+
+/**
+ * "<app>" polls every sensor until the end marker, "<app> <name> [args]" runs one test
+ */
+int main(int argc, char *argv[])
 {
     struct hw_module_t module;
     char id;
@@ -28,6 +61,26 @@ int main()
     sensors_event_t events[MAX_EVENTS_READ];
     int msg_cnt = 0;
 
+    if (argc > 1)
+    {
+        for (i = 0; i < (int)(sizeof(unit_tests) / sizeof(unit_tests[0])); ++i)
+        {
+            if (0 == strcmp(argv[1], unit_tests[i].name))
+            {
+                msg_cnt = unit_tests[i].run(argc - 1, argv + 1);
+                printf("%s: %s\n", unit_tests[i].name, (0 == msg_cnt) ? "PASS" : "FAIL");
+                return (0 == msg_cnt) ? 0 : 1;
+            }
+        }
+
+        printf("unknown test %s, one of:\n", argv[1]);
+        for (i = 0; i < (int)(sizeof(unit_tests) / sizeof(unit_tests[0])); ++i)
+        {
+            printf("  %s\n", unit_tests[i].name);
+        }
+        return 1;
+    }
+
     open_sensors(&module, &id, &p_hw_device_t);
 
     for (i = 0; i < sensorsNum; ++i) {
@@ -92,7 +92,7 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
     int bosch_evncnt = 0;
     struct pollfd extended_mPollFds[1];
 
-    extended_mPollFds[0].fd = bosch_sensor->HALpipe_fd[0];
+    extended_mPollFds[0].fd = bosch_sensor->get_poll_fd();
     extended_mPollFds[0].events = POLLIN;
     extended_mPollFds[0].revents = 0;
 
@@ -143,6 +143,16 @@ int sensors_poll_context_t::inject_sensor_data(const sensors_event_t *data)
 {
     return bosch_sensor->inject_sensor_data(data);
 }
+
+int sensors_poll_context_t::register_direct_channel(const struct sensors_direct_mem_t* mem, int channel_handle)
+{
+    return bosch_sensor->register_direct_channel(mem, channel_handle);
+}
+
+int sensors_poll_context_t::config_direct_report(int sensor_handle, int channel_handle, const struct sensors_direct_cfg_t *config)
+{
+    return bosch_sensor->config_direct_report(sensor_handle, channel_handle, config);
+}
 #endif
 
 /*****************************************************************************/
@@ -197,6 +207,20 @@ static int poll__inject_sensor_data(struct sensors_poll_device_1 *dev, const sen
     sensors_poll_context_t *ctx = (sensors_poll_context_t *) dev;
     return ctx->inject_sensor_data(data);
 }
+
+static int poll__register_direct_channel(struct sensors_poll_device_1 *dev,
+        const struct sensors_direct_mem_t* mem, int channel_handle)
+{
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *) dev;
+    return ctx->register_direct_channel(mem, channel_handle);
+}
+
+static int poll__config_direct_report(struct sensors_poll_device_1 *dev,
+        int sensor_handle, int channel_handle, const struct sensors_direct_cfg_t *config)
+{
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *) dev;
+    return ctx->config_direct_report(sensor_handle, channel_handle, config);
+}
 #endif
 
 
@@ -212,7 +236,11 @@ static int open_sensors(const struct hw_module_t* module, const char* id,
     memset(&dev->device, 0, sizeof(struct sensors_poll_device_1));
 
     dev->device.common.tag = HARDWARE_DEVICE_TAG;
+#if defined(SENSORS_DEVICE_API_VERSION_1_4)
+    dev->device.common.version = SENSORS_DEVICE_API_VERSION_1_4;
+#else
     dev->device.common.version = SENSORS_DEVICE_API_VERSION_1_3;
+#endif
     dev->device.common.module = const_cast<hw_module_t*>(module);
     dev->device.common.close = poll__close;
     dev->device.activate = poll__activate;
@@ -223,6 +251,8 @@ static int open_sensors(const struct hw_module_t* module, const char* id,
     dev->device.flush = poll__flush;
 #if defined(SENSORS_DEVICE_API_VERSION_1_4)
     dev->device.inject_sensor_data = poll__inject_sensor_data;
+    dev->device.register_direct_channel = poll__register_direct_channel;
+    dev->device.config_direct_report = poll__config_direct_report;
 #endif
     *device = &dev->device.common;
     status = 0;
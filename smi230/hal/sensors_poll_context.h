@@ -34,6 +34,8 @@ struct sensors_poll_context_t
     int flush(int handle);
 #if defined(SENSORS_DEVICE_API_VERSION_1_4)
     int inject_sensor_data(const sensors_event_t *data);
+    int register_direct_channel(const struct sensors_direct_mem_t* mem, int channel_handle);
+    int config_direct_report(int sensor_handle, int channel_handle, const struct sensors_direct_cfg_t *config);
 #endif
 
 private:
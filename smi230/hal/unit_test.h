@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __UNIT_TEST_H
+#define __UNIT_TEST_H
+
+/**
+ * Tests and benchmarks of the LOCAL_UNIT_TEST build. The test app runs one of them
+ * instead of the polling loop when started as "<app> <name> [args]".
+ * Each prints its measurements to stdout and returns 0 when every check passed.
+ */
+
+/// acc offset/scale calibration of a simulated part, control words
+extern int unit_test_acccal(int argc, char *argv[]);
+
+/// batch store driven by jittered sensord passes: no loss, order, latency met, burst count
+extern int unit_test_batch(int argc, char *argv[]);
+
+/// time to converged gyro output after a HAL start, cold against restored
+extern int unit_test_converge(int argc, char *argv[]);
+
+/// raw to SI conversion against the scalar reference, every range, odd counts and tails, frames/s
+extern int unit_test_convert(int argc, char *argv[]);
+
+/// direct channel read from its own mapping while written: counter, ordering, decimation per rate level
+extern int unit_test_direct(int argc, char *argv[]);
+
+/// event ring and HAL pipe as hal_deliver_events() and pollEvents drive them, batches of 10/100/2000
+extern int unit_test_event(int argc, char *argv[]);
+
+/// replay of tilted motion through the 6-axis orientation filter
+extern int unit_test_fusion(int argc, char *argv[]);
+
+/// IIO scan types, scan layout and value decoding against a reference packer
+extern int unit_test_iio(int argc, char *argv[]);
+
+/// input frame parser on bad and split frames, ns per frame
+extern int unit_test_input(int argc, char *argv[]);
+
+/// raw sample merge, old align indication array against the merge iterator, batches of 10/100/2000
+extern int unit_test_merge(int argc, char *argv[]);
+
+/// mounting remap of a batch against hw_remap_sensor_data, every placement, as placement and as matrix
+extern int unit_test_remap(int argc, char *argv[]);
+
+/// rational resampler against a double precision reference, ratios of the physical ODRs, CIC decimator
+extern int unit_test_resample(int argc, char *argv[]);
+
+/// raw sample rings and sample pool between two threads: order, loss, overflow drops, throughput
+extern int unit_test_sample(int argc, char *argv[]);
+
+/// state file round trip, older and damaged files, boot id
+extern int unit_test_state(int argc, char *argv[]);
+
+/// step detector on simulated walks, still device, decimated raw stream
+extern int unit_test_step(int argc, char *argv[]);
+
+/// io_uring reader against the epoll loop on an emulated input device, and its give-up path
+extern int unit_test_uring(int argc, char *argv[]);
+
+/// watermark controller on an emulated overflowing FIFO: back off, regrowth, budget cap, flush drain
+extern int unit_test_wmctl(int argc, char *argv[]);
+
+#endif
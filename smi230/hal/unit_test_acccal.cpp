@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "sensord_acccal.h"
+#include "unit_test.h"
+
+/**
+ * Acc calibration against a simulated part with per axis gain and offset errors.
+ * Still window means are what the part reads for gravity along a direction, plus
+ * a little noise. The error of a calibration is the worst |corrected - true| over
+ * 26 directions, the faces, edges and corners of a cube.
+ * A six-face run must find gain and offset of each axis, the in use sphere fit a
+ * common gain and the offset, and after a six-face run it must move only the offset.
+ * A part far out of tolerance must be refused. The control words of the FIFO must
+ * map to the commands.
+ */
+#define UT_ACCCAL_NOISE 0.005f
+#define UT_ACCCAL_FIT_WINDOWS_MAX 1000
+#define UT_ACCCAL_FACES_ERR_MAX 0.03f
+#define UT_ACCCAL_FIT_ERR_MAX 0.15f
+
+typedef struct
+{
+    float gain[3];          /// corrected = measured * gain + offset gives the true value
+    float offset[3];
+} UT_ACCCAL_PART;
+
+static uint32_t ut_acccal_seed = 0x9e3779b9;
+
+static float ut_acccal_rand(void)
+{
+    ut_acccal_seed ^= ut_acccal_seed << 13;
+    ut_acccal_seed ^= ut_acccal_seed >> 17;
+    ut_acccal_seed ^= ut_acccal_seed << 5;
+
+    return (ut_acccal_seed >> 8) / (float)(1 << 24) * 2 - 1;
+}
+
+/// what @param p_part reads with gravity along unit vector @param dir
+static void ut_acccal_measure(const UT_ACCCAL_PART *p_part, const float dir[3], float mean[3])
+{
+    uint32_t c;
+
+    for (c = 0; c < 3; ++c)
+    {
+        mean[c] = (dir[c] * SENSORD_ACCCAL_G - p_part->offset[c]) / p_part->gain[c] +
+                UT_ACCCAL_NOISE * ut_acccal_rand();
+    }
+}
+
+static float ut_acccal_err(const SENSORD_ACCCAL *p_cal, const UT_ACCCAL_PART *p_part)
+{
+    float dir[3];
+    float m[3];
+    float d;
+    float err;
+    float worst = 0;
+    float n;
+    int i;
+    uint32_t c;
+
+    for (i = 0; i < 27; ++i)
+    {
+        dir[0] = (float)(i % 3 - 1);
+        dir[1] = (float)(i / 3 % 3 - 1);
+        dir[2] = (float)(i / 9 - 1);
+        n = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        if (0 == n)
+        {
+            continue;
+        }
+
+        err = 0;
+        for (c = 0; c < 3; ++c)
+        {
+            dir[c] /= n;
+            m[c] = (dir[c] * SENSORD_ACCCAL_G - p_part->offset[c]) / p_part->gain[c];
+            d = m[c] * p_cal->gain[c] + p_cal->offset[c] - dir[c] * SENSORD_ACCCAL_G;
+            err += d * d;
+        }
+        err = sqrtf(err);
+        worst = (err > worst) ? err : worst;
+    }
+
+    return worst;
+}
+
+/**
+ * lay @param p_part on its faces after a tilted window that is no face
+ * @return what the last feed returned
+ */
+static int ut_acccal_faces(SENSORD_ACCCAL *p_cal, const UT_ACCCAL_PART *p_part)
+{
+    static const float tilted[3] = { 0.6f, 0.0f, 0.8f };
+    float dir[3];
+    float mean[3];
+    uint32_t face;
+    int ret;
+
+    ut_acccal_measure(p_part, tilted, mean);
+    ret = sensord_acccal_feed(p_cal, mean);
+
+    for (face = 0; face < SENSORD_ACCCAL_FACE_NUM; ++face)
+    {
+        memset(dir, 0, sizeof(dir));
+        dir[face / 2] = (face & 1) ? -1.0f : 1.0f;
+        ut_acccal_measure(p_part, dir, mean);
+        ret = sensord_acccal_feed(p_cal, mean);
+    }
+
+    return ret;
+}
+
+/**
+ * still windows in random poses until the sphere fit updates
+ * @return windows fed, UT_ACCCAL_FIT_WINDOWS_MAX + 1 when it never did
+ */
+static uint32_t ut_acccal_fit(SENSORD_ACCCAL *p_cal, const UT_ACCCAL_PART *p_part)
+{
+    float dir[3];
+    float mean[3];
+    float n;
+    uint32_t k;
+
+    for (k = 1; k <= UT_ACCCAL_FIT_WINDOWS_MAX; ++k)
+    {
+        do
+        {
+            dir[0] = ut_acccal_rand();
+            dir[1] = ut_acccal_rand();
+            dir[2] = ut_acccal_rand();
+            n = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        } while (n > 1 || n < 0.1f);
+
+        dir[0] /= n;
+        dir[1] /= n;
+        dir[2] /= n;
+        ut_acccal_measure(p_part, dir, mean);
+        if (sensord_acccal_feed(p_cal, mean))
+        {
+            return k;
+        }
+    }
+
+    return k;
+}
+
+/**
+ * @return 0 when @param p_text reads as the @param n commands in @param p_cmd
+ */
+static int ut_acccal_words(const char *p_text, const int *p_cmd, uint32_t n)
+{
+    int32_t len = (int32_t)strlen(p_text);
+    int32_t pos = 0;
+    uint32_t i = 0;
+    int cmd;
+
+    while (sensord_acccal_next_word(p_text, len, &pos, &cmd))
+    {
+        if (i == n || cmd != p_cmd[i])
+        {
+            return -1;
+        }
+        i++;
+    }
+
+    return (i == n && pos == len) ? 0 : -1;
+}
+
+int unit_test_acccal(int argc, char *argv[])
+{
+    static const UT_ACCCAL_PART part = { { 1.01f, 0.99f, 1.006f }, { 0.18f, -0.22f, 0.12f } };
+    static const UT_ACCCAL_PART drifted = { { 1.01f, 0.99f, 1.006f }, { 0.28f, -0.15f, 0.12f } };
+    static const UT_ACCCAL_PART bad_part = { { 1.1f, 0.99f, 1.0f }, { 0.0f, 0.0f, 0.0f } };
+    static const int words_cmd[] = {
+        SENSORD_ACCCAL_CMD_FACES, SENSORD_ACCCAL_CMD_ABORT, SENSORD_ACCCAL_CMD_CLEAR, SENSORD_ACCCAL_CMD_FACES
+    };
+    static const int unknown_cmd[] = { -1, SENSORD_ACCCAL_CMD_CLEAR };
+    SENSORD_ACCCAL cal;
+    float gain[3];
+    float err;
+    uint32_t windows;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    sensord_acccal_reset(&cal);
+    printf("acccal: part gain %.3f %.3f %.3f, offset %.2f %.2f %.2f m/s^2, uncorrected error %.3f m/s^2\n",
+            part.gain[0], part.gain[1], part.gain[2], part.offset[0], part.offset[1], part.offset[2],
+            ut_acccal_err(&cal, &part));
+
+    /*in use, common gain and offset*/
+    windows = ut_acccal_fit(&cal, &part);
+    err = ut_acccal_err(&cal, &part);
+    printf("acccal: in use fit after %u windows, error %.3f m/s^2\n", windows, err);
+    if (windows > UT_ACCCAL_FIT_WINDOWS_MAX || err > UT_ACCCAL_FIT_ERR_MAX || cal.per_axis)
+    {
+        printf("acccal: FAIL in use fit over %.2f m/s^2\n", UT_ACCCAL_FIT_ERR_MAX);
+        ret = -1;
+    }
+
+    /*six-face, per axis gain*/
+    sensord_acccal_command(&cal, SENSORD_ACCCAL_CMD_FACES);
+    if (1 != ut_acccal_faces(&cal, &part) || cal.face_run || 0 == cal.per_axis)
+    {
+        printf("acccal: FAIL six-face run did not finish\n");
+        ret = -1;
+    }
+    err = ut_acccal_err(&cal, &part);
+    printf("acccal: six-face error %.3f m/s^2\n", err);
+    if (err > UT_ACCCAL_FACES_ERR_MAX)
+    {
+        printf("acccal: FAIL six-face over %.2f m/s^2\n", UT_ACCCAL_FACES_ERR_MAX);
+        ret = -1;
+    }
+
+    /*offset drifts, the fit follows it and keeps the per axis gains*/
+    memcpy(gain, cal.gain, sizeof(gain));
+    windows = ut_acccal_fit(&cal, &drifted);
+    err = ut_acccal_err(&cal, &drifted);
+    printf("acccal: offset drift refit after %u windows, error %.3f m/s^2\n", windows, err);
+    if (windows > UT_ACCCAL_FIT_WINDOWS_MAX || err > UT_ACCCAL_FACES_ERR_MAX ||
+            memcmp(gain, cal.gain, sizeof(gain)) || 0 == cal.per_axis)
+    {
+        printf("acccal: FAIL refit lost the six-face gains or the offset\n");
+        ret = -1;
+    }
+
+    /*10 % off is a bad run, the correction stays*/
+    sensord_acccal_command(&cal, SENSORD_ACCCAL_CMD_CLEAR);
+    sensord_acccal_command(&cal, SENSORD_ACCCAL_CMD_FACES);
+    if (0 != ut_acccal_faces(&cal, &bad_part) || 1.0f != cal.gain[0] || cal.per_axis)
+    {
+        printf("acccal: FAIL out of range six-face result taken\n");
+        ret = -1;
+    }
+    else
+    {
+        printf("acccal: six-face result 10 %% off refused\n");
+    }
+
+    if (-EINVAL != sensord_acccal_command(&cal, 7) ||
+            0 != ut_acccal_words("faces abort\tclear 1\n", words_cmd, 4) ||
+            0 != ut_acccal_words(" \n", NULL, 0) ||
+            0 != ut_acccal_words("clear_everything_now clear", unknown_cmd, 2))
+    {
+        printf("acccal: FAIL control words\n");
+        ret = -1;
+    }
+    else
+    {
+        printf("acccal: control words and unknown command ok\n");
+    }
+
+    return ret;
+}
@@ -0,0 +1,287 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "BoschBatchStore.h"
+#include "BoschSensor.h"
+#include "unit_test.h"
+
+/**
+ * Batch store driven the way sensord drives it. Raw data passes come every
+ * UT_BATCH_PASS_NS with jitter, each carrying the events sampled since the last
+ * one, and the delivery timer brings extra passes at its armed deadline less
+ * DELIVER_TIMER_SLACK_NS. Raw data stops UT_BATCH_TAIL_NS before the end, so
+ * what is held then only goes up by the timer. Handle 1 at 200 Hz is a wakeup
+ * sensor held for 100 ms, handle 2 at 400 Hz is held for 200 ms in a store of
+ * 64 that fills first, handle 3 is not batched. Every event must come up once,
+ * in order, and no held event later than its timestamp plus latency. The alarm
+ * deadline must follow handle 1 only.
+ */
+#define UT_BATCH_PASS_NS 20000000LL
+#define UT_BATCH_RUN_NS 10000000000LL
+#define UT_BATCH_TAIL_NS 1000000000LL
+#define UT_BATCH_HANDLES 4
+
+typedef struct
+{
+    int64_t period_ns;
+    int64_t latency_ns;
+    uint32_t capacity;
+    int wakeup;
+    int64_t next_ts;
+    int64_t last_delivered_ts;
+    uint64_t produced;
+    uint64_t delivered;
+    uint64_t late;
+    uint64_t disorder;
+} UT_BATCH_HANDLE;
+
+static UT_BATCH_HANDLE ut_batch_h[UT_BATCH_HANDLES];
+static uint64_t ut_batch_bursts;
+static uint32_t ut_batch_max_burst;
+
+static void ut_batch_deliver(const sensors_event_t *p_events, uint32_t count, int64_t now_ns)
+{
+    UT_BATCH_HANDLE *p_h;
+    uint32_t i;
+
+    ut_batch_bursts++;
+    if (count > ut_batch_max_burst)
+    {
+        ut_batch_max_burst = count;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        p_h = &ut_batch_h[p_events[i].sensor];
+        p_h->delivered++;
+        if (p_events[i].timestamp <= p_h->last_delivered_ts)
+        {
+            p_h->disorder++;
+        }
+        p_h->last_delivered_ts = p_events[i].timestamp;
+        if (p_h->latency_ns && now_ns > p_events[i].timestamp + p_h->latency_ns)
+        {
+            p_h->late++;
+        }
+    }
+}
+
+/**
+ * as BoschSensor::deliver_batch_store()
+ * @param handle -1 for all handles
+ */
+static void ut_batch_deliver_store(BoschBatchStore *p_store, int handle, int64_t now_ns)
+{
+    const sensors_event_t *p_events;
+    uint32_t count;
+    int i;
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (handle >= 0 && handle != i)
+        {
+            continue;
+        }
+
+        count = p_store->get_events(i, &p_events);
+        if (count)
+        {
+            ut_batch_deliver(p_events, count, now_ns);
+            p_store->clear(i, now_ns);
+        }
+    }
+}
+
+/**
+ * one sensord pass, raw data up to @param now_ns if @param raw, then what is due
+ * @return 0, -1 if the alarm deadline doesn't follow the wakeup handle
+ */
+static int ut_batch_pass(BoschBatchStore *p_store, int64_t now_ns, int raw)
+{
+    const sensors_event_t *p_events;
+    sensors_event_t event;
+    int64_t wake_deadline_ns;
+    int i;
+
+    memset(&event, 0, sizeof(event));
+
+    for (i = 1; raw && i < UT_BATCH_HANDLES; ++i)
+    {
+        while (ut_batch_h[i].next_ts <= now_ns)
+        {
+            event.sensor = i;
+            event.timestamp = ut_batch_h[i].next_ts;
+            ut_batch_h[i].next_ts += ut_batch_h[i].period_ns;
+            ut_batch_h[i].produced++;
+
+            if (p_store->is_batching(i))
+            {
+                if (p_store->is_full(i))
+                {
+                    ut_batch_deliver_store(p_store, -1, now_ns);
+                }
+                p_store->put(&event);
+            }
+            else
+            {
+                ut_batch_deliver(&event, 1, now_ns);
+            }
+        }
+    }
+
+    /*as BoschSensor::deliver_due_batches()*/
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (p_store->is_due(i, now_ns + DELIVER_TIMER_SLACK_NS))
+        {
+            ut_batch_deliver_store(p_store, i, now_ns);
+        }
+    }
+
+    wake_deadline_ns = INT64_MAX;
+    if (p_store->get_events(1, &p_events))
+    {
+        wake_deadline_ns = p_events[0].timestamp + ut_batch_h[1].latency_ns;
+    }
+
+    return wake_deadline_ns == p_store->get_next_wake_deadline() ? 0 : -1;
+}
+
+int unit_test_batch(int argc, char *argv[])
+{
+    BoschBatchStore *p_store;
+    uint32_t seed = 0x9e3779b9;
+    int64_t now_ns = 0;
+    int64_t raw_ns = UT_BATCH_PASS_NS;
+    int64_t timer_ns;
+    uint64_t events = 0;
+    uint64_t timer_passes = 0;
+    uint64_t misses = 0;
+    int ret = 0;
+    int raw;
+    int i;
+
+    (void)argc;
+    (void)argv;
+
+    memset(ut_batch_h, 0, sizeof(ut_batch_h));
+    ut_batch_h[1].period_ns = 5000000;
+    ut_batch_h[1].latency_ns = 100000000;
+    ut_batch_h[1].capacity = 1000;
+    ut_batch_h[1].wakeup = 1;
+    ut_batch_h[2].period_ns = 2500000;
+    ut_batch_h[2].latency_ns = 200000000;
+    ut_batch_h[2].capacity = 64;
+    ut_batch_h[3].period_ns = 10000000;
+
+    p_store = new BoschBatchStore();
+    p_store->lock();
+    for (i = 1; i < UT_BATCH_HANDLES; ++i)
+    {
+        ut_batch_h[i].next_ts = ut_batch_h[i].period_ns;
+        if (p_store->configure(i, ut_batch_h[i].latency_ns, ut_batch_h[i].capacity, ut_batch_h[i].wakeup))
+        {
+            printf("batch: configure handle %d fail\n", i);
+            ret = -1;
+        }
+    }
+    if (-EINVAL != p_store->configure(HAL_SENSOR_HANDLE_MAX, 1, 1, 0) || p_store->is_batching(3))
+    {
+        printf("batch: bad handle or unbatched handle accepted\n");
+        ret = -1;
+    }
+
+    while (now_ns < UT_BATCH_RUN_NS)
+    {
+        timer_ns = INT64_MAX;
+        if (INT64_MAX != p_store->get_next_deadline())
+        {
+            timer_ns = p_store->get_next_deadline() - DELIVER_TIMER_SLACK_NS;
+        }
+
+        raw = raw_ns <= timer_ns;
+        now_ns = raw ? raw_ns : timer_ns;
+        if (raw)
+        {
+            /*raw data lands 10 ms early to 10 ms late, and stops for the tail*/
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            raw_ns += UT_BATCH_PASS_NS - 10000000 + (int64_t)(seed % 20000000);
+            if (raw_ns > UT_BATCH_RUN_NS - UT_BATCH_TAIL_NS)
+            {
+                raw_ns = INT64_MAX;
+            }
+        }
+        else
+        {
+            timer_passes++;
+        }
+
+        if (ut_batch_pass(p_store, now_ns, raw))
+        {
+            printf("batch: alarm deadline doesn't follow wakeup handle at %lld ns\n", (long long)now_ns);
+            ret = -1;
+            break;
+        }
+        if (INT64_MAX == raw_ns && INT64_MAX == p_store->get_next_deadline())
+        {
+            break;
+        }
+    }
+
+    if (INT64_MAX != p_store->get_next_deadline())
+    {
+        printf("batch: events left held after raw data stopped\n");
+        ret = -1;
+    }
+    p_store->unlock();
+
+    for (i = 1; i < UT_BATCH_HANDLES; ++i)
+    {
+        UT_BATCH_HANDLE *p_h = &ut_batch_h[i];
+
+        printf("batch: handle %d latency %lld ms: %llu events, %llu late, %llu out of order, %llu deadlines missed\n",
+                i, (long long)(p_h->latency_ns / 1000000), (unsigned long long)p_h->produced,
+                (unsigned long long)p_h->late, (unsigned long long)p_h->disorder,
+                (unsigned long long)p_store->get_miss_count(i));
+        if (p_h->delivered != p_h->produced || p_h->late || p_h->disorder)
+        {
+            ret = -1;
+        }
+        events += p_h->produced;
+        misses += p_store->get_miss_count(i);
+    }
+
+    printf("batch: %llu events in %llu bursts, largest %u, %llu timer passes\n", (unsigned long long)events,
+            (unsigned long long)ut_batch_bursts, ut_batch_max_burst, (unsigned long long)timer_passes);
+    if (misses || 0 == timer_passes)
+    {
+        ret = -1;
+    }
+
+    delete p_store;
+
+    return ret;
+}
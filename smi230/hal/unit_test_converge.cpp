@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "sensord_gyrocal.h"
+#include "sensord_state.h"
+#include "unit_test.h"
+
+/**
+ * Time to converged gyro output after a HAL start, cold against restored.
+ * A handheld device turns around all the time and lies still only now and
+ * then. Cold, the bias is unknown until the first still stretch; restored,
+ * it comes from the state file of the last run and is right from the first
+ * sample, up to what temperature moved it since.
+ * The stream goes through sensord_gyrocal_run in FIFO sized bursts like
+ * sensord_calib_process feeds it, the bias goes through the state file the
+ * way destroy and the next constructor pass it on.
+ * Last, the device is picked up near the end of a still gyro window while the
+ * acc window before was still: that window must not reach the bias.
+ */
+
+#define UT_CONV_S 120
+#define UT_CONV_ACC_HZ 1600
+#define UT_CONV_GYR_HZ 2000
+#define UT_CONV_BURST_MS 20
+#define UT_CONV_ACC_BURST (UT_CONV_ACC_HZ * UT_CONV_BURST_MS / 1000)
+#define UT_CONV_GYR_BURST (UT_CONV_GYR_HZ * UT_CONV_BURST_MS / 1000)
+/*lies still this long every period, first time at the offset*/
+#define UT_CONV_STILL_PERIOD_S 20
+#define UT_CONV_STILL_OFFSET_S 15
+#define UT_CONV_STILL_S 1.5
+/*output is converged once every axis stays this close to the true rate, 0.1 dps*/
+#define UT_CONV_ERR_MAX 0.0017453f
+#define UT_CONV_RAD2DEG 57.29578
+
+typedef struct
+{
+    float conv_s;           /// end of the last burst that went out with a bias off by more than UT_CONV_ERR_MAX
+    float drift_deg;        /// angle a consumer integrating the calibrated rate is off at the end
+} UT_CONV_RESULT;
+
+static float ut_conv_noise(float amp)
+{
+    return (rand() / (float)RAND_MAX - 0.5f) * 2 * amp;
+}
+
+static int ut_conv_still(double t)
+{
+    double in_period = t - UT_CONV_STILL_OFFSET_S;
+
+    if (in_period < 0)
+    {
+        return 0;
+    }
+
+    return fmod(in_period, UT_CONV_STILL_PERIOD_S) < UT_CONV_STILL_S;
+}
+
+/**
+ * run one HAL lifetime on @param p_cal with gyro offset @param p_bias
+ */
+static void ut_conv_run(SENSORD_GYROCAL *p_cal, const float *p_bias, UT_CONV_RESULT *p_res)
+{
+    float acc[3 * UT_CONV_ACC_BURST];
+    int64_t acc_tm[UT_CONV_ACC_BURST];
+    float gyr[3 * UT_CONV_GYR_BURST];
+    int64_t gyr_tm[UT_CONV_GYR_BURST];
+    double drift[3] = { 0, 0, 0 };
+    double t;
+    uint32_t burst;
+    uint32_t i;
+    uint32_t k;
+    int still;
+
+    p_res->conv_s = 0;
+
+    for (burst = 0; burst < UT_CONV_S * 1000 / UT_CONV_BURST_MS; ++burst)
+    {
+        for (i = 0; i < UT_CONV_ACC_BURST; ++i)
+        {
+            acc_tm[i] = ((int64_t)burst * UT_CONV_ACC_BURST + i) * 1000000000LL / UT_CONV_ACC_HZ;
+            t = acc_tm[i] / 1e9;
+            still = ut_conv_still(t);
+            acc[3 * i] = 0.1f + ut_conv_noise(0.02f);
+            acc[3 * i + 1] = -0.2f + ut_conv_noise(0.02f);
+            acc[3 * i + 2] = 9.8f + ut_conv_noise(0.02f);
+            if (!still)
+            {
+                acc[3 * i] += 0.8f * sin(2 * M_PI * 1.3 * t);
+                acc[3 * i + 1] += 0.6f * sin(2 * M_PI * 0.8 * t + 1);
+                acc[3 * i + 2] += 0.5f * sin(2 * M_PI * 1.7 * t + 2);
+            }
+        }
+
+        for (i = 0; i < UT_CONV_GYR_BURST; ++i)
+        {
+            gyr_tm[i] = ((int64_t)burst * UT_CONV_GYR_BURST + i) * 1000000000LL / UT_CONV_GYR_HZ;
+            t = gyr_tm[i] / 1e9;
+            still = ut_conv_still(t);
+            for (k = 0; k < 3; ++k)
+            {
+                gyr[3 * i + k] = p_bias[k] + ut_conv_noise(0.005f);
+            }
+            if (!still)
+            {
+                gyr[3 * i] += 0.6f * sin(2 * M_PI * 0.7 * t);
+                gyr[3 * i + 1] += 0.4f * sin(2 * M_PI * 1.1 * t + 1);
+                gyr[3 * i + 2] += 0.5f * sin(2 * M_PI * 0.9 * t + 2);
+            }
+        }
+
+        sensord_gyrocal_run(p_cal, acc, acc_tm, UT_CONV_ACC_BURST, gyr, gyr_tm, UT_CONV_GYR_BURST);
+
+        /*the burst goes out with the bias as it is after calibration, like sensord_algo_process*/
+        for (k = 0; k < 3; ++k)
+        {
+            drift[k] += (double)(p_bias[k] - p_cal->bias[k]) * UT_CONV_BURST_MS / 1000;
+            if (fabsf(p_bias[k] - p_cal->bias[k]) > UT_CONV_ERR_MAX)
+            {
+                p_res->conv_s = (burst + 1) * UT_CONV_BURST_MS / 1000.f;
+            }
+        }
+    }
+
+    p_res->drift_deg = sqrt(drift[0] * drift[0] + drift[1] * drift[1] + drift[2] * drift[2]) * UT_CONV_RAD2DEG;
+}
+
+/**
+ * acc windows a quarter window ahead of the gyro ones. From @param pick_s on the device
+ * is handled and turned slowly, slow enough that the gyro window alone looks still
+ * @return still windows taken into the bias
+ */
+static uint32_t ut_conv_picked_up(double pick_s)
+{
+    float acc[3 * UT_CONV_ACC_BURST];
+    int64_t acc_tm[UT_CONV_ACC_BURST];
+    float gyr[3 * UT_CONV_GYR_BURST];
+    int64_t gyr_tm[UT_CONV_GYR_BURST];
+    SENSORD_GYROCAL cal;
+    double t;
+    uint32_t burst;
+    uint32_t i;
+
+    sensord_gyrocal_reset(&cal);
+
+    for (burst = 0; burst < 2000 / UT_CONV_BURST_MS; ++burst)
+    {
+        for (i = 0; i < UT_CONV_ACC_BURST; ++i)
+        {
+            t = 0.75 + (burst * UT_CONV_ACC_BURST + i) / (double)UT_CONV_ACC_HZ;
+            acc_tm[i] = (int64_t)(t * 1e9);
+            acc[3 * i] = ut_conv_noise(0.02f);
+            acc[3 * i + 1] = ut_conv_noise(0.02f);
+            acc[3 * i + 2] = 9.8f + ut_conv_noise(0.02f);
+            if (t >= pick_s)
+            {
+                acc[3 * i] += 0.8f * sin(2 * M_PI * 3 * t);
+            }
+        }
+
+        for (i = 0; i < UT_CONV_GYR_BURST; ++i)
+        {
+            t = 1.0 + (burst * UT_CONV_GYR_BURST + i) / (double)UT_CONV_GYR_HZ;
+            gyr_tm[i] = (int64_t)(t * 1e9);
+            gyr[3 * i] = ut_conv_noise(0.005f);
+            gyr[3 * i + 1] = ut_conv_noise(0.005f);
+            gyr[3 * i + 2] = ut_conv_noise(0.005f) + ((t >= pick_s) ? 0.03f : 0);
+        }
+
+        sensord_gyrocal_run(&cal, acc, acc_tm, UT_CONV_ACC_BURST, gyr, gyr_tm, UT_CONV_GYR_BURST);
+    }
+
+    return cal.updates;
+}
+
+int unit_test_converge(int argc, char *argv[])
+{
+    char dir[] = "/tmp/ut_converge_XXXXXX";
+    char path[64];
+    /*about 1 dps, then what a few degrees of temperature move it by till the next start*/
+    const float bias[3] = { 0.02f, -0.015f, 0.01f };
+    const float bias_warm[3] = { 0.0204f, -0.0153f, 0.0102f };
+    SENSORD_GYROCAL cal;
+    SENSORD_STATE state;
+    UT_CONV_RESULT cold;
+    UT_CONV_RESULT warm;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    if (NULL == mkdtemp(dir))
+    {
+        printf("converge: scratch dir fail, errno = %d\n", errno);
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/state.bin", dir);
+
+    srand(1);
+    sensord_gyrocal_reset(&cal);
+    ut_conv_run(&cal, bias, &cold);
+
+    /*destroy saves, the next constructor loads, see sensord_algo_load_state*/
+    memset(&state, 0, sizeof(state));
+    memcpy(state.gyr_bias, cal.bias, sizeof(state.gyr_bias));
+    state.gyr_updates = cal.updates;
+    if (sensord_state_save(path, &state) || sensord_state_load(path, &state))
+    {
+        printf("converge: state file round trip fail\n");
+        ret = -1;
+    }
+    sensord_gyrocal_reset(&cal);
+    memcpy(cal.bias, state.gyr_bias, sizeof(cal.bias));
+    cal.updates = state.gyr_updates;
+
+    ut_conv_run(&cal, bias_warm, &warm);
+
+    unlink(path);
+    rmdir(dir);
+
+    printf("converge: %d s handheld, still %.1f s every %d s from %d s, error bound %.2f dps\n",
+            UT_CONV_S, UT_CONV_STILL_S, UT_CONV_STILL_PERIOD_S, UT_CONV_STILL_OFFSET_S,
+            UT_CONV_ERR_MAX * UT_CONV_RAD2DEG);
+    printf("converge: %-10s converged after %6.2f s, %6.2f deg integrated error at %d s\n",
+            "cold", cold.conv_s, cold.drift_deg, UT_CONV_S);
+    printf("converge: %-10s converged after %6.2f s, %6.2f deg integrated error at %d s\n",
+            "restored", warm.conv_s, warm.drift_deg, UT_CONV_S);
+
+    if (cold.conv_s <= UT_CONV_STILL_OFFSET_S || cold.conv_s >= UT_CONV_S)
+    {
+        printf("converge: cold start should converge at the first still stretch\n");
+        ret = -1;
+    }
+    if (warm.conv_s != 0)
+    {
+        printf("converge: restored bias should be within bound from the first burst\n");
+        ret = -1;
+    }
+    if (warm.drift_deg >= cold.drift_deg)
+    {
+        printf("converge: restored start should drift less than cold\n");
+        ret = -1;
+    }
+
+    /*gyro window 1.0-1.5 s, acc windows 0.75-1.25 s still and 1.25-1.75 s picked up*/
+    if (0 != ut_conv_picked_up(1.3))
+    {
+        printf("converge: gyro window picked up at its end taken for offset\n");
+        ret = -1;
+    }
+    else if (0 == ut_conv_picked_up(100.0))
+    {
+        printf("converge: still device never taken for offset\n");
+        ret = -1;
+    }
+    else
+    {
+        printf("converge: picked up at the end of a still gyro window, not taken for offset\n");
+    }
+
+    return ret;
+}
@@ -0,0 +1,312 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "sensord_cfg.h"
+#include "sensord_convert.h"
+#include "unit_test.h"
+
+/**
+ * Raw to SI conversion, sensord_convert_xyz() against sensord_convert_xyz_scalar().
+ * Every acc and gyro range is set through sensord_convert_set_*_range() and its scale
+ * used. Frame counts run 1..UT_CONVERT_FRAMES_ODD and a full ring, so 3 * count hits
+ * every tail length of the vector loop, at every alignment of input and output.
+ * Raw values are random 16 bit ones plus the extremes, and a few above 2^24, where
+ * int32 to float has to round. Results must be bit exact, and nothing past the last
+ * frame may be written.
+ * The same runs compare sensord_convert_xyz_affine() with its scalar reference, with
+ * acc calibration sized per axis gains and offsets. There a value may be 1 ulp off
+ * where the compiler fuses the scalar multiply-add, nothing outside the block may change.
+ */
+#define UT_CONVERT_FRAMES 2048
+#define UT_CONVERT_FRAMES_ODD 67
+#define UT_CONVERT_ALIGN 4
+#define UT_CONVERT_GUARD 4
+#define UT_CONVERT_BENCH_FRAMES (64 * 1024 * 1024)
+#define UT_CONVERT_AFFINE_ULP_MAX 1
+
+static int32_t ut_raw[3 * UT_CONVERT_FRAMES + UT_CONVERT_ALIGN];
+static float ut_out[3 * UT_CONVERT_FRAMES + UT_CONVERT_ALIGN + UT_CONVERT_GUARD];
+static float ut_ref[3 * UT_CONVERT_FRAMES + UT_CONVERT_ALIGN + UT_CONVERT_GUARD];
+
+static double ut_convert_thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void ut_convert_fill(void)
+{
+    uint32_t seed = 0x68e31da4;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(ut_raw) / sizeof(ut_raw[0]); ++i)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        ut_raw[i] = (int16_t)seed;
+    }
+
+    ut_raw[0] = INT16_MIN;
+    ut_raw[1] = INT16_MAX;
+    ut_raw[2] = 0;
+    ut_raw[7] = (1 << 24) + 1;
+    ut_raw[11] = -((1 << 24) + 3);
+    ut_raw[3 * UT_CONVERT_FRAMES - 1] = INT32_MAX;
+}
+
+/**
+ * every frame count up to UT_CONVERT_FRAMES_ODD and a full ring, at every alignment
+ * @return number of mismatching blocks
+ */
+static int ut_convert_check(float scale)
+{
+    uint32_t frames;
+    uint32_t align;
+    uint32_t n;
+    int bad = 0;
+
+    for (frames = 1; frames <= UT_CONVERT_FRAMES; frames = (frames < UT_CONVERT_FRAMES_ODD) ? frames + 1 : UT_CONVERT_FRAMES)
+    {
+        n = 3 * frames;
+        for (align = 0; align < UT_CONVERT_ALIGN; ++align)
+        {
+            memset(ut_out, 0x5a, sizeof(ut_out));
+            memset(ut_ref, 0x5a, sizeof(ut_ref));
+
+            sensord_convert_xyz(ut_raw + align, ut_out + align, frames, scale);
+            sensord_convert_xyz_scalar(ut_raw + align, ut_ref + align, frames, scale);
+
+            /*bit exact, and the guard after the block untouched*/
+            if (memcmp(ut_out, ut_ref, (align + n + UT_CONVERT_GUARD) * sizeof(float)))
+            {
+                bad++;
+            }
+        }
+        if (UT_CONVERT_FRAMES == frames)
+        {
+            break;
+        }
+    }
+
+    return bad;
+}
+
+/**
+ * distance of two floats of the same sign in units in the last place
+ */
+static uint32_t ut_convert_ulp(float a, float b)
+{
+    int32_t ia;
+    int32_t ib;
+
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+
+    return (ia > ib) ? (uint32_t)(ia - ib) : (uint32_t)(ib - ia);
+}
+
+/**
+ * like ut_convert_check for the affine path
+ * @param p_ulp largest distance seen, in ulp
+ * @return number of mismatching blocks
+ */
+static int ut_convert_check_affine(const float scale[3], const float offset[3], uint32_t *p_ulp)
+{
+    uint32_t frames;
+    uint32_t align;
+    uint32_t n;
+    uint32_t i;
+    uint32_t ulp;
+    int bad = 0;
+
+    *p_ulp = 0;
+
+    for (frames = 1; frames <= UT_CONVERT_FRAMES; frames = (frames < UT_CONVERT_FRAMES_ODD) ? frames + 1 : UT_CONVERT_FRAMES)
+    {
+        n = 3 * frames;
+        for (align = 0; align < UT_CONVERT_ALIGN; ++align)
+        {
+            memset(ut_out, 0x5a, sizeof(ut_out));
+            memset(ut_ref, 0x5a, sizeof(ut_ref));
+
+            sensord_convert_xyz_affine(ut_raw + align, ut_out + align, frames, scale, offset);
+            sensord_convert_xyz_affine_scalar(ut_raw + align, ut_ref + align, frames, scale, offset);
+
+            ulp = 0;
+            for (i = align; i < align + n; ++i)
+            {
+                ulp = (ut_convert_ulp(ut_out[i], ut_ref[i]) > ulp) ? ut_convert_ulp(ut_out[i], ut_ref[i]) : ulp;
+            }
+            *p_ulp = (ulp > *p_ulp) ? ulp : *p_ulp;
+
+            if (ulp > UT_CONVERT_AFFINE_ULP_MAX || memcmp(ut_out, ut_ref, align * sizeof(float)) ||
+                    memcmp(ut_out + align + n, ut_ref + align + n, UT_CONVERT_GUARD * sizeof(float)))
+            {
+                bad++;
+            }
+        }
+        if (UT_CONVERT_FRAMES == frames)
+        {
+            break;
+        }
+    }
+
+    return bad;
+}
+
+/**
+ * @return frames per second through the affine @param vector path or its scalar reference
+ */
+static double ut_convert_bench_affine(int vector, const float scale[3], const float offset[3])
+{
+    uint32_t blocks = UT_CONVERT_BENCH_FRAMES / UT_CONVERT_FRAMES;
+    uint32_t i;
+    double ns;
+
+    ns = ut_convert_thread_ns();
+    for (i = 0; i < blocks; ++i)
+    {
+        if (vector)
+        {
+            sensord_convert_xyz_affine(ut_raw, ut_out, UT_CONVERT_FRAMES, scale, offset);
+        }
+        else
+        {
+            sensord_convert_xyz_affine_scalar(ut_raw, ut_out, UT_CONVERT_FRAMES, scale, offset);
+        }
+        __asm__ __volatile__("" : : "r"(ut_out) : "memory");
+    }
+    ns = ut_convert_thread_ns() - ns;
+
+    return (double)blocks * UT_CONVERT_FRAMES / ns * 1e9;
+}
+
+/**
+ * @return frames per second through @param vector or the scalar reference
+ */
+static double ut_convert_bench(int vector, float scale)
+{
+    uint32_t blocks = UT_CONVERT_BENCH_FRAMES / UT_CONVERT_FRAMES;
+    uint32_t i;
+    double ns;
+
+    ns = ut_convert_thread_ns();
+    for (i = 0; i < blocks; ++i)
+    {
+        if (vector)
+        {
+            sensord_convert_xyz(ut_raw, ut_out, UT_CONVERT_FRAMES, scale);
+        }
+        else
+        {
+            sensord_convert_xyz_scalar(ut_raw, ut_out, UT_CONVERT_FRAMES, scale);
+        }
+        /*keep the stores from being dropped as dead*/
+        __asm__ __volatile__("" : : "r"(ut_out) : "memory");
+    }
+    ns = ut_convert_thread_ns() - ns;
+
+    return (double)blocks * UT_CONVERT_FRAMES / ns * 1e9;
+}
+
+int unit_test_convert(int argc, char *argv[])
+{
+    static const int acc_range[] = {
+        ACC_CHIP_RANGCONF_2G, ACC_CHIP_RANGCONF_4G, ACC_CHIP_RANGCONF_8G, ACC_CHIP_RANGCONF_16G
+    };
+    static const int gyro_range[] = {
+        GYRO_CHIP_RANGCONF_125DPS, GYRO_CHIP_RANGCONF_250DPS, GYRO_CHIP_RANGCONF_500DPS,
+        GYRO_CHIP_RANGCONF_1000DPS, GYRO_CHIP_RANGCONF_2000DPS
+    };
+    /*what an acc calibration ends up with: gains within 5 %, offsets within 1 m/s^2*/
+    static const float acc_gain[3] = { 1.012f, 0.987f, 1.0031f };
+    static const float acc_offset[3] = { 0.13f, -0.21f, 0.047f };
+    float scale;
+    float scale_xyz[3];
+    uint32_t ulp;
+    uint32_t i;
+    uint32_t k;
+    int bad;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    ut_convert_fill();
+
+    for (i = 0; i < sizeof(acc_range) / sizeof(acc_range[0]); ++i)
+    {
+        if (sensord_convert_set_acc_range(acc_range[i]))
+        {
+            ret = -1;
+            continue;
+        }
+        scale = sensord_convert_get_acc_scale();
+        bad = ut_convert_check(scale);
+        printf("convert: acc  range %4d, scale %.9f: %d blocks differ from scalar\n", acc_range[i], scale, bad);
+        ret |= bad ? -1 : 0;
+
+        for (k = 0; k < 3; ++k)
+        {
+            scale_xyz[k] = scale * acc_gain[k];
+        }
+        bad = ut_convert_check_affine(scale_xyz, acc_offset, &ulp);
+        printf("convert: acc  range %4d, affine: %d blocks differ from scalar, max %u ulp\n", acc_range[i], bad, ulp);
+        ret |= bad ? -1 : 0;
+    }
+
+    for (i = 0; i < sizeof(gyro_range) / sizeof(gyro_range[0]); ++i)
+    {
+        if (sensord_convert_set_gyro_range(gyro_range[i]))
+        {
+            ret = -1;
+            continue;
+        }
+        scale = sensord_convert_get_gyro_scale();
+        bad = ut_convert_check(scale);
+        printf("convert: gyro range %4d, scale %.11f: %d blocks differ from scalar\n", gyro_range[i], scale, bad);
+        ret |= bad ? -1 : 0;
+    }
+
+    /*an unknown range is refused and the scale kept*/
+    scale = sensord_convert_get_gyro_scale();
+    if (-EINVAL != sensord_convert_set_gyro_range(3) || scale != sensord_convert_get_gyro_scale())
+    {
+        printf("convert: unknown gyro range not refused\n");
+        ret = -1;
+    }
+
+    printf("convert: %u frame blocks: vector %.1f M frames/s, scalar %.1f M frames/s\n",
+            UT_CONVERT_FRAMES, ut_convert_bench(1, scale) / 1e6, ut_convert_bench(0, scale) / 1e6);
+    printf("convert: %u frame blocks: affine vector %.1f M frames/s, scalar %.1f M frames/s\n",
+            UT_CONVERT_FRAMES, ut_convert_bench_affine(1, scale_xyz, acc_offset) / 1e6,
+            ut_convert_bench_affine(0, scale_xyz, acc_offset) / 1e6);
+
+    return ret;
+}
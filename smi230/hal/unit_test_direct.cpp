@@ -0,0 +1,522 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "BoschDirectChannel.h"
+#include "unit_test.h"
+
+/**
+ * The direct channel is written through BoschDirectChannel::post() the way the
+ * sensord thread does, one FIFO burst per call: the acc samples of the burst, then
+ * the gyro samples. Each channel is read by its own thread from a separate mapping
+ * of the same memfd, the way the framework reads the ashmem region.
+ */
+#define UT_DIRECT_ACC_HANDLE 1
+#define UT_DIRECT_GYR_HANDLE 2
+#define UT_DIRECT_ACC_PERIOD_NS 625000LL    /// 1600 Hz
+#define UT_DIRECT_GYR_PERIOD_NS 500000LL    /// 2000 Hz
+#define UT_DIRECT_JITTER_PERMILLE 20
+#define UT_DIRECT_DURATION_NS (20 * 1000000000LL)
+#define UT_DIRECT_BURST_MAX_NS 25000000LL
+#define UT_DIRECT_BURST_MAX 128
+#define UT_DIRECT_EVENT_CAP 256
+#define UT_DIRECT_CHANNELS 2
+#define UT_DIRECT_BENCH_EVENTS 400000
+
+typedef struct
+{
+    uint32_t count;
+    int64_t first_ts;
+    int64_t last_ts;
+    int64_t min_iv;
+    int64_t max_iv;
+    float last_index;
+} UT_DIRECT_STAT;
+
+typedef struct
+{
+    const sensors_event_t *p_mem;   /// reader's own mapping
+    uint32_t cap;
+    uint32_t pos;
+    int32_t next_counter;
+    uint64_t consumed;              /// atomic, read by the writer for flow control
+    int done;                       /// atomic, writer posted everything
+    int torn;
+    int lapped;
+    int bad_event;
+    int out_of_order;
+    UT_DIRECT_STAT stat[HAL_SENSOR_HANDLE_MAX];
+} UT_DIRECT_READER;
+
+typedef struct
+{
+    int fd;
+    native_handle_t *p_handle;
+    struct sensors_direct_mem_t mem;
+    int channel_handle;
+} UT_DIRECT_MEM;
+
+static int ut_direct_mem_open(UT_DIRECT_MEM *p_dm, size_t size)
+{
+    memset(p_dm, 0, sizeof(UT_DIRECT_MEM));
+
+    p_dm->fd = memfd_create("ut_direct", MFD_CLOEXEC);
+    if (p_dm->fd < 0)
+    {
+        return -errno;
+    }
+    if (ftruncate(p_dm->fd, size))
+    {
+        close(p_dm->fd);
+        return -errno;
+    }
+
+    p_dm->p_handle = (native_handle_t *)calloc(1, sizeof(native_handle_t) + sizeof(int));
+    p_dm->p_handle->version = sizeof(native_handle_t);
+    p_dm->p_handle->numFds = 1;
+    p_dm->p_handle->data[0] = p_dm->fd;
+
+    p_dm->mem.type = SENSOR_DIRECT_MEM_TYPE_ASHMEM;
+    p_dm->mem.format = SENSOR_DIRECT_FMT_SENSORS_EVENT;
+    p_dm->mem.size = size;
+    p_dm->mem.handle = p_dm->p_handle;
+
+    return 0;
+}
+
+static void ut_direct_mem_close(UT_DIRECT_MEM *p_dm)
+{
+    free(p_dm->p_handle);
+    close(p_dm->fd);
+}
+
+static void ut_direct_reader_init(UT_DIRECT_READER *p_rd, const UT_DIRECT_MEM *p_dm)
+{
+    uint32_t h;
+
+    memset(p_rd, 0, sizeof(UT_DIRECT_READER));
+    p_rd->p_mem = (const sensors_event_t *)mmap(NULL, p_dm->mem.size, PROT_READ, MAP_SHARED, p_dm->fd, 0);
+    p_rd->cap = p_dm->mem.size / sizeof(sensors_event_t);
+    p_rd->next_counter = 1;
+    for (h = 0; h < HAL_SENSOR_HANDLE_MAX; ++h)
+    {
+        p_rd->stat[h].min_iv = INT64_MAX;
+    }
+}
+
+/**
+ * reads the slot the next event must land in, as the framework does: counter, payload, counter again
+ * @return 1 when an event was taken, 0 when it is not written yet
+ */
+static int ut_direct_read_one(UT_DIRECT_READER *p_rd)
+{
+    const sensors_event_t *p_slot = &p_rd->p_mem[p_rd->pos];
+    sensors_event_t event;
+    UT_DIRECT_STAT *p_stat;
+    int32_t counter;
+    int32_t old_counter;
+    int64_t iv;
+
+    counter = __atomic_load_n(&p_slot->reserved0, __ATOMIC_ACQUIRE);
+    if (counter != p_rd->next_counter)
+    {
+        /*still the previous lap, or never written*/
+        old_counter = (p_rd->next_counter > (int32_t)p_rd->cap) ? p_rd->next_counter - (int32_t)p_rd->cap : 0;
+        if (counter != old_counter)
+        {
+            p_rd->lapped = 1;
+        }
+        return 0;
+    }
+
+    memcpy(&event, p_slot, sizeof(event));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&p_slot->reserved0, __ATOMIC_RELAXED) != counter)
+    {
+        p_rd->torn = 1;
+    }
+
+    if (sizeof(sensors_event_t) != event.version ||
+            event.sensor <= 0 || event.sensor >= HAL_SENSOR_HANDLE_MAX ||
+            event.data[1] != (float)event.sensor)
+    {
+        p_rd->bad_event = 1;
+    }
+    else
+    {
+        p_stat = &p_rd->stat[event.sensor];
+        if (p_stat->count)
+        {
+            iv = event.timestamp - p_stat->last_ts;
+            if (iv <= 0 || event.data[0] <= p_stat->last_index)
+            {
+                p_rd->out_of_order = 1;
+            }
+            if (iv < p_stat->min_iv)
+            {
+                p_stat->min_iv = iv;
+            }
+            if (iv > p_stat->max_iv)
+            {
+                p_stat->max_iv = iv;
+            }
+        }
+        else
+        {
+            p_stat->first_ts = event.timestamp;
+        }
+        p_stat->count++;
+        p_stat->last_ts = event.timestamp;
+        p_stat->last_index = event.data[0];
+    }
+
+    p_rd->pos = (p_rd->pos + 1) % p_rd->cap;
+    p_rd->next_counter++;
+    __atomic_store_n(&p_rd->consumed, p_rd->consumed + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+static void *ut_direct_reader(void *arg)
+{
+    UT_DIRECT_READER *p_rd = (UT_DIRECT_READER *)arg;
+    int done;
+
+    while (1)
+    {
+        /*done is read before the slot, so a miss after done means nothing is left*/
+        done = __atomic_load_n(&p_rd->done, __ATOMIC_ACQUIRE);
+        if (0 == ut_direct_read_one(p_rd))
+        {
+            if (done)
+            {
+                break;
+            }
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static int64_t ut_direct_jitter(int64_t period_ns)
+{
+    return (int64_t)(rand() % (2 * UT_DIRECT_JITTER_PERMILLE + 1) - UT_DIRECT_JITTER_PERMILLE) * period_ns / 1000;
+}
+
+/**
+ * one FIFO burst of both sensors up to end_ns
+ * @return number of events
+ */
+static uint32_t ut_direct_burst(sensors_event_t *p_events, int64_t end_ns, uint32_t *p_acc_idx, uint32_t *p_gyr_idx)
+{
+    uint32_t n = 0;
+
+    while ((int64_t)*p_acc_idx * UT_DIRECT_ACC_PERIOD_NS < end_ns)
+    {
+        memset(&p_events[n], 0, sizeof(sensors_event_t));
+        p_events[n].sensor = UT_DIRECT_ACC_HANDLE;
+        p_events[n].type = SENSOR_TYPE_ACCELEROMETER;
+        p_events[n].timestamp = (int64_t)*p_acc_idx * UT_DIRECT_ACC_PERIOD_NS + ut_direct_jitter(UT_DIRECT_ACC_PERIOD_NS);
+        p_events[n].data[0] = (float)*p_acc_idx;
+        p_events[n].data[1] = (float)UT_DIRECT_ACC_HANDLE;
+        (*p_acc_idx)++;
+        n++;
+    }
+
+    while ((int64_t)*p_gyr_idx * UT_DIRECT_GYR_PERIOD_NS < end_ns)
+    {
+        memset(&p_events[n], 0, sizeof(sensors_event_t));
+        p_events[n].sensor = UT_DIRECT_GYR_HANDLE;
+        p_events[n].type = SENSOR_TYPE_GYROSCOPE;
+        p_events[n].timestamp = (int64_t)*p_gyr_idx * UT_DIRECT_GYR_PERIOD_NS + ut_direct_jitter(UT_DIRECT_GYR_PERIOD_NS);
+        p_events[n].data[0] = (float)*p_gyr_idx;
+        p_events[n].data[1] = (float)UT_DIRECT_GYR_HANDLE;
+        (*p_gyr_idx)++;
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * delivered rate must be the nominal rate of the level, and never burst above it
+ */
+static int ut_direct_check_rate(int ch, const char *name, const UT_DIRECT_STAT *p_stat,
+        int64_t in_period_ns, int64_t period_ns)
+{
+    double rate = 0;
+    double nominal = 1e9 / period_ns;
+    int ok;
+
+    if (p_stat->count > 1)
+    {
+        rate = (p_stat->count - 1) * 1e9 / (p_stat->last_ts - p_stat->first_ts);
+    }
+
+    /*the sample nearest to each grid point is taken, off by at most half an input period plus jitter*/
+    ok = p_stat->count > 1 &&
+            rate > nominal * 0.99 && rate < nominal * 1.01 &&
+            p_stat->min_iv >= period_ns - in_period_ns * 6 / 10 &&
+            p_stat->max_iv <= period_ns + in_period_ns * 6 / 10;
+
+    printf("direct: channel %d %s %5u events, %7.2f Hz of %4.0f Hz, interval %.3f..%.3f ms%s\n",
+            ch, name, p_stat->count, rate, nominal, p_stat->min_iv / 1e6, p_stat->max_iv / 1e6,
+            ok ? "" : ", WRONG RATE");
+
+    return ok ? 0 : -1;
+}
+
+/**
+ * two channels with different rate levels, read concurrently while written
+ */
+static int ut_direct_stream(void)
+{
+    static const int acc_level[UT_DIRECT_CHANNELS] = { SENSOR_DIRECT_RATE_VERY_FAST, SENSOR_DIRECT_RATE_NORMAL };
+    static const int gyr_level[UT_DIRECT_CHANNELS] = { SENSOR_DIRECT_RATE_FAST, SENSOR_DIRECT_RATE_VERY_FAST };
+    static const int64_t level_period[] = { 0, 1000000000LL / 50, 1000000000LL / 200, 1000000000LL / 800 };
+    static sensors_event_t events[UT_DIRECT_BURST_MAX];
+    static UT_DIRECT_READER reader[UT_DIRECT_CHANNELS];
+    BoschDirectChannel direct;
+    UT_DIRECT_MEM dm[UT_DIRECT_CHANNELS];
+    pthread_t thread[UT_DIRECT_CHANNELS];
+    uint64_t delivered[UT_DIRECT_CHANNELS];
+    uint32_t pos[UT_DIRECT_CHANNELS];
+    int32_t next_counter[UT_DIRECT_CHANNELS];
+    const sensors_event_t *p_own[UT_DIRECT_CHANNELS];
+    void *p_garbage;
+    uint32_t acc_idx = 0;
+    uint32_t gyr_idx = 0;
+    uint32_t n;
+    int64_t now_ns = 0;
+    int ret = 0;
+    int ch;
+
+    srand(1);
+
+    for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+    {
+        if (ut_direct_mem_open(&dm[ch], UT_DIRECT_EVENT_CAP * sizeof(sensors_event_t)))
+        {
+            printf("direct: memfd fail, errno = %d\n", errno);
+            return -1;
+        }
+        /*garbage left in the region must not look like events*/
+        p_garbage = mmap(NULL, dm[ch].mem.size, PROT_WRITE, MAP_SHARED, dm[ch].fd, 0);
+        memset(p_garbage, 0xa5, dm[ch].mem.size);
+        munmap(p_garbage, dm[ch].mem.size);
+
+        dm[ch].channel_handle = direct.register_channel(&dm[ch].mem);
+        if (dm[ch].channel_handle <= 0 ||
+                UT_DIRECT_ACC_HANDLE != direct.config_report(UT_DIRECT_ACC_HANDLE, dm[ch].channel_handle, acc_level[ch]) ||
+                UT_DIRECT_GYR_HANDLE != direct.config_report(UT_DIRECT_GYR_HANDLE, dm[ch].channel_handle, gyr_level[ch]))
+        {
+            printf("direct: channel %d setup fail, handle %d\n", ch, dm[ch].channel_handle);
+            return -1;
+        }
+
+        ut_direct_reader_init(&reader[ch], &dm[ch]);
+        p_own[ch] = reader[ch].p_mem;
+        delivered[ch] = 0;
+        pos[ch] = 0;
+        next_counter[ch] = 1;
+        pthread_create(&thread[ch], NULL, ut_direct_reader, &reader[ch]);
+    }
+
+    if (level_period[SENSOR_DIRECT_RATE_VERY_FAST] != direct.get_period_ns(UT_DIRECT_GYR_HANDLE) ||
+            level_period[SENSOR_DIRECT_RATE_VERY_FAST] != direct.get_period_ns(UT_DIRECT_ACC_HANDLE))
+    {
+        printf("direct: FAIL shortest period over the channels not reported\n");
+        ret = -1;
+    }
+
+    while (now_ns < UT_DIRECT_DURATION_NS)
+    {
+        now_ns += 1000000LL + rand() % UT_DIRECT_BURST_MAX_NS;
+        n = ut_direct_burst(events, now_ns, &acc_idx, &gyr_idx);
+
+        /*the reader may be at most half a region behind, so a burst can never lap it*/
+        for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+        {
+            while (delivered[ch] > __atomic_load_n(&reader[ch].consumed, __ATOMIC_ACQUIRE) + UT_DIRECT_EVENT_CAP / 2)
+            {
+                sched_yield();
+            }
+        }
+
+        direct.post(events, n);
+
+        /*the writer counts what it delivered from its own side of the region*/
+        for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+        {
+            while (next_counter[ch] == __atomic_load_n(&p_own[ch][pos[ch]].reserved0, __ATOMIC_RELAXED))
+            {
+                pos[ch] = (pos[ch] + 1) % UT_DIRECT_EVENT_CAP;
+                next_counter[ch]++;
+                delivered[ch]++;
+            }
+        }
+    }
+
+    for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+    {
+        __atomic_store_n(&reader[ch].done, 1, __ATOMIC_RELEASE);
+        pthread_join(thread[ch], NULL);
+    }
+
+    printf("direct: %u acc and %u gyro samples posted\n", acc_idx, gyr_idx);
+    for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+    {
+        ret |= ut_direct_check_rate(ch, "acc", &reader[ch].stat[UT_DIRECT_ACC_HANDLE],
+                UT_DIRECT_ACC_PERIOD_NS, level_period[acc_level[ch]]);
+        ret |= ut_direct_check_rate(ch, "gyr", &reader[ch].stat[UT_DIRECT_GYR_HANDLE],
+                UT_DIRECT_GYR_PERIOD_NS, level_period[gyr_level[ch]]);
+
+        if (reader[ch].consumed != delivered[ch] || reader[ch].torn || reader[ch].lapped ||
+                reader[ch].bad_event || reader[ch].out_of_order)
+        {
+            printf("direct: FAIL channel %d read %llu of %llu, torn %d, lapped %d, bad %d, out of order %d\n",
+                    ch, (unsigned long long)reader[ch].consumed, (unsigned long long)delivered[ch],
+                    reader[ch].torn, reader[ch].lapped, reader[ch].bad_event, reader[ch].out_of_order);
+            ret = -1;
+        }
+    }
+
+    /*a stopped sensor, then a stopped channel, must not advance the counter any more*/
+    direct.config_report(UT_DIRECT_ACC_HANDLE, dm[0].channel_handle, SENSOR_DIRECT_RATE_STOP);
+    n = ut_direct_burst(events, now_ns + UT_DIRECT_BURST_MAX_NS, &acc_idx, &gyr_idx);
+    direct.post(events, n);
+    for (n = 0; n < UT_DIRECT_EVENT_CAP &&
+            next_counter[0] == __atomic_load_n(&p_own[0][pos[0]].reserved0, __ATOMIC_RELAXED); ++n)
+    {
+        if (UT_DIRECT_GYR_HANDLE != p_own[0][pos[0]].sensor)
+        {
+            printf("direct: FAIL stopped sensor %d still reported\n", p_own[0][pos[0]].sensor);
+            ret = -1;
+        }
+        pos[0] = (pos[0] + 1) % UT_DIRECT_EVENT_CAP;
+        next_counter[0]++;
+    }
+
+    if (0 != direct.config_report(-1, dm[0].channel_handle, SENSOR_DIRECT_RATE_STOP) ||
+            -EINVAL != direct.config_report(-1, dm[0].channel_handle, SENSOR_DIRECT_RATE_FAST))
+    {
+        printf("direct: FAIL stop of all sensors\n");
+        ret = -1;
+    }
+    n = ut_direct_burst(events, now_ns + 2 * UT_DIRECT_BURST_MAX_NS, &acc_idx, &gyr_idx);
+    direct.post(events, n);
+    if (next_counter[0] == __atomic_load_n(&p_own[0][pos[0]].reserved0, __ATOMIC_RELAXED))
+    {
+        printf("direct: FAIL stopped channel still written\n");
+        ret = -1;
+    }
+
+    for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+    {
+        direct.unregister_channel(dm[ch].channel_handle);
+        munmap((void *)reader[ch].p_mem, dm[ch].mem.size);
+        ut_direct_mem_close(&dm[ch]);
+    }
+
+    return ret;
+}
+
+/**
+ * cost of post() per input event, both channels configured, no reader
+ */
+static int ut_direct_bench(void)
+{
+    static sensors_event_t events[UT_DIRECT_BURST_MAX];
+    static const uint32_t burst_ms[] = { 1, 10, 25 };
+    BoschDirectChannel direct;
+    UT_DIRECT_MEM dm[UT_DIRECT_CHANNELS];
+    struct timespec start;
+    struct timespec end;
+    uint32_t acc_idx;
+    uint32_t gyr_idx;
+    uint32_t total;
+    uint32_t n;
+    uint32_t i;
+    int64_t now_ns;
+    double ns;
+    int ch;
+
+    for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+    {
+        if (ut_direct_mem_open(&dm[ch], UT_DIRECT_EVENT_CAP * sizeof(sensors_event_t)))
+        {
+            return -1;
+        }
+        dm[ch].channel_handle = direct.register_channel(&dm[ch].mem);
+        direct.config_report(UT_DIRECT_ACC_HANDLE, dm[ch].channel_handle, SENSOR_DIRECT_RATE_VERY_FAST);
+        direct.config_report(UT_DIRECT_GYR_HANDLE, dm[ch].channel_handle, SENSOR_DIRECT_RATE_FAST);
+    }
+
+    for (i = 0; i < sizeof(burst_ms) / sizeof(burst_ms[0]); ++i)
+    {
+        acc_idx = 0;
+        gyr_idx = 0;
+        total = 0;
+        now_ns = 0;
+        ns = 0;
+        while (total < UT_DIRECT_BENCH_EVENTS)
+        {
+            now_ns += burst_ms[i] * 1000000LL;
+            n = ut_direct_burst(events, now_ns, &acc_idx, &gyr_idx);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            direct.post(events, n);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            ns += (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+            total += n;
+        }
+        printf("direct: post() %2u ms bursts, %.1f ns per input event, 2 channels\n", burst_ms[i], ns / total);
+    }
+
+    for (ch = 0; ch < UT_DIRECT_CHANNELS; ++ch)
+    {
+        direct.unregister_channel(dm[ch].channel_handle);
+        ut_direct_mem_close(&dm[ch]);
+    }
+
+    return 0;
+}
+
+int unit_test_direct(int argc, char *argv[])
+{
+    int ret;
+
+    (void)argc;
+    (void)argv;
+
+    ret = ut_direct_stream();
+    ret |= ut_direct_bench();
+
+    return ret;
+}
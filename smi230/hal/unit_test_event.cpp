@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "BoschEventRing.h"
+#include "unit_test.h"
+
+/**
+ * Event delivery from the sensord thread to pollEvents, through the event ring and
+ * through the HAL pipe it replaces, driven as hal_deliver_events() drives them.
+ * A writer thread stands in for sensord, the calling thread runs the pollEvents
+ * loop with the framework's 256 event buffer. The timestamp carries a sequence
+ * number, so order and loss are checked on every event.
+ *
+ * paced: the writer waits until a batch was read before the next one, the normal
+ * case with sensors at their ODR. saturated: back to back, the ring or pipe fills up.
+ */
+#define UT_EVENT_BATCH_MAX 2000
+#define UT_EVENT_POLL_BUF 256
+#define UT_EVENT_TOTAL 1000000
+
+typedef struct
+{
+    BoschEventRing *p_ring;     /// NULL for the HAL pipe
+    int pipe_fd[2];
+    uint32_t batch;
+    int paced;
+    uint64_t consumed;          /// atomic, read by the writer when paced
+    uint64_t writes;
+    double cpu_ns;
+} UT_EVENT_PATH;
+
+typedef struct
+{
+    uint64_t next_seq;
+    uint64_t polls;
+    int bad;
+} UT_EVENT_SINK;
+
+static sensors_event_t ut_batch[UT_EVENT_BATCH_MAX];
+
+static double ut_event_thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *ut_event_writer(void *arg)
+{
+    UT_EVENT_PATH *p_path = (UT_EVENT_PATH *)arg;
+    uint64_t seq = 0;
+    uint32_t writes;
+    uint32_t i;
+    double start_ns;
+
+    while (seq < UT_EVENT_TOTAL)
+    {
+        for (i = 0; i < p_path->batch; ++i)
+        {
+            ut_batch[i].timestamp = (int64_t)(seq + i);
+        }
+
+        start_ns = ut_event_thread_ns();
+        if (p_path->p_ring)
+        {
+            p_path->p_ring->write(ut_batch, p_path->batch);
+        }
+        else
+        {
+            (void) event_pipe_write(p_path->pipe_fd[1], ut_batch, p_path->batch, &writes);
+            p_path->writes += writes;
+        }
+        p_path->cpu_ns += ut_event_thread_ns() - start_ns;
+        seq += p_path->batch;
+
+        while (p_path->paced && __atomic_load_n(&p_path->consumed, __ATOMIC_ACQUIRE) < seq)
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static int ut_event_read(UT_EVENT_PATH *p_path, sensors_event_t *p_data, int count)
+{
+    int ret;
+
+    if (p_path->p_ring)
+    {
+        return p_path->p_ring->read(p_data, count);
+    }
+
+    ret = read(p_path->pipe_fd[0], p_data, count * sizeof(sensors_event_t));
+
+    return (ret < 0) ? 0 : ret / sizeof(sensors_event_t);
+}
+
+/**
+ * the pollEvents loop of sensors.cpp over one fd
+ */
+static int ut_event_poll(UT_EVENT_PATH *p_path, UT_EVENT_SINK *p_sink, sensors_event_t *p_data, int count)
+{
+    struct pollfd pfd;
+    int nb_events = 0;
+    int n = 0;
+    int cnt;
+
+    pfd.fd = p_path->p_ring ? p_path->p_ring->get_fd() : p_path->pipe_fd[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do
+    {
+        if (pfd.revents & POLLIN)
+        {
+            cnt = ut_event_read(p_path, p_data, count);
+            if (cnt < count)
+            {
+                pfd.revents = 0;
+            }
+            count -= cnt;
+            nb_events += cnt;
+            p_data += cnt;
+        }
+
+        if (count)
+        {
+            do
+            {
+                p_sink->polls++;
+                n = poll(&pfd, 1, nb_events ? 0 : -1);
+            } while (n < 0 && EINTR == errno);
+        }
+    } while (n > 0 && count);
+
+    return nb_events;
+}
+
+/**
+ * @return 0 when every event arrived once and in order
+ */
+static int ut_event_run(int ring, uint32_t batch, int paced)
+{
+    static sensors_event_t data[UT_EVENT_POLL_BUF];
+    BoschEventRing event_ring;
+    UT_EVENT_PATH path;
+    UT_EVENT_SINK sink;
+    pthread_t writer;
+    struct timespec start;
+    struct timespec end;
+    double reader_ns;
+    double wall_ns;
+    uint64_t batches;
+    int n;
+    int i;
+
+    memset(&path, 0, sizeof(path));
+    memset(&sink, 0, sizeof(sink));
+    path.batch = batch;
+    path.paced = paced;
+
+    if (ring)
+    {
+        if (event_ring.init())
+        {
+            return -1;
+        }
+        path.p_ring = &event_ring;
+    }
+    else
+    {
+        if (pipe(path.pipe_fd))
+        {
+            return -1;
+        }
+        /*same as the HAL pipe: blocking writer, nonblocking reader*/
+        fcntl(path.pipe_fd[0], F_SETFL, O_NONBLOCK);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    reader_ns = ut_event_thread_ns();
+    pthread_create(&writer, NULL, ut_event_writer, &path);
+
+    while (sink.next_seq < UT_EVENT_TOTAL)
+    {
+        n = ut_event_poll(&path, &sink, data, UT_EVENT_POLL_BUF);
+        for (i = 0; i < n; ++i)
+        {
+            if ((uint64_t)data[i].timestamp != sink.next_seq)
+            {
+                sink.bad = 1;
+            }
+            sink.next_seq = data[i].timestamp + 1;
+        }
+        __atomic_store_n(&path.consumed, sink.next_seq, __ATOMIC_RELEASE);
+    }
+
+    reader_ns = ut_event_thread_ns() - reader_ns;
+    pthread_join(writer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    wall_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    if (!ring)
+    {
+        close(path.pipe_fd[0]);
+        close(path.pipe_fd[1]);
+    }
+
+    batches = UT_EVENT_TOTAL / batch;
+    printf("event: %-4s %-9s batch %4u: hal_deliver_events %6.1f ns/event, pollEvents %6.1f ns/event,"
+            " %5.2f polls/batch, wall %6.1f ns/event%s\n",
+            ring ? "ring" : "pipe", paced ? "paced" : "saturated", batch,
+            path.cpu_ns / UT_EVENT_TOTAL, reader_ns / UT_EVENT_TOTAL,
+            (double)sink.polls / batches, wall_ns / UT_EVENT_TOTAL, sink.bad ? ", OUT OF ORDER" : "");
+    if (!ring)
+    {
+        printf("event:                      %.2f pipe writes/batch\n", (double)path.writes / batches);
+    }
+
+    return sink.bad ? -1 : 0;
+}
+
+int unit_test_event(int argc, char *argv[])
+{
+    static const uint32_t batch[] = { 10, 100, 2000 };
+    uint32_t i;
+    int paced;
+    int ring;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    for (paced = 1; paced >= 0; --paced)
+    {
+        for (i = 0; i < sizeof(batch) / sizeof(batch[0]); ++i)
+        {
+            for (ring = 1; ring >= 0; --ring)
+            {
+                ret |= ut_event_run(ring, batch[i], paced);
+            }
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,343 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "sensord_fusion.h"
+#include "sensord_resample.h"
+#include "unit_test.h"
+
+/*one minute of motion, two streams like the FIFOs deliver them*/
+#define UT_FUSION_S 60
+#define UT_FUSION_ACC_HZ 1600
+#define UT_FUSION_GYR_HZ 2000
+#define UT_FUSION_BURST_MS 20
+#define UT_FUSION_SUBSTEPS 20
+/*outputs of the first seconds are the filter settling from the first acc sample,
+ the max is reached while linear acceleration leaks into the gravity estimate*/
+#define UT_FUSION_SETTLE_S 2
+#define UT_FUSION_TILT_MEAN_MAX_DEG 2.0
+#define UT_FUSION_TILT_MAX_DEG 15.0
+#define UT_FUSION_BENCH_ROUNDS 20
+/*acc goes through the resampler as raw counts of this many m/s^2*/
+#define UT_FUSION_ACC_LSB 0.001f
+#define UT_FUSION_BURST_MAX (UT_FUSION_GYR_HZ * UT_FUSION_BURST_MS / 1000 + 8)
+
+typedef struct
+{
+    float *acc;
+    int64_t *acc_tm;
+    uint32_t acc_len;
+    float *gyr;
+    int64_t *gyr_tm;
+    double *gyr_q;          /// true orientation at each gyro sample, w x y z
+    uint32_t gyr_len;
+} UT_FUSION_REPLAY;
+
+static double ut_noise(void)
+{
+    return (rand() / (double)RAND_MAX - 0.5) * 2;
+}
+
+static void ut_angular_rate(double t, double w[3])
+{
+    w[0] = 1.5 * sin(0.7 * t);
+    w[1] = 1.2 * cos(0.45 * t);
+    w[2] = 0.8 * sin(0.3 * t + 1);
+}
+
+/// gravity direction in device frame for orientation @param q
+static void ut_up(const double q[4], double up[3])
+{
+    up[0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+    up[1] = 2 * (q[0] * q[1] + q[2] * q[3]);
+    up[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+}
+
+static void ut_integrate(double q[4], const double w[3], double dt)
+{
+    double h = 0.5 * dt;
+    double o[4];
+    double n;
+    int k;
+
+    o[0] = q[0] - h * (q[1] * w[0] + q[2] * w[1] + q[3] * w[2]);
+    o[1] = q[1] + h * (q[0] * w[0] + q[2] * w[2] - q[3] * w[1]);
+    o[2] = q[2] + h * (q[0] * w[1] - q[1] * w[2] + q[3] * w[0]);
+    o[3] = q[3] + h * (q[0] * w[2] + q[1] * w[1] - q[2] * w[0]);
+    n = sqrt(o[0] * o[0] + o[1] * o[1] + o[2] * o[2] + o[3] * o[3]);
+    for (k = 0; k < 4; ++k)
+    {
+        q[k] = o[k] / n;
+    }
+}
+
+/**
+ * record acc and gyro as a tilted device turning on all axes would give them,
+ * with sensor noise, gyro bias and one second of linear acceleration every ten
+ */
+static int ut_fusion_record(UT_FUSION_REPLAY *p_rec)
+{
+    const double bias[3] = { 0.01, -0.008, 0.005 };
+    double q[4] = { cos(0.3), sin(0.3), 0, 0 };
+    double up[3];
+    double w[3];
+    double t = 0;
+    double t_end = UT_FUSION_S;
+    double dt;
+    double t_acc = 0;
+    double t_gyr = 0;
+    uint32_t k;
+
+    p_rec->acc_len = 0;
+    p_rec->gyr_len = 0;
+    p_rec->acc = (float *)malloc(3 * sizeof(float) * UT_FUSION_S * UT_FUSION_ACC_HZ);
+    p_rec->acc_tm = (int64_t *)malloc(sizeof(int64_t) * UT_FUSION_S * UT_FUSION_ACC_HZ);
+    p_rec->gyr = (float *)malloc(3 * sizeof(float) * UT_FUSION_S * UT_FUSION_GYR_HZ);
+    p_rec->gyr_tm = (int64_t *)malloc(sizeof(int64_t) * UT_FUSION_S * UT_FUSION_GYR_HZ);
+    p_rec->gyr_q = (double *)malloc(4 * sizeof(double) * UT_FUSION_S * UT_FUSION_GYR_HZ);
+    if (NULL == p_rec->acc || NULL == p_rec->acc_tm || NULL == p_rec->gyr ||
+            NULL == p_rec->gyr_tm || NULL == p_rec->gyr_q)
+    {
+        return -1;
+    }
+
+    srand(1);
+    dt = 1.0 / (UT_FUSION_GYR_HZ * UT_FUSION_SUBSTEPS);
+    while (t < t_end)
+    {
+        ut_angular_rate(t, w);
+
+        if (t >= t_acc && p_rec->acc_len < UT_FUSION_S * UT_FUSION_ACC_HZ)
+        {
+            ut_up(q, up);
+            for (k = 0; k < 3; ++k)
+            {
+                p_rec->acc[3 * p_rec->acc_len + k] = (float)(SENSORD_FUSION_G * up[k] + 0.05 * ut_noise());
+            }
+            if (fmod(t, 10) < 1)
+            {
+                p_rec->acc[3 * p_rec->acc_len] += 3.0f;
+            }
+            p_rec->acc_tm[p_rec->acc_len++] = (int64_t)(t * 1e9);
+            t_acc += 1.0 / UT_FUSION_ACC_HZ;
+        }
+
+        if (t >= t_gyr && p_rec->gyr_len < UT_FUSION_S * UT_FUSION_GYR_HZ)
+        {
+            for (k = 0; k < 3; ++k)
+            {
+                p_rec->gyr[3 * p_rec->gyr_len + k] = (float)(w[k] + bias[k] + 0.005 * ut_noise());
+            }
+            for (k = 0; k < 4; ++k)
+            {
+                p_rec->gyr_q[4 * p_rec->gyr_len + k] = q[k];
+            }
+            p_rec->gyr_tm[p_rec->gyr_len++] = (int64_t)(t * 1e9);
+            t_gyr += 1.0 / UT_FUSION_GYR_HZ;
+        }
+
+        ut_integrate(q, w, dt);
+        t += dt;
+    }
+
+    return 0;
+}
+
+static SENSORD_RESAMPLER ut_fusion_rs;
+static int32_t ut_fusion_raw[3 * UT_FUSION_BURST_MAX];
+static int32_t ut_fusion_rs_raw[3 * UT_FUSION_BURST_MAX];
+static float ut_fusion_rs_si[3 * UT_FUSION_BURST_MAX];
+static int64_t ut_fusion_rs_tm[UT_FUSION_BURST_MAX];
+
+/**
+ * acc burst onto the gyro rate the way the algo path feeds the filter
+ * @return acc samples at ut_fusion_rs_si / ut_fusion_rs_tm
+ */
+static uint32_t ut_fusion_resample(const float *p_acc, const int64_t *p_tm, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < 3 * len; ++i)
+    {
+        ut_fusion_raw[i] = (int32_t)lrintf(p_acc[i] / UT_FUSION_ACC_LSB);
+    }
+
+    len = sensord_resample_xyz(&ut_fusion_rs, ut_fusion_raw, p_tm, len,
+            ut_fusion_rs_raw, ut_fusion_rs_tm, UT_FUSION_BURST_MAX);
+
+    for (i = 0; i < 3 * len; ++i)
+    {
+        ut_fusion_rs_si[i] = ut_fusion_rs_raw[i] * UT_FUSION_ACC_LSB;
+    }
+
+    return len;
+}
+
+/**
+ * feed the recording in bursts the way the FIFO watermark drains it
+ * @param resample 1 to put acc on the gyro rate first
+ * @return outputs written to p_out
+ */
+static uint32_t ut_fusion_replay(SENSORD_FUSION *p_fusion, const UT_FUSION_REPLAY *p_rec, SENSORD_FUSION_OUT *p_out,
+        int resample)
+{
+    uint32_t acc_i = 0;
+    uint32_t gyr_i = 0;
+    uint32_t acc_n;
+    uint32_t gyr_n;
+    uint32_t rs_n;
+    uint32_t out_len = 0;
+    int64_t burst_end = 0;
+
+    sensord_fusion_reset(p_fusion);
+    (void) sensord_resample_init(&ut_fusion_rs, UT_FUSION_ACC_HZ, UT_FUSION_GYR_HZ);
+
+    while (gyr_i < p_rec->gyr_len)
+    {
+        burst_end += UT_FUSION_BURST_MS * 1000000LL;
+        for (acc_n = 0; acc_i + acc_n < p_rec->acc_len && p_rec->acc_tm[acc_i + acc_n] < burst_end; ++acc_n)
+        {
+        }
+        for (gyr_n = 0; gyr_i + gyr_n < p_rec->gyr_len && p_rec->gyr_tm[gyr_i + gyr_n] < burst_end; ++gyr_n)
+        {
+        }
+
+        if (resample)
+        {
+            rs_n = ut_fusion_resample(&p_rec->acc[3 * acc_i], &p_rec->acc_tm[acc_i], acc_n);
+            out_len += sensord_fusion_run(p_fusion, ut_fusion_rs_si, ut_fusion_rs_tm, rs_n,
+                    &p_rec->gyr[3 * gyr_i], &p_rec->gyr_tm[gyr_i], gyr_n, &p_out[out_len]);
+        }
+        else
+        {
+            out_len += sensord_fusion_run(p_fusion, &p_rec->acc[3 * acc_i], &p_rec->acc_tm[acc_i], acc_n,
+                    &p_rec->gyr[3 * gyr_i], &p_rec->gyr_tm[gyr_i], gyr_n, &p_out[out_len]);
+        }
+        acc_i += acc_n;
+        gyr_i += gyr_n;
+    }
+
+    return out_len;
+}
+
+/**
+ * tilt error of the replay against the recorded orientation, and its speed
+ * @return 0 when the error is within bounds
+ */
+static int ut_fusion_check(const UT_FUSION_REPLAY *p_rec, SENSORD_FUSION_OUT *p_out, int resample)
+{
+    static const char *const name[2] = { "acc as is", "acc on gyro rate" };
+    SENSORD_FUSION fusion;
+    struct timespec start;
+    struct timespec end;
+    uint32_t out_len;
+    uint32_t i;
+    uint32_t j;
+    uint32_t cnt = 0;
+    double up[3];
+    double d;
+    double err;
+    double err_sum = 0;
+    double err_max = 0;
+    double ns;
+    int ret = 0;
+
+    out_len = ut_fusion_replay(&fusion, p_rec, p_out, resample);
+
+    /*outputs are 1:1 with gyro samples once acc was seen, match them by timestamp*/
+    for (i = 0, j = 0; i < out_len; ++i)
+    {
+        while (j < p_rec->gyr_len && p_rec->gyr_tm[j] < p_out[i].timestamp)
+        {
+            ++j;
+        }
+        if (j == p_rec->gyr_len || p_out[i].timestamp < UT_FUSION_SETTLE_S * 1000000000LL)
+        {
+            continue;
+        }
+
+        ut_up(&p_rec->gyr_q[4 * j], up);
+        d = (up[0] * p_out[i].gravity[0] + up[1] * p_out[i].gravity[1] + up[2] * p_out[i].gravity[2]) / SENSORD_FUSION_G;
+        d = (d > 1) ? 1 : d;
+        err = acos(d) * 180.0 / M_PI;
+        err_sum += err;
+        err_max = (err > err_max) ? err : err_max;
+        cnt++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < UT_FUSION_BENCH_ROUNDS; ++i)
+    {
+        (void)ut_fusion_replay(&fusion, p_rec, p_out, resample);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("fusion: %s, %u outputs for %u gyro samples, tilt error mean %.3f deg, max %.3f deg, %.1f ns per gyro sample\n",
+            name[resample], out_len, p_rec->gyr_len, cnt ? err_sum / cnt : 0, err_max,
+            ns / ((double)UT_FUSION_BENCH_ROUNDS * p_rec->gyr_len));
+    if (0 == cnt || err_sum / cnt > UT_FUSION_TILT_MEAN_MAX_DEG || err_max > UT_FUSION_TILT_MAX_DEG)
+    {
+        printf("fusion: FAIL tilt error over %.1f deg mean / %.1f deg max\n",
+                UT_FUSION_TILT_MEAN_MAX_DEG, UT_FUSION_TILT_MAX_DEG);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int unit_test_fusion(int argc, char *argv[])
+{
+    UT_FUSION_REPLAY rec;
+    SENSORD_FUSION_OUT *p_out;
+    int ret;
+
+    (void)argc;
+    (void)argv;
+
+    if (ut_fusion_record(&rec))
+    {
+        printf("fusion: out of memory\n");
+        return -1;
+    }
+
+    p_out = (SENSORD_FUSION_OUT *)malloc(sizeof(SENSORD_FUSION_OUT) * rec.gyr_len);
+    if (NULL == p_out)
+    {
+        printf("fusion: out of memory\n");
+        return -1;
+    }
+
+    ret = ut_fusion_check(&rec, p_out, 0);
+    ret |= ut_fusion_check(&rec, p_out, 1);
+
+    free(p_out);
+    free(rec.acc);
+    free(rec.acc_tm);
+    free(rec.gyr);
+    free(rec.gyr_tm);
+    free(rec.gyr_q);
+
+    return ret;
+}
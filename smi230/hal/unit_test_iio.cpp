@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sensord_iio_buffer.h"
+#include "unit_test.h"
+
+/**
+ * IIO scan handling without a device. Scan types as drivers write them are
+ * parsed, bad ones refused. An acc scan of x, y, z and timestamp listed out
+ * of index order is laid out as the IIO core lays it out. Then values of
+ * every width, endianness, shift and sign are written into a scan by a plain
+ * reference packer and must decode back unchanged.
+ */
+#define UT_IIO_VALUES 100000
+
+typedef struct
+{
+    const char *type;
+    int ret;
+    uint32_t real_bits;
+    uint32_t storage_bytes;
+    uint32_t shift;
+    int is_signed;
+    int is_be;
+} UT_IIO_TYPE;
+
+static const UT_IIO_TYPE ut_iio_types[] = {
+    { "le:s16/16>>0", 0, 16, 2, 0, 1, 0 },
+    { "be:s12/16>>4", 0, 12, 2, 4, 1, 1 },
+    { "le:u24/32>>8", 0, 24, 4, 8, 0, 0 },
+    { "le:s64/64>>0", 0, 64, 8, 0, 1, 0 },
+    { "be:u8/8X3>>0", 0, 8, 1, 0, 0, 1 },
+    { "le:s16/12>>0", -EINVAL, 0, 0, 0, 0, 0 },
+    { "le:s0/16>>0", -EINVAL, 0, 0, 0, 0, 0 },
+    { "le:s16/128>>0", -EINVAL, 0, 0, 0, 0, 0 },
+    { "le:s16/15>>0", -EINVAL, 0, 0, 0, 0, 0 },
+    { "garbage", -EINVAL, 0, 0, 0, 0, 0 },
+};
+
+static int ut_iio_parse(void)
+{
+    IIO_CHANNEL ch;
+    const UT_IIO_TYPE *p_t;
+    uint32_t i;
+    int ret = 0;
+
+    for (i = 0; i < sizeof(ut_iio_types) / sizeof(ut_iio_types[0]); ++i)
+    {
+        p_t = &ut_iio_types[i];
+        memset(&ch, 0, sizeof(ch));
+        if (iio_channel_parse_type(&ch, p_t->type) != p_t->ret)
+        {
+            printf("iio: type \"%s\" not %s\n", p_t->type, p_t->ret ? "refused" : "parsed");
+            ret = -1;
+            continue;
+        }
+        if (0 == p_t->ret && (ch.real_bits != p_t->real_bits || ch.storage_bytes != p_t->storage_bytes ||
+                ch.shift != p_t->shift || ch.is_signed != p_t->is_signed || ch.is_be != p_t->is_be))
+        {
+            printf("iio: type \"%s\" parsed wrong\n", p_t->type);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+static int ut_iio_layout(void)
+{
+    static const char *const names[] = { "timestamp", "accel_z", "accel_x", "accel_y" };
+    static const uint32_t index[] = { 3, 2, 0, 1 };
+    static const uint32_t offset[] = { 0, 2, 4, 8 };
+    IIO_BUFFER buf;
+    uint32_t i;
+
+    memset(&buf, 0, sizeof(buf));
+    for (i = 0; i < 4; ++i)
+    {
+        snprintf(buf.channel[i].name, sizeof(buf.channel[i].name), "%s", names[i]);
+        buf.channel[i].index = index[i];
+        (void) iio_channel_parse_type(&buf.channel[i], 0 == i ? "le:s64/64>>0" : "le:s16/16>>0");
+    }
+    buf.channel_num = 4;
+
+    iio_buffer_layout(&buf);
+
+    for (i = 0; i < 4; ++i)
+    {
+        if (buf.channel[i].index != i || buf.channel[i].offset != offset[i])
+        {
+            printf("iio: channel %u of the scan is %s at %u\n", i, buf.channel[i].name, buf.channel[i].offset);
+            return -1;
+        }
+    }
+
+    printf("iio: x, y, z and timestamp in a %u byte scan\n", buf.scan_size);
+
+    return 16 == buf.scan_size ? 0 : -1;
+}
+
+/**
+ * the way a driver puts @param value into the scan
+ */
+static void ut_iio_pack(const IIO_CHANNEL *p_ch, uint8_t *p_scan, int64_t value)
+{
+    uint64_t raw = (uint64_t)value;
+    uint32_t i;
+
+    if (p_ch->real_bits < 64)
+    {
+        raw &= (1ULL << p_ch->real_bits) - 1;
+    }
+    raw <<= p_ch->shift;
+
+    for (i = 0; i < p_ch->storage_bytes; ++i)
+    {
+        if (p_ch->is_be)
+        {
+            p_scan[p_ch->offset + p_ch->storage_bytes - 1 - i] = (uint8_t)(raw >> (8 * i));
+        }
+        else
+        {
+            p_scan[p_ch->offset + i] = (uint8_t)(raw >> (8 * i));
+        }
+    }
+}
+
+static int ut_iio_values(void)
+{
+    IIO_CHANNEL ch;
+    uint8_t scan[16];
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    int64_t value;
+    int64_t lo;
+    int64_t hi;
+    uint32_t t;
+    uint32_t i;
+    uint32_t bad = 0;
+
+    for (t = 0; t < sizeof(ut_iio_types) / sizeof(ut_iio_types[0]); ++t)
+    {
+        memset(&ch, 0, sizeof(ch));
+        if (iio_channel_parse_type(&ch, ut_iio_types[t].type))
+        {
+            continue;
+        }
+        ch.offset = 3;
+
+        if (ch.real_bits == 64)
+        {
+            lo = INT64_MIN;
+            hi = INT64_MAX;
+        }
+        else if (ch.is_signed)
+        {
+            lo = -(1LL << (ch.real_bits - 1));
+            hi = (1LL << (ch.real_bits - 1)) - 1;
+        }
+        else
+        {
+            lo = 0;
+            hi = (1LL << ch.real_bits) - 1;
+        }
+
+        for (i = 0; i < UT_IIO_VALUES; ++i)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            if (i < 2)
+            {
+                value = i ? hi : lo;
+            }
+            else if (ch.real_bits == 64)
+            {
+                value = (int64_t)seed;
+            }
+            else
+            {
+                value = lo + (int64_t)(seed % (uint64_t)(hi - lo + 1));
+            }
+
+            memset(scan, 0xa5, sizeof(scan));
+            ut_iio_pack(&ch, scan, value);
+            if (iio_channel_value(&ch, scan) != value)
+            {
+                bad++;
+            }
+        }
+    }
+
+    printf("iio: %u values decoded wrong\n", bad);
+
+    return bad ? -1 : 0;
+}
+
+int unit_test_iio(int argc, char *argv[])
+{
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    ret |= ut_iio_parse();
+    ret |= ut_iio_layout();
+    ret |= ut_iio_values();
+
+    return ret ? -1 : 0;
+}
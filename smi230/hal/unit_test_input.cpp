@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sensord_input_frame.h"
+#include "unit_test.h"
+
+/**
+ * Input frame parser fed the event stream of the acc device, split into reads
+ * of random length so frames straddle reads. Between good frames the stream
+ * carries a frame missing a value, a frame with one value too many, and a
+ * frame evdev flagged with SYN_DROPPED. Only the good frames may come out,
+ * each with its own values, and every bad one must be counted as dropped.
+ */
+#define UT_INPUT_FRAME_VALUES 5
+#define UT_INPUT_FRAMES 4096
+#define UT_INPUT_EVENTS_MAX (UT_INPUT_FRAMES * (UT_INPUT_FRAME_VALUES + 3))
+#define UT_INPUT_BENCH_ROUNDS 200
+
+static struct input_event ut_input_ev[UT_INPUT_EVENTS_MAX];
+static uint32_t ut_input_len;
+
+static void ut_input_put(uint16_t type, uint16_t code, int32_t value)
+{
+    ut_input_ev[ut_input_len].type = type;
+    ut_input_ev[ut_input_len].code = code;
+    ut_input_ev[ut_input_len].value = value;
+    ut_input_len++;
+}
+
+/**
+ * @param kind 0 good, 1 a value short, 2 a value too many, 3 SYN_DROPPED inside
+ */
+static void ut_input_frame(uint32_t seq, int kind)
+{
+    uint32_t len = UT_INPUT_FRAME_VALUES;
+    uint32_t i;
+
+    if (1 == kind)
+    {
+        len--;
+    }
+    else if (2 == kind)
+    {
+        len++;
+    }
+
+    for (i = 0; i < len; ++i)
+    {
+        /*seconds, nanoseconds, x, y, z all carry the frame number*/
+        ut_input_put(EV_MSC, (uint16_t)i, (int32_t)(seq * 8 + i));
+        if (3 == kind && 1 == i)
+        {
+            ut_input_put(EV_SYN, SYN_DROPPED, 0);
+        }
+    }
+    ut_input_put(EV_SYN, SYN_REPORT, 0);
+}
+
+static double ut_input_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int unit_test_input(int argc, char *argv[])
+{
+    INPUT_FRAME_PARSER parser;
+    uint32_t seed = 0x2545f491;
+    uint32_t good = 0;
+    uint32_t bad = 0;
+    uint32_t out = 0;
+    uint32_t wrong = 0;
+    uint32_t expect_seq = 0;
+    uint32_t pos;
+    uint32_t chunk;
+    uint32_t seq;
+    uint32_t i;
+    uint32_t k;
+    int kind;
+    double t0;
+    double t1;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    ut_input_len = 0;
+    for (seq = 0; seq < UT_INPUT_FRAMES; ++seq)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        kind = (seed % 16 < 13) ? 0 : (int)(seed % 16) - 12;
+        ut_input_frame(seq, kind);
+        if (kind)
+        {
+            bad++;
+        }
+        else
+        {
+            good++;
+        }
+    }
+
+    memset(&parser, 0, sizeof(parser));
+    pos = 0;
+    while (pos < ut_input_len)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        chunk = 1 + seed % 37;
+        if (chunk > ut_input_len - pos)
+        {
+            chunk = ut_input_len - pos;
+        }
+
+        for (i = pos; i < pos + chunk; ++i)
+        {
+            if (0 == input_frame_feed(&parser, &ut_input_ev[i], UT_INPUT_FRAME_VALUES, "ut"))
+            {
+                continue;
+            }
+
+            out++;
+            seq = (uint32_t)parser.value[0] / 8;
+            if (seq < expect_seq)
+            {
+                wrong++;
+            }
+            expect_seq = seq + 1;
+            for (k = 0; k < UT_INPUT_FRAME_VALUES; ++k)
+            {
+                if (parser.value[k] != (int32_t)(seq * 8 + k))
+                {
+                    wrong++;
+                }
+            }
+        }
+        pos += chunk;
+    }
+
+    printf("input: %u events, %u good and %u bad frames in, %u out, %llu dropped, %u wrong\n",
+            ut_input_len, good, bad, out, (unsigned long long)parser.drop_count, wrong);
+    if (out != good || parser.drop_count != bad || wrong)
+    {
+        ret = -1;
+    }
+
+    /*good frames only, as a healthy driver sends them*/
+    ut_input_len = 0;
+    for (seq = 0; seq < UT_INPUT_FRAMES; ++seq)
+    {
+        ut_input_frame(seq, 0);
+    }
+
+    out = 0;
+    t0 = ut_input_now_ns();
+    for (k = 0; k < UT_INPUT_BENCH_ROUNDS; ++k)
+    {
+        for (i = 0; i < ut_input_len; ++i)
+        {
+            out += input_frame_feed(&parser, &ut_input_ev[i], UT_INPUT_FRAME_VALUES, "ut");
+        }
+    }
+    t1 = ut_input_now_ns();
+
+    printf("input: %.1f ns per frame\n", (t1 - t0) / (double)out);
+    if (out != UT_INPUT_FRAMES * UT_INPUT_BENCH_ROUNDS)
+    {
+        ret = -1;
+    }
+
+    return ret;
+}
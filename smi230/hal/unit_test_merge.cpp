@@ -0,0 +1,412 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sensord_merge.h"
+#include "unit_test.h"
+
+/**
+ * Raw sample merge in sensord_algo_process(), the old way against the merge iterator.
+ * old: acc/mag/gyro pointer arrays malloc'ed per pass, then sort_input_samples()
+ * callocs an align indication array and the library feed walks it with one index
+ * per stream. new: merge_iter_init()/merge_iter_next() over the drained arrays.
+ *
+ * Streams are acc at 1600 Hz and gyro at 2000 Hz, batches of 10/100/2000 gyro
+ * samples with acc of the same time span. "grid" has exact ODR timestamps, so
+ * acc and gyro meet every 2.5 ms, "jitter" adds up to 2% of a period to each.
+ * Both paths must give every sample once, in stream order, tuples in time order.
+ * At zero tolerance the iterator must give the same tuples as the old path.
+ */
+#define UT_MERGE_BATCH_MAX 2000
+#define UT_MERGE_SAMPLES (4 * 1024 * 1024)
+#define UT_MERGE_ACC_PERIOD_NS 625000LL
+#define UT_MERGE_GYR_PERIOD_NS 500000LL
+#define UT_MERGE_JITTER_PCT 2
+/*align_tolerance_us default*/
+#define UT_MERGE_TOLERANCE_NS 250000LL
+
+typedef struct
+{
+    HW_DATA_UNION **pp_data[MERGE_STREAM_NUM];
+    uint32_t seen[MERGE_STREAM_NUM];
+    int64_t last_tm;
+    int64_t tolerance_ns;
+    int8_t *p_masks;            /// tuple masks in order, NULL to skip
+    uint32_t tuples;
+    uint32_t paired;
+    int bad;
+} UT_MERGE_SINK;
+
+static HW_DATA_UNION ut_acc[UT_MERGE_BATCH_MAX];
+static HW_DATA_UNION ut_gyr[UT_MERGE_BATCH_MAX];
+static HW_DATA_UNION *ut_acc_p[UT_MERGE_BATCH_MAX];
+static HW_DATA_UNION *ut_gyr_p[UT_MERGE_BATCH_MAX];
+static int8_t ut_masks_old[2 * UT_MERGE_BATCH_MAX];
+static int8_t ut_masks_new[2 * UT_MERGE_BATCH_MAX];
+
+static double ut_merge_thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t ut_merge_rand(uint32_t *p_seed)
+{
+    *p_seed ^= *p_seed << 13;
+    *p_seed ^= *p_seed >> 17;
+    *p_seed ^= *p_seed << 5;
+
+    return *p_seed;
+}
+
+static void ut_merge_fill(HW_DATA_UNION *p_data, HW_DATA_UNION **pp_data, uint32_t len,
+        int64_t period_ns, int jitter, uint32_t *p_seed)
+{
+    int64_t max_ns = period_ns * UT_MERGE_JITTER_PCT / 100;
+    uint32_t i;
+
+    for (i = 0; i < len; ++i)
+    {
+        p_data[i].timestamp = 1000000000LL + i * period_ns;
+        if (jitter)
+        {
+            p_data[i].timestamp += (int64_t)(ut_merge_rand(p_seed) % (2 * max_ns + 1)) - max_ns;
+        }
+        p_data[i].x = (int32_t)i;
+        pp_data[i] = &p_data[i];
+    }
+}
+
+/**
+ * check one tuple: each sample is the next of its stream, joined samples are
+ * within tolerance of the earliest, and tuples come in time order
+ */
+static void ut_merge_sink(UT_MERGE_SINK *p_sink, int8_t mask, HW_DATA_UNION *pp_in[MERGE_STREAM_NUM])
+{
+    static const int8_t flag[MERGE_STREAM_NUM] = { HAS_ACC, HAS_MAG, HAS_GYR };
+    int64_t first_tm = INT64_MAX;
+    int64_t last_tm = INT64_MIN;
+    int members = 0;
+    int i;
+
+    for (i = 0; i < MERGE_STREAM_NUM; ++i)
+    {
+        if (0 == (mask & flag[i]))
+        {
+            continue;
+        }
+        if (NULL == pp_in[i] || pp_in[i] != p_sink->pp_data[i][p_sink->seen[i]])
+        {
+            p_sink->bad = 1;
+            return;
+        }
+        p_sink->seen[i]++;
+        first_tm = (pp_in[i]->timestamp < first_tm) ? pp_in[i]->timestamp : first_tm;
+        last_tm = (pp_in[i]->timestamp > last_tm) ? pp_in[i]->timestamp : last_tm;
+        members++;
+    }
+
+    if (0 == members || first_tm < p_sink->last_tm || last_tm - first_tm > p_sink->tolerance_ns)
+    {
+        p_sink->bad = 1;
+    }
+    p_sink->last_tm = first_tm;
+
+    if (p_sink->p_masks)
+    {
+        p_sink->p_masks[p_sink->tuples] = mask;
+    }
+    p_sink->tuples++;
+    p_sink->paired += (members > 1);
+}
+
+/**
+ * sort_input_samples() as it was before the merge iterator, exact timestamp match only
+ */
+static void ut_merge_sort_old(int8_t **pp_align_ind, uint32_t *p_len,
+        HW_DATA_UNION **pp_ACC_hwdata, uint32_t ACC_hwdata_len,
+        HW_DATA_UNION **pp_MAG_hwdata, uint32_t MAG_hwdata_len,
+        HW_DATA_UNION **pp_GYRO_hwdata, uint32_t GYRO_hwdata_len)
+{
+    int64_t cur_base_tm = 0;
+    int acc_cur_index = 0;
+    int mag_cur_index = 0;
+    int gyr_cur_index = 0;
+    int pos = 0;
+
+    if(0 == ACC_hwdata_len + MAG_hwdata_len + GYRO_hwdata_len)
+    {
+        *p_len = 0;
+        return;
+    }
+
+    (*pp_align_ind) = (int8_t *)calloc(ACC_hwdata_len + MAG_hwdata_len + GYRO_hwdata_len, 1);
+    if(NULL == (*pp_align_ind))
+    {
+        *p_len = 0;
+        return;
+    }
+
+    while(ACC_hwdata_len + MAG_hwdata_len + GYRO_hwdata_len)
+    {
+        cur_base_tm = 0;
+
+        if(GYRO_hwdata_len){
+            cur_base_tm = pp_GYRO_hwdata[gyr_cur_index]->timestamp;
+        }
+
+        if(ACC_hwdata_len)
+        {
+            if(cur_base_tm)
+            {
+                if(pp_ACC_hwdata[acc_cur_index]->timestamp < cur_base_tm){
+                    cur_base_tm = pp_ACC_hwdata[acc_cur_index]->timestamp;
+                }
+            }else{
+                cur_base_tm = pp_ACC_hwdata[acc_cur_index]->timestamp;
+            }
+        }
+
+        if(MAG_hwdata_len)
+        {
+            if(cur_base_tm)
+            {
+                if(pp_MAG_hwdata[mag_cur_index]->timestamp < cur_base_tm){
+                    cur_base_tm = pp_MAG_hwdata[mag_cur_index]->timestamp;
+                }
+            }else{
+                cur_base_tm = pp_MAG_hwdata[mag_cur_index]->timestamp;
+            }
+        }
+
+        if(ACC_hwdata_len)
+        {
+            if(pp_ACC_hwdata[acc_cur_index]->timestamp == cur_base_tm)
+            {
+                (*pp_align_ind)[pos] |= HAS_ACC;
+                acc_cur_index++;
+                ACC_hwdata_len--;
+            }
+        }
+
+        if(MAG_hwdata_len)
+        {
+            if(pp_MAG_hwdata[mag_cur_index]->timestamp == cur_base_tm)
+            {
+                (*pp_align_ind)[pos] |= HAS_MAG;
+                mag_cur_index++;
+                MAG_hwdata_len--;
+            }
+        }
+
+        if(GYRO_hwdata_len)
+        {
+            if(pp_GYRO_hwdata[gyr_cur_index]->timestamp == cur_base_tm)
+            {
+                (*pp_align_ind)[pos] |= HAS_GYR;
+                gyr_cur_index++;
+                GYRO_hwdata_len--;
+            }
+        }
+
+        pos++;
+    }
+
+    *p_len = pos;
+}
+
+/**
+ * one sensord pass the old way: copy the drained samples into malloc'ed arrays,
+ * build the align indication array, walk it with an index per stream, free all
+ */
+static int ut_merge_old_pass(UT_MERGE_SINK *p_sink, uint32_t acc_len, uint32_t gyr_len)
+{
+    HW_DATA_UNION **pp_acc;
+    HW_DATA_UNION **pp_gyr;
+    HW_DATA_UNION *in[MERGE_STREAM_NUM] = { NULL, NULL, NULL };
+    int8_t *p_align_ind = NULL;
+    uint32_t align_ind_len;
+    uint32_t acc_index = 0;
+    uint32_t gyr_index = 0;
+    uint32_t i;
+
+    pp_acc = (HW_DATA_UNION **)malloc(acc_len * sizeof(HW_DATA_UNION *));
+    pp_gyr = (HW_DATA_UNION **)malloc(gyr_len * sizeof(HW_DATA_UNION *));
+    if (NULL == pp_acc || NULL == pp_gyr)
+    {
+        free(pp_acc);
+        free(pp_gyr);
+        return -1;
+    }
+    memcpy(pp_acc, ut_acc_p, acc_len * sizeof(HW_DATA_UNION *));
+    memcpy(pp_gyr, ut_gyr_p, gyr_len * sizeof(HW_DATA_UNION *));
+
+    ut_merge_sort_old(&p_align_ind, &align_ind_len, pp_acc, acc_len, NULL, 0, pp_gyr, gyr_len);
+    if (NULL == p_align_ind)
+    {
+        free(pp_acc);
+        free(pp_gyr);
+        return -1;
+    }
+
+    for (i = 0; i < align_ind_len; ++i)
+    {
+        in[MERGE_STREAM_ACC] = (p_align_ind[i] & HAS_ACC) ? pp_acc[acc_index++] : NULL;
+        in[MERGE_STREAM_GYR] = (p_align_ind[i] & HAS_GYR) ? pp_gyr[gyr_index++] : NULL;
+        ut_merge_sink(p_sink, p_align_ind[i], in);
+    }
+
+    free(p_align_ind);
+    free(pp_acc);
+    free(pp_gyr);
+
+    return 0;
+}
+
+static int ut_merge_new_pass(UT_MERGE_SINK *p_sink, uint32_t acc_len, uint32_t gyr_len)
+{
+    SAMPLE_MERGE_ITER merge_iter;
+    HW_DATA_UNION *out[MERGE_STREAM_NUM];
+    int8_t mask;
+
+    merge_iter_init(&merge_iter, ut_acc_p, acc_len, NULL, 0, ut_gyr_p, gyr_len, p_sink->tolerance_ns);
+    while (0 != (mask = merge_iter_next(&merge_iter, out)))
+    {
+        ut_merge_sink(p_sink, mask, out);
+    }
+
+    return 0;
+}
+
+static void ut_merge_sink_init(UT_MERGE_SINK *p_sink, int64_t tolerance_ns, int8_t *p_masks)
+{
+    memset(p_sink, 0, sizeof(*p_sink));
+    p_sink->pp_data[MERGE_STREAM_ACC] = ut_acc_p;
+    p_sink->pp_data[MERGE_STREAM_GYR] = ut_gyr_p;
+    p_sink->last_tm = INT64_MIN;
+    p_sink->tolerance_ns = tolerance_ns;
+    p_sink->p_masks = p_masks;
+}
+
+static int ut_merge_sink_done(const UT_MERGE_SINK *p_sink, uint32_t acc_len, uint32_t gyr_len)
+{
+    return (p_sink->bad || p_sink->seen[MERGE_STREAM_ACC] != acc_len ||
+            p_sink->seen[MERGE_STREAM_GYR] != gyr_len) ? -1 : 0;
+}
+
+/**
+ * time UT_MERGE_SAMPLES samples through one path, checking every pass
+ * @return ns per sample, negative on a failed check
+ */
+static double ut_merge_time(int old, uint32_t acc_len, uint32_t gyr_len, int64_t tolerance_ns,
+        UT_MERGE_SINK *p_sink)
+{
+    uint32_t passes = UT_MERGE_SAMPLES / (acc_len + gyr_len);
+    uint32_t i;
+    double ns;
+
+    ns = ut_merge_thread_ns();
+    for (i = 0; i < passes; ++i)
+    {
+        ut_merge_sink_init(p_sink, tolerance_ns, NULL);
+        if ((old ? ut_merge_old_pass(p_sink, acc_len, gyr_len) :
+                ut_merge_new_pass(p_sink, acc_len, gyr_len)) ||
+                ut_merge_sink_done(p_sink, acc_len, gyr_len))
+        {
+            return -1.0;
+        }
+    }
+    ns = ut_merge_thread_ns() - ns;
+
+    return ns / ((double)passes * (acc_len + gyr_len));
+}
+
+static int ut_merge_run(uint32_t batch, int jitter)
+{
+    UT_MERGE_SINK sink_old;
+    UT_MERGE_SINK sink_new;
+    uint32_t seed = 0x2545f491;
+    uint32_t acc_len;
+    uint32_t gyr_len = batch;
+    double old_ns;
+    double new_ns;
+    int ret = 0;
+
+    /*acc samples spanning the same time as the gyro ones*/
+    acc_len = (uint32_t)(gyr_len * UT_MERGE_GYR_PERIOD_NS / UT_MERGE_ACC_PERIOD_NS);
+    ut_merge_fill(ut_acc, ut_acc_p, acc_len, UT_MERGE_ACC_PERIOD_NS, jitter, &seed);
+    ut_merge_fill(ut_gyr, ut_gyr_p, gyr_len, UT_MERGE_GYR_PERIOD_NS, jitter, &seed);
+
+    /*zero tolerance, the iterator must pair exactly what the old path paired*/
+    ut_merge_sink_init(&sink_old, 0, ut_masks_old);
+    ut_merge_sink_init(&sink_new, 0, ut_masks_new);
+    if (ut_merge_old_pass(&sink_old, acc_len, gyr_len) || ut_merge_sink_done(&sink_old, acc_len, gyr_len) ||
+            ut_merge_new_pass(&sink_new, acc_len, gyr_len) || ut_merge_sink_done(&sink_new, acc_len, gyr_len) ||
+            sink_old.tuples != sink_new.tuples || memcmp(ut_masks_old, ut_masks_new, sink_old.tuples))
+    {
+        printf("merge: %-6s batch %4u: iterator at zero tolerance differs from the old path\n",
+                jitter ? "jitter" : "grid", batch);
+        ret = -1;
+    }
+
+    old_ns = ut_merge_time(1, acc_len, gyr_len, 0, &sink_old);
+    new_ns = ut_merge_time(0, acc_len, gyr_len, UT_MERGE_TOLERANCE_NS, &sink_new);
+    if (old_ns < 0 || new_ns < 0)
+    {
+        printf("merge: %-6s batch %4u: sample lost, repeated or out of order\n",
+                jitter ? "jitter" : "grid", batch);
+        return -1;
+    }
+
+    printf("merge: %-6s batch %4u: old %6.1f ns/sample, %4u of %4u tuples paired;"
+            " iterator %5.1f ns/sample, %4u of %4u tuples paired\n",
+            jitter ? "jitter" : "grid", batch,
+            old_ns, sink_old.paired, sink_old.tuples, new_ns, sink_new.paired, sink_new.tuples);
+
+    return ret;
+}
+
+int unit_test_merge(int argc, char *argv[])
+{
+    static const uint32_t batch[] = { 10, 100, 2000 };
+    uint32_t i;
+    int jitter;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    for (jitter = 0; jitter <= 1; ++jitter)
+    {
+        for (i = 0; i < sizeof(batch) / sizeof(batch[0]); ++i)
+        {
+            ret |= ut_merge_run(batch[i], jitter);
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "axis_remap.h"
+#include "unit_test.h"
+
+/**
+ * Mounting remap of drained batches, axis_remap_xyz() against the per sample
+ * hw_remap_sensor_data() it replaces. Every placement P0..P7 is checked given as
+ * placement and given as the same matrix, which must fold into the placement.
+ * A free matrix must stay a matrix and give the rounded product. A bad placement
+ * must be refused with -EINVAL and leave identity.
+ */
+#define UT_REMAP_FRAMES 2047
+#define UT_REMAP_BENCH_FRAMES (32 * 1024 * 1024)
+
+static int32_t ut_in[3 * UT_REMAP_FRAMES];
+static int32_t ut_out[3 * UT_REMAP_FRAMES];
+
+static double ut_remap_thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void ut_remap_fill(void)
+{
+    uint32_t seed = 0x3c6ef372;
+    uint32_t i;
+
+    for (i = 0; i < 3 * UT_REMAP_FRAMES; ++i)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        ut_in[i] = (int16_t)seed;
+    }
+    ut_in[0] = INT16_MIN;
+    ut_in[1] = INT16_MAX;
+}
+
+/**
+ * the legacy path: one float triple at a time through hw_remap_sensor_data
+ */
+static void ut_remap_legacy(int place, const int32_t *p_in, int32_t *p_out, uint32_t frames)
+{
+    float x;
+    float y;
+    float z;
+    uint32_t i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        x = (float)p_in[3 * i];
+        y = (float)p_in[3 * i + 1];
+        z = (float)p_in[3 * i + 2];
+        hw_remap_sensor_data(&x, &y, &z, place);
+        p_out[3 * i] = (int32_t)x;
+        p_out[3 * i + 1] = (int32_t)y;
+        p_out[3 * i + 2] = (int32_t)z;
+    }
+}
+
+/**
+ * @param p_matrix NULL to pass @param place itself, else the matrix of it
+ */
+static int ut_remap_place(int place, const float *p_matrix)
+{
+    static int32_t ref[3 * UT_REMAP_FRAMES];
+    AXIS_REMAP remap;
+
+    if (axis_remap_init(&remap, p_matrix ? AXIS_REMAP_PLACE_MATRIX : place, p_matrix) || remap.place != place)
+    {
+        return -1;
+    }
+
+    memcpy(ut_out, ut_in, sizeof(ut_out));
+    axis_remap_xyz(&remap, ut_out, UT_REMAP_FRAMES);
+    ut_remap_legacy(place, ut_in, ref, UT_REMAP_FRAMES);
+
+    return memcmp(ut_out, ref, sizeof(ref)) ? -1 : 0;
+}
+
+/**
+ * matrix of @param place, the image of each unit vector through hw_remap_sensor_data
+ */
+static void ut_remap_place_matrix(int place, float m[9])
+{
+    float v[3];
+    int col;
+
+    for (col = 0; col < 3; ++col)
+    {
+        v[0] = (0 == col);
+        v[1] = (1 == col);
+        v[2] = (2 == col);
+        hw_remap_sensor_data(&v[0], &v[1], &v[2], place);
+        m[col] = v[0];
+        m[3 + col] = v[1];
+        m[6 + col] = v[2];
+    }
+}
+
+static int ut_remap_free_matrix(void)
+{
+    /*30 degrees about z*/
+    const float m[9] = { 0.8660254f, -0.5f, 0, 0.5f, 0.8660254f, 0, 0, 0, 1 };
+    AXIS_REMAP remap;
+    uint32_t i;
+    int k;
+
+    if (axis_remap_init(&remap, AXIS_REMAP_PLACE_MATRIX, m) || AXIS_REMAP_PLACE_MATRIX != remap.place)
+    {
+        return -1;
+    }
+
+    memcpy(ut_out, ut_in, sizeof(ut_out));
+    axis_remap_xyz(&remap, ut_out, UT_REMAP_FRAMES);
+    for (i = 0; i < UT_REMAP_FRAMES; ++i)
+    {
+        for (k = 0; k < 3; ++k)
+        {
+            if (ut_out[3 * i + k] != (int32_t)lrintf(m[3 * k] * (float)ut_in[3 * i] +
+                    m[3 * k + 1] * (float)ut_in[3 * i + 1] + m[3 * k + 2] * (float)ut_in[3 * i + 2]))
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int ut_remap_bad_place(void)
+{
+    static const int bad_place[] = { -1, AXIS_REMAP_PLACE_MATRIX + 1 };
+    AXIS_REMAP remap;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(bad_place) / sizeof(bad_place[0]); ++i)
+    {
+        remap.place = 5;
+        if (-EINVAL != axis_remap_init(&remap, bad_place[i], NULL) || 0 != remap.place)
+        {
+            return -1;
+        }
+    }
+
+    /*a matrix placement without a matrix*/
+    remap.place = 5;
+    if (-EINVAL != axis_remap_init(&remap, AXIS_REMAP_PLACE_MATRIX, NULL) || 0 != remap.place)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @return ns per frame through axis_remap_xyz, or the legacy path when @param legacy
+ */
+static double ut_remap_bench(int place, int legacy)
+{
+    uint32_t blocks = UT_REMAP_BENCH_FRAMES / UT_REMAP_FRAMES;
+    AXIS_REMAP remap;
+    uint32_t i;
+    double ns;
+
+    axis_remap_init(&remap, place, NULL);
+    memcpy(ut_out, ut_in, sizeof(ut_out));
+
+    ns = ut_remap_thread_ns();
+    for (i = 0; i < blocks; ++i)
+    {
+        if (legacy)
+        {
+            ut_remap_legacy(place, ut_in, ut_out, UT_REMAP_FRAMES);
+        }
+        else
+        {
+            axis_remap_xyz(&remap, ut_out, UT_REMAP_FRAMES);
+        }
+        __asm__ __volatile__("" : : "r"(ut_out) : "memory");
+    }
+    ns = ut_remap_thread_ns() - ns;
+
+    return ns / ((double)blocks * UT_REMAP_FRAMES);
+}
+
+int unit_test_remap(int argc, char *argv[])
+{
+    float m[9];
+    int place;
+    int bad;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    ut_remap_fill();
+
+    for (place = 0; place < AXIS_REMAP_PLACE_NUM; ++place)
+    {
+        ut_remap_place_matrix(place, m);
+        bad = ut_remap_place(place, NULL) | ut_remap_place(place, m);
+        printf("remap: P%d %s\n", place, bad ? "FAIL" : "matches hw_remap_sensor_data, as placement and as matrix");
+        ret |= bad;
+    }
+
+    bad = ut_remap_free_matrix();
+    printf("remap: free matrix %s\n", bad ? "FAIL" : "applied and rounded");
+    ret |= bad;
+
+    bad = ut_remap_bad_place();
+    printf("remap: bad placement %s\n", bad ? "FAIL" : "refused, identity kept");
+    ret |= bad;
+
+    printf("remap: P7 batch %.2f ns/frame, per sample hw_remap_sensor_data %.2f ns/frame\n",
+            ut_remap_bench(7, 0), ut_remap_bench(7, 1));
+
+    return ret;
+}
@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "sensord_resample.h"
+#include "unit_test.h"
+
+#define UT_RS_SAMPLES 20000
+#define UT_RS_BATCH_MAX 300
+#define UT_RS_OUT_MAX (UT_RS_SAMPLES * 160 + 16)
+#define UT_RS_BENCH_ROUNDS 200
+
+typedef uint32_t (*UT_RS_FUNC)(SENSORD_RESAMPLER *p_rs,
+        const int32_t *p_in, const int64_t *p_in_tm, uint32_t in_count,
+        int32_t *p_out, int64_t *p_out_tm, uint32_t out_capacity);
+
+static int32_t ut_rs_in[3 * UT_RS_SAMPLES];
+static int64_t ut_rs_in_tm[UT_RS_SAMPLES];
+static int32_t ut_rs_out[3 * UT_RS_OUT_MAX];
+static int64_t ut_rs_out_tm[UT_RS_OUT_MAX];
+static SENSORD_RESAMPLER ut_rs;
+
+/**
+ * gyro like input: a few sines near full scale plus noise, timestamps with jitter
+ */
+static void ut_rs_input(uint32_t in_mHz)
+{
+    double period_ns = 1e12 / in_mHz;
+    double t;
+    uint32_t i;
+    uint32_t c;
+
+    srand(7);
+    for (i = 0; i < UT_RS_SAMPLES; ++i)
+    {
+        t = i * period_ns;
+        for (c = 0; c < 3; ++c)
+        {
+            ut_rs_in[3 * i + c] = (int32_t)(20000.0 * sin(t * 1e-9 * (3 + c)) + 9000.0 * sin(t * 1e-9 * 41)
+                    + (rand() % 201) - 100);
+        }
+        ut_rs_in_tm[i] = 1000000000LL + (int64_t)t + (rand() % 2001) - 1000;
+    }
+}
+
+/**
+ * output n sits at input position n * down / up of the whole stream, interpolated in double
+ * @return worst sample error in LSB, *p_tm_err worst timestamp error in ns, -1 on a count mismatch
+ */
+static double ut_rs_check(uint32_t up, uint32_t down, uint32_t out_len, double *p_tm_err)
+{
+    uint64_t expected = 0;
+    uint64_t pos;
+    uint32_t n;
+    uint32_t i;
+    uint32_t c;
+    double f;
+    double ref;
+    double err;
+    double err_max = 0;
+
+    *p_tm_err = 0;
+
+    /*positions strictly before the last input, the last one is the carry of the next batch*/
+    while ((uint64_t)expected * down < (uint64_t)(UT_RS_SAMPLES - 1) * up)
+    {
+        expected++;
+    }
+    if (expected != out_len)
+    {
+        printf("resample: %u outputs, expected %llu\n", out_len, (unsigned long long)expected);
+        return -1;
+    }
+
+    for (n = 0; n < out_len; ++n)
+    {
+        pos = (uint64_t)n * down;
+        i = (uint32_t)(pos / up);
+        f = (double)(pos % up) / up;
+        for (c = 0; c < 3; ++c)
+        {
+            ref = ut_rs_in[3 * i + c] + (ut_rs_in[3 * (i + 1) + c] - (double)ut_rs_in[3 * i + c]) * f;
+            err = fabs(ut_rs_out[3 * n + c] - ref);
+            err_max = (err > err_max) ? err : err_max;
+        }
+        ref = ut_rs_in_tm[i] + (ut_rs_in_tm[i + 1] - (double)ut_rs_in_tm[i]) * f;
+        err = fabs((double)ut_rs_out_tm[n] - ref);
+        *p_tm_err = (err > *p_tm_err) ? err : *p_tm_err;
+    }
+
+    return err_max;
+}
+
+/**
+ * the whole input in random batch sizes, 0 and 1 included, as the rings hand it over
+ */
+static uint32_t ut_rs_run(UT_RS_FUNC func, uint32_t seed)
+{
+    uint32_t pos = 0;
+    uint32_t out_len = 0;
+    uint32_t n;
+
+    sensord_resample_reset(&ut_rs);
+    srand(seed);
+    while (pos < UT_RS_SAMPLES)
+    {
+        n = rand() % (UT_RS_BATCH_MAX + 1);
+        n = (n > UT_RS_SAMPLES - pos) ? UT_RS_SAMPLES - pos : n;
+        out_len += func(&ut_rs, &ut_rs_in[3 * pos], &ut_rs_in_tm[pos], n,
+                &ut_rs_out[3 * out_len], &ut_rs_out_tm[out_len], UT_RS_OUT_MAX - out_len);
+        pos += n;
+    }
+
+    return out_len;
+}
+
+/**
+ * per handle CIC decimator, 1600 Hz in, factor 16: a constant must come out settled
+ * from the first output, a 430 Hz tone, which aliases to 30 Hz when every 16th sample
+ * is picked, must come out below 0.5 % of its amplitude. Each output is stamped with
+ * the filter center, the first sample of its block
+ */
+static int ut_rs_decimate(void)
+{
+    const uint32_t factor = 16;
+    const double amp = 10000.0;
+    SENSORD_DECIMATOR dec;
+    struct timespec start;
+    struct timespec end;
+    int32_t in[3];
+    float out[3];
+    int64_t tm;
+    int64_t out_tm;
+    uint32_t outputs = 0;
+    uint32_t i;
+    uint32_t c;
+    double dc_err = 0;
+    double tone_max = 0;
+    double pick_max = 0;
+    double ns;
+    int ret = 0;
+
+    sensord_decimate_init(&dec, factor);
+    in[0] = 1234;
+    in[1] = -567;
+    in[2] = 32767;
+    for (i = 0; i < 4 * factor; ++i)
+    {
+        tm = 1000000000LL + i * 625000LL;
+        if (sensord_decimate_xyz(&dec, in, tm, 1.0f, out, &out_tm))
+        {
+            for (c = 0; c < 3; ++c)
+            {
+                dc_err = fmax(dc_err, fabs(out[c] - in[c]));
+            }
+            if (out_tm != tm - (int64_t)(factor - 1) * 625000LL)
+            {
+                ret = -1;
+            }
+            outputs++;
+        }
+    }
+    if (4 != outputs || dc_err > 1e-3)
+    {
+        ret = -1;
+    }
+
+    sensord_decimate_init(&dec, factor);
+    for (i = 0; i < UT_RS_SAMPLES; ++i)
+    {
+        for (c = 0; c < 3; ++c)
+        {
+            in[c] = (int32_t)lrint(amp * sin(2 * M_PI * 430.0 * i / 1600.0 + c));
+        }
+        if (0 == i % factor)
+        {
+            pick_max = fmax(pick_max, fabs((double)in[0]));
+        }
+        /*skip the first window, the priming takes the first sample as a constant*/
+        if (sensord_decimate_xyz(&dec, in, i, 1.0f, out, &out_tm) && i > 2 * factor)
+        {
+            for (c = 0; c < 3; ++c)
+            {
+                tone_max = fmax(tone_max, fabs(out[c]));
+            }
+        }
+    }
+    if (tone_max > amp * 0.005)
+    {
+        ret = -1;
+    }
+
+    /*factor 1 passes through*/
+    sensord_decimate_init(&dec, 1);
+    if (1 != sensord_decimate_xyz(&dec, in, 77, 0.5f, out, &out_tm) || 77 != out_tm || out[0] != 0.5f * in[0])
+    {
+        ret = -1;
+    }
+
+    sensord_decimate_init(&dec, factor);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < 3 * UT_RS_SAMPLES; i += 3)
+    {
+        (void) sensord_decimate_xyz(&dec, &ut_rs_in[i], i, 1.0f, out, &out_tm);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("resample: decimate 1600 Hz by %u, constant off by %.4f LSB, 430 Hz tone %.1f of %.0f LSB"
+            " (every 16th sample: %.0f), %.2f ns per input%s\n",
+            factor, dc_err, tone_max, amp, pick_max, ns / UT_RS_SAMPLES, ret ? ", FAIL" : "");
+
+    return ret;
+}
+
+int unit_test_resample(int argc, char *argv[])
+{
+    /*in mHz: the 2000/1600 Hz pair both ways, the old 5:4, integer ratios, odd ones*/
+    static const uint32_t rate[][2] = {
+            { 2000000, 1600000 }, { 1600000, 2000000 }, { 5, 4 }, { 4000, 1000 },
+            { 1000, 4000 }, { 400000, 400000 }, { 1600000, 1000000 }, { 12500, 2000000 },
+    };
+    static const char *const name[2] = { "vector", "scalar" };
+    static const UT_RS_FUNC func[2] = { sensord_resample_xyz, sensord_resample_xyz_scalar };
+    struct timespec start;
+    struct timespec end;
+    uint32_t r;
+    uint32_t k;
+    uint32_t i;
+    uint32_t out_len = 0;
+    double err;
+    double tm_err;
+    double ns;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    for (r = 0; r < sizeof(rate) / sizeof(rate[0]); ++r)
+    {
+        ut_rs_input(rate[r][0]);
+        if (sensord_resample_init(&ut_rs, rate[r][0], rate[r][1]))
+        {
+            printf("resample: init %u -> %u fail\n", rate[r][0], rate[r][1]);
+            ret = -1;
+            continue;
+        }
+
+        for (k = 0; k < 2; ++k)
+        {
+            out_len = ut_rs_run(func[k], r + 1);
+            err = ut_rs_check(ut_rs.up, ut_rs.down, out_len, &tm_err);
+            printf("resample: %7u -> %7u mHz %s, %u outputs, max error %.3f LSB, %.2f ns\n",
+                    rate[r][0], rate[r][1], name[k], out_len, err, tm_err);
+            if (err < 0 || err > 1.0 || tm_err > 1.0)
+            {
+                printf("resample: FAIL over 1 LSB / 1 ns from double reference\n");
+                ret = -1;
+            }
+        }
+    }
+
+    /*throughput of the pair the engine was written for*/
+    ut_rs_input(2000000);
+    (void) sensord_resample_init(&ut_rs, 2000000, 1600000);
+    for (k = 0; k < 2; ++k)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < UT_RS_BENCH_ROUNDS; ++i)
+        {
+            out_len = ut_rs_run(func[k], 1);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        printf("resample: 2000 -> 1600 Hz %s %.2f ns per output\n", name[k],
+                ns / ((double)UT_RS_BENCH_ROUNDS * out_len));
+    }
+
+    ret |= ut_rs_decimate();
+
+    return ret;
+}
@@ -0,0 +1,495 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "boschsample_ring.h"
+#include "boschsample_pool.h"
+#include "unit_test.h"
+
+/**
+ * The raw sample rings and the sample pool between hwcntl and sensord, each side
+ * on its own thread. Both sides run random burst lengths and random pauses, so
+ * the rings go through full, empty and overflow phases. Every sample must come
+ * out once, either popped by the consumer or handed back as dropped to the
+ * producer, and the consumer must see it in push order.
+ */
+#define UT_SAMPLE_RING_ITEMS (8 * 1024 * 1024)
+#define UT_SAMPLE_POOL_ITEMS (4 * 1024 * 1024)
+#define UT_SAMPLE_BENCH_ITEMS (16 * 1024 * 1024)
+#define UT_SAMPLE_BURST_MAX 256
+#define UT_SAMPLE_PAUSE_MAX 2000
+#define UT_SAMPLE_SENSORS 2
+
+typedef struct
+{
+    BoschSampleRing *p_ring;
+    uint32_t items;
+    uint32_t seed;
+    int bursty;             /// random bursts and pauses, else back to back without overflow
+    int done;               /// atomic, producer finished
+    uint8_t *p_popped;
+    uint8_t *p_dropped;
+    uint64_t dropped;
+    int bad_order;
+} UT_SAMPLE_RING_RUN;
+
+typedef struct
+{
+    BoschSamplePool *p_pool;
+    BoschSampleRing *p_ring[UT_SAMPLE_SENSORS];
+    HW_DATA_UNION *p_base;              /// first sample of the slab, the free ring hands it out first
+    std::atomic<uint8_t> *p_in_use;
+    uint32_t items;
+    int done;                           /// atomic, hwcntl side finished
+    uint64_t produced[UT_SAMPLE_SENSORS];
+    uint64_t dropped[UT_SAMPLE_SENSORS];
+    uint64_t popped[UT_SAMPLE_SENSORS];
+    uint64_t exhausted;
+    int bad;
+} UT_SAMPLE_POOL_RUN;
+
+static uint32_t ut_sample_rand(uint32_t *p_seed)
+{
+    /*xorshift, cheap enough not to hide the ring cost*/
+    *p_seed ^= *p_seed << 13;
+    *p_seed ^= *p_seed >> 17;
+    *p_seed ^= *p_seed << 5;
+
+    return *p_seed;
+}
+
+/**
+ * short spin or a yield, the yield lets the other side in when both share one core
+ */
+static void ut_sample_pause(uint32_t *p_seed)
+{
+    volatile uint32_t spin;
+    uint32_t r = ut_sample_rand(p_seed);
+
+    if (0 == (r & 7))
+    {
+        for (spin = (r >> 8) % UT_SAMPLE_PAUSE_MAX; spin; --spin)
+        {
+        }
+    }
+    else if (1 == (r & 7))
+    {
+        sched_yield();
+    }
+}
+
+static double ut_sample_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * the ring never dereferences what it carries, so the pointer value is the sequence number + 1
+ */
+static void *ut_sample_ring_producer(void *arg)
+{
+    UT_SAMPLE_RING_RUN *p_run = (UT_SAMPLE_RING_RUN *)arg;
+    HW_DATA_UNION *p_dropped;
+    uint32_t seed = p_run->seed;
+    uint32_t burst;
+    uint32_t seq = 0;
+    uint32_t last_dropped = 0;
+    uintptr_t v;
+
+    while (seq < p_run->items)
+    {
+        burst = p_run->bursty ? 1 + ut_sample_rand(&seed) % UT_SAMPLE_BURST_MAX : UT_SAMPLE_BURST_MAX;
+        for (; burst && seq < p_run->items; --burst, ++seq)
+        {
+            while (!p_run->bursty && p_run->p_ring->size() == p_run->p_ring->get_capacity())
+            {
+                sched_yield();
+            }
+            p_dropped = p_run->p_ring->push((HW_DATA_UNION *)(uintptr_t)(seq + 1));
+            if (p_dropped)
+            {
+                v = (uintptr_t)p_dropped;
+                /*always the oldest sample goes*/
+                if (v <= last_dropped || v > seq)
+                {
+                    p_run->bad_order = 1;
+                }
+                last_dropped = v;
+                p_run->p_dropped[v - 1]++;
+                p_run->dropped++;
+            }
+        }
+        if (p_run->bursty)
+        {
+            ut_sample_pause(&seed);
+        }
+    }
+
+    __atomic_store_n(&p_run->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void ut_sample_ring_consumer(UT_SAMPLE_RING_RUN *p_run)
+{
+    static HW_DATA_UNION *buf[SAMPLE_RING_CAPACITY];
+    uint32_t seed = p_run->seed * 7 + 1;
+    uintptr_t last = 0;
+    uintptr_t v;
+    uint32_t n;
+    uint32_t i;
+    int done;
+
+    while (1)
+    {
+        done = __atomic_load_n(&p_run->done, __ATOMIC_ACQUIRE);
+        n = p_run->p_ring->pop_bulk(buf, p_run->bursty ? 1 + ut_sample_rand(&seed) % SAMPLE_RING_CAPACITY :
+                SAMPLE_RING_CAPACITY);
+        for (i = 0; i < n; ++i)
+        {
+            v = (uintptr_t)buf[i];
+            if (v <= last || v > p_run->items)
+            {
+                p_run->bad_order = 1;
+                continue;
+            }
+            last = v;
+            p_run->p_popped[v - 1]++;
+        }
+        if (0 == n && done)
+        {
+            break;
+        }
+        if (p_run->bursty)
+        {
+            ut_sample_pause(&seed);
+        }
+        else if (0 == n)
+        {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * @return 0 when every sample came out exactly once and in order
+ */
+static int ut_sample_ring(uint32_t capacity, int bursty)
+{
+    UT_SAMPLE_RING_RUN run;
+    pthread_t producer;
+    uint64_t popped = 0;
+    uint32_t lost = 0;
+    uint32_t twice = 0;
+    uint32_t i;
+    double ns;
+    int ret = 0;
+
+    memset(&run, 0, sizeof(run));
+    run.p_ring = new BoschSampleRing(capacity);
+    run.items = UT_SAMPLE_RING_ITEMS;
+    run.seed = 0x2545f491;
+    run.bursty = bursty;
+    run.p_popped = (uint8_t *)calloc(run.items, 1);
+    run.p_dropped = (uint8_t *)calloc(run.items, 1);
+
+    ns = ut_sample_now_ns();
+    pthread_create(&producer, NULL, ut_sample_ring_producer, &run);
+    ut_sample_ring_consumer(&run);
+    pthread_join(producer, NULL);
+    ns = ut_sample_now_ns() - ns;
+
+    for (i = 0; i < run.items; ++i)
+    {
+        popped += run.p_popped[i];
+        if (0 == run.p_popped[i] + run.p_dropped[i])
+        {
+            lost++;
+        }
+        else if (run.p_popped[i] + run.p_dropped[i] > 1)
+        {
+            twice++;
+        }
+    }
+
+    printf("sample: ring of %4u %-8s %u pushed, %llu popped, %llu dropped (drop count %llu), %.1f ns/sample\n",
+            run.p_ring->get_capacity(), bursty ? "bursty" : "flat", run.items, (unsigned long long)popped,
+            (unsigned long long)run.dropped, (unsigned long long)run.p_ring->get_drop_count(), ns / run.items);
+
+    /*bursty runs must have gone through both the pop and the drop path*/
+    if (lost || twice || run.bad_order || run.dropped != run.p_ring->get_drop_count() || !run.p_ring->empty() ||
+            (bursty && (0 == popped || 0 == run.dropped)) || (!bursty && run.dropped))
+    {
+        printf("sample: FAIL %u lost, %u twice, order %s\n", lost, twice, run.bad_order ? "broken" : "kept");
+        ret = -1;
+    }
+
+    free(run.p_popped);
+    free(run.p_dropped);
+    delete run.p_ring;
+
+    return ret;
+}
+
+static int ut_sample_pool_mark(UT_SAMPLE_POOL_RUN *p_run, HW_DATA_UNION *p_data, uint8_t in_use)
+{
+    uintptr_t idx = p_data - p_run->p_base;
+
+    if (p_data < p_run->p_base || idx >= p_run->p_pool->get_capacity())
+    {
+        return -1;
+    }
+
+    /*a sample must never be handed out while it is still in use, nor released twice*/
+    return (in_use == p_run->p_in_use[idx].exchange(in_use)) ? -1 : 0;
+}
+
+/**
+ * hwcntl side: alloc, fill, push, recycle what the ring drops
+ */
+static void *ut_sample_pool_hwcntl(void *arg)
+{
+    UT_SAMPLE_POOL_RUN *p_run = (UT_SAMPLE_POOL_RUN *)arg;
+    HW_DATA_UNION *p_data;
+    uint32_t seed = 0x9e3779b9;
+    uint32_t burst;
+    uint32_t seq = 0;
+    uint32_t i;
+    int s;
+
+    while (seq < p_run->items)
+    {
+        /*one FIFO read: a burst of acc frames, then of gyro frames*/
+        burst = 1 + ut_sample_rand(&seed) % UT_SAMPLE_BURST_MAX;
+        for (s = 0; s < UT_SAMPLE_SENSORS; ++s)
+        {
+            for (i = 0; i < burst; ++i)
+            {
+                p_data = p_run->p_pool->alloc();
+                if (NULL == p_data)
+                {
+                    p_run->exhausted++;
+                    continue;
+                }
+                if (ut_sample_pool_mark(p_run, p_data, 1))
+                {
+                    p_run->bad = 1;
+                }
+                p_data->timestamp = (int64_t)(seq + i);
+                p_data->id = s;
+                p_run->produced[s]++;
+
+                p_data = p_run->p_ring[s]->push(p_data);
+                if (p_data)
+                {
+                    if (ut_sample_pool_mark(p_run, p_data, 0))
+                    {
+                        p_run->bad = 1;
+                    }
+                    p_run->dropped[s]++;
+                    p_run->p_pool->recycle(p_data);
+                }
+            }
+        }
+        seq += burst;
+        ut_sample_pause(&seed);
+    }
+
+    __atomic_store_n(&p_run->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/**
+ * sensord side: pop_bulk each ring, check, release
+ */
+static void ut_sample_pool_sensord(UT_SAMPLE_POOL_RUN *p_run)
+{
+    static HW_DATA_UNION *buf[SAMPLE_RING_CAPACITY];
+    int64_t last_ts[UT_SAMPLE_SENSORS] = { -1, -1 };
+    uint32_t seed = 0x85ebca6b;
+    uint32_t total;
+    uint32_t n;
+    uint32_t i;
+    int done;
+    int s;
+
+    while (1)
+    {
+        done = __atomic_load_n(&p_run->done, __ATOMIC_ACQUIRE);
+        total = 0;
+        for (s = 0; s < UT_SAMPLE_SENSORS; ++s)
+        {
+            n = p_run->p_ring[s]->pop_bulk(buf, SAMPLE_RING_CAPACITY);
+            for (i = 0; i < n; ++i)
+            {
+                if (buf[i]->id != (uint32_t)s || buf[i]->timestamp <= last_ts[s])
+                {
+                    p_run->bad = 1;
+                }
+                last_ts[s] = buf[i]->timestamp;
+                if (ut_sample_pool_mark(p_run, buf[i], 0))
+                {
+                    p_run->bad = 1;
+                }
+                p_run->p_pool->release(buf[i]);
+            }
+            p_run->popped[s] += n;
+            total += n;
+        }
+        if (0 == total && done)
+        {
+            break;
+        }
+        ut_sample_pause(&seed);
+    }
+}
+
+/**
+ * @return 0 when no sample was lost, duplicated, reordered or leaked from the pool
+ */
+static int ut_sample_pool(void)
+{
+    UT_SAMPLE_POOL_RUN run;
+    pthread_t hwcntl;
+    uint32_t capacity;
+    uint32_t n = 0;
+    int ret = 0;
+    int s;
+
+    memset(&run, 0, sizeof(run));
+    run.p_pool = new BoschSamplePool();
+    for (s = 0; s < UT_SAMPLE_SENSORS; ++s)
+    {
+        run.p_ring[s] = new BoschSampleRing();
+    }
+    capacity = run.p_pool->get_capacity();
+    run.p_in_use = new std::atomic<uint8_t>[capacity];
+    for (n = 0; n < capacity; ++n)
+    {
+        run.p_in_use[n].store(0, std::memory_order_relaxed);
+    }
+    run.p_base = run.p_pool->alloc();
+    run.p_pool->recycle(run.p_base);
+    run.items = UT_SAMPLE_POOL_ITEMS;
+
+    pthread_create(&hwcntl, NULL, ut_sample_pool_hwcntl, &run);
+    ut_sample_pool_sensord(&run);
+    pthread_join(hwcntl, NULL);
+
+    /*everything went back, so the whole slab can be taken again*/
+    for (n = 0; n < capacity && run.p_pool->alloc(); ++n)
+    {
+    }
+
+    for (s = 0; s < UT_SAMPLE_SENSORS; ++s)
+    {
+        printf("sample: pool sensor %d %llu produced, %llu popped, %llu dropped\n", s,
+                (unsigned long long)run.produced[s], (unsigned long long)run.popped[s],
+                (unsigned long long)run.dropped[s]);
+        if (run.produced[s] != run.popped[s] + run.dropped[s])
+        {
+            ret = -1;
+        }
+    }
+    printf("sample: pool of %u, high water %u, %llu allocs exhausted, %u free after the run\n",
+            capacity, run.p_pool->get_high_water(), (unsigned long long)run.exhausted, n);
+
+    if (ret || run.bad || capacity != n)
+    {
+        printf("sample: FAIL pool %s\n", run.bad ? "handed out a sample in use, or order broken" : "lost samples");
+        ret = -1;
+    }
+
+    for (s = 0; s < UT_SAMPLE_SENSORS; ++s)
+    {
+        delete run.p_ring[s];
+    }
+    delete[] run.p_in_use;
+    delete run.p_pool;
+
+    return ret;
+}
+
+/**
+ * one hwcntl to sensord hop per sample: alloc, push, pop_bulk, release, single thread
+ */
+static void ut_sample_bench(void)
+{
+    static HW_DATA_UNION *buf[SAMPLE_RING_CAPACITY];
+    static const uint32_t burst[] = { 1, 16, 256 };
+    BoschSamplePool pool;
+    BoschSampleRing ring;
+    HW_DATA_UNION *p_data;
+    uint32_t done;
+    uint32_t n;
+    uint32_t b;
+    uint32_t i;
+    double ns;
+
+    for (b = 0; b < sizeof(burst) / sizeof(burst[0]); ++b)
+    {
+        ns = ut_sample_now_ns();
+        for (done = 0; done < UT_SAMPLE_BENCH_ITEMS; done += burst[b])
+        {
+            for (i = 0; i < burst[b]; ++i)
+            {
+                p_data = pool.alloc();
+                pool.recycle(ring.push(p_data));
+            }
+            n = ring.pop_bulk(buf, SAMPLE_RING_CAPACITY);
+            for (i = 0; i < n; ++i)
+            {
+                pool.release(buf[i]);
+            }
+        }
+        ns = ut_sample_now_ns() - ns;
+        printf("sample: alloc/push/pop/release, bursts of %3u, %.1f ns/sample, %.1f M samples/s\n",
+                burst[b], ns / UT_SAMPLE_BENCH_ITEMS, UT_SAMPLE_BENCH_ITEMS / ns * 1e3);
+    }
+}
+
+int unit_test_sample(int argc, char *argv[])
+{
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    /*a small ring overflows all the time, the default one in bursts*/
+    ret |= ut_sample_ring(64, 1);
+    ret |= ut_sample_ring(SAMPLE_RING_CAPACITY, 1);
+    /*back to back, the producer waiting on a full ring, is the hand-off throughput*/
+    ret |= ut_sample_ring(SAMPLE_RING_CAPACITY, 0);
+    ret |= ut_sample_pool();
+    ut_sample_bench();
+
+    return ret;
+}
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "sensord_state.h"
+#include "unit_test.h"
+
+/**
+ * State file round trip in a scratch directory: what is saved comes back, a
+ * file of an older version leaves the newer fields as the caller preset them,
+ * and a damaged file is refused. The boot id tells a HAL restart from a reboot.
+ */
+
+/*layout of the file header, see sensord_state.cpp*/
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t payload_len;
+} UT_STATE_HDR;
+
+static uint32_t ut_state_crc32(const uint8_t *p_buf, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < len; ++i)
+    {
+        crc ^= p_buf[i];
+        for (k = 0; k < 8; ++k)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+static int ut_state_write(const char *path, const void *p_buf, size_t len)
+{
+    int fd;
+    ssize_t ret;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+    ret = write(fd, p_buf, len);
+    close(fd);
+
+    return ((size_t)ret == len) ? 0 : -EIO;
+}
+
+/**
+ * a file as an older HAL wrote it, @param payload_len bytes of payload
+ */
+static int ut_state_write_old(const char *path, const SENSORD_STATE *p_state, uint16_t version, uint16_t payload_len)
+{
+    uint8_t buf[sizeof(UT_STATE_HDR) + sizeof(SENSORD_STATE) + sizeof(uint32_t)];
+    UT_STATE_HDR hdr;
+    uint32_t crc;
+
+    hdr.magic = SENSORD_STATE_MAGIC;
+    hdr.version = version;
+    hdr.payload_len = payload_len;
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), p_state, hdr.payload_len);
+    crc = ut_state_crc32(buf, sizeof(hdr) + hdr.payload_len);
+    memcpy(buf + sizeof(hdr) + hdr.payload_len, &crc, sizeof(crc));
+
+    return ut_state_write(path, buf, sizeof(hdr) + hdr.payload_len + sizeof(crc));
+}
+
+static int ut_state_check(const char *name, int ok)
+{
+    printf("state: %-44s %s\n", name, ok ? "ok" : "FAIL");
+
+    return ok ? 0 : -1;
+}
+
+int unit_test_state(int argc, char *argv[])
+{
+    char dir[] = "/tmp/ut_state_XXXXXX";
+    char path[64];
+    char id_path[64];
+    char tmp_path[80];
+    char boot_id[SENSORD_STATE_BOOT_ID_LEN];
+    char boot_id2[SENSORD_STATE_BOOT_ID_LEN];
+    SENSORD_STATE saved;
+    SENSORD_STATE state;
+    uint8_t buf[512];
+    uint32_t crc;
+    ssize_t len;
+    int fd;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    if (NULL == mkdtemp(dir))
+    {
+        printf("state: scratch dir fail, errno = %d\n", errno);
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/state.bin", dir);
+    snprintf(id_path, sizeof(id_path), "%s/boot_id", dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    memset(&saved, 0, sizeof(saved));
+    saved.gyr_bias[0] = 0.01f;
+    saved.gyr_bias[2] = -0.005f;
+    saved.gyr_updates = 7;
+    saved.acc_gain[0] = saved.acc_gain[1] = saved.acc_gain[2] = 1.01f;
+    saved.acc_offset[2] = -0.2f;
+    saved.step_count = 12345;
+    strcpy(saved.boot_id, "0f8e3a52-8f4c-4b5e-9b36-1f2d3c4b5a69");
+
+    memset(&state, 0, sizeof(state));
+    ret |= ut_state_check("no file is -ENOENT", -ENOENT == sensord_state_load(path, &state));
+
+    ret |= ut_state_check("save", 0 == sensord_state_save(path, &saved));
+    ret |= ut_state_check("load gives back what was saved",
+            0 == sensord_state_load(path, &state) && 0 == memcmp(&state, &saved, sizeof(state)));
+    ret |= ut_state_check("no temp file left", 0 != access(tmp_path, F_OK));
+
+    /*older file: the gyro fields come from it, acc stays as preset*/
+    ret |= ut_state_check("write version 1 file",
+            0 == ut_state_write_old(path, &saved, 1, offsetof(SENSORD_STATE, acc_gain)));
+    memset(&state, 0, sizeof(state));
+    state.acc_gain[0] = state.acc_gain[1] = state.acc_gain[2] = 1.0f;
+    ret |= ut_state_check("version 1 file loads, acc gain left at 1",
+            0 == sensord_state_load(path, &state) && 7 == state.gyr_updates &&
+            1.0f == state.acc_gain[0] && 0 == state.acc_offset[2]);
+    ret |= ut_state_check("write version 2 file",
+            0 == ut_state_write_old(path, &saved, 2, offsetof(SENSORD_STATE, step_count)));
+    memset(&state, 0, sizeof(state));
+    ret |= ut_state_check("version 2 file loads without step count",
+            0 == sensord_state_load(path, &state) && 1.01f == state.acc_gain[0] &&
+            0 == state.step_count && 0 == state.boot_id[0]);
+
+    /*damaged files*/
+    ret |= ut_state_check("save", 0 == sensord_state_save(path, &saved));
+    fd = open(path, O_RDONLY);
+    len = read(fd, buf, sizeof(buf));
+    close(fd);
+    buf[len / 2] ^= 0x10;
+    ut_state_write(path, buf, len);
+    ret |= ut_state_check("flipped bit is -EINVAL", -EINVAL == sensord_state_load(path, &state));
+    buf[len / 2] ^= 0x10;
+    ut_state_write(path, buf, len - 1);
+    ret |= ut_state_check("truncated file is -EINVAL", -EINVAL == sensord_state_load(path, &state));
+    /*crc made to match, so only the version is wrong*/
+    ((UT_STATE_HDR *)buf)->version = SENSORD_STATE_VERSION + 1;
+    crc = ut_state_crc32(buf, len - sizeof(crc));
+    memcpy(buf + len - sizeof(crc), &crc, sizeof(crc));
+    ut_state_write(path, buf, len);
+    ret |= ut_state_check("newer version is -EINVAL", -EINVAL == sensord_state_load(path, &state));
+
+    /*boot id*/
+    ret |= ut_state_check("boot id of this boot",
+            0 == sensord_state_boot_id(SENSORD_STATE_BOOT_ID_PATH, boot_id) && 36 == strlen(boot_id) &&
+            0 == sensord_state_boot_id(SENSORD_STATE_BOOT_ID_PATH, boot_id2) && 0 == strcmp(boot_id, boot_id2));
+    ut_state_write(id_path, "0f8e3a52-8f4c-4b5e-9b36-1f2d3c4b5a69\n", 37);
+    ret |= ut_state_check("boot id without line end",
+            0 == sensord_state_boot_id(id_path, boot_id) && 0 == strcmp(boot_id, saved.boot_id));
+    ut_state_write(id_path, "", 0);
+    ret |= ut_state_check("empty boot id is -EINVAL",
+            -EINVAL == sensord_state_boot_id(id_path, boot_id) && 0 == boot_id[0]);
+
+    unlink(path);
+    unlink(id_path);
+    rmdir(dir);
+
+    return ret;
+}
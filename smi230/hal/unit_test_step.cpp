@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "sensord_step.h"
+#include "sensord_resample.h"
+#include "unit_test.h"
+
+/**
+ * Step detection on simulated walks. The device is held in a fixed tilted pose,
+ * walking adds a bounce along gravity with a second harmonic, and every axis gets
+ * uniform noise. The cadence wanders a little from step to step, a true step is one
+ * bounce period. Samples go in as 25-sample bursts, as the step watermark drains them.
+ * The count of each minute-long walk must be within UT_STEP_ERR_MAX of the true one,
+ * a still or slowly turned device must give no step, and a 1600 Hz raw stream
+ * decimated 32x must count as well as the 50 Hz one.
+ */
+#define UT_STEP_HZ 50
+#define UT_STEP_BURST 25
+#define UT_STEP_WALK_S 60
+#define UT_STEP_ERR_MAX 2
+#define UT_STEP_G 9.80665f
+#define UT_STEP_BOUNCE 2.5f
+#define UT_STEP_RAW_HZ 1600
+#define UT_STEP_RAW_FACTOR (UT_STEP_RAW_HZ / UT_STEP_HZ)
+#define UT_STEP_RAW_SCALE (UT_STEP_G / 10920.0f)
+
+typedef struct
+{
+    float cadence;          /// steps per second, 0 still
+    float noise;            /// m/s^2 on each axis
+    float turn_hz;          /// pose turns around at this rate, 0 fixed
+} UT_STEP_WALK;
+
+static uint32_t ut_step_seed = 0x2545f491;
+
+static float ut_step_rand(void)
+{
+    ut_step_seed ^= ut_step_seed << 13;
+    ut_step_seed ^= ut_step_seed >> 17;
+    ut_step_seed ^= ut_step_seed << 5;
+
+    return (ut_step_seed >> 8) / (float)(1 << 24) * 2 - 1;
+}
+
+static double ut_step_thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * acc of @param p_walk at sample rate @param hz, @param p_phase in bounce periods carried between calls
+ * @return the true steps taken by this sample
+ */
+static uint32_t ut_step_sample(const UT_STEP_WALK *p_walk, uint32_t k, uint32_t hz, double *p_phase,
+        float *p_cadence, float acc[3])
+{
+    float t = (float)k / hz;
+    float a = 2.0f * (float)M_PI * p_walk->turn_hz * t;
+    float dir[3] = { 0.35f * cosf(a), 0.35f * sinf(a), 0.94f };
+    float bounce = 0;
+    float w;
+    uint32_t c;
+    uint32_t steps = 0;
+    double prev = *p_phase;
+
+    if (p_walk->cadence > 0)
+    {
+        *p_phase += (double)*p_cadence / hz;
+        if ((uint64_t)*p_phase != (uint64_t)prev)
+        {
+            steps = 1;
+            /*next step a little faster or slower*/
+            *p_cadence = p_walk->cadence * (1.0f + 0.05f * ut_step_rand());
+        }
+        w = 2.0f * (float)M_PI * (float)*p_phase;
+        bounce = UT_STEP_BOUNCE * (sinf(w) + 0.3f * sinf(2 * w + 0.7f));
+    }
+
+    for (c = 0; c < 3; ++c)
+    {
+        acc[c] = dir[c] * (UT_STEP_G + bounce) + p_walk->noise * ut_step_rand();
+    }
+
+    return steps;
+}
+
+/**
+ * one walk at 50 Hz in watermark bursts
+ * @param p_true receives the true step count
+ * @return detected steps
+ */
+static uint32_t ut_step_walk(const UT_STEP_WALK *p_walk, uint32_t *p_true)
+{
+    static float acc[3 * UT_STEP_BURST];
+    static int64_t tm[UT_STEP_BURST];
+    static int64_t step_tm[UT_STEP_BURST];
+    SENSORD_STEP step;
+    double phase = 0;
+    float cadence = p_walk->cadence;
+    uint32_t k;
+    uint32_t n = 0;
+    uint32_t found = 0;
+
+    sensord_step_reset(&step);
+    *p_true = 0;
+
+    for (k = 0; k < UT_STEP_WALK_S * UT_STEP_HZ; ++k)
+    {
+        *p_true += ut_step_sample(p_walk, k, UT_STEP_HZ, &phase, &cadence, &acc[3 * n]);
+        tm[n] = 1000000000LL + (int64_t)k * 1000000000LL / UT_STEP_HZ;
+        if (++n == UT_STEP_BURST)
+        {
+            found += sensord_step_run(&step, acc, tm, n, step_tm, UT_STEP_BURST);
+            n = 0;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * the same walk as raw LSB at 1600 Hz through the step decimator
+ * @param p_ns receives the time spent per input sample in decimator and detector
+ */
+static uint32_t ut_step_walk_raw(const UT_STEP_WALK *p_walk, uint32_t *p_true, double *p_ns)
+{
+    static float acc[3 * UT_STEP_BURST];
+    static int64_t tm[UT_STEP_BURST];
+    static int64_t step_tm[UT_STEP_BURST];
+    static int32_t raw[3 * UT_STEP_RAW_FACTOR * UT_STEP_BURST];
+    static int64_t raw_tm[UT_STEP_RAW_FACTOR * UT_STEP_BURST];
+    SENSORD_STEP step;
+    SENSORD_DECIMATOR dec;
+    double phase = 0;
+    double ns = 0;
+    double t0;
+    float cadence = p_walk->cadence;
+    float si[3];
+    uint32_t k;
+    uint32_t i;
+    uint32_t c;
+    uint32_t n;
+    uint32_t len = 0;
+    uint32_t found = 0;
+
+    sensord_step_reset(&step);
+    sensord_decimate_init(&dec, UT_STEP_RAW_FACTOR);
+    *p_true = 0;
+
+    for (k = 0; k < UT_STEP_WALK_S * UT_STEP_RAW_HZ; k += n)
+    {
+        /*one watermark worth of raw samples, then the burst as sensord runs it*/
+        for (n = 0; n < UT_STEP_RAW_FACTOR * UT_STEP_BURST; ++n)
+        {
+            *p_true += ut_step_sample(p_walk, k + n, UT_STEP_RAW_HZ, &phase, &cadence, si);
+            for (c = 0; c < 3; ++c)
+            {
+                raw[3 * n + c] = (int32_t)lrintf(si[c] / UT_STEP_RAW_SCALE);
+            }
+            raw_tm[n] = 1000000000LL + (int64_t)(k + n) * 1000000000LL / UT_STEP_RAW_HZ;
+        }
+
+        t0 = ut_step_thread_ns();
+        len = 0;
+        for (i = 0; i < n; ++i)
+        {
+            if (sensord_decimate_xyz(&dec, &raw[3 * i], raw_tm[i], UT_STEP_RAW_SCALE, &acc[3 * len], &tm[len]))
+            {
+                len++;
+            }
+        }
+        found += sensord_step_run(&step, acc, tm, len, step_tm, UT_STEP_BURST);
+        ns += ut_step_thread_ns() - t0;
+    }
+
+    *p_ns = ns / k;
+
+    return found;
+}
+
+static int ut_step_check(const char *name, uint32_t found, uint32_t true_steps, uint32_t err_max)
+{
+    uint32_t err = (found > true_steps) ? found - true_steps : true_steps - found;
+
+    printf("step: %-40s %4u steps for %4u true %s\n", name, found, true_steps,
+            (err <= err_max) ? "ok" : "FAIL");
+
+    return (err <= err_max) ? 0 : -1;
+}
+
+int unit_test_step(int argc, char *argv[])
+{
+    static const UT_STEP_WALK walk[] = {
+        { 1.6f, 0.3f, 0 }, { 2.0f, 0.3f, 0 }, { 2.6f, 0.3f, 0 },
+        { 1.6f, 0.5f, 0 }, { 2.0f, 0.5f, 0.05f }, { 2.6f, 0.5f, 0 },
+    };
+    static const UT_STEP_WALK still = { 0, 0.05f, 0 };
+    static const UT_STEP_WALK turned = { 0, 0.3f, 0.2f };
+    char name[40];
+    uint32_t i;
+    uint32_t true_steps;
+    uint32_t found;
+    double ns;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < sizeof(walk) / sizeof(walk[0]); ++i)
+    {
+        snprintf(name, sizeof(name), "walk %.1f Hz, noise %.1f m/s^2%s", walk[i].cadence, walk[i].noise,
+                walk[i].turn_hz ? ", turning" : "");
+        found = ut_step_walk(&walk[i], &true_steps);
+        ret |= ut_step_check(name, found, true_steps, UT_STEP_ERR_MAX);
+    }
+
+    found = ut_step_walk(&still, &true_steps);
+    ret |= ut_step_check("still", found, true_steps, 0);
+    found = ut_step_walk(&turned, &true_steps);
+    ret |= ut_step_check("slowly turned, noise 0.3 m/s^2", found, true_steps, 0);
+
+    found = ut_step_walk_raw(&walk[1], &true_steps, &ns);
+    ret |= ut_step_check("1600 Hz raw decimated 32x", found, true_steps, UT_STEP_ERR_MAX);
+    printf("step: decimator and detector %.1f ns per input sample\n", ns);
+
+    return ret;
+}
@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "sensord_uring.h"
+#include "unit_test.h"
+
+/**
+ * The emulated input device is a nonblocking pipe carrying the record stream of
+ * an evdev node: per frame the x, y, z, time values and a SYN_REPORT. A writer
+ * thread pushes one FIFO burst per write and waits until the reader has taken
+ * all of it, so every burst costs one wakeup of the reader.
+ */
+#define UT_URING_VALUES_PER_FRAME 5
+#define UT_URING_EVENTS_PER_FRAME (UT_URING_VALUES_PER_FRAME + 1)
+#define UT_URING_BURST_MAX 100
+#define UT_URING_EVENTS_PER_READ 512
+#define UT_URING_BURSTS 20000
+
+typedef struct
+{
+    int dev_fd[2];          /// [1] written by emulated driver, [0] read by the loop under test
+    int ack_fd;             /// reader to writer, burst fully taken
+    uint32_t frames;        /// per burst
+    uint32_t bursts;
+} UT_URING_DEV;
+
+typedef struct
+{
+    uint32_t next_value;    /// sequence carried in the value fields
+    uint64_t events;
+    uint64_t syscalls;
+    int bad;
+} UT_URING_SINK;
+
+static struct input_event ut_burst[UT_URING_BURST_MAX * UT_URING_EVENTS_PER_FRAME];
+static struct input_event ut_read_buf[UT_URING_EVENTS_PER_READ];
+
+static void *ut_uring_writer(void *arg)
+{
+    UT_URING_DEV *p_dev = (UT_URING_DEV *)arg;
+    uint32_t value = 0;
+    uint32_t b;
+    uint32_t i;
+    uint32_t n;
+    uint64_t cnt;
+
+    for (b = 0; b < p_dev->bursts; ++b)
+    {
+        n = 0;
+        for (i = 0; i < p_dev->frames * UT_URING_VALUES_PER_FRAME; ++i)
+        {
+            ut_burst[n].type = EV_MSC;
+            ut_burst[n].code = MSC_RAW;
+            ut_burst[n].value = (int32_t)value++;
+            n++;
+            if (0 == (i + 1) % UT_URING_VALUES_PER_FRAME)
+            {
+                ut_burst[n].type = EV_SYN;
+                ut_burst[n].code = SYN_REPORT;
+                ut_burst[n].value = 0;
+                n++;
+            }
+        }
+
+        if (write(p_dev->dev_fd[1], ut_burst, n * sizeof(struct input_event)) < 0)
+        {
+            printf("uring: emulated device write fail, errno = %d\n", errno);
+            break;
+        }
+
+        while (read(p_dev->ack_fd, &cnt, sizeof(cnt)) < 0 && EINTR == errno)
+        {
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * check the stream, ack the writer once a whole burst is in
+ */
+static void ut_uring_sink(UT_URING_SINK *p_sink, const UT_URING_DEV *p_dev, const uint8_t *p_data, int32_t len)
+{
+    const struct input_event *p_ev = (const struct input_event *)p_data;
+    uint32_t n = len / sizeof(struct input_event);
+    uint32_t i;
+    uint64_t one = 1;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (EV_SYN == p_ev[i].type)
+        {
+            continue;
+        }
+        if ((uint32_t)p_ev[i].value != p_sink->next_value)
+        {
+            p_sink->bad = 1;
+        }
+        p_sink->next_value = (uint32_t)p_ev[i].value + 1;
+    }
+
+    p_sink->events += n;
+    if (0 == p_sink->events % (p_dev->frames * UT_URING_EVENTS_PER_FRAME))
+    {
+        (void) write(p_dev->ack_fd, &one, sizeof(one));
+    }
+}
+
+static int ut_uring_dev_open(UT_URING_DEV *p_dev, uint32_t frames, uint32_t bursts)
+{
+    if (pipe2(p_dev->dev_fd, O_NONBLOCK | O_CLOEXEC))
+    {
+        return -errno;
+    }
+
+    /*writer blocks on the ack, the reader's copy of the eventfd is nonblocking by then*/
+    p_dev->ack_fd = eventfd(0, EFD_CLOEXEC);
+    if (p_dev->ack_fd < 0)
+    {
+        close(p_dev->dev_fd[0]);
+        close(p_dev->dev_fd[1]);
+        return -errno;
+    }
+
+    /*writes of a full burst must not be split by a short pipe*/
+    (void) fcntl(p_dev->dev_fd[1], F_SETFL, 0);
+    p_dev->frames = frames;
+    p_dev->bursts = bursts;
+
+    return 0;
+}
+
+static void ut_uring_dev_close(UT_URING_DEV *p_dev)
+{
+    close(p_dev->dev_fd[0]);
+    if (p_dev->dev_fd[1] >= 0)
+    {
+        close(p_dev->dev_fd[1]);
+    }
+    close(p_dev->ack_fd);
+}
+
+static double ut_uring_thread_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/// the epoll loop hwcntl falls back to: epoll_wait, then read until EAGAIN
+static int ut_uring_run_epoll(UT_URING_DEV *p_dev, UT_URING_SINK *p_sink)
+{
+    struct epoll_event event;
+    uint64_t total = (uint64_t)p_dev->frames * UT_URING_EVENTS_PER_FRAME * p_dev->bursts;
+    int epoll_fd;
+    ssize_t ret;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p_dev->dev_fd[0], &event))
+    {
+        return -1;
+    }
+
+    while (p_sink->events < total)
+    {
+        p_sink->syscalls++;
+        if (epoll_wait(epoll_fd, &event, 1, -1) <= 0)
+        {
+            continue;
+        }
+
+        while (1)
+        {
+            p_sink->syscalls++;
+            ret = read(p_dev->dev_fd[0], ut_read_buf, sizeof(ut_read_buf));
+            if (ret <= 0)
+            {
+                break;
+            }
+            ut_uring_sink(p_sink, p_dev, (const uint8_t *)ut_read_buf, (int32_t)ret);
+        }
+    }
+
+    close(epoll_fd);
+
+    return 0;
+}
+
+static int ut_uring_run_uring(UT_URING_DEV *p_dev, UT_URING_SINK *p_sink)
+{
+    URING_READER reader;
+    URING_COMPLETION comp;
+    uint64_t total = (uint64_t)p_dev->frames * UT_URING_EVENTS_PER_FRAME * p_dev->bursts;
+    int ret;
+
+    ret = uring_reader_open(&reader);
+    if (ret)
+    {
+        return ret;
+    }
+
+    ret = uring_reader_add(&reader, p_dev->dev_fd[0], 0, sizeof(ut_read_buf));
+    if (0 == ret)
+    {
+        ret = uring_reader_start(&reader);
+    }
+
+    while (0 == ret && p_sink->events < total)
+    {
+        p_sink->syscalls++;
+        ret = uring_reader_wait(&reader);
+        while (0 == ret && uring_reader_next(&reader, &comp))
+        {
+            if (comp.len > 0)
+            {
+                ut_uring_sink(p_sink, p_dev, comp.p_data, comp.len);
+            }
+        }
+    }
+
+    uring_reader_close(&reader);
+
+    return ret;
+}
+
+/**
+ * @return 0 when both loops got every event in order
+ */
+static int ut_uring_compare(uint32_t frames)
+{
+    static const char *const name[2] = { "epoll", "io_uring" };
+    UT_URING_DEV dev;
+    UT_URING_SINK sink;
+    pthread_t writer;
+    double cpu_ns;
+    double wall_ns;
+    struct timespec start;
+    struct timespec end;
+    int ret = 0;
+    int run;
+    int loop_ret;
+
+    for (run = 0; run < 2; ++run)
+    {
+        if (ut_uring_dev_open(&dev, frames, UT_URING_BURSTS))
+        {
+            printf("uring: emulated device open fail\n");
+            return -1;
+        }
+        memset(&sink, 0, sizeof(sink));
+
+        pthread_create(&writer, NULL, ut_uring_writer, &dev);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        cpu_ns = ut_uring_thread_ns();
+        loop_ret = (0 == run) ? ut_uring_run_epoll(&dev, &sink) : ut_uring_run_uring(&dev, &sink);
+        cpu_ns = ut_uring_thread_ns() - cpu_ns;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (loop_ret)
+        {
+            /*writer waits for acks that never come, unblock it*/
+            pthread_cancel(writer);
+        }
+        pthread_join(writer, NULL);
+        ut_uring_dev_close(&dev);
+
+        if (loop_ret)
+        {
+            printf("uring: %s loop not available, ret = %d\n", name[run], loop_ret);
+            continue;
+        }
+
+        wall_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        printf("uring: %3u frames/burst %-8s %.2f syscalls/burst, reader cpu %.0f ns/burst, wall %.0f ns/burst%s\n",
+                frames, name[run], (double)sink.syscalls / UT_URING_BURSTS, cpu_ns / UT_URING_BURSTS,
+                wall_ns / UT_URING_BURSTS, sink.bad ? ", OUT OF ORDER" : "");
+        if (sink.bad)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * a device that goes away must be reported as given up, not go silent
+ */
+static int ut_uring_stop(void)
+{
+    URING_READER reader;
+    URING_COMPLETION comp;
+    UT_URING_DEV dev;
+    uint32_t eof = 0;
+    uint32_t round;
+    int stopped = 0;
+    int ret;
+
+    if (ut_uring_dev_open(&dev, 1, 0))
+    {
+        return -1;
+    }
+
+    ret = uring_reader_open(&reader);
+    if (ret)
+    {
+        printf("uring: io_uring not available, ret = %d, stop check skipped\n", ret);
+        ut_uring_dev_close(&dev);
+        return 0;
+    }
+    (void) uring_reader_add(&reader, dev.dev_fd[0], 0, sizeof(ut_read_buf));
+    ret = uring_reader_start(&reader);
+
+    close(dev.dev_fd[1]);
+    dev.dev_fd[1] = -1;
+
+    /*each EOF is re-armed until the fail limit, then the slot is given up*/
+    for (round = 0; 0 == ret && 0 == stopped && round < 4 * URING_FAIL_MAX; ++round)
+    {
+        ret = uring_reader_wait(&reader);
+        while (0 == ret && uring_reader_next(&reader, &comp))
+        {
+            eof += (0 == comp.len);
+            stopped |= comp.stopped;
+        }
+    }
+
+    uring_reader_close(&reader);
+    ut_uring_dev_close(&dev);
+
+    printf("uring: writer gone, %u EOF completions, reader %s\n", eof, stopped ? "gave the fd up" : "kept waiting");
+    if (ret || 0 == stopped || URING_FAIL_MAX != eof)
+    {
+        printf("uring: FAIL expected %u EOF completions and the fd given up\n", URING_FAIL_MAX);
+        return -1;
+    }
+
+    return 0;
+}
+
+int unit_test_uring(int argc, char *argv[])
+{
+    static const uint32_t frames[] = { 1, 10, 100 };
+    uint32_t i;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    for (i = 0; i < sizeof(frames) / sizeof(frames[0]); ++i)
+    {
+        ret |= ut_uring_compare(frames[i]);
+    }
+
+    ret |= ut_uring_stop();
+
+    return ret;
+}
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sensord_wmctl.h"
+#include "unit_test.h"
+
+/**
+ * Watermark controller against an emulated 1600 Hz acc FIFO of 146 frames that
+ * overwrites its oldest frames when full. The interrupt fires at watermark and
+ * is normally served 2 ms later. For the first UT_WMCTL_LATE_NS every 10th one
+ * is served 30 ms late, which overflows the FIFO at the starting watermark.
+ * The controller must back off until nothing is lost, then grow back to the
+ * latency target left by the worst service delay seen, never above the client
+ * budget. A flush drain in between must not be taken for an overflow.
+ */
+#define UT_WMCTL_PERIOD_NS 625000LL
+#define UT_WMCTL_FIFO_FRAMES 146
+#define UT_WMCTL_BUDGET 160
+#define UT_WMCTL_RUN_NS 30000000000LL
+#define UT_WMCTL_LATE_NS 6000000000LL
+
+static uint32_t ut_wmctl_wm;
+static uint32_t ut_wmctl_writes;
+
+static int32_t ut_wmctl_write(int32_t fifo, uint32_t frames)
+{
+    (void)fifo;
+    ut_wmctl_wm = frames;
+    ut_wmctl_writes++;
+
+    return 0;
+}
+
+/**
+ * read what the FIFO holds at @param now_ns, frames sampled since @param p_next_ts
+ * @return frames overwritten before the read
+ */
+static uint32_t ut_wmctl_read(WMCTL_READ *p_read, int64_t *p_next_ts, int64_t now_ns)
+{
+    uint32_t held = 0;
+    uint32_t lost = 0;
+
+    memset(p_read, 0, sizeof(*p_read));
+    while (*p_next_ts + (int64_t)(held + lost) * UT_WMCTL_PERIOD_NS <= now_ns)
+    {
+        if (held == UT_WMCTL_FIFO_FRAMES)
+        {
+            lost++;
+        }
+        else
+        {
+            held++;
+        }
+    }
+
+    *p_next_ts += (int64_t)lost * UT_WMCTL_PERIOD_NS;
+    while (held--)
+    {
+        wmctl_read_add(p_read, *p_next_ts);
+        *p_next_ts += UT_WMCTL_PERIOD_NS;
+    }
+
+    return lost;
+}
+
+int unit_test_wmctl(int argc, char *argv[])
+{
+    WMCTL_READ read;
+    int64_t next_ts = UT_WMCTL_PERIOD_NS;
+    int64_t now_ns;
+    int64_t irq_ns;
+    uint64_t lost_late = 0;
+    uint64_t lost_clean = 0;
+    uint64_t irqs_clean = 0;
+    uint32_t start_wm;
+    uint32_t min_wm;
+    uint32_t max_wm = 0;
+    uint32_t irq_cnt = 0;
+    uint32_t clean_wm = 0;
+    uint32_t backoffs_clean = 0;
+    uint32_t lost;
+    int flushed = 0;
+    int ret = 0;
+
+    (void)argc;
+    (void)argv;
+
+    sensord_wmctl_init(ut_wmctl_write);
+    start_wm = sensord_wmctl_configure(WMCTL_FIFO_ACC, 1600, UT_WMCTL_BUDGET, UT_WMCTL_FIFO_FRAMES, 7);
+    min_wm = start_wm;
+    if (start_wm != ut_wmctl_wm || start_wm != UT_WMCTL_FIFO_FRAMES - WMCTL_HEADROOM_MIN)
+    {
+        printf("wmctl: starts at %u, expected %u\n", start_wm, UT_WMCTL_FIFO_FRAMES - WMCTL_HEADROOM_MIN);
+        ret = -1;
+    }
+
+    now_ns = 0;
+    while (now_ns < UT_WMCTL_RUN_NS)
+    {
+        /*interrupt at the frame that reaches watermark*/
+        irq_ns = next_ts + (int64_t)(ut_wmctl_wm - 1) * UT_WMCTL_PERIOD_NS;
+        now_ns = irq_ns + 2000000;
+        if (irq_ns < UT_WMCTL_LATE_NS && 0 == ++irq_cnt % 10)
+        {
+            now_ns = irq_ns + 30000000;
+        }
+
+        if (0 == flushed && now_ns > UT_WMCTL_RUN_NS / 2)
+        {
+            /*flush drains a few frames out of turn*/
+            (void)ut_wmctl_read(&read, &next_ts, now_ns - 10 * UT_WMCTL_PERIOD_NS);
+            sensord_wmctl_note_drain(WMCTL_FIFO_ACC, &read);
+            flushed = 1;
+        }
+
+        lost = ut_wmctl_read(&read, &next_ts, now_ns);
+        sensord_wmctl_note_read(WMCTL_FIFO_ACC, &read, now_ns);
+
+        if (now_ns < UT_WMCTL_LATE_NS)
+        {
+            lost_late += lost;
+        }
+        else if (now_ns > UT_WMCTL_LATE_NS + 2 * WMCTL_WINDOW_NS)
+        {
+            lost_clean += lost;
+            irqs_clean++;
+            if (ut_wmctl_wm < clean_wm)
+            {
+                backoffs_clean++;
+            }
+            clean_wm = ut_wmctl_wm;
+        }
+
+        if (ut_wmctl_wm < min_wm)
+        {
+            min_wm = ut_wmctl_wm;
+        }
+        if (ut_wmctl_wm > max_wm)
+        {
+            max_wm = ut_wmctl_wm;
+        }
+    }
+
+    printf("wmctl: wm %u, backs off to %u while %llu frames lost to late service, ends at %u\n",
+            start_wm, min_wm, (unsigned long long)lost_late, ut_wmctl_wm);
+    printf("wmctl: %llu frames lost and %u back offs afterwards, %.1f irq/s at the end, %u watermark writes\n",
+            (unsigned long long)lost_clean, backoffs_clean,
+            (double)irqs_clean * 1e9 / (double)(UT_WMCTL_RUN_NS - UT_WMCTL_LATE_NS - 2 * WMCTL_WINDOW_NS),
+            ut_wmctl_writes);
+
+    /*30 ms late is 48 frames arriving past watermark*/
+    if (0 == lost_late || lost_clean || backoffs_clean || min_wm + 48 > UT_WMCTL_FIFO_FRAMES ||
+            ut_wmctl_wm != UT_WMCTL_FIFO_FRAMES - 48 || max_wm > UT_WMCTL_BUDGET)
+    {
+        ret = -1;
+    }
+
+    if (sensord_wmctl_configure(WMCTL_FIFO_ACC, 1600, 20, UT_WMCTL_FIFO_FRAMES, 7) != 20 ||
+            sensord_wmctl_configure(WMCTL_FIFO_ACC, 0, 0, 0, 0) != 0)
+    {
+        printf("wmctl: client budget or switch off not followed\n");
+        ret = -1;
+    }
+
+    return ret;
+}
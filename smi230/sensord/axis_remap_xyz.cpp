@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include "axis_remap.h"
+
+AXIS_REMAP g_remap_a = { 0, { 1, 0, 0, 0, 1, 0, 0, 0, 1 } };
+AXIS_REMAP g_remap_g = { 0, { 1, 0, 0, 0, 1, 0, 0, 0, 1 } };
+
+/**
+ * one legacy placement, same meaning as axis_remap_matrix in axis_remap.c:
+ * swap x/y first, then negate. Resolved at compile time so the loop body
+ * is plain moves and negations without any branch.
+ */
+template <int RX_Y, int SX, int SY, int SZ>
+static void remap_place_xyz(int32_t *p_xyz, uint32_t frame_count)
+{
+    uint32_t i;
+    int32_t x;
+    int32_t y;
+    int32_t z;
+
+    for (i = 0; i < frame_count; ++i)
+    {
+        x = p_xyz[3 * i + (RX_Y ? 1 : 0)];
+        y = p_xyz[3 * i + (RX_Y ? 0 : 1)];
+        z = p_xyz[3 * i + 2];
+        p_xyz[3 * i] = SX ? -x : x;
+        p_xyz[3 * i + 1] = SY ? -y : y;
+        p_xyz[3 * i + 2] = SZ ? -z : z;
+    }
+}
+
+typedef void (*REMAP_PLACE_FN)(int32_t *p_xyz, uint32_t frame_count);
+
+/*P0 is identity and never dispatched*/
+static const REMAP_PLACE_FN remap_place_fn[AXIS_REMAP_PLACE_NUM] = {
+        /* rx_y sx sy sz */
+        NULL,                           /* P0 */
+        remap_place_xyz<0, 1, 0, 1>,    /* P1 */
+        remap_place_xyz<0, 1, 1, 0>,    /* P2 */
+        remap_place_xyz<0, 0, 1, 1>,    /* P3 */
+        remap_place_xyz<1, 1, 0, 0>,    /* P4 */
+        remap_place_xyz<1, 0, 1, 0>,    /* P5 */
+        remap_place_xyz<1, 0, 0, 1>,    /* P6 */
+        remap_place_xyz<1, 1, 1, 1>,    /* P7 */
+};
+
+/*the same placements in matrix form, row major*/
+static const float remap_place_matrix[AXIS_REMAP_PLACE_NUM][9] = {
+        {  1,  0,  0,    0,  1,  0,    0,  0,  1 }, /* P0 */
+        { -1,  0,  0,    0,  1,  0,    0,  0, -1 }, /* P1 */
+        { -1,  0,  0,    0, -1,  0,    0,  0,  1 }, /* P2 */
+        {  1,  0,  0,    0, -1,  0,    0,  0, -1 }, /* P3 */
+        {  0, -1,  0,    1,  0,  0,    0,  0,  1 }, /* P4 */
+        {  0,  1,  0,   -1,  0,  0,    0,  0,  1 }, /* P5 */
+        {  0,  1,  0,    1,  0,  0,    0,  0, -1 }, /* P6 */
+        {  0, -1,  0,   -1,  0,  0,    0,  0, -1 }, /* P7 */
+};
+
+static void remap_matrix_xyz(const float *m, int32_t *p_xyz, uint32_t frame_count)
+{
+    uint32_t i;
+    float x;
+    float y;
+    float z;
+
+    for (i = 0; i < frame_count; ++i)
+    {
+        x = (float)p_xyz[3 * i];
+        y = (float)p_xyz[3 * i + 1];
+        z = (float)p_xyz[3 * i + 2];
+        p_xyz[3 * i] = (int32_t)lrintf(m[0] * x + m[1] * y + m[2] * z);
+        p_xyz[3 * i + 1] = (int32_t)lrintf(m[3] * x + m[4] * y + m[5] * z);
+        p_xyz[3 * i + 2] = (int32_t)lrintf(m[6] * x + m[7] * y + m[8] * z);
+    }
+}
+
+static int is_same_matrix(const float *m0, const float *m1)
+{
+    int i;
+
+    for (i = 0; i < 9; ++i)
+    {
+        if(m0[i] != m1[i])
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int axis_remap_init(AXIS_REMAP *p_remap, int place, const float *p_matrix)
+{
+    int i;
+
+    if(place >= 0 && place < AXIS_REMAP_PLACE_NUM)
+    {
+        p_remap->place = place;
+        memcpy(p_remap->matrix, remap_place_matrix[place], sizeof(p_remap->matrix));
+        return 0;
+    }
+
+    if(AXIS_REMAP_PLACE_MATRIX != place || NULL == p_matrix)
+    {
+        p_remap->place = 0;
+        memcpy(p_remap->matrix, remap_place_matrix[0], sizeof(p_remap->matrix));
+        return -EINVAL;
+    }
+
+    memcpy(p_remap->matrix, p_matrix, sizeof(p_remap->matrix));
+
+    /*a plain placement given as matrix still gets the specialised path*/
+    for (i = 0; i < AXIS_REMAP_PLACE_NUM; ++i)
+    {
+        if(is_same_matrix(p_remap->matrix, remap_place_matrix[i]))
+        {
+            p_remap->place = i;
+            return 0;
+        }
+    }
+
+    p_remap->place = AXIS_REMAP_PLACE_MATRIX;
+
+    return 0;
+}
+
+void axis_remap_xyz(const AXIS_REMAP *p_remap, int32_t *p_xyz, uint32_t frame_count)
+{
+    if(0 == frame_count || 0 == p_remap->place)
+    {
+        return;
+    }
+
+    if(AXIS_REMAP_PLACE_MATRIX == p_remap->place)
+    {
+        remap_matrix_xyz(p_remap->matrix, p_xyz, frame_count);
+        return;
+    }
+
+    remap_place_fn[p_remap->place](p_xyz, frame_count);
+}
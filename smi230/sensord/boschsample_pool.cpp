@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "boschsample_pool.h"
+#include "sensord_pltf.h"
+
+/**
+ * @param pool_size number of samples, the free ring is rounded up to power of 2
+ */
+BoschSamplePool::BoschSamplePool(uint32_t pool_size)
+{
+    uint32_t i;
+
+    stash_len = 0;
+    high_water.store(0, std::memory_order_relaxed);
+    exhausted_count.store(0, std::memory_order_relaxed);
+
+    free_ring = new BoschSampleRing(pool_size);
+
+    slab = (HW_DATA_UNION *) calloc(pool_size, sizeof(HW_DATA_UNION));
+    if (NULL == slab)
+    {
+        PERR("calloc %u samples fail", pool_size);
+        capacity = 0;
+        return;
+    }
+
+    capacity = pool_size;
+    for (i = 0; i < capacity; ++i)
+    {
+        free_ring->push(&slab[i]);
+    }
+
+    return;
+}
+
+BoschSamplePool::~BoschSamplePool()
+{
+    delete free_ring;
+    free(slab);
+}
+
+/**
+ * hwcntl thread only
+ * @return zeroed sample, NULL if pool is exhausted
+ */
+HW_DATA_UNION *BoschSamplePool::alloc()
+{
+    HW_DATA_UNION *p_data;
+    uint32_t in_use;
+
+    if (stash_len)
+    {
+        p_data = stash[--stash_len];
+    }
+    else
+    {
+        p_data = free_ring->pop();
+        if (NULL == p_data)
+        {
+            exhausted_count.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+    }
+
+    in_use = capacity - free_ring->size() - stash_len;
+    if (in_use > high_water.load(std::memory_order_relaxed))
+    {
+        high_water.store(in_use, std::memory_order_relaxed);
+    }
+
+    memset(p_data, 0, sizeof(HW_DATA_UNION));
+
+    return p_data;
+}
+
+/**
+ * hwcntl thread only, for samples which never reached sensord
+ * @param p_data may be NULL
+ */
+void BoschSamplePool::recycle(HW_DATA_UNION *p_data)
+{
+    if (NULL == p_data)
+    {
+        return;
+    }
+
+    if (SAMPLE_POOL_STASH_LEN == stash_len)
+    {
+        /*alloc() always drains the stash first, so this should never happen*/
+        PERR("sample pool stash full, sample lost");
+        return;
+    }
+
+    stash[stash_len++] = p_data;
+
+    return;
+}
+
+/**
+ * sensord thread only
+ * @param p_data may be NULL
+ */
+void BoschSamplePool::release(HW_DATA_UNION *p_data)
+{
+    if (NULL == p_data)
+    {
+        return;
+    }
+
+    /*free ring can hold the whole slab, so nothing is dropped here*/
+    free_ring->push(p_data);
+
+    return;
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boschsample_ring.h"
+#include "sensord_pltf.h"
+
+/**
+ * @param capacity rounded up to power of 2, at least 2
+ */
+BoschSampleRing::BoschSampleRing(uint32_t capacity)
+{
+    uint32_t cap = 2;
+
+    while (cap < capacity)
+    {
+        cap <<= 1;
+    }
+
+    this->capacity = cap;
+    mask = cap - 1;
+    slots = new std::atomic<HW_DATA_UNION *>[cap];
+    for (uint32_t i = 0; i < cap; ++i)
+    {
+        slots[i].store(NULL, std::memory_order_relaxed);
+    }
+
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    drop_count.store(0, std::memory_order_relaxed);
+
+    return;
+}
+
+/**
+ * samples still in the ring are owned by the caller, release them before
+ */
+BoschSampleRing::~BoschSampleRing()
+{
+    delete[] slots;
+}
+
+/**
+ * Producer side only.
+ * @param p_data
+ * @return the oldest sample dropped to make room, NULL if nothing was dropped
+ */
+HW_DATA_UNION *BoschSampleRing::push(HW_DATA_UNION *p_data)
+{
+    HW_DATA_UNION *p_dropped = NULL;
+    HW_DATA_UNION *p_oldest;
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+
+    while (t - h >= capacity)
+    {
+        p_oldest = slots[h & mask].load(std::memory_order_relaxed);
+        /*on failure h is reloaded, the consumer may already have made room*/
+        if (head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            p_dropped = p_oldest;
+            drop_count.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    slots[t & mask].store(p_data, std::memory_order_relaxed);
+    tail.store(t + 1, std::memory_order_release);
+
+    return p_dropped;
+}
+
+/**
+ * Consumer side only.
+ * @return oldest sample, NULL if ring is empty
+ */
+HW_DATA_UNION *BoschSampleRing::pop()
+{
+    HW_DATA_UNION *p_data;
+    uint32_t h = head.load(std::memory_order_acquire);
+
+    while (h != tail.load(std::memory_order_acquire))
+    {
+        p_data = slots[h & mask].load(std::memory_order_relaxed);
+        /*lose the race against producer dropping this slot, retry from new head*/
+        if (head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            return p_data;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Consumer side only.
+ * @param pp_data
+ * @param max_len
+ * @return number of samples taken
+ */
+uint32_t BoschSampleRing::pop_bulk(HW_DATA_UNION **pp_data, uint32_t max_len)
+{
+    uint32_t n = 0;
+    HW_DATA_UNION *p_data;
+
+    while (n < max_len)
+    {
+        p_data = pop();
+        if (NULL == p_data)
+        {
+            break;
+        }
+        pp_data[n++] = p_data;
+    }
+
+    return n;
+}
+
+uint32_t BoschSampleRing::size() const
+{
+    uint32_t h = head.load(std::memory_order_acquire);
+    uint32_t t = tail.load(std::memory_order_acquire);
+
+    return t - h;
+}
+
+bool BoschSampleRing::empty() const
+{
+    return 0 == size();
+}
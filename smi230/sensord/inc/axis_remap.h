@@ -20,13 +20,48 @@
 #ifndef __AXIS_REMAP_H
 #define __AXIS_REMAP_H
 
+#include <stdint.h>
+
+/// number of legacy placements P0..P7
+#define AXIS_REMAP_PLACE_NUM 8
+/// placement value selecting the free 3x3 matrix instead of P0..P7
+#define AXIS_REMAP_PLACE_MATRIX AXIS_REMAP_PLACE_NUM
+
+/**
+ * resolved mounting remap of one sensor.
+ * place is P0..P7 when the matrix is one of the legacy placements,
+ * otherwise AXIS_REMAP_PLACE_MATRIX and matrix is applied as is.
+ */
+typedef struct
+{
+    int place;
+    float matrix[9]; /// row major, out = matrix * in
+} AXIS_REMAP;
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    /// resolved by hwcntl_init from g_place_a / g_place_g, applied to each drained batch
+    extern AXIS_REMAP g_remap_a;
+    extern AXIS_REMAP g_remap_g;
+
     void hw_remap_sensor_data(float *px, float *py, float *pz, int position);
 
+    /**
+     * resolve @param place, or @param p_matrix when place is AXIS_REMAP_PLACE_MATRIX.
+     * a matrix equal to one of the legacy placements is folded into that placement.
+     * @return 0 on success, -EINVAL on bad place, p_remap is then set to identity
+     */
+    int axis_remap_init(AXIS_REMAP *p_remap, int place, const float *p_matrix);
+
+    /**
+     * remap a contiguous block of raw int32 xyz triples in place
+     * @param frame_count number of xyz triples
+     */
+    void axis_remap_xyz(const AXIS_REMAP *p_remap, int32_t *p_xyz, uint32_t frame_count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOSCH_SAMPLE_POOL_H
+#define BOSCH_SAMPLE_POOL_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "sensord_def.h"
+#include "boschsample_ring.h"
+
+/*acc and gyro rings full plus the same amount being processed by sensord*/
+#define SAMPLE_POOL_SIZE (2 * 2 * SAMPLE_RING_CAPACITY)
+
+#define SAMPLE_POOL_STASH_LEN 8
+
+/**
+ * Preallocated HW_DATA_UNION slab shared by hwcntl and sensord.
+ *
+ * hwcntl takes samples with alloc(), sensord gives them back with release().
+ * The free list is a BoschSampleRing with hwcntl as its only consumer and sensord
+ * as its only producer. Samples dropped by hwcntl itself on ring overflow go to
+ * a small hwcntl-local stash through recycle(), which alloc() uses first.
+ */
+class BoschSamplePool
+{
+public:
+    explicit BoschSamplePool(uint32_t pool_size = SAMPLE_POOL_SIZE);
+    ~BoschSamplePool();
+
+    HW_DATA_UNION *alloc();
+    void recycle(HW_DATA_UNION *p_data);
+    void release(HW_DATA_UNION *p_data);
+
+    uint32_t get_capacity() const { return capacity; }
+    uint32_t get_high_water() const { return high_water.load(std::memory_order_relaxed); }
+    uint64_t get_exhausted_count() const { return exhausted_count.load(std::memory_order_relaxed); }
+
+private:
+    BoschSamplePool(const BoschSamplePool & other); //for cppcheck "noCopyConstructor"
+    BoschSamplePool &operator=(const BoschSamplePool & other);
+
+    HW_DATA_UNION *slab;
+    BoschSampleRing *free_ring;
+    uint32_t capacity;
+
+    /*hwcntl thread only*/
+    HW_DATA_UNION *stash[SAMPLE_POOL_STASH_LEN];
+    uint32_t stash_len;
+
+    std::atomic<uint32_t> high_water;
+    std::atomic<uint64_t> exhausted_count;
+};
+
+#endif
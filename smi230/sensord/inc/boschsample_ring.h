@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOSCH_SAMPLE_RING_H
+#define BOSCH_SAMPLE_RING_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "sensord_def.h"
+
+#define SAMPLE_RING_CACHELINE 64
+
+/*capacity of one raw sample ring, BATCH_MAX_FRAME_COUNT rounded up to power of 2*/
+#define SAMPLE_RING_CAPACITY 2048
+
+static_assert(SAMPLE_RING_CAPACITY >= BATCH_MAX_FRAME_COUNT, "sample ring smaller than max batch");
+static_assert(0 == (SAMPLE_RING_CAPACITY & (SAMPLE_RING_CAPACITY - 1)), "sample ring must be power of 2");
+
+/**
+ * Fixed capacity single producer / single consumer ring of raw samples.
+ *
+ * head and tail are free running counters, each on its own cache line.
+ * When the ring is full, the producer drops the oldest sample by moving head
+ * forward itself, so the consumer takes a sample only if its CAS on head wins.
+ */
+class BoschSampleRing
+{
+public:
+    explicit BoschSampleRing(uint32_t capacity = SAMPLE_RING_CAPACITY);
+    ~BoschSampleRing();
+
+    HW_DATA_UNION *push(HW_DATA_UNION *p_data);
+    HW_DATA_UNION *pop();
+    uint32_t pop_bulk(HW_DATA_UNION **pp_data, uint32_t max_len);
+
+    uint32_t size() const;
+    bool empty() const;
+    uint32_t get_capacity() const { return capacity; }
+    uint64_t get_drop_count() const { return drop_count.load(std::memory_order_relaxed); }
+
+private:
+    BoschSampleRing(const BoschSampleRing & other); //for cppcheck "noCopyConstructor"
+    BoschSampleRing &operator=(const BoschSampleRing & other);
+
+    alignas(SAMPLE_RING_CACHELINE) std::atomic<uint32_t> head;
+    alignas(SAMPLE_RING_CACHELINE) std::atomic<uint32_t> tail;
+    alignas(SAMPLE_RING_CACHELINE) std::atomic<uint64_t> drop_count;
+
+    std::atomic<HW_DATA_UNION *> *slots;
+    uint32_t capacity;
+    uint32_t mask;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_ACCCAL_H
+#define __SENSORD_ACCCAL_H
+
+#include <stdint.h>
+
+#include "sensord_def.h"
+
+/**
+ * acc offset/scale calibration, corrected = measured * gain + offset per axis.
+ * Fed with the means of still acc windows, in uncorrected m/s^2, two ways:
+ * - six-face: started by command, each still window lying flat on a face not
+ *   seen yet is taken. With all six, gain and offset of every axis follow from
+ *   the +g/-g pair, and the run ends.
+ * - in use: otherwise, windows close to 1 g that point in new directions are
+ *   fitted to a sphere, |m * gain - c| = r, by least squares over running sums.
+ *   c gives the offset and g/r a common gain. Per axis gains of an earlier
+ *   six-face run are kept, only the offset follows.
+ */
+
+/// gravity the calibration pulls toward, same as GRAVITY_EARTH
+#define SENSORD_ACCCAL_G 9.80665f
+
+/// commands, written as "abort", "faces", "clear" or their numbers to SENSORD_ACCCAL_CTL_FIFO,
+/// or injected by the test app as SENSOR_TYPE_BOSCH_ACC_CAL_CMD. They run while acc is streaming
+#define SENSORD_ACCCAL_CMD_ABORT 0      /// drop a running six-face run
+#define SENSORD_ACCCAL_CMD_FACES 1      /// start a six-face run
+#define SENSORD_ACCCAL_CMD_CLEAR 2      /// back to no correction
+
+/// control FIFO read by hwcntl, e.g. echo faces > /data/misc/sensord_stor/acc_cal_ctl
+#define SENSORD_ACCCAL_CTL_FIFO (PATH_DIR_SENSOR_STORAGE "/acc_cal_ctl")
+
+#define SENSORD_ACCCAL_FACE_NUM 6
+
+typedef struct
+{
+    float gain[3];
+    float offset[3];            /// m/s^2
+    uint8_t per_axis;           /// gain comes from a six-face run
+    uint8_t face_run;
+    uint8_t face_done;          /// bit per face, +x -x +y -y +z -z
+    float face[SENSORD_ACCCAL_FACE_NUM][3];
+    /*in use fit, normal equations of |m|^2 = 2 m.c + k with k = r^2 - |c|^2*/
+    double ata[4][4];
+    double atb[4];
+    uint32_t fit_n;
+    float fit_min[3];
+    float fit_max[3];
+    float last_dir[3];          /// direction of last taken window
+} SENSORD_ACCCAL;
+
+/// no correction, no run, fit emptied
+extern void sensord_acccal_reset(SENSORD_ACCCAL *p_cal);
+
+/**
+ * @param cmd SENSORD_ACCCAL_CMD_*
+ * @return 0 on success, -EINVAL unknown command
+ */
+extern int sensord_acccal_command(SENSORD_ACCCAL *p_cal, int cmd);
+
+/**
+ * read the next word of a control text, "abort", "faces", "clear" or a number
+ * @param p_text not 0 terminated, @param len its length
+ * @param p_pos where to start, left past the word
+ * @param p_cmd SENSORD_ACCCAL_CMD_* or the number given, -1 for an unknown word
+ * @return 1 when a word was read, 0 when only blanks were left
+ */
+extern int sensord_acccal_next_word(const char *p_text, int32_t len, int32_t *p_pos, int *p_cmd);
+
+/**
+ * feed the mean of one still window
+ * @param p_mean uncorrected xyz, m/s^2, device axes
+ * @return 1 when gain/offset changed, 0 otherwise
+ */
+extern int sensord_acccal_feed(SENSORD_ACCCAL *p_cal, const float p_mean[3]);
+
+#endif
@@ -53,12 +53,15 @@ extern "C"
 extern int sensord_bsx_init(void);
 
 extern void sensord_algo_process(BoschSensor *boschsensor);
+extern void sensord_algo_load_state(void);
+extern void sensord_algo_save_state(void);
+extern int sensord_algo_acc_cal_command(int cmd);
+extern int sensord_algo_acc_cal_text(const char *p_text, int32_t len);
 extern bsx_return_t sensord_update_subscription(
                             bsx_sensor_configuration_t *const virtual_sensor_config_p,
                             bsx_u32_t *const n_virtual_sensor_config_p,
                             bsx_sensor_configuration_t *const physical_sensor_config_p,
                             bsx_u32_t *const n_physical_sensor_config_p,
                             uint32_t cur_active_cnt);
-extern uint8_t sensord_resample5to4(int32_t data[3], int64_t *tm,  int32_t pre_data[3], int64_t *pre_tm, uint32_t counter);
 
 #endif
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_ARBITER_H
+#define __SENSORD_ARBITER_H
+
+#include <stdint.h>
+
+/**
+ * Rate arbitration between handles sharing one physical sensor.
+ *
+ * The physical sensor runs at the highest rate any active consumer asked for,
+ * each consumer is brought down to its own rate by a decimator in the algo path.
+ * Written from hwcntl thread through ap_activate/ap_batch, the per consumer
+ * decimation factor and active state are read by sensord thread.
+ */
+
+/// handles fed 1:1 from a physical sensor, wakeup and non-wakeup variants are separate consumers
+#define SENSORD_ARBITER_RAW_CONSUMER_NUM 6
+/// after them the fused sensors, one consumer per physical sensor feeding them
+#define SENSORD_ARBITER_FUSED_CONSUMER_NUM 6
+/// fused consumers come in acc feed, gyro feed pairs, the gyro feed paces the output
+#define SENSORD_ARBITER_IS_FUSED_GYRO_FEED(index) (1 == (((index) - SENSORD_ARBITER_RAW_CONSUMER_NUM) & 1))
+/// last the step sensors, fed from acc through their own decimator
+#define SENSORD_ARBITER_STEP_CONSUMER_NUM 2
+#define SENSORD_ARBITER_STEP_CONSUMER_BASE (SENSORD_ARBITER_RAW_CONSUMER_NUM + SENSORD_ARBITER_FUSED_CONSUMER_NUM)
+#define SENSORD_ARBITER_CONSUMER_NUM (SENSORD_ARBITER_STEP_CONSUMER_BASE + SENSORD_ARBITER_STEP_CONSUMER_NUM)
+
+/**
+ * record what consumer @param index wants and resolve the physical request
+ * @param Hz SAMPLE_RATE_DISABLED when the consumer goes off
+ * @param p_phy_Hz rate the physical sensor has to run at, SAMPLE_RATE_DISABLED when no consumer is left
+ * @param p_fifo_data_len smallest watermark among active consumers
+ * @return 1 if physical config differs from what was written last, 0 if nothing to write,
+ *         -EINVAL if index is out of range
+ */
+extern int sensord_arbiter_request(uint32_t index, float Hz, uint16_t fifo_data_len,
+        uint32_t *p_input_id, float *p_phy_Hz, uint16_t *p_fifo_data_len);
+
+/// physical sensor of @param input_id really runs at @param phy_Hz, decimation factors follow it
+extern void sensord_arbiter_set_phy_rate(uint32_t input_id, float phy_Hz);
+
+/// rate physical sensor @param input_id runs at, 0 while it is off
+extern float sensord_arbiter_get_phy_rate(uint32_t input_id);
+
+/**
+ * @param index 0 .. SENSORD_ARBITER_CONSUMER_NUM - 1
+ * @param p_input_id physical sensor the consumer is fed from
+ * @return bsx list index of the consumer
+ */
+extern int32_t sensord_arbiter_consumer(uint32_t index, uint32_t *p_input_id);
+
+/// decimation factor of consumer @param index, 1 when it takes every sample
+extern uint32_t sensord_arbiter_get_factor(uint32_t index);
+
+/// 1 while consumer @param index is enabled
+extern int sensord_arbiter_is_active(uint32_t index);
+
+#endif
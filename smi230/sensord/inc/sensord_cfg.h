@@ -23,6 +23,8 @@
 extern int g_place_a;
 extern int g_place_m;
 extern int g_place_g;
+extern float g_matrix_a[9];
+extern float g_matrix_g[9];
 extern int solution_type;
 extern int accl_chip;
 extern int gyro_chip;
@@ -34,6 +36,7 @@ extern int amsh_intr_pin;
 extern int amsh_calibration;
 extern int data_log;
 extern int bsx_datalog;
+extern int align_tolerance_us;
 extern int trace_level;
 extern int trace_to_logcat;
 extern long long unsigned int sensors_mask;
@@ -41,6 +44,16 @@ extern long long unsigned int sensors_mask;
 //#define SMI230_DATA_SYNC
 //#define SMI230_NEW_DATA
 #define SMI230_FIFO
+/*read packed scans from IIO buffer of SMI230 driver, input events are used
+ if driver has no IIO device*/
+//#define SMI230_IIO
+/*hwcntl waits and reads through io_uring, one syscall per wakeup.
+ epoll loop is used if kernel has no io_uring*/
+//#define SMI230_IO_URING
+
+/*deliver events to pollEvents through user space ring instead of HAL pipe,
+ pipe is still used if ring setup fails at runtime*/
+#define HAL_EVENT_RING
 
 #define SOLUTION_MDOF       0
 #define SOLUTION_ECOMPASS   1
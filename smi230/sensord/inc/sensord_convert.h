@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_CONVERT_H
+#define __SENSORD_CONVERT_H
+
+#include <stdint.h>
+
+/**
+ * resolve the raw LSB to SI scale factor for the configured range,
+ * called once when range is written to the chip.
+ * @return 0 on success, -EINVAL on unknown range, scale keeps its old value
+ */
+extern int sensord_convert_set_acc_range(int range);
+extern int sensord_convert_set_gyro_range(int range);
+
+/// m/s^2 per LSB
+extern float sensord_convert_get_acc_scale(void);
+/// rad/s per LSB
+extern float sensord_convert_get_gyro_scale(void);
+
+/**
+ * convert a contiguous block of raw int32 xyz triples to float, p_out[i] = p_in[i] * scale
+ * @param frame_count number of xyz triples, p_in and p_out hold 3 * frame_count values
+ */
+extern void sensord_convert_xyz(const int32_t *p_in, float *p_out, uint32_t frame_count, float scale);
+
+/// plain C reference of sensord_convert_xyz, result is bit exact with the vector path
+extern void sensord_convert_xyz_scalar(const int32_t *p_in, float *p_out, uint32_t frame_count, float scale);
+
+/**
+ * same block conversion with a per axis scale and offset, p_out[3i+c] = p_in[3i+c] * scale[c] + offset[c].
+ * Lets a calibration ride along in the conversion pass instead of a second one.
+ */
+extern void sensord_convert_xyz_affine(const int32_t *p_in, float *p_out, uint32_t frame_count,
+        const float scale[3], const float offset[3]);
+
+/// plain C reference of sensord_convert_xyz_affine, within 1 ulp of it when the compiler fuses multiply-add
+extern void sensord_convert_xyz_affine_scalar(const int32_t *p_in, float *p_out, uint32_t frame_count,
+        const float scale[3], const float offset[3]);
+
+#endif
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_FUSION_H
+#define __SENSORD_FUSION_H
+
+#include <stdint.h>
+
+/**
+ * 6-axis orientation filter (Mahony complementary filter) over the aligned
+ * acc + gyro stream, source of game rotation vector, gravity and linear acceleration.
+ * Gyro is integrated into a unit quaternion, the gravity direction seen by acc
+ * pulls it back through a proportional term. Yaw has no reference and drifts
+ * with gyro bias, as game rotation vector is allowed to.
+ */
+
+/// gravity magnitude of fused outputs, same as GRAVITY_EARTH
+#define SENSORD_FUSION_G 9.80665f
+
+typedef struct
+{
+    float q[4];             /// w, x, y, z, rotates device frame into world frame
+    float gyr_bias[3];      /// subtracted from every gyro sample, rad/s
+    float acc[3];           /// latest acc sample, m/s^2
+    int64_t acc_tm;
+    int64_t gyr_tm;         /// timestamp of last integrated gyro sample
+    float aligned_s;        /// seconds integrated since q was set from gravity
+    uint8_t has_acc;
+    uint8_t aligned;
+} SENSORD_FUSION;
+
+typedef struct
+{
+    float rv[4];            /// x, y, z, w, layout of sensors_event_t.data
+    float gravity[3];
+    float linear[3];
+    int64_t timestamp;
+} SENSORD_FUSION_OUT;
+
+/// forget the orientation, next acc sample aligns it again
+extern void sensord_fusion_reset(SENSORD_FUSION *p_fusion);
+
+/**
+ * run one drained burst. Both streams are in time order, in SI units and device axes.
+ * Each gyro sample gives one output once the filter has seen acc.
+ * @param p_acc, p_gyr xyz triples
+ * @param p_out room for gyr_len outputs
+ * @return number of outputs written to p_out
+ */
+extern uint32_t sensord_fusion_run(SENSORD_FUSION *p_fusion,
+        const float *p_acc, const int64_t *p_acc_tm, uint32_t acc_len,
+        const float *p_gyr, const int64_t *p_gyr_tm, uint32_t gyr_len,
+        SENSORD_FUSION_OUT *p_out);
+
+#endif
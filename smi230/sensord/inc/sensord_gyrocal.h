@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_GYROCAL_H
+#define __SENSORD_GYROCAL_H
+
+#include <stdint.h>
+
+/**
+ * online gyro zero-rate offset estimation.
+ * Both streams are cut into fixed time windows with running sums only.
+ * A gyro window taken while the device lies still is folded into the bias
+ * by a recursive average. Acc tells stillness when it is running: every acc
+ * window overlapping the gyro window must be still, so a gyro window may wait
+ * for the acc window still open at its end. Without acc the gyro window's own
+ * spread has to do.
+ */
+
+typedef struct
+{
+    float ref[3];           /// first sample of the window, sums are taken around it
+    float sum[3];
+    float sq[3];
+    uint32_t n;
+    int64_t start_tm;
+    int64_t last_tm;
+} SENSORD_GYROCAL_WIN;
+
+typedef struct
+{
+    float bias[3];          /// rad/s, device axes
+    uint32_t updates;       /// still windows folded into bias so far
+    SENSORD_GYROCAL_WIN gyr;
+    SENSORD_GYROCAL_WIN acc;
+    int64_t acc_still_tm;   /// end of last acc window found still, 0 after a moving one
+    float acc_still_mean[3];    /// mean of that window, m/s^2
+    int64_t acc_moving_tm;  /// end of last acc window found moving, 0 none yet
+    float pend_mean[3];     /// still gyro window waiting for the acc windows up to its end
+    int64_t pend_start_tm;
+    int64_t pend_end_tm;    /// 0 none pending
+} SENSORD_GYROCAL;
+
+/// forget the bias and both windows
+extern void sensord_gyrocal_reset(SENSORD_GYROCAL *p_cal);
+
+/**
+ * feed one drained burst, in SI units and device axes, streams in time order.
+ * Acc may be empty. Bias is updated in place at every finished still gyro window.
+ * @param p_acc, p_gyr xyz triples
+ */
+extern void sensord_gyrocal_run(SENSORD_GYROCAL *p_cal,
+        const float *p_acc, const int64_t *p_acc_tm, uint32_t acc_len,
+        const float *p_gyr, const int64_t *p_gyr_tm, uint32_t gyr_len);
+
+#endif
@@ -119,6 +119,10 @@ enum BST_DEV_GYRO_OP_MODE
 #define BSX_SENSOR_ID_GAS_RESIST                    103
 #define SENSOR_TYPE_BOSCH_GAS_RESIST                (SENSOR_TYPE_BOSCH_ACTIVITY_RECOGNITION + 4)
 #define SENSOR_STRING_TYPE_BOSCH_GAS_RESIST         "com.bosch-BoschSensor.www.GAS"
+/*not a listed sensor, inject_sensor_data with this type carries an acc calibration command in data[0].
+ Only the test app gets there, the framework injects only in data injection mode, whose samples are ignored.
+ Outside the test app commands go through SENSORD_ACCCAL_CTL_FIFO*/
+#define SENSOR_TYPE_BOSCH_ACC_CAL_CMD               (SENSOR_TYPE_BOSCH_ACTIVITY_RECOGNITION + 5)
 
 #define BSX_CONFSTR_2000Hz  18
 #define BSX_CONFSTR_1600Hz  17
@@ -225,6 +229,7 @@ extern void open_input_by_name(const char *event_name, int *p_fd, int *p_num);
 extern void *hwcntl_main(void *arg);
 
 extern int hwcntl_init(BoschSensor *boschsensor);
+extern void hwcntl_shutdown(void);
 
 #endif
 
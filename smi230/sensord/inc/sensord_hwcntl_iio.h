@@ -180,5 +180,30 @@ static inline int rd_sysfs_oneint(const char *filename, char *basedir, int *pval
     return 0;
 }
 
+static inline int rd_sysfs_str(const char *filename, const char *basedir, char *str, int len)
+{
+    FILE *fp;
+    char fname_buf[MAX_FILENAME_LEN+1];
+    char *p_ret;
+
+    snprintf(fname_buf, MAX_FILENAME_LEN, "%s/%s", basedir, filename);
+
+    fp = fopen(fname_buf, "r");
+    if (NULL == fp)
+    {
+        return -errno;
+    }
+
+    p_ret = fgets(str, len, fp);
+    fclose(fp);
+
+    if (NULL == p_ret)
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
 
 #endif /* SENSORD_HWCNTL_IIO_H_ */
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SENSORD_IIO_BUFFER_H
+#define __SENSORD_IIO_BUFFER_H
+
+#include <stdint.h>
+
+/**
+ * IIO buffered capture: scan elements are discovered from sysfs, scan layout is
+ * computed from in_*_type and packed binary scans are read many at a time
+ * from /dev/iio:deviceN.
+ */
+
+#define IIO_CHANNEL_MAX 16
+/*scans taken per read(), 16 byte scans make this 4KB*/
+#define IIO_SCANS_PER_READ 256
+/*device directory, names below it are sized to hold it plus their suffix*/
+#define IIO_DIR_NAME_LEN 128
+
+typedef struct
+{
+    char name[32];              /// without in_ prefix, e.g. "accel_x"
+    uint32_t index;
+    uint32_t offset;            /// bytes into one scan
+    uint32_t storage_bytes;
+    uint32_t real_bits;
+    uint32_t shift;
+    int is_signed;
+    int is_be;
+} IIO_CHANNEL;
+
+typedef struct
+{
+    int fd;
+    char dev_dir_name[IIO_DIR_NAME_LEN];
+    char buf_dir_name[IIO_DIR_NAME_LEN + sizeof("/buffer")];
+    IIO_CHANNEL channel[IIO_CHANNEL_MAX];   /// in scan order
+    const IIO_CHANNEL *p_req[IIO_CHANNEL_MAX];  /// in the order asked for at open
+    uint32_t channel_num;
+    uint32_t scan_size;
+    uint8_t *p_scans;
+} IIO_BUFFER;
+
+/**
+ * enable @param channel_names of IIO device @param dev_name and start capture
+ * @param length IIO buffer length in scans
+ * @return 0 on success, -errno otherwise with p_buf->fd = -1
+ */
+extern int iio_buffer_open(IIO_BUFFER *p_buf, const char *dev_name,
+        const char *const *channel_names, uint32_t channel_num, uint32_t length);
+
+extern void iio_buffer_close(IIO_BUFFER *p_buf);
+
+/// wake poll() only once @param scans are buffered
+extern int iio_buffer_set_watermark(IIO_BUFFER *p_buf, uint32_t scans);
+
+/**
+ * @return number of scans now in p_buf->p_scans, 0 if none pending, -errno on error
+ */
+extern int32_t iio_buffer_read(IIO_BUFFER *p_buf);
+
+/**
+ * in_*_type is "[be|le]:[s|u]realbits/storagebits[Xrepeat]>>shift"
+ * @return 0 on success, -EINVAL if @param type can't be decoded
+ */
+extern int iio_channel_parse_type(IIO_CHANNEL *p_ch, const char *type);
+
+/**
+ * sort p_buf->channel by index and place them: each aligned to its own storage
+ * size, scan padded to the largest storage size
+ */
+extern void iio_buffer_layout(IIO_BUFFER *p_buf);
+
+/// value of @param p_ch in @param p_scan, shifted, masked and sign extended
+extern int64_t iio_channel_value(const IIO_CHANNEL *p_ch, const uint8_t *p_scan);
+
+#endif
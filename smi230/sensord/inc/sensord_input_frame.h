@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SENSORD_INPUT_FRAME_H
+#define __SENSORD_INPUT_FRAME_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+/**
+ * One SMI230 input frame is a run of value events closed by EV_SYN/SYN_REPORT:
+ * timestamp seconds, timestamp nanoseconds, then x, y, z (acc and gyro halves in data sync mode).
+ * The parser keeps a partial frame across reads, so a read may end anywhere.
+ * A frame of wrong length, or one evdev flagged with SYN_DROPPED, is dropped
+ * at its SYN_REPORT and the next frame starts clean from there.
+ */
+#define INPUT_FRAME_VALUES_MAX 11
+
+typedef struct
+{
+    int32_t value[INPUT_FRAME_VALUES_MAX];
+    uint32_t len;
+    int bad;
+    uint64_t drop_count;
+} INPUT_FRAME_PARSER;
+
+/**
+ * @param expected_len value events making up one frame, at most INPUT_FRAME_VALUES_MAX
+ * @param name device name for the drop warning
+ * @return 1 when p_ev completed a frame, values are in p_parser->value until next call
+ */
+extern int input_frame_feed(INPUT_FRAME_PARSER *p_parser, const struct input_event *p_ev,
+        uint32_t expected_len, const char *name);
+
+#endif
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSORD_MERGE_H
+#define SENSORD_MERGE_H
+
+#include <stdint.h>
+
+#include "sensord_def.h"
+
+#define HAS_ACC 0x1
+#define HAS_MAG 0x2
+#define HAS_GYR 0x4
+
+/// index of each stream in SAMPLE_MERGE_ITER
+#define MERGE_STREAM_ACC 0
+#define MERGE_STREAM_MAG 1
+#define MERGE_STREAM_GYR 2
+#define MERGE_STREAM_NUM 3
+
+/**
+ * streaming merge over the drained acc/mag/gyro arrays, each already in time order.
+ * no allocation, state is only a read position per stream.
+ */
+typedef struct
+{
+    HW_DATA_UNION **pp_data[MERGE_STREAM_NUM];
+    uint32_t len[MERGE_STREAM_NUM];
+    uint32_t pos[MERGE_STREAM_NUM];
+    int64_t tolerance_ns;
+} SAMPLE_MERGE_ITER;
+
+extern void merge_iter_init(SAMPLE_MERGE_ITER *p_iter,
+        HW_DATA_UNION **pp_ACC_hwdata, uint32_t ACC_hwdata_len,
+        HW_DATA_UNION **pp_MAG_hwdata, uint32_t MAG_hwdata_len,
+        HW_DATA_UNION **pp_GYRO_hwdata, uint32_t GYRO_hwdata_len,
+        int64_t tolerance_ns);
+
+/**
+ * yield next aligned tuple.
+ * the earliest head sample opens the tuple, and the head of every other stream
+ * whose timestamp is within tolerance of it joins. Each stream gives at most one sample.
+ * @param pp_out samples of the tuple, indexed by MERGE_STREAM_*, NULL if absent
+ * @return HAS_ACC/HAS_MAG/HAS_GYR mask, 0 when all streams are consumed
+ */
+extern int8_t merge_iter_next(SAMPLE_MERGE_ITER *p_iter, HW_DATA_UNION *pp_out[MERGE_STREAM_NUM]);
+
+#endif
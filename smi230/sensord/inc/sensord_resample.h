@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_RESAMPLE_H
+#define __SENSORD_RESAMPLE_H
+
+#include <stdint.h>
+
+/// largest reduced output count of one resample period, i.e. number of phases
+#define SENSORD_RESAMPLE_MAX_PHASE 1024
+
+/**
+ * linear polyphase resampler for one stream of raw int32 xyz triples.
+ * Every down input samples give up output samples, output n sits at
+ * input position n * down / up. The last input sample of a batch is carried
+ * over, so batches can be cut anywhere.
+ */
+typedef struct
+{
+    uint32_t up;        /// output samples per period, number of phases
+    uint32_t down;      /// input samples per period
+    uint64_t pos;       /// next output position in 1/up input samples, 0 is the carried sample
+    int32_t carry_xyz[3];
+    int64_t carry_tm;
+    uint8_t primed;     /// carry_xyz/carry_tm hold a sample
+    float frac[SENSORD_RESAMPLE_MAX_PHASE]; /// phase / up, weight of the later sample
+} SENSORD_RESAMPLER;
+
+/**
+ * set up p_rs for in_rate -> out_rate, both in the same unit (Hz, mHz ...).
+ * the ratio is reduced first, so 2000 -> 1600 runs with 4 phases.
+ * e.g. 5 -> 4 replaces the former sensord_resample5to4.
+ * @return 0 on success, -EINVAL if a rate is 0 or the reduced out rate exceeds SENSORD_RESAMPLE_MAX_PHASE
+ */
+extern int sensord_resample_init(SENSORD_RESAMPLER *p_rs, uint32_t in_rate, uint32_t out_rate);
+
+/// drop carried sample and phase, e.g. when the stream restarts
+extern void sensord_resample_reset(SENSORD_RESAMPLER *p_rs);
+
+/// upper bound of outputs produced by the next sensord_resample_xyz call with in_count samples
+extern uint32_t sensord_resample_out_max(const SENSORD_RESAMPLER *p_rs, uint32_t in_count);
+
+/**
+ * resample one batch.
+ * @param p_in_tm, p_out_tm timestamps of the samples, both may be NULL
+ * @param out_capacity number of xyz triples p_out can hold, outputs beyond it are lost,
+ *        use sensord_resample_out_max to size it
+ * @return number of xyz triples written to p_out
+ */
+extern uint32_t sensord_resample_xyz(SENSORD_RESAMPLER *p_rs,
+        const int32_t *p_in, const int64_t *p_in_tm, uint32_t in_count,
+        int32_t *p_out, int64_t *p_out_tm, uint32_t out_capacity);
+
+/// plain C path of sensord_resample_xyz, result is within 1 LSB of it
+extern uint32_t sensord_resample_xyz_scalar(SENSORD_RESAMPLER *p_rs,
+        const int32_t *p_in, const int64_t *p_in_tm, uint32_t in_count,
+        int32_t *p_out, int64_t *p_out_tm, uint32_t out_capacity);
+
+/**
+ * 2nd order CIC decimator for one stream of raw int32 xyz triples.
+ * Every factor inputs give one output, averaged over a triangular window of
+ * 2 * factor - 1 samples, so content above the output Nyquist is attenuated
+ * before it can alias. Integrators wrap in 64 bit on purpose.
+ */
+typedef struct
+{
+    uint32_t factor;
+    uint32_t phase;         /// inputs taken in the current window
+    uint64_t integ1[3];
+    uint64_t integ2[3];
+    uint64_t comb1[3];      /// integ2 at last output
+    uint64_t comb2[3];      /// 1st comb stage at last output
+    int64_t center_tm;      /// timestamp of first sample of the window, the filter center
+    uint8_t primed;
+} SENSORD_DECIMATOR;
+
+/// factor 1 passes every sample through unchanged
+extern void sensord_decimate_init(SENSORD_DECIMATOR *p_dec, uint32_t factor);
+
+/**
+ * feed one sample
+ * @param scale LSB to SI factor applied to the output
+ * @return 1 when p_out and p_out_tm hold a new output, 0 otherwise
+ */
+extern int sensord_decimate_xyz(SENSORD_DECIMATOR *p_dec, const int32_t p_in[3], int64_t tm,
+        float scale, float p_out[3], int64_t *p_out_tm);
+
+#endif
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_STATE_H
+#define __SENSORD_STATE_H
+
+#include <stdint.h>
+
+#include "sensord_def.h"
+
+/**
+ * calibration state kept across HAL restarts, one small binary file:
+ * header, payload, crc32 over both. Payload fields are only ever appended,
+ * a file from an older version leaves the newer fields at their defaults.
+ * Written to a temp file and renamed over the old one, so a crash leaves
+ * either the old or the new state, never a torn one.
+ */
+
+#define SENSORD_STATE_FILE (PATH_DIR_SENSOR_STORAGE "/sensord_state.bin")
+#define SENSORD_STATE_MAGIC 0x41545353  /* "SSTA" */
+#define SENSORD_STATE_VERSION 3
+
+/*changes on every boot, tells a HAL restart from a reboot*/
+#define SENSORD_STATE_BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+/*uuid text and its terminating 0*/
+#define SENSORD_STATE_BOOT_ID_LEN 40
+
+typedef struct
+{
+    float gyr_bias[3];      /// rad/s, device axes
+    uint32_t gyr_updates;   /// still windows behind gyr_bias, 0 no estimate
+    /*version 2*/
+    float acc_gain[3];
+    float acc_offset[3];    /// m/s^2
+    uint32_t acc_per_axis;  /// acc_gain is from a six-face run
+    /*version 3*/
+    uint64_t step_count;    /// step counter value, counts on across HAL restarts of the same boot
+    char boot_id[SENSORD_STATE_BOOT_ID_LEN];  /// boot step_count belongs to, empty if unknown
+} SENSORD_STATE;
+
+/**
+ * @param p_state filled from file, untouched fields keep what the caller put there
+ * @return 0 on success, -ENOENT no file, -EINVAL bad magic/version/length/crc, -errno on io error
+ */
+extern int sensord_state_load(const char *path, SENSORD_STATE *p_state);
+
+/**
+ * written to path.tmp, synced, renamed over @param path, then its directory synced
+ * @return 0 on success, -errno on io error
+ */
+extern int sensord_state_save(const char *path, const SENSORD_STATE *p_state);
+
+/**
+ * @param p_id filled with the boot id text without line end, 0 terminated
+ * @return 0 on success, -errno on io error, -EINVAL empty
+ */
+extern int sensord_state_boot_id(const char *path, char p_id[SENSORD_STATE_BOOT_ID_LEN]);
+
+#endif
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SENSORD_STEP_H
+#define __SENSORD_STEP_H
+
+#include <stdint.h>
+
+/**
+ * step detection on the acc magnitude, so device orientation does not matter.
+ * |acc| goes through a 1st order high-pass and low-pass, leaving the walking
+ * band. A local maximum is a step when its rise over the lowest point since
+ * the previous step beats an adaptive threshold, half the running average of
+ * recent step amplitudes but not less than a floor, and when it comes no
+ * sooner than a step could. Filter coefficients follow the sample timestamps,
+ * so any input rate from about 25 Hz up works.
+ */
+
+/// acc rate step handles ask for, the pipeline is fed by a decimator at that rate
+#define SENSORD_STEP_ACC_HZ 50.0f
+/// samples per FIFO watermark for step handles, step events may lag this much
+#define SENSORD_STEP_ACC_WM 25
+
+typedef struct
+{
+    float hp_in;            /// last |acc| into the high-pass
+    float hp_out;
+    float lp_out;           /// band-passed signal
+    int64_t last_tm;
+    uint8_t primed;
+    uint8_t rising;
+    float valley;           /// lowest band-passed value since last step
+    float amp_avg;          /// running average of step amplitudes, 0 none yet
+    int64_t step_tm;        /// last step, 0 none
+} SENSORD_STEP;
+
+extern void sensord_step_reset(SENSORD_STEP *p_step);
+
+/**
+ * feed acc samples in time order
+ * @param p_acc xyz triples, m/s^2
+ * @param p_step_tm receives the timestamp of each step found, room for step_max
+ * @return number of steps found
+ */
+extern uint32_t sensord_step_run(SENSORD_STEP *p_step, const float *p_acc, const int64_t *p_tm,
+        uint32_t len, int64_t *p_step_tm, uint32_t step_max);
+
+#endif
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SENSORD_URING_H
+#define __SENSORD_URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * io_uring reader over a handful of nonblocking fds.
+ * Every fd keeps a poll linked to a read outstanding in the ring, reads land
+ * in one registered buffer arena, re-arms are batched into the next wait.
+ * One read per fd at a time: two reads pending on one fd may take bytes out of order.
+ * Every completion re-arms its fd, only a fd failing URING_FAIL_MAX reads in a row
+ * is given up, its last completion says so and the caller has to read it otherwise.
+ */
+
+#define URING_SLOT_MAX 8
+#define URING_FAIL_MAX 8
+
+typedef struct
+{
+    int fd;
+    uint32_t tag;
+    uint32_t buf_len;
+    uint8_t *p_buf;             /// inside arena
+    uint32_t fail_count;        /// reads in a row ending in EOF or error
+    int stopped;                /// no longer armed
+} URING_SLOT;
+
+typedef struct
+{
+    int ring_fd;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_sqe *p_sqes;
+    struct io_uring_cqe *p_cqes;
+    void *p_sq_map;
+    size_t sq_map_len;
+    void *p_cq_map;
+    size_t cq_map_len;
+    size_t sqe_map_len;
+    uint32_t sq_local_tail;     /// SQEs filled in, published on submit
+    URING_SLOT slot[URING_SLOT_MAX];
+    uint32_t slot_num;
+    uint8_t *p_arena;
+    size_t arena_len;
+    int fixed_buf;              /// arena registered, reads go READ_FIXED
+} URING_READER;
+
+typedef struct
+{
+    uint32_t tag;
+    const uint8_t *p_data;      /// valid until next uring_reader_wait()
+    int32_t len;                /// bytes read, 0 on EOF, -errno on error
+    int stopped;                /// 1 when the fd was given up and is not read through the ring any more
+} URING_COMPLETION;
+
+/**
+ * @return 0 on success, -errno when kernel has no io_uring, p_reader->ring_fd = -1 then
+ */
+extern int32_t uring_reader_open(URING_READER *p_reader);
+
+/**
+ * read @param fd @param buf_len bytes at a time, completions carry @param tag
+ * must be called before uring_reader_start()
+ */
+extern int32_t uring_reader_add(URING_READER *p_reader, int fd, uint32_t tag, uint32_t buf_len);
+
+/// register buffer arena and submit first read of every fd
+extern int32_t uring_reader_start(URING_READER *p_reader);
+
+/**
+ * submit pending re-arms and sleep until at least one completion
+ * @return 0 on success, -errno otherwise
+ */
+extern int32_t uring_reader_wait(URING_READER *p_reader);
+
+/**
+ * take one read completion off the ring and queue a re-arm of its fd
+ * @return 1 if @param p_comp was filled, 0 if ring is empty
+ */
+extern int32_t uring_reader_next(URING_READER *p_reader, URING_COMPLETION *p_comp);
+
+extern void uring_reader_close(URING_READER *p_reader);
+
+#endif
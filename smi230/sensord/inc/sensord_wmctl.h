@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SENSORD_WMCTL_H
+#define __SENSORD_WMCTL_H
+
+#include <stdint.h>
+
+/**
+ * FIFO watermark controller.
+ *
+ * The client latency budget gives the highest watermark allowed, the CPU
+ * budget (WMCTL_IRQ_HZ_MAX wakeups per second) the lowest one worth using.
+ * Watermark starts at the latency driven target, backs off towards the CPU
+ * driven one when frames get lost and creeps back once reads are clean again.
+ * Configured from framework threads, fed by hwcntl thread after each read.
+ */
+
+#define WMCTL_FIFO_ACC 0
+#define WMCTL_FIFO_GYRO 1
+#define WMCTL_FIFO_NUM 2
+
+/*interrupt rate the CPU driven target aims to stay under*/
+#define WMCTL_IRQ_HZ_MAX 25
+/*statistics window between two watermark decisions*/
+#define WMCTL_WINDOW_NS 1000000000LL
+/*clean windows before watermark grows again after a back off*/
+#define WMCTL_CLEAN_WINDOWS 4
+/*frames kept free above watermark for read latency of the input path*/
+#define WMCTL_HEADROOM_MIN 2
+
+/// what one read of the input path brought
+typedef struct
+{
+    uint32_t frames;
+    int64_t first_tm;
+    int64_t last_tm;
+} WMCTL_READ;
+
+static inline void wmctl_read_add(WMCTL_READ *p_read, int64_t tm)
+{
+    if (0 == p_read->frames)
+    {
+        p_read->first_tm = tm;
+    }
+    p_read->last_tm = tm;
+    p_read->frames++;
+}
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @param pfun_write_wm programs watermark of @param fifo in frames, called with controller lock held
+ */
+extern void sensord_wmctl_init(int32_t (*pfun_write_wm)(int32_t fifo, uint32_t frames));
+
+/**
+ * (re)start control of one FIFO and write the initial watermark
+ * @param odr_Hz rate the FIFO is filled at, 0 when it goes off
+ * @param budget_frames most frames the client latency allows to be held
+ * @param max_frames hardware FIFO size in frames
+ * @param frame_bytes bytes per frame, for statistics
+ * @return watermark written, 0 when FIFO is off
+ */
+extern uint32_t sensord_wmctl_configure(int32_t fifo, float odr_Hz, uint32_t budget_frames,
+        uint32_t max_frames, uint32_t frame_bytes);
+
+/**
+ * account one read of the input path, watermark is rewritten at end of a window if needed
+ * @param now_ns
+ */
+extern void sensord_wmctl_note_read(int32_t fifo, const WMCTL_READ *p_read, int64_t now_ns);
+
+/**
+ * account a read that drained the input path out of turn, e.g. for flush. Its
+ * frames don't count towards statistics but aren't taken for lost either
+ */
+extern void sensord_wmctl_note_drain(int32_t fifo, const WMCTL_READ *p_read);
+
+/// watermark currently programmed for @param fifo
+extern uint32_t sensord_wmctl_get_wm(int32_t fifo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
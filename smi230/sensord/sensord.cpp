@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <sys/timerfd.h>
 
 #include "BoschSensor.h"
 #include "sensord.h"
@@ -37,91 +38,372 @@
 #include "util_misc.h"
 
 
+/**
+ * block until hwcntl has pushed raw samples into the rings
+ */
 void BoschSensor::sensord_read_rawdata()
 {
     int ret;
-    HW_DATA_UNION *p_hwdata;
-
-    pthread_mutex_lock(&(shmem_hwcntl.mutex));
-
-    if(0 == shmem_hwcntl.p_list->list_len)
+    uint64_t cnt;
+    int i;
+
+    /*eventfd counter may carry wakeups of samples already consumed,
+     so emptiness of the rings is checked again after each wakeup.
+     A due batch deadline or a drained flush ends the wait with empty rings*/
+    while (ring_acclraw->empty() && ring_gyroraw->empty() && ring_magnraw->empty() &&
+            0 == __atomic_exchange_n(&wakeup_pending, 0, __ATOMIC_ACQ_REL))
     {
-        ret = pthread_cond_wait(&(shmem_hwcntl.cond), &(shmem_hwcntl.mutex));
-        if (ret)
+        ret = read(rawdata_evtfd, &cnt, sizeof(cnt));
+        if (ret < 0 && EINTR != errno)
         {
-            pthread_mutex_unlock(&(shmem_hwcntl.mutex));
+            PERR("read rawdata eventfd fail, errno = %d(%s)", errno, strerror(errno));
             return;
         }
     }
-    /*	testing result and code investigation shows that even time out,
-     pthread_cond_timedwait() will wait on calling pthread_mutex_lock(),
-     so when return from pthread_cond_timedwait(), hwcntl may have sent
-     the signal and unlock the pthread mutex at the same time occasionally,
-     so check on share memory is still needed.
-     When runs here, it means:
-     1. 0 == ret, thread is woke up
-     2. ETIMEDOUT == ret, but meanwhile hwcntl have sent the signal
-     */
 
-    while (shmem_hwcntl.p_list->list_len)
+    /*taken before the rings are popped, so samples hwcntl drained for these
+     flushes are processed in this pass, ahead of their flush complete*/
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
     {
-        shmem_hwcntl.p_list->list_get_headdata((void **) &p_hwdata);
-
-        switch (p_hwdata->id)
+        if (__atomic_load_n(&flush_drained[i], __ATOMIC_RELAXED))
         {
+            flush_taken[i] += __atomic_exchange_n(&flush_drained[i], 0, __ATOMIC_ACQUIRE);
+        }
+    }
 
-            case SENSOR_TYPE_ACCELEROMETER:
-                ret = tmplist_sensord_acclraw->list_add_rear((void *) p_hwdata);
-                if (ret)
-                {
-                    PERR("list_add_rear() fail, ret = %d", ret);
-                    if(-1 == ret){
-                        free(p_hwdata);
-                    }
-                }
-                break;
-            case SENSOR_TYPE_GYROSCOPE_UNCALIBRATED:
-                ret = tmplist_sensord_gyroraw->list_add_rear((void *) p_hwdata);
-                if (ret)
-                {
-                    PERR("list_add_rear() fail, ret = %d", ret);
-                    if(-1 == ret){
-                        free(p_hwdata);
-                    }
-                }
-                break;
-            case SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED:
-                ret = tmplist_sensord_magnraw->list_add_rear((void *) p_hwdata);
-                if (ret)
+    return;
+}
+
+/**
+ * called by hwcntl once per poll pass after pushing samples
+ */
+void BoschSensor::sensord_notify_rawdata()
+{
+    int ret;
+    uint64_t cnt = 1;
+
+    ret = write(rawdata_evtfd, &cnt, sizeof(cnt));
+    if (ret < 0)
+    {
+        PERR("write rawdata eventfd fail, errno = %d(%s)", errno, strerror(errno));
+    }
+
+    return;
+}
+
+/**
+ * @param fd wake_lock_fd to acquire, wake_unlock_fd to release
+ */
+void BoschSensor::wake_lock_write(int fd)
+{
+    if (fd < 0)
+    {
+        return;
+    }
+
+    if (write(fd, WAKE_LOCK_NAME, strlen(WAKE_LOCK_NAME)) < 0)
+    {
+        PERR("write wakelock fail, errno = %d(%s)", errno, strerror(errno));
+    }
+
+    return;
+}
+
+/**
+ * hwcntl thread, after samples are pushed and before sensord is notified
+ * @param force 1 when held wakeup events are due, otherwise only held while a wakeup handle is on
+ */
+void BoschSensor::hwcntl_wake_hold(int force)
+{
+    if (0 == force && 0 == (__atomic_load_n(&poll_active_mask, __ATOMIC_RELAXED) & wakeup_handle_mask))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&wake_mutex);
+    wake_hold_seq++;
+    if (0 == wake_held)
+    {
+        wake_lock_write(wake_lock_fd);
+        wake_held = 1;
+    }
+    pthread_mutex_unlock(&wake_mutex);
+
+    return;
+}
+
+/**
+ * sensord thread, taken before the rings are popped
+ */
+uint32_t BoschSensor::sensord_wake_seq()
+{
+    uint32_t seq;
+
+    pthread_mutex_lock(&wake_mutex);
+    seq = wake_hold_seq;
+    pthread_mutex_unlock(&wake_mutex);
+
+    return seq;
+}
+
+/**
+ * sensord thread, once the pass that began at @param seq has written its events
+ */
+void BoschSensor::sensord_wake_release(uint32_t seq)
+{
+    pthread_mutex_lock(&wake_mutex);
+    if (wake_held && seq == wake_hold_seq)
+    {
+        wake_lock_write(wake_unlock_fd);
+        wake_held = 0;
+    }
+    pthread_mutex_unlock(&wake_mutex);
+
+    return;
+}
+
+/**
+ * hwcntl thread, wake sensord without raw data, on delivery timer expiry or drained flush
+ */
+void BoschSensor::sensord_notify_wakeup()
+{
+    __atomic_store_n(&wakeup_pending, 1, __ATOMIC_RELEASE);
+    sensord_notify_rawdata();
+
+    return;
+}
+
+/**
+ * sensord thread only
+ * @return zeroed event at the end of the batch, only counted after sensord_deliver_event()
+ */
+sensors_event_t *BoschSensor::sensord_event_slot()
+{
+    sensors_event_t *p_event;
+
+    if (EVENT_BATCH_LEN == event_batch_len)
+    {
+        sensord_flush_events();
+    }
+
+    p_event = &event_batch[event_batch_len];
+    memset(p_event, 0, sizeof(sensors_event_t));
+
+    return p_event;
+}
+
+/**
+ * commit the event got from sensord_event_slot() into the batch
+ * @param p_event
+ */
+void BoschSensor::sensord_deliver_event(sensors_event_t *p_event)
+{
+    if (p_event != &event_batch[event_batch_len])
+    {
+        PERR("event not from current batch slot");
+        return;
+    }
+
+    event_batch_len++;
+
+    return;
+}
+
+/**
+ * deliver up events to event ring, or to HAL pipe one write per EVENTS_PER_PIPE_WRITE events
+ * @param p_events
+ * @param count
+ */
+void BoschSensor::hal_deliver_events(const sensors_event_t *p_events, uint32_t count)
+{
+    uint32_t writes;
+
+    if (event_ring)
+    {
+        event_ring->write(p_events, count);
+        return;
+    }
+
+    stat_pipe_events += event_pipe_write(HALpipe_fd[1], p_events, count, &writes);
+    stat_pipe_writes += writes;
+
+    return;
+}
+
+/**
+ * deliver up all events in the batch, or hold them in batch store for sensors batched with latency
+ */
+void BoschSensor::sensord_flush_events()
+{
+    uint64_t active_mask;
+    int64_t now_ns;
+    uint32_t i;
+    uint32_t n = 0;
+    int32_t handle;
+
+    now_ns = sensord_get_tmstmp_ns();
+
+    if (event_batch_len)
+    {
+        direct_channel->post(event_batch, event_batch_len);
+    }
+
+    batch_store->lock();
+
+    /*sensors running only for direct channels are not reported through poll,
+     sensors batched with latency are held in batch store*/
+    active_mask = __atomic_load_n(&poll_active_mask, __ATOMIC_RELAXED);
+    for (i = 0; i < event_batch_len; ++i)
+    {
+        handle = event_batch[i].sensor;
+        if (handle >= 0 && handle < HAL_SENSOR_HANDLE_MAX)
+        {
+            if (0 == ((active_mask >> handle) & 0x1))
+            {
+                continue;
+            }
+
+            if (batch_store->is_batching(handle))
+            {
+                if (batch_store->is_full(handle))
                 {
-                    PERR("list_add_rear() fail, ret = %d", ret);
-                    if(-1 == ret){
-                        free(p_hwdata);
-                    }
+                    /*whole store goes up in the one wakeup the full handle costs anyway*/
+                    deliver_batch_store(-1);
                 }
-                break;
+                batch_store->put(&event_batch[i]);
+                continue;
+            }
         }
+        if (n != i)
+        {
+            event_batch[n] = event_batch[i];
+        }
+        n++;
     }
 
-    pthread_mutex_unlock(&(shmem_hwcntl.mutex));
+    if (n)
+    {
+        hal_deliver_events(event_batch, n);
+    }
+
+    deliver_due_batches(now_ns);
+    arm_deliver_timer();
+
+    batch_store->unlock();
+
+#ifdef TEST_APP_ACTIVE
+    now_ns = sensord_get_tmstmp_ns();
+    if (stat_pipe_writes && now_ns - stat_report_ns >= STAT_REPORT_INTERVAL_NS)
+    {
+        stat_report_ns = now_ns;
+        PDEBUG("events per pipe write: %.1f", (double)stat_pipe_events / (double)stat_pipe_writes);
+    }
+#endif
+
+    event_batch_len = 0;
 
     return;
 }
 
-void BoschSensor::sensord_deliver_event(sensors_event_t *p_event)
+/**
+ * deliver up events held in batch store, caller holds batch store lock
+ * @param handle -1 for all handles
+ */
+void BoschSensor::deliver_batch_store(int handle)
+{
+    const sensors_event_t *p_events;
+    uint32_t count;
+    int i;
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (handle >= 0 && handle != i)
+        {
+            continue;
+        }
+
+        count = batch_store->get_events(i, &p_events);
+        if (count)
+        {
+            hal_deliver_events(p_events, count);
+            batch_store->clear(i, sensord_get_tmstmp_ns());
+        }
+    }
+
+    return;
+}
+
+/**
+ * deliver up only the handles whose deadline is within timer slack, caller holds batch store lock
+ * @param now_ns
+ */
+void BoschSensor::deliver_due_batches(int64_t now_ns)
 {
-    int32_t ret;
-    /*deliver up*/
-    ret = write(HALpipe_fd[1], p_event, sizeof(sensors_event_t));
-    if(ret < 0){
-        PERR("deliver event fail, errno = %d(%s)", errno, strerror(errno));
+    int i;
+
+    if (batch_store->get_next_deadline() > now_ns + DELIVER_TIMER_SLACK_NS)
+    {
+        return;
     }
 
-    free(p_event);
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (batch_store->is_due(i, now_ns + DELIVER_TIMER_SLACK_NS))
+        {
+            deliver_batch_store(i);
+        }
+    }
 
     return;
 }
 
+/**
+ * @param deadline_ns INT64_MAX disarms
+ * @param p_armed_ns deadline the timer is armed for, left as is if arming fails
+ */
+static void arm_timer(int fd, int64_t deadline_ns, int64_t *p_armed_ns)
+{
+    struct itimerspec timerspec;
+    int64_t expiry_ns;
+    int ret;
+
+    if (fd < 0 || deadline_ns == *p_armed_ns)
+    {
+        return;
+    }
+
+    /*zero it_value disarms*/
+    memset(&timerspec, 0, sizeof(timerspec));
+    if (INT64_MAX != deadline_ns)
+    {
+        expiry_ns = MAX(deadline_ns - DELIVER_TIMER_SLACK_NS, 1);
+        timerspec.it_value.tv_sec = expiry_ns / 1000000000LL;
+        timerspec.it_value.tv_nsec = expiry_ns % 1000000000LL;
+    }
+
+    ret = timerfd_settime(fd, TFD_TIMER_ABSTIME, &timerspec, NULL);
+    if (ret)
+    {
+        PERR("arm delivery timer fail, errno = %d(%s)", errno, strerror(errno));
+        return;
+    }
+
+    *p_armed_ns = deadline_ns;
+
+    return;
+}
+
+/**
+ * re-arm delivery timer for earliest deadline in batch store, and alarm timer
+ * for earliest deadline of wakeup handles, caller holds batch store lock
+ */
+void BoschSensor::arm_deliver_timer()
+{
+    arm_timer(deliver_timer_fd, batch_store->get_next_deadline(), &armed_deadline_ns);
+    arm_timer(wake_timer_fd, batch_store->get_next_wake_deadline(), &armed_wake_deadline_ns);
+
+    return;
+}
 
 /**
  *
@@ -130,31 +412,96 @@ void BoschSensor::sensord_deliver_event(sensors_event_t *p_event)
  */
 int BoschSensor::send_flush_event(int32_t sensor_id)
 {
-    sensors_meta_data_event_t *p_event;
-    int32_t ret;
+    sensors_meta_data_event_t event;
 
-    p_event = (sensors_meta_data_event_t *) calloc(1, sizeof(sensors_meta_data_event_t));
-    if (NULL == p_event)
+    memset(&event, 0, sizeof(event));
+    event.version = META_DATA_VERSION;
+    event.type = SENSOR_TYPE_META_DATA;
+    event.meta_data.what = META_DATA_FLUSH_COMPLETE;
+    event.meta_data.sensor = sensor_id;
+
+    /*held events precede the flush complete of their sensor*/
+    batch_store->lock();
+    deliver_batch_store(sensor_id);
+    hal_deliver_events(&event, 1);
+    arm_deliver_timer();
+    batch_store->unlock();
+
+    return 0;
+}
+
+
+/**
+ * framework thread, flush complete follows once hwcntl has drained input fds
+ * and sensord has delivered what was drained
+ * @param sensor_id
+ * @return
+ */
+int BoschSensor::request_flush(int32_t sensor_id)
+{
+    int ret;
+    uint64_t cnt = 1;
+
+    if (sensor_id < 0 || sensor_id >= HAL_SENSOR_HANDLE_MAX || flush_evtfd < 0)
     {
-        PWARN("calloc fail");
-        return -1;
+        return send_flush_event(sensor_id);
     }
 
-    p_event->version = META_DATA_VERSION;
-    p_event->type = SENSOR_TYPE_META_DATA;
-    p_event->meta_data.what = META_DATA_FLUSH_COMPLETE;
-    p_event->meta_data.sensor = sensor_id;
+    __atomic_fetch_add(&flush_requested[sensor_id], 1, __ATOMIC_RELAXED);
 
-    ret = write(HALpipe_fd[1], p_event, sizeof(sensors_meta_data_event_t));
-    if(ret < 0){
-        PERR("send flush echo fail, errno = %d(%s)", errno, strerror(errno));
+    ret = write(flush_evtfd, &cnt, sizeof(cnt));
+    if (ret < 0)
+    {
+        PERR("write flush eventfd fail, errno = %d(%s)", errno, strerror(errno));
     }
 
-    free(p_event);
-
     return 0;
 }
 
+/**
+ * hwcntl thread, after input fds were read empty and pushed into the rings
+ */
+void BoschSensor::hwcntl_flush_drained()
+{
+    uint32_t cnt;
+    int i;
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        if (0 == __atomic_load_n(&flush_requested[i], __ATOMIC_RELAXED))
+        {
+            continue;
+        }
+
+        cnt = __atomic_exchange_n(&flush_requested[i], 0, __ATOMIC_RELAXED);
+        /*release orders the ring pushes before the count sensord acquires*/
+        __atomic_fetch_add(&flush_drained[i], cnt, __ATOMIC_RELEASE);
+    }
+
+    sensord_notify_wakeup();
+
+    return;
+}
+
+/**
+ * sensord thread, at end of a pass, one flush complete per flush() taken
+ */
+void BoschSensor::sensord_complete_flush()
+{
+    int i;
+
+    for (i = 0; i < HAL_SENSOR_HANDLE_MAX; ++i)
+    {
+        while (flush_taken[i])
+        {
+            (void) send_flush_event(i);
+            flush_taken[i]--;
+        }
+    }
+
+    return;
+}
+
 
 /**
  * Only used in AP solution
@@ -164,10 +511,15 @@ void *sensord_main(void *arg)
     BoschSensor *bosch_sensor = reinterpret_cast<BoschSensor *>(arg);
     int ret = 0;
 
+    uint32_t wake_seq;
+
     while (1)
     {
         bosch_sensor->sensord_read_rawdata();
+        wake_seq = bosch_sensor->sensord_wake_seq();
         sensord_algo_process(bosch_sensor);
+        bosch_sensor->sensord_complete_flush();
+        bosch_sensor->sensord_wake_release(wake_seq);
     }
 
     //should not run here
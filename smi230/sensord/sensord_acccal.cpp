@@ -0,0 +1,385 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "sensord_pltf.h"
+#include "sensord_acccal.h"
+#include "util_misc.h"
+
+/*a face is taken when one axis holds nearly all of gravity*/
+#define ACCCAL_FACE_MIN (0.9f * SENSORD_ACCCAL_G)
+#define ACCCAL_FACE_OFF_AXIS (0.2f * SENSORD_ACCCAL_G)
+/*in use windows further off 1 g are not static enough to fit*/
+#define ACCCAL_FIT_NORM_TOL (0.1f * SENSORD_ACCCAL_G)
+/*cos of the least angle to the last taken direction, 20 deg*/
+#define ACCCAL_FIT_DIR_COS 0.94f
+/*fit is solved once this many windows spread this far on every axis*/
+#define ACCCAL_FIT_MIN_N 32
+#define ACCCAL_FIT_MIN_SPREAD (0.8f * SENSORD_ACCCAL_G)
+/*results beyond these are a bad run, not a bad part*/
+#define ACCCAL_OFFSET_MAX 1.0f
+#define ACCCAL_GAIN_TOL 0.05f
+
+static void acccal_fit_reset(SENSORD_ACCCAL *p_cal)
+{
+    memset(p_cal->ata, 0, sizeof(p_cal->ata));
+    memset(p_cal->atb, 0, sizeof(p_cal->atb));
+    p_cal->fit_n = 0;
+    p_cal->fit_min[0] = p_cal->fit_min[1] = p_cal->fit_min[2] = SENSORD_ACCCAL_G;
+    p_cal->fit_max[0] = p_cal->fit_max[1] = p_cal->fit_max[2] = -SENSORD_ACCCAL_G;
+    memset(p_cal->last_dir, 0, sizeof(p_cal->last_dir));
+}
+
+void sensord_acccal_reset(SENSORD_ACCCAL *p_cal)
+{
+    memset(p_cal, 0, sizeof(*p_cal));
+    p_cal->gain[0] = p_cal->gain[1] = p_cal->gain[2] = 1.0f;
+    acccal_fit_reset(p_cal);
+}
+
+int sensord_acccal_command(SENSORD_ACCCAL *p_cal, int cmd)
+{
+    switch (cmd)
+    {
+        case SENSORD_ACCCAL_CMD_ABORT:
+            p_cal->face_run = 0;
+            break;
+        case SENSORD_ACCCAL_CMD_FACES:
+            p_cal->face_run = 1;
+            p_cal->face_done = 0;
+            PINFO("acc cal: six-face run started, lay the device still on each face");
+            break;
+        case SENSORD_ACCCAL_CMD_CLEAR:
+            sensord_acccal_reset(p_cal);
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    return 0;
+}
+
+int sensord_acccal_next_word(const char *p_text, int32_t len, int32_t *p_pos, int *p_cmd)
+{
+    static const char *const names[] = { "abort", "faces", "clear" };
+    char word[16];
+    int32_t pos = *p_pos;
+    uint32_t n;
+
+    while (pos < len && isspace((unsigned char)p_text[pos]))
+    {
+        pos++;
+    }
+
+    for (n = 0; pos < len && !isspace((unsigned char)p_text[pos]); ++pos)
+    {
+        if (n < sizeof(word) - 1)
+        {
+            word[n++] = p_text[pos];
+        }
+    }
+    *p_pos = pos;
+    if (0 == n)
+    {
+        return 0;
+    }
+    word[n] = 0;
+
+    *p_cmd = -1;
+    if (isdigit((unsigned char)word[0]))
+    {
+        *p_cmd = atoi(word);
+    }
+    for (n = 0; n < ARRAY_ELEMENTS(names); ++n)
+    {
+        if (0 == strcmp(word, names[n]))
+        {
+            *p_cmd = SENSORD_ACCCAL_CMD_ABORT + n;
+        }
+    }
+    if (*p_cmd < 0)
+    {
+        PWARN("unknown acc cal control word \"%s\"", word);
+    }
+
+    return 1;
+}
+
+static int acccal_plausible(const float gain[3], const float offset[3])
+{
+    uint32_t c;
+
+    for (c = 0; c < 3; ++c)
+    {
+        if (!(fabsf(gain[c] - 1.0f) <= ACCCAL_GAIN_TOL) || !(fabsf(offset[c]) <= ACCCAL_OFFSET_MAX))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int acccal_feed_face(SENSORD_ACCCAL *p_cal, const float p_mean[3])
+{
+    uint32_t c;
+    uint32_t axis = 0;
+    uint32_t face;
+    float gain[3];
+    float offset[3];
+
+    for (c = 1; c < 3; ++c)
+    {
+        if (fabsf(p_mean[c]) > fabsf(p_mean[axis]))
+        {
+            axis = c;
+        }
+    }
+
+    if (fabsf(p_mean[axis]) < ACCCAL_FACE_MIN ||
+            fabsf(p_mean[(axis + 1) % 3]) > ACCCAL_FACE_OFF_AXIS ||
+            fabsf(p_mean[(axis + 2) % 3]) > ACCCAL_FACE_OFF_AXIS)
+    {
+        return 0;
+    }
+
+    face = 2 * axis + ((p_mean[axis] < 0) ? 1 : 0);
+    if (p_cal->face_done & (1 << face))
+    {
+        return 0;
+    }
+
+    memcpy(p_cal->face[face], p_mean, sizeof(p_cal->face[face]));
+    p_cal->face_done |= (1 << face);
+    PINFO("acc cal: face %c%c taken, %.4f", (face & 1) ? '-' : '+', 'x' + axis, p_mean[axis]);
+
+    if ((1 << SENSORD_ACCCAL_FACE_NUM) - 1 != p_cal->face_done)
+    {
+        return 0;
+    }
+
+    p_cal->face_run = 0;
+
+    /*m+ * gain + offset = g, m- * gain + offset = -g*/
+    for (c = 0; c < 3; ++c)
+    {
+        gain[c] = 2.0f * SENSORD_ACCCAL_G / (p_cal->face[2 * c][c] - p_cal->face[2 * c + 1][c]);
+        offset[c] = -0.5f * (p_cal->face[2 * c][c] + p_cal->face[2 * c + 1][c]) * gain[c];
+    }
+
+    if (0 == acccal_plausible(gain, offset))
+    {
+        PERR("acc cal: six-face result out of range, gain %f %f %f, offset %f %f %f",
+                gain[0], gain[1], gain[2], offset[0], offset[1], offset[2]);
+        return 0;
+    }
+
+    memcpy(p_cal->gain, gain, sizeof(gain));
+    memcpy(p_cal->offset, offset, sizeof(offset));
+    p_cal->per_axis = 1;
+    acccal_fit_reset(p_cal);
+    PINFO("acc cal: six-face done, gain %f %f %f, offset %f %f %f",
+            gain[0], gain[1], gain[2], offset[0], offset[1], offset[2]);
+
+    return 1;
+}
+
+/**
+ * solve the 4x4 normal equations in place, gauss with partial pivoting
+ * @return 0 on success, -EINVAL if singular
+ */
+static int acccal_solve4(double a[4][4], double b[4], double x[4])
+{
+    int i;
+    int j;
+    int k;
+    int p;
+    double t;
+
+    for (k = 0; k < 4; ++k)
+    {
+        p = k;
+        for (i = k + 1; i < 4; ++i)
+        {
+            if (fabs(a[i][k]) > fabs(a[p][k]))
+            {
+                p = i;
+            }
+        }
+        if (fabs(a[p][k]) < 1e-9)
+        {
+            return -EINVAL;
+        }
+        if (p != k)
+        {
+            for (j = 0; j < 4; ++j)
+            {
+                t = a[k][j];
+                a[k][j] = a[p][j];
+                a[p][j] = t;
+            }
+            t = b[k];
+            b[k] = b[p];
+            b[p] = t;
+        }
+        for (i = k + 1; i < 4; ++i)
+        {
+            t = a[i][k] / a[k][k];
+            for (j = k; j < 4; ++j)
+            {
+                a[i][j] -= t * a[k][j];
+            }
+            b[i] -= t * b[k];
+        }
+    }
+
+    for (k = 3; k >= 0; --k)
+    {
+        t = b[k];
+        for (j = k + 1; j < 4; ++j)
+        {
+            t -= a[k][j] * x[j];
+        }
+        x[k] = t / a[k][k];
+    }
+
+    return 0;
+}
+
+static int acccal_feed_fit(SENSORD_ACCCAL *p_cal, const float p_raw[3])
+{
+    double row[4];
+    double x[4];
+    float p_mean[3];
+    float norm;
+    float r;
+    float gain[3];
+    float offset[3];
+    uint32_t c;
+    uint32_t i;
+    uint32_t j;
+
+    /*fit in gain corrected units, per axis gains of a six-face run then leave a sphere*/
+    p_mean[0] = p_raw[0] * p_cal->gain[0];
+    p_mean[1] = p_raw[1] * p_cal->gain[1];
+    p_mean[2] = p_raw[2] * p_cal->gain[2];
+
+    norm = sqrtf(p_mean[0] * p_mean[0] + p_mean[1] * p_mean[1] + p_mean[2] * p_mean[2]);
+    if (fabsf(norm - SENSORD_ACCCAL_G) > ACCCAL_FIT_NORM_TOL)
+    {
+        return 0;
+    }
+
+    /*same pose as last time adds weight, not information*/
+    if ((p_mean[0] * p_cal->last_dir[0] + p_mean[1] * p_cal->last_dir[1] +
+            p_mean[2] * p_cal->last_dir[2]) / norm > ACCCAL_FIT_DIR_COS)
+    {
+        return 0;
+    }
+
+    for (c = 0; c < 3; ++c)
+    {
+        p_cal->last_dir[c] = p_mean[c] / norm;
+        row[c] = 2.0 * p_mean[c];
+        if (p_mean[c] < p_cal->fit_min[c])
+        {
+            p_cal->fit_min[c] = p_mean[c];
+        }
+        if (p_mean[c] > p_cal->fit_max[c])
+        {
+            p_cal->fit_max[c] = p_mean[c];
+        }
+    }
+    row[3] = 1.0;
+
+    for (i = 0; i < 4; ++i)
+    {
+        for (j = 0; j < 4; ++j)
+        {
+            p_cal->ata[i][j] += row[i] * row[j];
+        }
+        p_cal->atb[i] += row[i] * (double)norm * norm;
+    }
+    p_cal->fit_n++;
+
+    if (p_cal->fit_n < ACCCAL_FIT_MIN_N)
+    {
+        return 0;
+    }
+    for (c = 0; c < 3; ++c)
+    {
+        if (p_cal->fit_max[c] - p_cal->fit_min[c] < ACCCAL_FIT_MIN_SPREAD)
+        {
+            return 0;
+        }
+    }
+
+    if (acccal_solve4(p_cal->ata, p_cal->atb, x) || x[3] + x[0] * x[0] + x[1] * x[1] + x[2] * x[2] <= 0)
+    {
+        acccal_fit_reset(p_cal);
+        return 0;
+    }
+    r = (float)sqrt(x[3] + x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+
+    /*next fit starts over, so the estimate follows slow drift*/
+    acccal_fit_reset(p_cal);
+
+    for (c = 0; c < 3; ++c)
+    {
+        if (p_cal->per_axis)
+        {
+            gain[c] = p_cal->gain[c];
+            offset[c] = -(float)x[c];
+        }
+        else
+        {
+            gain[c] = p_cal->gain[c] * SENSORD_ACCCAL_G / r;
+            offset[c] = -(float)x[c] * SENSORD_ACCCAL_G / r;
+        }
+    }
+
+    if (0 == acccal_plausible(gain, offset))
+    {
+        PWARN("acc cal: sphere fit out of range, center %f %f %f, radius %f", x[0], x[1], x[2], r);
+        return 0;
+    }
+
+    memcpy(p_cal->gain, gain, sizeof(gain));
+    memcpy(p_cal->offset, offset, sizeof(offset));
+    PINFO("acc cal: sphere fit, gain %f %f %f, offset %f %f %f",
+            gain[0], gain[1], gain[2], offset[0], offset[1], offset[2]);
+
+    return 1;
+}
+
+int sensord_acccal_feed(SENSORD_ACCCAL *p_cal, const float p_mean[3])
+{
+    if (p_cal->face_run)
+    {
+        return acccal_feed_face(p_cal, p_mean);
+    }
+
+    return acccal_feed_fit(p_cal, p_mean);
+}
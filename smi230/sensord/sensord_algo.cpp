@@ -31,6 +31,16 @@
 #include "sensord_cfg.h"
 #include "sensord_algo.h"
 #include "sensord_hwcntl.h"
+#include "sensord_merge.h"
+#include "sensord_convert.h"
+#include "axis_remap.h"
+#include "sensord_resample.h"
+#include "sensord_arbiter.h"
+#include "sensord_fusion.h"
+#include "sensord_gyrocal.h"
+#include "sensord_acccal.h"
+#include "sensord_step.h"
+#include "sensord_state.h"
 #include "util_misc.h"
 
 
@@ -39,29 +49,11 @@
 #define CONVERT_MAG (0.1)
 #define CONVERT_ORI (57.2958)
 
-#define CONVERT_ACC_2G (0.000598755)
-#define CONVERT_ACC_4G (0.001197510)
-#define CONVERT_ACC_8G (0.002395020)
-#define CONVERT_ACC_16G (0.004790039)
+/*sample time between two saves of the calibration state*/
+#define STATE_SAVE_INTERVAL_NS (300 * 1000000000LL)
 
-#define CONVERT_GYRO_125DPS (0.0038147)
-#define CONVERT_GYRO_250DPS (0.0076294)
-#define CONVERT_GYRO_500DPS (0.0152588)
-#define CONVERT_GYRO_1000DPS (0.0305176)
-#define CONVERT_GYRO_2000DPS (0.0610352)
-
-#define CONVERT_GYRO_125_RADPS (0.00006657903)
-#define CONVERT_GYRO_250_RADPS (0.00013315805)
-#define CONVERT_GYRO_500_RADPS (0.00026631611)
-#define CONVERT_GYRO_1000_RADPS (0.00053263222)
-#define CONVERT_GYRO_2000_RADPS (0.00106526444)
-
-static float convert_acc;
-static float convert_gyro;
-
-#define HAS_ACC 0x1
-#define HAS_MAG 0x2
-#define HAS_GYR 0x4
+/*acc calibration commands waiting for sensord thread*/
+#define ACCCAL_CMD_QUEUE_LEN 8
 
 typedef struct
 {
@@ -156,272 +148,839 @@ bsx_fifo_data_t ang_in_data =
 /// library input package
 static bsx_fifo_data_t library_in_package[3];
 
+/// samples drained from rings in one pass, only touched by sensord thread
+static HW_DATA_UNION *ACC_hwdata_buf[SAMPLE_RING_CAPACITY];
+static HW_DATA_UNION *MAG_hwdata_buf[SAMPLE_RING_CAPACITY];
+static HW_DATA_UNION *GYRO_hwdata_buf[SAMPLE_RING_CAPACITY];
+
+/// raw xyz of the drained samples packed as int32 triples, and the same in SI units
+static int32_t ACC_raw_xyz[3 * SAMPLE_RING_CAPACITY];
+static float ACC_si_xyz[3 * SAMPLE_RING_CAPACITY];
+static int32_t GYRO_raw_xyz[3 * SAMPLE_RING_CAPACITY];
+static float GYRO_si_xyz[3 * SAMPLE_RING_CAPACITY];
+/// timestamps of the drained acc/gyro samples, for the fusion pass
+static int64_t ACC_tm[SAMPLE_RING_CAPACITY];
+static int64_t GYRO_tm[SAMPLE_RING_CAPACITY];
+/// per handle decimation state, indexed like the arbiter's consumers
+static SENSORD_DECIMATOR consumer_decimator[SENSORD_ARBITER_CONSUMER_NUM];
+/// gyro offset, kept across activations. All zero is the reset state
+static SENSORD_GYROCAL gyrocal;
+/// acc correction, folded into the acc conversion
+static SENSORD_ACCCAL acccal;
+/// end of the still acc window last given to acccal
+static int64_t acccal_seen_tm = 0;
+/// SENSORD_ACCCAL_CMD_* posted from framework and hwcntl threads, run in order by sensord thread
+static int acccal_cmd_queue[ACCCAL_CMD_QUEUE_LEN];
+static uint32_t acccal_cmd_head = 0;
+static uint32_t acccal_cmd_tail = 0;
+static pthread_mutex_t acccal_cmd_mutex = PTHREAD_MUTEX_INITIALIZER;
+/// what the state file holds, so a save is skipped when nothing new was learnt
+static SENSORD_STATE state_saved;
+/// state at the end of the last whole sensord pass, for the save on destroy.
+/// Two slots, a pass killed while filling one leaves the published one intact. -1 none yet
+static SENSORD_STATE state_snapshot[2];
+static int state_snapshot_idx = -1;
+/// boot this HAL runs in, empty when it could not be read
+static char state_boot_id[SENSORD_STATE_BOOT_ID_LEN];
+static int64_t state_saved_tm = 0;
+/// orientation filter behind the fused handles, runs only while one of them is active
+static SENSORD_FUSION fusion;
+static uint8_t fusion_running = 0;
+static SENSORD_FUSION_OUT fusion_out[SAMPLE_RING_CAPACITY];
+/// acc brought onto the gyro rate for the filter, e.g. 1600 Hz next to a 2000 Hz gyro
+static SENSORD_RESAMPLER fusion_acc_rs;
+static uint32_t fusion_acc_rs_in_mHz = 0;
+static uint32_t fusion_acc_rs_out_mHz = 0;
+static int32_t fusion_acc_raw[3 * SAMPLE_RING_CAPACITY];
+static float fusion_acc_si[3 * SAMPLE_RING_CAPACITY];
+static int64_t fusion_acc_tm[SAMPLE_RING_CAPACITY];
+/// fused outputs skipped since last event, per consumer
+static uint32_t fusion_phase[SENSORD_ARBITER_CONSUMER_NUM];
+/// step pipeline, on its own decimated acc while a step handle is active
+static SENSORD_STEP step;
+static SENSORD_DECIMATOR step_decimator;
+static uint8_t step_running = 0;
+static float step_acc[3 * SAMPLE_RING_CAPACITY];
+static int64_t step_acc_tm[SAMPLE_RING_CAPACITY];
+static int64_t step_tm[SAMPLE_RING_CAPACITY];
+/// counter value, kept in the state file. Reported is what the counter handle saw last, -1 none
+static uint64_t step_count = 0;
+static int64_t step_count_reported = -1;
 
 /**
- * generate an align indication array @param p_align_ind XX XX XX XX... with length @param p_len
- * if @param p_align_ind [i] & HAS_ACC/HAS_MAG/HAS_GYR, then a acc/mag/gyro should be delivered
- * to libary at that postion.
+ * @param p_cal correction applied in the same pass, NULL for none
  */
-static void sort_input_samples(int8_t **pp_align_ind, uint32_t *p_len,
-        HW_DATA_UNION **pp_ACC_hwdata, uint32_t ACC_hwdata_len,
-        HW_DATA_UNION **pp_MAG_hwdata, uint32_t MAG_hwdata_len,
-        HW_DATA_UNION **pp_GYRO_hwdata, uint32_t GYRO_hwdata_len)
+static void convert_raw(const int32_t *p_raw, float *p_si, uint32_t len, float scale,
+        const SENSORD_ACCCAL *p_cal)
 {
-    int64_t cur_base_tm = 0;
-    int acc_cur_index = 0;
-    int mag_cur_index = 0;
-    int gyr_cur_index = 0;
-    int pos = 0;
+    float scale_xyz[3];
 
-    if(0 == ACC_hwdata_len + MAG_hwdata_len + GYRO_hwdata_len)
+    if (NULL == p_cal)
     {
-        *p_len = 0;
+        sensord_convert_xyz(p_raw, p_si, len, scale);
         return;
     }
 
-    (*pp_align_ind) = (int8_t *)calloc(ACC_hwdata_len + MAG_hwdata_len + GYRO_hwdata_len, 1);
-    if(NULL == (*pp_align_ind))
+    scale_xyz[0] = scale * p_cal->gain[0];
+    scale_xyz[1] = scale * p_cal->gain[1];
+    scale_xyz[2] = scale * p_cal->gain[2];
+    sensord_convert_xyz_affine(p_raw, p_si, len, scale_xyz, p_cal->offset);
+}
+
+/**
+ * pack xyz of @param pp_hwdata into int32 triples at @param p_raw and timestamps at @param p_tm,
+ * remap the block to device axes, then convert it to SI units at @param p_si in one pass
+ * @param p_cal correction applied in the same pass, NULL for none
+ */
+static void convert_hwdata(HW_DATA_UNION **pp_hwdata, uint32_t hwdata_len,
+        int32_t *p_raw, float *p_si, int64_t *p_tm, const AXIS_REMAP *p_remap, float scale,
+        const SENSORD_ACCCAL *p_cal)
+{
+    uint32_t i;
+
+    for (i = 0; i < hwdata_len; ++i)
     {
-        *p_len = 0;
-        PERR("calloc fail");
-        return;
+        p_raw[3 * i] = (int32_t)pp_hwdata[i]->x;
+        p_raw[3 * i + 1] = (int32_t)pp_hwdata[i]->y;
+        p_raw[3 * i + 2] = (int32_t)pp_hwdata[i]->z;
+        p_tm[i] = pp_hwdata[i]->timestamp;
     }
 
-    while(ACC_hwdata_len + MAG_hwdata_len + GYRO_hwdata_len)
+    axis_remap_xyz(p_remap, p_raw, hwdata_len);
+
+    convert_raw(p_raw, p_si, hwdata_len, scale, p_cal);
+}
+
+/**
+ * emit one sample of physical sensor @param input_id to each handle it feeds,
+ * through the consumer's decimator when it wants a lower rate than the sensor runs at
+ * @param p_raw remapped raw xyz, @param p_si the same in SI units
+ */
+static void deliver_consumer_events(BoschSensor *boschsensor, uint32_t input_id,
+        const int32_t *p_raw, const float *p_si, int64_t timestamp, float scale)
+{
+    uint32_t i;
+    uint32_t con_input_id;
+    uint32_t factor;
+    int32_t bsx_list_inx;
+    const struct sensor_t *p_sensor;
+    sensors_event_t *p_event;
+    float xyz[3];
+    int64_t tm;
+
+    for (i = 0; i < SENSORD_ARBITER_RAW_CONSUMER_NUM; ++i)
     {
-        /** firstly find out the current tm base as the alignment standard*/
-        cur_base_tm = 0;
+        bsx_list_inx = sensord_arbiter_consumer(i, &con_input_id);
+        if (con_input_id != input_id)
+        {
+            continue;
+        }
 
-        if(GYRO_hwdata_len){
-            cur_base_tm = pp_GYRO_hwdata[gyr_cur_index]->timestamp;
+        factor = sensord_arbiter_get_factor(i);
+        if (factor != consumer_decimator[i].factor)
+        {
+            sensord_decimate_init(&consumer_decimator[i], factor);
         }
 
-        if(ACC_hwdata_len)
+        if (1 == factor)
         {
-            if(cur_base_tm)
-            {
-                if(pp_ACC_hwdata[acc_cur_index]->timestamp < cur_base_tm){
-                    cur_base_tm = pp_ACC_hwdata[acc_cur_index]->timestamp;
-                }
-            }else{
-                cur_base_tm = pp_ACC_hwdata[acc_cur_index]->timestamp;
-            }
+            xyz[0] = p_si[0];
+            xyz[1] = p_si[1];
+            xyz[2] = p_si[2];
+            tm = timestamp;
         }
+        else if (0 == sensord_decimate_xyz(&consumer_decimator[i], p_raw, timestamp, scale, xyz, &tm))
+        {
+            continue;
+        }
+        else if (BSX_INPUT_ID_ACCELERATION == input_id)
+        {
+            /*decimator has unit DC gain, the correction goes on its output as it would on each input*/
+            xyz[0] = xyz[0] * acccal.gain[0] + acccal.offset[0];
+            xyz[1] = xyz[1] * acccal.gain[1] + acccal.offset[1];
+            xyz[2] = xyz[2] * acccal.gain[2] + acccal.offset[2];
+        }
+
+        p_sensor = &bosch_all_sensors[bsx_list_inx];
+        p_event = boschsensor->sensord_event_slot();
+        p_event->version = sizeof(sensors_event_t);
+        p_event->timestamp = tm;
+        p_event->sensor = p_sensor->handle;
+        p_event->type = p_sensor->type;
 
-        if(MAG_hwdata_len)
+        if (BSX_INPUT_ID_ACCELERATION == input_id)
         {
-            if(cur_base_tm)
-            {
-                if(pp_MAG_hwdata[mag_cur_index]->timestamp < cur_base_tm){
-                    cur_base_tm = pp_MAG_hwdata[mag_cur_index]->timestamp;
-                }
-            }else{
-                cur_base_tm = pp_MAG_hwdata[mag_cur_index]->timestamp;
-            }
+            p_event->acceleration.x = xyz[0];
+            p_event->acceleration.y = xyz[1];
+            p_event->acceleration.z = xyz[2];
+            p_event->acceleration.status = 0;
+        }
+        else if (SENSOR_TYPE_GYROSCOPE == p_sensor->type)
+        {
+            p_event->gyro.x = xyz[0] - gyrocal.bias[0];
+            p_event->gyro.y = xyz[1] - gyrocal.bias[1];
+            p_event->gyro.z = xyz[2] - gyrocal.bias[2];
+            /*no still window seen yet, bias is still the zero guess*/
+            p_event->gyro.status = gyrocal.updates ? SENSOR_STATUS_ACCURACY_HIGH : SENSOR_STATUS_UNRELIABLE;
         }
+        else
+        {
+            p_event->uncalibrated_gyro.x_uncalib = xyz[0];
+            p_event->uncalibrated_gyro.y_uncalib = xyz[1];
+            p_event->uncalibrated_gyro.z_uncalib = xyz[2];
+            p_event->uncalibrated_gyro.x_bias = gyrocal.bias[0];
+            p_event->uncalibrated_gyro.y_bias = gyrocal.bias[1];
+            p_event->uncalibrated_gyro.z_bias = gyrocal.bias[2];
+        }
+
+        boschsensor->sensord_deliver_event(p_event);
+    }
+}
 
-        /**Then the raw data can be aligned according to the currect tm base*/
-        if(ACC_hwdata_len)
+/**
+ * emit fused outputs to every active fused handle. The handle's gyro feed paces it,
+ * every factor-th output goes out when it wants a lower rate than gyro runs at
+ */
+static void deliver_fusion_events(BoschSensor *boschsensor, const SENSORD_FUSION_OUT *p_out, uint32_t out_len)
+{
+    uint32_t i;
+    uint32_t k;
+    uint32_t input_id;
+    uint32_t factor;
+    int32_t bsx_list_inx;
+    const struct sensor_t *p_sensor;
+    sensors_event_t *p_event;
+
+    for (i = SENSORD_ARBITER_RAW_CONSUMER_NUM; i < SENSORD_ARBITER_STEP_CONSUMER_BASE; ++i)
+    {
+        /*with data sync the gyro feed is taken from acc, so go by position*/
+        if (0 == SENSORD_ARBITER_IS_FUSED_GYRO_FEED(i) || 0 == sensord_arbiter_is_active(i))
         {
-            if(pp_ACC_hwdata[acc_cur_index]->timestamp == cur_base_tm)
-            {
-                (*pp_align_ind)[pos] |= HAS_ACC;
-                acc_cur_index++;
-                ACC_hwdata_len--;
-            }
+            continue;
         }
 
-        if(MAG_hwdata_len)
+        bsx_list_inx = sensord_arbiter_consumer(i, &input_id);
+        factor = sensord_arbiter_get_factor(i);
+        p_sensor = &bosch_all_sensors[bsx_list_inx];
+
+        for (k = 0; k < out_len; ++k)
         {
-            if(pp_MAG_hwdata[mag_cur_index]->timestamp == cur_base_tm)
+            if (++fusion_phase[i] < factor)
             {
-                (*pp_align_ind)[pos] |= HAS_MAG;
-                mag_cur_index++;
-                MAG_hwdata_len--;
+                continue;
             }
-        }
+            fusion_phase[i] = 0;
 
-        if(GYRO_hwdata_len)
-        {
-            if(pp_GYRO_hwdata[gyr_cur_index]->timestamp == cur_base_tm)
+            p_event = boschsensor->sensord_event_slot();
+            p_event->version = sizeof(sensors_event_t);
+            p_event->timestamp = p_out[k].timestamp;
+            p_event->sensor = p_sensor->handle;
+            p_event->type = p_sensor->type;
+
+            switch (p_sensor->type)
             {
-                (*pp_align_ind)[pos] |= HAS_GYR;
-                gyr_cur_index++;
-                GYRO_hwdata_len--;
+                case SENSOR_TYPE_GAME_ROTATION_VECTOR:
+                    p_event->data[0] = p_out[k].rv[0];
+                    p_event->data[1] = p_out[k].rv[1];
+                    p_event->data[2] = p_out[k].rv[2];
+                    p_event->data[3] = p_out[k].rv[3];
+                    p_event->data[4] = 0;
+                    break;
+                case SENSOR_TYPE_GRAVITY:
+                    p_event->acceleration.x = p_out[k].gravity[0];
+                    p_event->acceleration.y = p_out[k].gravity[1];
+                    p_event->acceleration.z = p_out[k].gravity[2];
+                    p_event->acceleration.status = 0;
+                    break;
+                default:
+                    p_event->acceleration.x = p_out[k].linear[0];
+                    p_event->acceleration.y = p_out[k].linear[1];
+                    p_event->acceleration.z = p_out[k].linear[2];
+                    p_event->acceleration.status = 0;
+                    break;
             }
+
+            boschsensor->sensord_deliver_event(p_event);
         }
+    }
+}
+
+/**
+ * put the acc block on the gyro timebase, linear interpolation at the gyro rate
+ * @return acc samples for the filter, at *pp_si and *pp_tm
+ */
+static uint32_t fusion_acc_feed(uint32_t ACC_hwdata_len, float acc_scale, const float **pp_si, const int64_t **pp_tm)
+{
+    uint32_t in_mHz = (uint32_t)(sensord_arbiter_get_phy_rate(BSX_INPUT_ID_ACCELERATION) * 1000.0f + 0.5f);
+    uint32_t out_mHz = (uint32_t)(sensord_arbiter_get_phy_rate(BSX_INPUT_ID_ANGULARRATE) * 1000.0f + 0.5f);
+    uint32_t len;
 
-        pos++;
+    *pp_si = ACC_si_xyz;
+    *pp_tm = ACC_tm;
+
+    /*same rate, or acc and gyro come from the same data sync frames*/
+    if (0 == in_mHz || 0 == out_mHz || in_mHz == out_mHz)
+    {
+        fusion_acc_rs_in_mHz = 0;
+        return ACC_hwdata_len;
     }
 
-    *p_len = pos;
+    if (in_mHz != fusion_acc_rs_in_mHz || out_mHz != fusion_acc_rs_out_mHz)
+    {
+        if (sensord_resample_init(&fusion_acc_rs, in_mHz, out_mHz))
+        {
+            fusion_acc_rs_in_mHz = 0;
+            return ACC_hwdata_len;
+        }
+        fusion_acc_rs_in_mHz = in_mHz;
+        fusion_acc_rs_out_mHz = out_mHz;
+        PINFO("fusion acc resampled %u -> %u mHz", in_mHz, out_mHz);
+    }
 
-    return;
+    len = sensord_resample_xyz(&fusion_acc_rs, ACC_raw_xyz, ACC_tm, ACC_hwdata_len,
+            fusion_acc_raw, fusion_acc_tm, SAMPLE_RING_CAPACITY);
+    convert_raw(fusion_acc_raw, fusion_acc_si, len, acc_scale, &acccal);
+
+    *pp_si = fusion_acc_si;
+    *pp_tm = fusion_acc_tm;
+
+    return len;
 }
 
 /**
- * free thoroughly the hwdata
+ * run the drained acc/gyro blocks through the orientation filter in one call
  */
-static void distory_hwdata(HW_DATA_UNION **pp_hwdata, uint32_t hwdata_len)
+static void sensord_fusion_process(BoschSensor *boschsensor, uint32_t ACC_hwdata_len, uint32_t GYRO_hwdata_len,
+        float acc_scale)
 {
     uint32_t i;
+    int active = 0;
+    uint32_t out_len;
+    uint32_t acc_len;
+    const float *p_acc_si;
+    const int64_t *p_acc_tm;
 
-    if(NULL == pp_hwdata)
+    for (i = SENSORD_ARBITER_RAW_CONSUMER_NUM; i < SENSORD_ARBITER_STEP_CONSUMER_BASE; ++i)
     {
+        active |= sensord_arbiter_is_active(i);
+    }
+
+    if (0 == active)
+    {
+        if (fusion_running)
+        {
+            /*next activation starts over from gravity*/
+            sensord_fusion_reset(&fusion);
+            fusion_running = 0;
+        }
         return;
     }
 
-    for (i = 0; i < hwdata_len; ++i) {
-        free(pp_hwdata[i]);
+    if (0 == fusion_running)
+    {
+        sensord_fusion_reset(&fusion);
+        memset(fusion_phase, 0, sizeof(fusion_phase));
+        /*carry of an earlier run is stale*/
+        fusion_acc_rs_in_mHz = 0;
+        fusion_running = 1;
     }
 
-    free(pp_hwdata);
+    acc_len = fusion_acc_feed(ACC_hwdata_len, acc_scale, &p_acc_si, &p_acc_tm);
+
+    memcpy(fusion.gyr_bias, gyrocal.bias, sizeof(fusion.gyr_bias));
+    out_len = sensord_fusion_run(&fusion, p_acc_si, p_acc_tm, acc_len,
+            GYRO_si_xyz, GYRO_tm, GYRO_hwdata_len, fusion_out);
+
+    deliver_fusion_events(boschsensor, fusion_out, out_len);
 }
 
+static void deliver_step_event(BoschSensor *boschsensor, int32_t bsx_list_inx, int64_t timestamp)
+{
+    const struct sensor_t *p_sensor = &bosch_all_sensors[bsx_list_inx];
+    sensors_event_t *p_event;
 
-void sensord_algo_process(BoschSensor *boschsensor)
+    p_event = boschsensor->sensord_event_slot();
+    p_event->version = sizeof(sensors_event_t);
+    p_event->timestamp = timestamp;
+    p_event->sensor = p_sensor->handle;
+    p_event->type = p_sensor->type;
+
+    if (SENSOR_TYPE_STEP_COUNTER == p_sensor->type)
+    {
+        p_event->u64.step_counter = step_count;
+    }
+    else
+    {
+        p_event->data[0] = 1.0f;
+    }
+
+    boschsensor->sensord_deliver_event(p_event);
+}
+
+/**
+ * decimate the acc block down to the step handles' rate and run step detection on it.
+ * Detector reports each step, counter reports on change and once right after it is enabled
+ */
+static void sensord_step_process(BoschSensor *boschsensor, uint32_t ACC_hwdata_len, float acc_scale)
 {
     uint32_t i;
-    uint32_t j;
-    HW_DATA_UNION **pp_ACC_hwdata = NULL;
-    uint32_t ACC_hwdata_len = 0;
-    HW_DATA_UNION **pp_MAG_hwdata = NULL;
-    uint32_t MAG_hwdata_len = 0;
-    HW_DATA_UNION **pp_GYRO_hwdata = NULL;
-    uint32_t GYRO_hwdata_len = 0;
-    int8_t *p_align_ind = NULL;
-    uint32_t align_ind_len;
-    int32_t ACC_hwdata_index;
-    int32_t MAG_hwdata_index;
-    int32_t GYRO_hwdata_index;
-
-    char data_log_buf[256] = { 0 };
-    uint32_t acc_has_input = 0;
-    uint32_t mag_has_input = 0;
-    uint32_t gyr_has_input = 0;
-    uint32_t input_package_index = 0;
-    sensors_event_t *p_event = NULL;
-    BSX_DATALOG_BUF acc_log_data;
-    BSX_DATALOG_BUF gyr_log_data;
-    BSX_DATALOG_BUF mag_log_data;
+    uint32_t len = 0;
+    uint32_t steps;
+    uint32_t factor;
+    uint32_t input_id;
+    uint32_t det_inx = SENSORD_ARBITER_STEP_CONSUMER_BASE;
+    uint32_t cnt_inx = SENSORD_ARBITER_STEP_CONSUMER_BASE + 1;
+    int det_active = sensord_arbiter_is_active(det_inx);
+    int cnt_active = sensord_arbiter_is_active(cnt_inx);
+    float *p_out;
+
+    if (0 == cnt_active)
+    {
+        step_count_reported = -1;
+    }
 
-    if(0 == boschsensor->tmplist_sensord_acclraw->list_len +
-            boschsensor->tmplist_sensord_gyroraw->list_len +
-            boschsensor->tmplist_sensord_magnraw->list_len)
+    if (0 == det_active && 0 == cnt_active)
     {
+        if (step_running)
+        {
+            sensord_step_reset(&step);
+            step_running = 0;
+        }
         return;
     }
 
-    /**
-     * Step 1 save the hardware data and generate align indication array
-     */
-    if(boschsensor->tmplist_sensord_acclraw->list_len)
+    factor = sensord_arbiter_get_factor(det_active ? det_inx : cnt_inx);
+    if (0 == step_running || factor != step_decimator.factor)
     {
-        pp_ACC_hwdata = (HW_DATA_UNION **)malloc(boschsensor->tmplist_sensord_acclraw->list_len * sizeof(HW_DATA_UNION *));
-        if(NULL == pp_ACC_hwdata)
+        sensord_decimate_init(&step_decimator, factor);
+        step_running = 1;
+    }
+
+    for (i = 0; i < ACC_hwdata_len; ++i)
+    {
+        p_out = &step_acc[3 * len];
+        if (sensord_decimate_xyz(&step_decimator, &ACC_raw_xyz[3 * i], ACC_tm[i], acc_scale,
+                p_out, &step_acc_tm[len]))
         {
-            PWARN("malloc fail");
-            return;
+            p_out[0] = p_out[0] * acccal.gain[0] + acccal.offset[0];
+            p_out[1] = p_out[1] * acccal.gain[1] + acccal.offset[1];
+            p_out[2] = p_out[2] * acccal.gain[2] + acccal.offset[2];
+            len++;
         }
+    }
+
+    steps = sensord_step_run(&step, step_acc, step_acc_tm, len, step_tm, SAMPLE_RING_CAPACITY);
 
-        ACC_hwdata_len = boschsensor->tmplist_sensord_acclraw->list_len;
-        for (i = 0; i < ACC_hwdata_len; ++i) {
-            boschsensor->tmplist_sensord_acclraw->list_get_headdata((void **) &(pp_ACC_hwdata[i]));
+    if (det_active)
+    {
+        for (i = 0; i < steps; ++i)
+        {
+            deliver_step_event(boschsensor, sensord_arbiter_consumer(det_inx, &input_id), step_tm[i]);
         }
     }
 
-    if(boschsensor->tmplist_sensord_magnraw->list_len)
+    if (cnt_active)
     {
-        pp_MAG_hwdata = (HW_DATA_UNION **)malloc(boschsensor->tmplist_sensord_magnraw->list_len * sizeof(HW_DATA_UNION *));
-        if(NULL == pp_MAG_hwdata)
+        step_count += steps;
+        if (steps)
+        {
+            deliver_step_event(boschsensor, sensord_arbiter_consumer(cnt_inx, &input_id), step_tm[steps - 1]);
+        }
+        else if (step_count_reported < 0 && len)
+        {
+            /*just enabled, the framework wants the current value*/
+            deliver_step_event(boschsensor, sensord_arbiter_consumer(cnt_inx, &input_id), step_acc_tm[len - 1]);
+        }
+        else
         {
-            PWARN("malloc fail");
-            distory_hwdata(pp_ACC_hwdata, ACC_hwdata_len);
             return;
         }
+        step_count_reported = (int64_t)step_count;
+    }
+}
 
-        MAG_hwdata_len = boschsensor->tmplist_sensord_magnraw->list_len;
-        for (i = 0; i < MAG_hwdata_len; ++i) {
-            boschsensor->tmplist_sensord_magnraw->list_get_headdata((void **) &(pp_MAG_hwdata[i]));
-        }
+/**
+ * queue an acc calibration command for sensord thread, it runs before the next burst is converted
+ * @param cmd SENSORD_ACCCAL_CMD_*
+ * @return 0 on success, -EINVAL unknown command, -EBUSY queue full
+ */
+int sensord_algo_acc_cal_command(int cmd)
+{
+    if (cmd < SENSORD_ACCCAL_CMD_ABORT || cmd > SENSORD_ACCCAL_CMD_CLEAR)
+    {
+        PERR("unknown acc cal command %d", cmd);
+        return -EINVAL;
     }
 
-    if(boschsensor->tmplist_sensord_gyroraw->list_len)
+    pthread_mutex_lock(&acccal_cmd_mutex);
+
+    if (acccal_cmd_tail - acccal_cmd_head >= ACCCAL_CMD_QUEUE_LEN)
     {
-        pp_GYRO_hwdata = (HW_DATA_UNION **)malloc(boschsensor->tmplist_sensord_gyroraw->list_len * sizeof(HW_DATA_UNION *));
-        if(NULL == pp_GYRO_hwdata)
+        pthread_mutex_unlock(&acccal_cmd_mutex);
+        PWARN("acc cal command %d dropped, %u still queued", cmd, ACCCAL_CMD_QUEUE_LEN);
+        return -EBUSY;
+    }
+
+    acccal_cmd_queue[acccal_cmd_tail % ACCCAL_CMD_QUEUE_LEN] = cmd;
+    __atomic_store_n(&acccal_cmd_tail, acccal_cmd_tail + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&acccal_cmd_mutex);
+
+    return 0;
+}
+
+/**
+ * queue the commands of a control text, words "abort", "faces", "clear" or their numbers
+ * @param p_text not 0 terminated
+ * @param len
+ * @return number of commands queued, or the error of the first word that was not
+ */
+int sensord_algo_acc_cal_text(const char *p_text, int32_t len)
+{
+    int32_t pos = 0;
+    int queued = 0;
+    int cmd;
+    int ret;
+
+    while (sensord_acccal_next_word(p_text, len, &pos, &cmd))
+    {
+        if (cmd < 0)
         {
-            PWARN("malloc fail");
-            distory_hwdata(pp_ACC_hwdata, ACC_hwdata_len);
-            distory_hwdata(pp_MAG_hwdata, MAG_hwdata_len);
-            return;
+            return queued ? queued : -EINVAL;
         }
 
-        GYRO_hwdata_len = boschsensor->tmplist_sensord_gyroraw->list_len;
-        for (i = 0; i < GYRO_hwdata_len; ++i) {
-            boschsensor->tmplist_sensord_gyroraw->list_get_headdata((void **) &(pp_GYRO_hwdata[i]));
+        ret = sensord_algo_acc_cal_command(cmd);
+        if (ret)
+        {
+            return queued ? queued : ret;
         }
+        queued++;
     }
 
-    //PDEBUG("Acc len: %u, Gyro len: %u, Mag len: %u", simple_listAccl->list_len, simple_listGyro->list_len, simple_listMagn->list_len);
+    return queued;
+}
 
-    sort_input_samples(&p_align_ind, &align_ind_len,
-            pp_ACC_hwdata, ACC_hwdata_len,
-            pp_MAG_hwdata, MAG_hwdata_len,
-            pp_GYRO_hwdata, GYRO_hwdata_len);
-    if(NULL == p_align_ind)
+/**
+ * state file content for the calibration as it is now
+ */
+static void state_fill(SENSORD_STATE *p_state)
+{
+    memset(p_state, 0, sizeof(*p_state));
+    memcpy(p_state->gyr_bias, gyrocal.bias, sizeof(p_state->gyr_bias));
+    p_state->gyr_updates = gyrocal.updates;
+    memcpy(p_state->acc_gain, acccal.gain, sizeof(p_state->acc_gain));
+    memcpy(p_state->acc_offset, acccal.offset, sizeof(p_state->acc_offset));
+    p_state->acc_per_axis = acccal.per_axis;
+    p_state->step_count = step_count;
+    memcpy(p_state->boot_id, state_boot_id, sizeof(p_state->boot_id));
+}
+
+/**
+ * write @param p_state out unless the file already holds it
+ */
+static void state_write(const SENSORD_STATE *p_state)
+{
+    int ret;
+
+    if (0 == memcmp(p_state, &state_saved, sizeof(state_saved)))
+    {
+        return;
+    }
+
+    ret = sensord_state_save(SENSORD_STATE_FILE, p_state);
+    if (ret)
+    {
+        PWARN("save state file %s fail, ret = %d", SENSORD_STATE_FILE, ret);
+        return;
+    }
+
+    state_saved = *p_state;
+}
+
+/**
+ * end of a sensord pass, fill the slot not published and publish it if anything changed
+ */
+static void state_publish(void)
+{
+    int idx = state_snapshot_idx;
+    SENSORD_STATE *p_next = &state_snapshot[(idx < 0) ? 0 : 1 - idx];
+
+    state_fill(p_next);
+    if (idx >= 0 && 0 == memcmp(p_next, &state_snapshot[idx], sizeof(*p_next)))
+    {
+        return;
+    }
+
+    __atomic_store_n(&state_snapshot_idx, (int)(p_next - state_snapshot), __ATOMIC_RELEASE);
+}
+
+/**
+ * sensord thread, runs every queued command in the order posted
+ */
+static void sensord_calib_command(void)
+{
+    int cmd[ACCCAL_CMD_QUEUE_LEN];
+    uint32_t n = 0;
+    uint32_t i;
+
+    if (__atomic_load_n(&acccal_cmd_tail, __ATOMIC_ACQUIRE) == acccal_cmd_head)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&acccal_cmd_mutex);
+    while (acccal_cmd_head != acccal_cmd_tail)
+    {
+        cmd[n++] = acccal_cmd_queue[acccal_cmd_head % ACCCAL_CMD_QUEUE_LEN];
+        acccal_cmd_head++;
+    }
+    pthread_mutex_unlock(&acccal_cmd_mutex);
+
+    for (i = 0; i < n; ++i)
+    {
+        PINFO("acc cal command %d", cmd[i]);
+        sensord_acccal_command(&acccal, cmd[i]);
+    }
+}
+
+/**
+ * run both calibrations over the burst just converted, and save their state now and then
+ */
+static void sensord_calib_process(uint32_t ACC_hwdata_len, uint32_t GYRO_hwdata_len)
+{
+    SENSORD_STATE state;
+    float raw_mean[3];
+    int64_t tm;
+
+    if (0 == ACC_hwdata_len + GYRO_hwdata_len)
+    {
+        return;
+    }
+
+    sensord_gyrocal_run(&gyrocal, ACC_si_xyz, ACC_tm, ACC_hwdata_len,
+            GYRO_si_xyz, GYRO_tm, GYRO_hwdata_len);
+
+    /*still acc windows are found by gyrocal, acccal wants them without the correction*/
+    if (gyrocal.acc_still_tm && gyrocal.acc_still_tm != acccal_seen_tm)
+    {
+        acccal_seen_tm = gyrocal.acc_still_tm;
+        raw_mean[0] = (gyrocal.acc_still_mean[0] - acccal.offset[0]) / acccal.gain[0];
+        raw_mean[1] = (gyrocal.acc_still_mean[1] - acccal.offset[1]) / acccal.gain[1];
+        raw_mean[2] = (gyrocal.acc_still_mean[2] - acccal.offset[2]) / acccal.gain[2];
+        sensord_acccal_feed(&acccal, raw_mean);
+    }
+
+    tm = GYRO_hwdata_len ? GYRO_tm[GYRO_hwdata_len - 1] : ACC_tm[ACC_hwdata_len - 1];
+    if (0 == state_saved_tm)
+    {
+        state_saved_tm = tm;
+    }
+    else if (tm - state_saved_tm >= STATE_SAVE_INTERVAL_NS)
+    {
+        state_saved_tm = tm;
+        state_fill(&state);
+        state_write(&state);
+    }
+}
+
+/**
+ * take the calibration of the last run, called before sensord thread starts
+ */
+void sensord_algo_load_state(void)
+{
+    SENSORD_STATE state;
+    int ret;
+
+    sensord_acccal_reset(&acccal);
+
+    ret = sensord_state_boot_id(SENSORD_STATE_BOOT_ID_PATH, state_boot_id);
+    if (ret)
+    {
+        PWARN("read %s fail, ret = %d, step count kept whatever boot it is from", SENSORD_STATE_BOOT_ID_PATH, ret);
+    }
+
+    /*what a file of an older version does not carry stays at no correction*/
+    memset(&state, 0, sizeof(state));
+    state.acc_gain[0] = state.acc_gain[1] = state.acc_gain[2] = 1.0f;
+    ret = sensord_state_load(SENSORD_STATE_FILE, &state);
+    if (ret)
+    {
+        if (-ENOENT != ret)
+        {
+            PWARN("drop state file %s, ret = %d", SENSORD_STATE_FILE, ret);
+        }
+        return;
+    }
+
+    state_saved = state;
+    memcpy(gyrocal.bias, state.gyr_bias, sizeof(gyrocal.bias));
+    gyrocal.updates = state.gyr_updates;
+    memcpy(acccal.gain, state.acc_gain, sizeof(acccal.gain));
+    memcpy(acccal.offset, state.acc_offset, sizeof(acccal.offset));
+    acccal.per_axis = state.acc_per_axis ? 1 : 0;
+    step_count = state.step_count;
+    /*the counter counts since reboot, an older file has no count to keep*/
+    if (state_boot_id[0] && strncmp(state.boot_id, state_boot_id, SENSORD_STATE_BOOT_ID_LEN))
+    {
+        PINFO("state file from an earlier boot, step count %llu starts over",
+                (unsigned long long)step_count);
+        step_count = 0;
+    }
+
+    PINFO("restored gyro bias %f, %f, %f from %u still windows",
+            gyrocal.bias[0], gyrocal.bias[1], gyrocal.bias[2], gyrocal.updates);
+    PINFO("restored acc gain %f, %f, %f, offset %f, %f, %f",
+            acccal.gain[0], acccal.gain[1], acccal.gain[2],
+            acccal.offset[0], acccal.offset[1], acccal.offset[2]);
+    PINFO("restored step count %llu", (unsigned long long)step_count);
+}
+
+/**
+ * take the destroy time save from the last whole pass, called once sensord thread is joined.
+ * The kill lands anywhere in a pass, the live calibration may be half updated by then
+ */
+void sensord_algo_save_state(void)
+{
+    int idx;
+
+    idx = __atomic_load_n(&state_snapshot_idx, __ATOMIC_ACQUIRE);
+    if (idx < 0)
+    {
+        return;
+    }
+
+    state_write(&state_snapshot[idx]);
+}
+
+/**
+ * give the hwdata back to sample pool, the pointer array itself is static
+ */
+static void distory_hwdata(BoschSamplePool *pool, HW_DATA_UNION **pp_hwdata, uint32_t hwdata_len)
+{
+    uint32_t i;
+
+    if(NULL == pp_hwdata)
     {
-        PWARN("sort_input_samples fail");
-        distory_hwdata(pp_ACC_hwdata, ACC_hwdata_len);
-        distory_hwdata(pp_MAG_hwdata, MAG_hwdata_len);
-        distory_hwdata(pp_GYRO_hwdata, GYRO_hwdata_len);
         return;
     }
 
+    for (i = 0; i < hwdata_len; ++i) {
+        pool->release(pp_hwdata[i]);
+    }
+}
+
+
+void sensord_algo_process(BoschSensor *boschsensor)
+{
+    uint32_t j;
+    HW_DATA_UNION **pp_ACC_hwdata = NULL;
+    uint32_t ACC_hwdata_len = 0;
+    HW_DATA_UNION **pp_MAG_hwdata = NULL;
+    uint32_t MAG_hwdata_len = 0;
+    HW_DATA_UNION **pp_GYRO_hwdata = NULL;
+    uint32_t GYRO_hwdata_len = 0;
+    SAMPLE_MERGE_ITER merge_iter;
+    HW_DATA_UNION *merge_out[MERGE_STREAM_NUM];
+    int8_t align_mask;
+    uint32_t ACC_hwdata_index = 0;
+    uint32_t GYRO_hwdata_index = 0;
+    const int32_t *p_acc_raw = NULL;
+    const float *p_acc_si = NULL;
+    const int32_t *p_gyr_raw = NULL;
+    const float *p_gyr_si = NULL;
+    float acc_scale;
+    float gyr_scale;
+
+    char data_log_buf[256] = { 0 };
+    uint32_t acc_has_input = 0;
+    uint32_t mag_has_input = 0;
+    uint32_t gyr_has_input = 0;
+    uint32_t input_package_index = 0;
+    sensors_event_t *p_event = NULL;
+    BSX_DATALOG_BUF acc_log_data;
+    BSX_DATALOG_BUF gyr_log_data;
+    BSX_DATALOG_BUF mag_log_data;
+
     /**
-     * Step 2 deliver hardware data to library according to align indication array
+     * Step 1 drain the rings
      */
-    ACC_hwdata_index = 0;
-    MAG_hwdata_index = 0;
-    GYRO_hwdata_index = 0;
+    pp_ACC_hwdata = ACC_hwdata_buf;
+    ACC_hwdata_len = boschsensor->ring_acclraw->pop_bulk(pp_ACC_hwdata, SAMPLE_RING_CAPACITY);
+    pp_MAG_hwdata = MAG_hwdata_buf;
+    MAG_hwdata_len = boschsensor->ring_magnraw->pop_bulk(pp_MAG_hwdata, SAMPLE_RING_CAPACITY);
+    pp_GYRO_hwdata = GYRO_hwdata_buf;
+    GYRO_hwdata_len = boschsensor->ring_gyroraw->pop_bulk(pp_GYRO_hwdata, SAMPLE_RING_CAPACITY);
+
+    if(0 == ACC_hwdata_len + MAG_hwdata_len + GYRO_hwdata_len)
+    {
+        /*woken by batch deadline only*/
+        boschsensor->sensord_flush_events();
+        return;
+    }
+
+    //PDEBUG("Acc len: %u, Gyro len: %u, Mag len: %u", simple_listAccl->list_len, simple_listGyro->list_len, simple_listMagn->list_len);
+
+    /*in data sync mode both blocks hold the acc/gyro halves of the same frames*/
+    acc_scale = sensord_convert_get_acc_scale();
+    gyr_scale = sensord_convert_get_gyro_scale();
+    sensord_calib_command();
+    convert_hwdata(pp_ACC_hwdata, ACC_hwdata_len, ACC_raw_xyz, ACC_si_xyz, ACC_tm,
+            &g_remap_a, acc_scale, &acccal);
+    convert_hwdata(pp_GYRO_hwdata, GYRO_hwdata_len, GYRO_raw_xyz, GYRO_si_xyz, GYRO_tm,
+            &g_remap_g, gyr_scale, NULL);
+
+    /*calibration first, so this burst already goes out with the gyro bias*/
+    sensord_calib_process(ACC_hwdata_len, GYRO_hwdata_len);
+
+    merge_iter_init(&merge_iter,
+            pp_ACC_hwdata, ACC_hwdata_len,
+            pp_MAG_hwdata, MAG_hwdata_len,
+            pp_GYRO_hwdata, GYRO_hwdata_len,
+            (int64_t)align_tolerance_us * 1000);
 
-    for (i = 0; i < align_ind_len; ++i)
+    /**
+     * Step 2 deliver hardware data to library in merged time order
+     */
+    while(0 != (align_mask = merge_iter_next(&merge_iter, merge_out)))
     {
         acc_has_input = 0;
         gyr_has_input = 0;
         mag_has_input = 0;
 
-        if(p_align_ind[i] & HAS_ACC)
+        if(align_mask & HAS_ACC)
         {
             acc_has_input = 1;
-            accel_sli_in_xyz[0].lw.mslw.sli = pp_ACC_hwdata[ACC_hwdata_index]->x;
-            accel_sli_in_xyz[1].lw.mslw.sli = pp_ACC_hwdata[ACC_hwdata_index]->y;
-            accel_sli_in_xyz[2].lw.mslw.sli = pp_ACC_hwdata[ACC_hwdata_index]->z;
-            accel_in_data.time_stamp = (bsx_ts_external_t) (pp_ACC_hwdata[ACC_hwdata_index]->timestamp);
-            accel_in_data.sensor_id = BSX_INPUT_ID_ACCELERATION;
+            p_acc_raw = &ACC_raw_xyz[3 * ACC_hwdata_index];
+            p_acc_si = &ACC_si_xyz[3 * ACC_hwdata_index];
             ACC_hwdata_index++;
+            accel_sli_in_xyz[0].lw.mslw.sli = p_acc_raw[0];
+            accel_sli_in_xyz[1].lw.mslw.sli = p_acc_raw[1];
+            accel_sli_in_xyz[2].lw.mslw.sli = p_acc_raw[2];
+            accel_in_data.time_stamp = (bsx_ts_external_t) (merge_out[MERGE_STREAM_ACC]->timestamp);
+            accel_in_data.sensor_id = BSX_INPUT_ID_ACCELERATION;
         }
 
-        if(p_align_ind[i] & HAS_MAG)
+        if(align_mask & HAS_MAG)
         {
             mag_has_input = 1;
-            mag_sli_in_xyz[0].lw.mslw.sli = pp_MAG_hwdata[MAG_hwdata_index]->x;
-            mag_sli_in_xyz[1].lw.mslw.sli = pp_MAG_hwdata[MAG_hwdata_index]->y;
-            mag_sli_in_xyz[2].lw.mslw.sli = pp_MAG_hwdata[MAG_hwdata_index]->z;
-            mag_in_data.time_stamp = (bsx_ts_external_t) (pp_MAG_hwdata[MAG_hwdata_index]->timestamp);
+            mag_sli_in_xyz[0].lw.mslw.sli = merge_out[MERGE_STREAM_MAG]->x;
+            mag_sli_in_xyz[1].lw.mslw.sli = merge_out[MERGE_STREAM_MAG]->y;
+            mag_sli_in_xyz[2].lw.mslw.sli = merge_out[MERGE_STREAM_MAG]->z;
+            mag_in_data.time_stamp = (bsx_ts_external_t) (merge_out[MERGE_STREAM_MAG]->timestamp);
             mag_in_data.sensor_id = BSX_INPUT_ID_MAGNETICFIELD;
-            MAG_hwdata_index++;
         }
 
-        if(p_align_ind[i] & HAS_GYR)
+        if(align_mask & HAS_GYR)
         {
             gyr_has_input = 1;
-            ang_sli_in_xyz[0].lw.mslw.sli = pp_GYRO_hwdata[GYRO_hwdata_index]->x;
-            ang_sli_in_xyz[1].lw.mslw.sli = pp_GYRO_hwdata[GYRO_hwdata_index]->y;
-            ang_sli_in_xyz[2].lw.mslw.sli = pp_GYRO_hwdata[GYRO_hwdata_index]->z;
-            ang_in_data.time_stamp = (bsx_ts_external_t) (pp_GYRO_hwdata[GYRO_hwdata_index]->timestamp);
-            ang_in_data.sensor_id = BSX_INPUT_ID_ANGULARRATE;
+            p_gyr_raw = &GYRO_raw_xyz[3 * GYRO_hwdata_index];
+            p_gyr_si = &GYRO_si_xyz[3 * GYRO_hwdata_index];
             GYRO_hwdata_index++;
+            ang_sli_in_xyz[0].lw.mslw.sli = p_gyr_raw[0];
+            ang_sli_in_xyz[1].lw.mslw.sli = p_gyr_raw[1];
+            ang_sli_in_xyz[2].lw.mslw.sli = p_gyr_raw[2];
+            ang_in_data.time_stamp = (bsx_ts_external_t) (merge_out[MERGE_STREAM_GYR]->timestamp);
+            ang_in_data.sensor_id = BSX_INPUT_ID_ANGULARRATE;
         }
 
         input_package_index = 0;
@@ -547,182 +1106,54 @@ void sensord_algo_process(BoschSensor *boschsensor)
         {
             for (j = 0; j < input_package_index; ++j)
             {
-                p_event = (sensors_event_t *) calloc(1, sizeof(sensors_event_t));
-                if (NULL == p_event)
-                {
-                    PWARN("calloc fail");
-                    continue;
-                }
-
-                p_event->version = sizeof(sensors_event_t);
-                p_event->timestamp = library_in_package[j].time_stamp;
-
                 switch(library_in_package[j].sensor_id)
                 {
                     case BSX_INPUT_ID_ACCELERATION:
-			switch(accl_range)
-			{
-				case ACC_CHIP_RANGCONF_2G:
-					convert_acc = CONVERT_ACC_2G;
-					break;
-				case ACC_CHIP_RANGCONF_4G:
-					convert_acc = CONVERT_ACC_4G;
-					break;
-				case ACC_CHIP_RANGCONF_8G:
-					convert_acc = CONVERT_ACC_8G;
-					break;
-				case ACC_CHIP_RANGCONF_16G:
-					convert_acc = CONVERT_ACC_16G;
-					break;
-				default:
-					PERR("error accel range config");
-					continue;
-			}
-#ifdef TEST_APP_ACTIVE
-			PDEBUG("ACC range %d, convert %f", accl_range, convert_acc);
-#endif
-
-                        p_event->sensor = BSX_SENSOR_ID_ACCELEROMETER;
-                        p_event->type = SENSOR_TYPE_ACCELEROMETER;
-                        p_event->acceleration.x = library_in_package[j].content_p[0].lw.mslw.sli * convert_acc;
-                        p_event->acceleration.y = library_in_package[j].content_p[1].lw.mslw.sli * convert_acc;
-                        p_event->acceleration.z = library_in_package[j].content_p[2].lw.mslw.sli * convert_acc;
-                        p_event->uncalibrated_accelerometer.x_uncalib = p_event->acceleration.x;
-                        p_event->uncalibrated_accelerometer.y_uncalib = p_event->acceleration.y;
-                        p_event->uncalibrated_accelerometer.z_uncalib = p_event->acceleration.z;
-                        p_event->acceleration.status = 0;
+                        deliver_consumer_events(boschsensor, BSX_INPUT_ID_ACCELERATION,
+                                p_acc_raw, p_acc_si, library_in_package[j].time_stamp, acc_scale);
                         break;
                     case BSX_INPUT_ID_MAGNETICFIELD:
+                        p_event = boschsensor->sensord_event_slot();
+                        p_event->version = sizeof(sensors_event_t);
+                        p_event->timestamp = library_in_package[j].time_stamp;
                         p_event->sensor = BSX_SENSOR_ID_MAGNETIC_FIELD_UNCALIBRATED;
                         p_event->type = SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED;
                         p_event->uncalibrated_magnetic.x_uncalib = library_in_package[j].content_p[0].lw.mslw.sli * CONVERT_MAG;
                         p_event->uncalibrated_magnetic.y_uncalib = library_in_package[j].content_p[1].lw.mslw.sli * CONVERT_MAG;
                         p_event->uncalibrated_magnetic.z_uncalib = library_in_package[j].content_p[2].lw.mslw.sli * CONVERT_MAG;
+                        boschsensor->sensord_deliver_event(p_event);
                         break;
                     case BSX_INPUT_ID_ANGULARRATE:
-			switch(gyro_range)
-			{
-				case GYRO_CHIP_RANGCONF_125DPS:
-					convert_gyro = CONVERT_GYRO_125_RADPS;
-					break;
-				case GYRO_CHIP_RANGCONF_250DPS:
-					convert_gyro = CONVERT_GYRO_250_RADPS;
-					break;
-				case GYRO_CHIP_RANGCONF_500DPS:
-					convert_gyro = CONVERT_GYRO_500_RADPS;
-					break;
-				case GYRO_CHIP_RANGCONF_1000DPS:
-					convert_gyro = CONVERT_GYRO_1000_RADPS;
-					break;
-				case GYRO_CHIP_RANGCONF_2000DPS:
-					convert_gyro = CONVERT_GYRO_2000_RADPS;
-					break;
-				default:
-					PERR("error gyro range config");
-					continue;
-			}
-#ifdef TEST_APP_ACTIVE
-			PDEBUG("GYRO range %d, convert %f", gyro_range, convert_gyro);
-#endif
-
-                        p_event->sensor = BSX_SENSOR_ID_GYROSCOPE_UNCALIBRATED;
-                        p_event->type = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
-                        p_event->uncalibrated_gyro.x_uncalib = library_in_package[j].content_p[0].lw.mslw.sli * convert_gyro;
-                        p_event->uncalibrated_gyro.y_uncalib = library_in_package[j].content_p[1].lw.mslw.sli * convert_gyro;
-                        p_event->uncalibrated_gyro.z_uncalib = library_in_package[j].content_p[2].lw.mslw.sli * convert_gyro;
+                        deliver_consumer_events(boschsensor, BSX_INPUT_ID_ANGULARRATE,
+                                p_gyr_raw, p_gyr_si, library_in_package[j].time_stamp, gyr_scale);
                         break;
                     default:
                         PERR("impossible bsx_distribute_id: %d", library_in_package[j].sensor_id);
-                        free(p_event);
-                        continue;
+                        break;
                 }
-
-                boschsensor->sensord_deliver_event(p_event);
             }
         }
     }
 
-    distory_hwdata(pp_ACC_hwdata, ACC_hwdata_len);
-    distory_hwdata(pp_MAG_hwdata, MAG_hwdata_len);
-    distory_hwdata(pp_GYRO_hwdata, GYRO_hwdata_len);
-    free(p_align_ind);
+    /**
+     * Step 3 fused sensors, over the whole burst at once
+     */
+    sensord_fusion_process(boschsensor, ACC_hwdata_len, GYRO_hwdata_len, acc_scale);
 
-    return;
-}
+    /**
+     * Step 4 step detector / counter on decimated acc
+     */
+    sensord_step_process(boschsensor, ACC_hwdata_len, acc_scale);
 
+    distory_hwdata(boschsensor->sample_pool, pp_ACC_hwdata, ACC_hwdata_len);
+    distory_hwdata(boschsensor->sample_pool, pp_MAG_hwdata, MAG_hwdata_len);
+    distory_hwdata(boschsensor->sample_pool, pp_GYRO_hwdata, GYRO_hwdata_len);
 
-uint8_t sensord_resample5to4(int32_t data[3], int64_t *tm,  int32_t pre_data[3], int64_t *pre_tm, uint32_t counter)
-{
-  uint8_t statusBit;
-  int32_t x_in_tmp, y_in_tmp, z_in_tmp;
-  int64_t tm_in_tmp;
-  uint32_t sampleNumber;
-  bool guard1 = false;
-  int32_t  x0, y0, z0;
-  int32_t  x1, y1, z1;
-  int64_t t0;
-  int64_t t1;
-
-  x_in_tmp = data[0];
-  y_in_tmp = data[1];
-  z_in_tmp = data[2];
-  tm_in_tmp = tm[0];
-
-  sampleNumber = counter % 5U;
-  guard1 = false;
-
-  switch (sampleNumber) {
-   case 0U:
-    statusBit = 1;
-    data[0] = pre_data[0];
-    data[1] = pre_data[1];
-    data[2] = pre_data[2];
-    tm[0] = pre_tm[0];
-    break;
-
-   case 1U:
-    guard1 = true;
-    break;
-
-   case 2U:
-    guard1 = true;
-    break;
-
-   case 3U:
-    guard1 = true;
-    break;
-
-   case 4U:
-    statusBit = 0;
-    break;
-  }
-
-  if (guard1)
-  {
-    statusBit = 1;
-    x0 = (pre_data[0] < 0x7FFFFFFD ? pre_data[0] : 0x7FFFFFFD);
-    y0 = (pre_data[1] < 0x7FFFFFFD ? pre_data[1] : 0x7FFFFFFD);
-    z0 = (pre_data[2] < 0x7FFFFFFD ? pre_data[2] : 0x7FFFFFFD);
-    x1 = (data[0] < 0x7FFFFFFD ? data[0] : 0x7FFFFFFD);
-    y1 = (data[1] < 0x7FFFFFFD ? data[1] : 0x7FFFFFFD);
-    z1 = (data[2] < 0x7FFFFFFD ? data[2] : 0x7FFFFFFD);
-
-    data[0] = (4 - (int32_t)sampleNumber) * ((x0 + 2) >> 2) + (int32_t)sampleNumber * ((x1 + 2) >> 2);
-    data[1] = (4 - (int32_t)sampleNumber) * ((y0 + 2) >> 2) + (int32_t)sampleNumber * ((y1 + 2) >> 2);
-    data[2] = (4 - (int32_t)sampleNumber) * ((z0 + 2) >> 2) + (int32_t)sampleNumber * ((z1 + 2) >> 2);
-
-    t0 = (pre_tm[0] < 0x7FFFFFFFFFFFFFFD ? pre_tm[0] : 0x7FFFFFFFFFFFFFFD);
-    t1 = (tm[0] < 0x7FFFFFFFFFFFFFFD ? tm[0] : 0x7FFFFFFFFFFFFFFD);
-
-    tm[0] = (4LL - sampleNumber) * ((t0 + 2LL) >> 2LL) + sampleNumber * ((t1 +2LL) >> 2LL);
-  }
-
-  pre_data[0] = x_in_tmp;
-  pre_data[1] = y_in_tmp;
-  pre_data[2] = z_in_tmp;
-  pre_tm[0] = tm_in_tmp;
-
-  return statusBit;
+    boschsensor->sensord_flush_events();
+
+    state_publish();
+
+    return;
 }
 
 
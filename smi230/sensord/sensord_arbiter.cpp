@@ -0,0 +1,275 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "BoschSensor.h"
+
+#include "sensord_pltf.h"
+#include "sensord_cfg.h"
+#include "sensord_algo.h"
+#include "sensord_hwcntl.h"
+#include "sensord_arbiter.h"
+#include "util_misc.h"
+
+typedef struct
+{
+    int32_t bsx_list_inx;
+    uint32_t input_id;
+    int active;             /// read by sensord thread with __atomic builtins
+    float Hz;
+    uint16_t fifo_data_len;
+    uint32_t factor;        /// read by sensord thread with __atomic builtins
+} ARBITER_CONSUMER;
+
+typedef struct
+{
+    uint32_t input_id;
+    float req_Hz;           /// last written to hardware
+    uint16_t fifo_data_len;
+    float phy_Hz;           /// what hardware really runs at
+} ARBITER_PHYSICAL;
+
+#ifdef SMI230_DATA_SYNC
+/*gyro samples arrive in the acc data sync frames at the acc rate, so the fused
+ gyro feed has to keep acc running and is decimated against it*/
+#define ARBITER_FUSED_GYRO_INPUT BSX_INPUT_ID_ACCELERATION
+#else
+#define ARBITER_FUSED_GYRO_INPUT BSX_INPUT_ID_ANGULARRATE
+#endif
+
+static ARBITER_CONSUMER arbiter_consumer[SENSORD_ARBITER_CONSUMER_NUM] = {
+        { SENSORLIST_INX_ACCELEROMETER, BSX_INPUT_ID_ACCELERATION, 0, 0, 0, 1 },
+        { SENSORLIST_INX_GYROSCOPE_UNCALIBRATED, BSX_INPUT_ID_ANGULARRATE, 0, 0, 0, 1 },
+        { SENSORLIST_INX_MAGNETIC_FIELD_UNCALIBRATED, BSX_INPUT_ID_MAGNETICFIELD, 0, 0, 0, 1 },
+        { SENSORLIST_INX_WAKEUP_ACCELEROMETER, BSX_INPUT_ID_ACCELERATION, 0, 0, 0, 1 },
+        { SENSORLIST_INX_WAKEUP_GYROSCOPE, BSX_INPUT_ID_ANGULARRATE, 0, 0, 0, 1 },
+        { SENSORLIST_INX_GYROSCOPE, BSX_INPUT_ID_ANGULARRATE, 0, 0, 0, 1 },
+        /*fused, see SENSORD_ARBITER_FUSED_CONSUMER_NUM*/
+        { SENSORLIST_INX_GRAVITY, BSX_INPUT_ID_ACCELERATION, 0, 0, 0, 1 },
+        { SENSORLIST_INX_GRAVITY, ARBITER_FUSED_GYRO_INPUT, 0, 0, 0, 1 },
+        { SENSORLIST_INX_LINEAR_ACCELERATION, BSX_INPUT_ID_ACCELERATION, 0, 0, 0, 1 },
+        { SENSORLIST_INX_LINEAR_ACCELERATION, ARBITER_FUSED_GYRO_INPUT, 0, 0, 0, 1 },
+        { SENSORLIST_INX_GAME_ROTATION_VECTOR, BSX_INPUT_ID_ACCELERATION, 0, 0, 0, 1 },
+        { SENSORLIST_INX_GAME_ROTATION_VECTOR, ARBITER_FUSED_GYRO_INPUT, 0, 0, 0, 1 },
+        /*step, see SENSORD_ARBITER_STEP_CONSUMER_NUM*/
+        { SENSORLIST_INX_STEP_DETECTOR, BSX_INPUT_ID_ACCELERATION, 0, 0, 0, 1 },
+        { SENSORLIST_INX_STEP_COUNTER, BSX_INPUT_ID_ACCELERATION, 0, 0, 0, 1 },
+};
+
+static ARBITER_PHYSICAL arbiter_physical[] = {
+        { BSX_INPUT_ID_ACCELERATION, SAMPLE_RATE_DISABLED, 0, 0 },
+        { BSX_INPUT_ID_ANGULARRATE, SAMPLE_RATE_DISABLED, 0, 0 },
+        { BSX_INPUT_ID_MAGNETICFIELD, SAMPLE_RATE_DISABLED, 0, 0 },
+};
+
+static pthread_mutex_t arbiter_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ARBITER_PHYSICAL *find_physical(uint32_t input_id)
+{
+    uint32_t i;
+
+    for (i = 0; i < ARRAY_ELEMENTS(arbiter_physical); ++i)
+    {
+        if (input_id == arbiter_physical[i].input_id)
+        {
+            return &arbiter_physical[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * factor is the largest integer decimation that still gives at least the requested rate
+ * arbiter_mutex held
+ */
+static void update_factors(const ARBITER_PHYSICAL *p_phy)
+{
+    uint32_t i;
+    uint32_t factor;
+    ARBITER_CONSUMER *p_con;
+
+    for (i = 0; i < SENSORD_ARBITER_CONSUMER_NUM; ++i)
+    {
+        p_con = &arbiter_consumer[i];
+        if (p_con->input_id != p_phy->input_id)
+        {
+            continue;
+        }
+
+        factor = 1;
+        if (p_con->active && p_con->Hz > 0 && p_phy->phy_Hz > p_con->Hz)
+        {
+            /*small margin so 1600 / 100 is 16 even with float rounding*/
+            factor = (uint32_t)(p_phy->phy_Hz / p_con->Hz + 0.001f);
+        }
+
+        __atomic_store_n(&p_con->factor, factor, __ATOMIC_RELAXED);
+    }
+}
+
+int sensord_arbiter_request(uint32_t index, float Hz, uint16_t fifo_data_len,
+        uint32_t *p_input_id, float *p_phy_Hz, uint16_t *p_fifo_data_len)
+{
+    ARBITER_CONSUMER *p_con;
+    ARBITER_PHYSICAL *p_phy;
+    float phy_Hz = 0;
+    uint16_t phy_fifo_data_len = 0;
+    uint16_t con_fifo_data_len;
+    float scaled;
+    int any_active = 0;
+    int wm_found = 0;
+    int changed;
+    uint32_t i;
+
+    if (index >= SENSORD_ARBITER_CONSUMER_NUM)
+    {
+        return -EINVAL;
+    }
+    p_con = &arbiter_consumer[index];
+
+    p_phy = find_physical(p_con->input_id);
+    if (NULL == p_phy)
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&arbiter_mutex);
+
+    __atomic_store_n(&p_con->active, (int)(SAMPLE_RATE_DISABLED != Hz), __ATOMIC_RELAXED);
+    p_con->Hz = p_con->active ? Hz : 0;
+    p_con->fifo_data_len = fifo_data_len;
+
+    for (i = 0; i < SENSORD_ARBITER_CONSUMER_NUM; ++i)
+    {
+        if (arbiter_consumer[i].input_id != p_con->input_id || 0 == arbiter_consumer[i].active)
+        {
+            continue;
+        }
+
+        if (0 == any_active || arbiter_consumer[i].Hz > phy_Hz)
+        {
+            phy_Hz = arbiter_consumer[i].Hz;
+        }
+        any_active = 1;
+    }
+
+    /*each consumer counts its watermark in its own samples, turn that into its
+     latency at phy_Hz so the tightest latency, wakeup or not, drives the FIFO*/
+    for (i = 0; i < SENSORD_ARBITER_CONSUMER_NUM && any_active; ++i)
+    {
+        if (arbiter_consumer[i].input_id != p_con->input_id || 0 == arbiter_consumer[i].active)
+        {
+            continue;
+        }
+
+        con_fifo_data_len = arbiter_consumer[i].fifo_data_len;
+        if (arbiter_consumer[i].Hz > 0 && phy_Hz > arbiter_consumer[i].Hz)
+        {
+            scaled = (float)con_fifo_data_len * phy_Hz / arbiter_consumer[i].Hz;
+            con_fifo_data_len = (scaled < 65535.0f) ? (uint16_t)scaled : 65535;
+        }
+
+        if (0 == wm_found || con_fifo_data_len < phy_fifo_data_len)
+        {
+            phy_fifo_data_len = con_fifo_data_len;
+            wm_found = 1;
+        }
+    }
+
+    if (0 == any_active)
+    {
+        phy_Hz = SAMPLE_RATE_DISABLED;
+    }
+
+    changed = (phy_Hz != p_phy->req_Hz || phy_fifo_data_len != p_phy->fifo_data_len);
+    p_phy->req_Hz = phy_Hz;
+    p_phy->fifo_data_len = phy_fifo_data_len;
+
+    /*until hwcntl reports the real rate, assume the requested one*/
+    if (changed)
+    {
+        p_phy->phy_Hz = any_active ? phy_Hz : 0;
+    }
+    update_factors(p_phy);
+
+    pthread_mutex_unlock(&arbiter_mutex);
+
+    *p_input_id = p_con->input_id;
+    *p_phy_Hz = phy_Hz;
+    *p_fifo_data_len = phy_fifo_data_len;
+
+    return changed;
+}
+
+void sensord_arbiter_set_phy_rate(uint32_t input_id, float phy_Hz)
+{
+    ARBITER_PHYSICAL *p_phy;
+
+    p_phy = find_physical(input_id);
+    if (NULL == p_phy)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&arbiter_mutex);
+    p_phy->phy_Hz = phy_Hz;
+    update_factors(p_phy);
+    pthread_mutex_unlock(&arbiter_mutex);
+
+    PINFO("physical sensor %u runs at %f Hz", input_id, phy_Hz);
+}
+
+float sensord_arbiter_get_phy_rate(uint32_t input_id)
+{
+    ARBITER_PHYSICAL *p_phy;
+    float phy_Hz;
+
+    p_phy = find_physical(input_id);
+    if (NULL == p_phy)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&arbiter_mutex);
+    phy_Hz = p_phy->phy_Hz;
+    pthread_mutex_unlock(&arbiter_mutex);
+
+    return phy_Hz;
+}
+
+int32_t sensord_arbiter_consumer(uint32_t index, uint32_t *p_input_id)
+{
+    *p_input_id = arbiter_consumer[index].input_id;
+
+    return arbiter_consumer[index].bsx_list_inx;
+}
+
+uint32_t sensord_arbiter_get_factor(uint32_t index)
+{
+    return __atomic_load_n(&arbiter_consumer[index].factor, __ATOMIC_RELAXED);
+}
+
+int sensord_arbiter_is_active(uint32_t index)
+{
+    return __atomic_load_n(&arbiter_consumer[index].active, __ATOMIC_RELAXED);
+}
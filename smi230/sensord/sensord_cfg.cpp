@@ -35,6 +35,9 @@
 int g_place_a = 0;
 int g_place_m = 0;
 int g_place_g = 0;
+/*row major mounting matrix, only used when g_place_a/g_place_g is AXIS_REMAP_PLACE_MATRIX*/
+float g_matrix_a[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+float g_matrix_g[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
 int solution_type = SOLUTION_IMU;
 int accl_chip = ACC_CHIP_SMI230;
 int gyro_chip = GYR_CHIP_SMI230;
@@ -46,6 +49,7 @@ int amsh_intr_pin = 0;
 int amsh_calibration = 0;
 int data_log = 0;
 int bsx_datalog = 0;
+int align_tolerance_us = 250; //samples closer than this are fed to library as one instant
 int trace_level = 0x1C; //NOTE + ERR + WARN
 int trace_to_logcat = 1;
 long long unsigned int sensors_mask = 0;
@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <errno.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "sensord_pltf.h"
+#include "sensord_cfg.h"
+#include "sensord_convert.h"
+
+#define CONVERT_ACC_2G (0.000598755)
+#define CONVERT_ACC_4G (0.001197510)
+#define CONVERT_ACC_8G (0.002395020)
+#define CONVERT_ACC_16G (0.004790039)
+
+#define CONVERT_GYRO_125_RADPS (0.00006657903)
+#define CONVERT_GYRO_250_RADPS (0.00013315805)
+#define CONVERT_GYRO_500_RADPS (0.00026631611)
+#define CONVERT_GYRO_1000_RADPS (0.00053263222)
+#define CONVERT_GYRO_2000_RADPS (0.00106526444)
+
+/*defaults match accl_range / gyro_range defaults in sensord_cfg.cpp*/
+static float convert_acc = CONVERT_ACC_4G;
+static float convert_gyro = CONVERT_GYRO_2000_RADPS;
+
+int sensord_convert_set_acc_range(int range)
+{
+    switch(range)
+    {
+        case ACC_CHIP_RANGCONF_2G:
+            convert_acc = CONVERT_ACC_2G;
+            break;
+        case ACC_CHIP_RANGCONF_4G:
+            convert_acc = CONVERT_ACC_4G;
+            break;
+        case ACC_CHIP_RANGCONF_8G:
+            convert_acc = CONVERT_ACC_8G;
+            break;
+        case ACC_CHIP_RANGCONF_16G:
+            convert_acc = CONVERT_ACC_16G;
+            break;
+        default:
+            PERR("error accel range config %d", range);
+            return -EINVAL;
+    }
+
+    PINFO("ACC range %d, convert %f", range, convert_acc);
+
+    return 0;
+}
+
+int sensord_convert_set_gyro_range(int range)
+{
+    switch(range)
+    {
+        case GYRO_CHIP_RANGCONF_125DPS:
+            convert_gyro = CONVERT_GYRO_125_RADPS;
+            break;
+        case GYRO_CHIP_RANGCONF_250DPS:
+            convert_gyro = CONVERT_GYRO_250_RADPS;
+            break;
+        case GYRO_CHIP_RANGCONF_500DPS:
+            convert_gyro = CONVERT_GYRO_500_RADPS;
+            break;
+        case GYRO_CHIP_RANGCONF_1000DPS:
+            convert_gyro = CONVERT_GYRO_1000_RADPS;
+            break;
+        case GYRO_CHIP_RANGCONF_2000DPS:
+            convert_gyro = CONVERT_GYRO_2000_RADPS;
+            break;
+        default:
+            PERR("error gyro range config %d", range);
+            return -EINVAL;
+    }
+
+    PINFO("GYRO range %d, convert %f", range, convert_gyro);
+
+    return 0;
+}
+
+float sensord_convert_get_acc_scale(void)
+{
+    return convert_acc;
+}
+
+float sensord_convert_get_gyro_scale(void)
+{
+    return convert_gyro;
+}
+
+void sensord_convert_xyz_scalar(const int32_t *p_in, float *p_out, uint32_t frame_count, float scale)
+{
+    uint32_t i;
+    uint32_t n = 3 * frame_count;
+
+    for (i = 0; i < n; ++i)
+    {
+        p_out[i] = (float)p_in[i] * scale;
+    }
+}
+
+void sensord_convert_xyz(const int32_t *p_in, float *p_out, uint32_t frame_count, float scale)
+{
+    uint32_t i = 0;
+    uint32_t n = 3 * frame_count;
+
+    /*int32 -> float rounds to nearest and the product is a single float multiply
+     * in every path, so the result does not depend on which path runs*/
+#if defined(__SSE2__)
+    __m128 v_scale = _mm_set1_ps(scale);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v_raw = _mm_loadu_si128((const __m128i *)(p_in + i));
+        _mm_storeu_ps(p_out + i, _mm_mul_ps(_mm_cvtepi32_ps(v_raw), v_scale));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 4 <= n; i += 4)
+    {
+        int32x4_t v_raw = vld1q_s32(p_in + i);
+        vst1q_f32(p_out + i, vmulq_n_f32(vcvtq_f32_s32(v_raw), scale));
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        p_out[i] = (float)p_in[i] * scale;
+    }
+}
+
+void sensord_convert_xyz_affine_scalar(const int32_t *p_in, float *p_out, uint32_t frame_count,
+        const float scale[3], const float offset[3])
+{
+    uint32_t i;
+
+    for (i = 0; i < frame_count; ++i)
+    {
+        p_out[3 * i] = (float)p_in[3 * i] * scale[0] + offset[0];
+        p_out[3 * i + 1] = (float)p_in[3 * i + 1] * scale[1] + offset[1];
+        p_out[3 * i + 2] = (float)p_in[3 * i + 2] * scale[2] + offset[2];
+    }
+}
+
+void sensord_convert_xyz_affine(const int32_t *p_in, float *p_out, uint32_t frame_count,
+        const float scale[3], const float offset[3])
+{
+    uint32_t i = 0;
+    uint32_t n = 3 * frame_count;
+
+    /*4 frames are 12 values, 3 vectors whose axis pattern is xyzx, yzxy, zxyz*/
+#if defined(__SSE2__)
+    __m128 v_s0 = _mm_setr_ps(scale[0], scale[1], scale[2], scale[0]);
+    __m128 v_s1 = _mm_setr_ps(scale[1], scale[2], scale[0], scale[1]);
+    __m128 v_s2 = _mm_setr_ps(scale[2], scale[0], scale[1], scale[2]);
+    __m128 v_o0 = _mm_setr_ps(offset[0], offset[1], offset[2], offset[0]);
+    __m128 v_o1 = _mm_setr_ps(offset[1], offset[2], offset[0], offset[1]);
+    __m128 v_o2 = _mm_setr_ps(offset[2], offset[0], offset[1], offset[2]);
+
+    for (; i + 12 <= n; i += 12)
+    {
+        __m128 v0 = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(p_in + i)));
+        __m128 v1 = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(p_in + i + 4)));
+        __m128 v2 = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(p_in + i + 8)));
+        _mm_storeu_ps(p_out + i, _mm_add_ps(_mm_mul_ps(v0, v_s0), v_o0));
+        _mm_storeu_ps(p_out + i + 4, _mm_add_ps(_mm_mul_ps(v1, v_s1), v_o1));
+        _mm_storeu_ps(p_out + i + 8, _mm_add_ps(_mm_mul_ps(v2, v_s2), v_o2));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const float s_pat[12] = { scale[0], scale[1], scale[2], scale[0], scale[1], scale[2],
+            scale[0], scale[1], scale[2], scale[0], scale[1], scale[2] };
+    const float o_pat[12] = { offset[0], offset[1], offset[2], offset[0], offset[1], offset[2],
+            offset[0], offset[1], offset[2], offset[0], offset[1], offset[2] };
+    float32x4_t v_s0 = vld1q_f32(s_pat);
+    float32x4_t v_s1 = vld1q_f32(s_pat + 4);
+    float32x4_t v_s2 = vld1q_f32(s_pat + 8);
+    float32x4_t v_o0 = vld1q_f32(o_pat);
+    float32x4_t v_o1 = vld1q_f32(o_pat + 4);
+    float32x4_t v_o2 = vld1q_f32(o_pat + 8);
+
+    for (; i + 12 <= n; i += 12)
+    {
+        vst1q_f32(p_out + i, vaddq_f32(vmulq_f32(vcvtq_f32_s32(vld1q_s32(p_in + i)), v_s0), v_o0));
+        vst1q_f32(p_out + i + 4, vaddq_f32(vmulq_f32(vcvtq_f32_s32(vld1q_s32(p_in + i + 4)), v_s1), v_o1));
+        vst1q_f32(p_out + i + 8, vaddq_f32(vmulq_f32(vcvtq_f32_s32(vld1q_s32(p_in + i + 8)), v_s2), v_o2));
+    }
+#endif
+
+    /*i is a multiple of 3 here, so the tail starts on an x*/
+    for (; i < n; i += 3)
+    {
+        p_out[i] = (float)p_in[i] * scale[0] + offset[0];
+        p_out[i + 1] = (float)p_in[i + 1] * scale[1] + offset[1];
+        p_out[i + 2] = (float)p_in[i + 2] * scale[2] + offset[2];
+    }
+}
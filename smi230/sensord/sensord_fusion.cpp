@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sensord_fusion.h"
+
+/*proportional gain in rad/s per unit of gravity direction error,
+ high until the first alignment has settled, then low so acc noise stays out*/
+#define FUSION_KP_ALIGN 5.0f
+#define FUSION_KP 0.5f
+#define FUSION_ALIGN_S 1.0f
+/*acc only corrects while its norm says the device is close to free of linear acceleration*/
+#define FUSION_ACC_GATE_LOW (0.85f * SENSORD_FUSION_G)
+#define FUSION_ACC_GATE_HIGH (1.15f * SENSORD_FUSION_G)
+/*an acc sample older than this does not correct*/
+#define FUSION_ACC_MAX_AGE_NS 50000000LL
+/*a gap longer than this is a stream restart, not something to integrate over*/
+#define FUSION_DT_MAX_S 0.1f
+
+void sensord_fusion_reset(SENSORD_FUSION *p_fusion)
+{
+    memset(p_fusion, 0, sizeof(*p_fusion));
+    p_fusion->q[0] = 1.0f;
+}
+
+/**
+ * roll and pitch from gravity, yaw 0
+ */
+static void fusion_align(SENSORD_FUSION *p_fusion)
+{
+    const float *a = p_fusion->acc;
+    float roll = atan2f(a[1], a[2]);
+    float pitch = atan2f(-a[0], sqrtf(a[1] * a[1] + a[2] * a[2]));
+    float cr = cosf(0.5f * roll);
+    float sr = sinf(0.5f * roll);
+    float cp = cosf(0.5f * pitch);
+    float sp = sinf(0.5f * pitch);
+
+    p_fusion->q[0] = cr * cp;
+    p_fusion->q[1] = sr * cp;
+    p_fusion->q[2] = cr * sp;
+    p_fusion->q[3] = -sr * sp;
+    p_fusion->aligned = 1;
+    p_fusion->aligned_s = 0;
+}
+
+/**
+ * one filter step, kept free of calls but sqrtf so the burst loop stays tight
+ * @param p_acc NULL when no usable acc sample
+ */
+static inline void fusion_step(float q[4], const float g[3], const float *p_acc, float kp, float dt)
+{
+    float gx = g[0];
+    float gy = g[1];
+    float gz = g[2];
+    float qw = q[0];
+    float qx = q[1];
+    float qy = q[2];
+    float qz = q[3];
+    float ax;
+    float ay;
+    float az;
+    float vx;
+    float vy;
+    float vz;
+    float recip;
+    float hdt = 0.5f * dt;
+
+    if (p_acc)
+    {
+        recip = 1.0f / sqrtf(p_acc[0] * p_acc[0] + p_acc[1] * p_acc[1] + p_acc[2] * p_acc[2]);
+        ax = p_acc[0] * recip;
+        ay = p_acc[1] * recip;
+        az = p_acc[2] * recip;
+
+        /*world up seen from device, 3rd row of the rotation matrix*/
+        vx = 2.0f * (qx * qz - qw * qy);
+        vy = 2.0f * (qw * qx + qy * qz);
+        vz = qw * qw - qx * qx - qy * qy + qz * qz;
+
+        /*measured x estimated is the rotation that closes the gap*/
+        gx += kp * (ay * vz - az * vy);
+        gy += kp * (az * vx - ax * vz);
+        gz += kp * (ax * vy - ay * vx);
+    }
+
+    q[0] = qw + (-qx * gx - qy * gy - qz * gz) * hdt;
+    q[1] = qx + (qw * gx + qy * gz - qz * gy) * hdt;
+    q[2] = qy + (qw * gy - qx * gz + qz * gx) * hdt;
+    q[3] = qz + (qw * gz + qx * gy - qy * gx) * hdt;
+
+    recip = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    q[0] *= recip;
+    q[1] *= recip;
+    q[2] *= recip;
+    q[3] *= recip;
+}
+
+static inline void fusion_output(const SENSORD_FUSION *p_fusion, int64_t tm, SENSORD_FUSION_OUT *p_out)
+{
+    const float *q = p_fusion->q;
+    float sign = (q[0] < 0) ? -1.0f : 1.0f;
+
+    /*q and -q are the same rotation, report the one with w >= 0*/
+    p_out->rv[0] = sign * q[1];
+    p_out->rv[1] = sign * q[2];
+    p_out->rv[2] = sign * q[3];
+    p_out->rv[3] = sign * q[0];
+
+    p_out->gravity[0] = SENSORD_FUSION_G * 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    p_out->gravity[1] = SENSORD_FUSION_G * 2.0f * (q[0] * q[1] + q[2] * q[3]);
+    p_out->gravity[2] = SENSORD_FUSION_G * (q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]);
+
+    p_out->linear[0] = p_fusion->acc[0] - p_out->gravity[0];
+    p_out->linear[1] = p_fusion->acc[1] - p_out->gravity[1];
+    p_out->linear[2] = p_fusion->acc[2] - p_out->gravity[2];
+
+    p_out->timestamp = tm;
+}
+
+uint32_t sensord_fusion_run(SENSORD_FUSION *p_fusion,
+        const float *p_acc, const int64_t *p_acc_tm, uint32_t acc_len,
+        const float *p_gyr, const int64_t *p_gyr_tm, uint32_t gyr_len,
+        SENSORD_FUSION_OUT *p_out)
+{
+    uint32_t ai = 0;
+    uint32_t gi;
+    uint32_t out_len = 0;
+    int64_t tm;
+    float dt;
+    float norm2;
+    float g[3];
+    const float *p_corr;
+
+    for (gi = 0; gi < gyr_len; ++gi)
+    {
+        tm = p_gyr_tm[gi];
+
+        /*latest acc at or before this gyro sample*/
+        while (ai < acc_len && p_acc_tm[ai] <= tm)
+        {
+            ai++;
+        }
+        if (ai > 0)
+        {
+            memcpy(p_fusion->acc, &p_acc[3 * (ai - 1)], sizeof(p_fusion->acc));
+            p_fusion->acc_tm = p_acc_tm[ai - 1];
+            p_fusion->has_acc = 1;
+        }
+
+        if (0 == p_fusion->aligned)
+        {
+            if (0 == p_fusion->has_acc)
+            {
+                continue;
+            }
+            fusion_align(p_fusion);
+            p_fusion->gyr_tm = tm;
+        }
+
+        dt = (float)(tm - p_fusion->gyr_tm) * 1e-9f;
+        p_fusion->gyr_tm = tm;
+
+        if (dt > 0 && dt <= FUSION_DT_MAX_S)
+        {
+            norm2 = p_fusion->acc[0] * p_fusion->acc[0] + p_fusion->acc[1] * p_fusion->acc[1] +
+                    p_fusion->acc[2] * p_fusion->acc[2];
+            p_corr = NULL;
+            if (tm - p_fusion->acc_tm <= FUSION_ACC_MAX_AGE_NS &&
+                    norm2 >= FUSION_ACC_GATE_LOW * FUSION_ACC_GATE_LOW &&
+                    norm2 <= FUSION_ACC_GATE_HIGH * FUSION_ACC_GATE_HIGH)
+            {
+                p_corr = p_fusion->acc;
+            }
+
+            g[0] = p_gyr[3 * gi] - p_fusion->gyr_bias[0];
+            g[1] = p_gyr[3 * gi + 1] - p_fusion->gyr_bias[1];
+            g[2] = p_gyr[3 * gi + 2] - p_fusion->gyr_bias[2];
+
+            fusion_step(p_fusion->q, g, p_corr,
+                    (p_fusion->aligned_s < FUSION_ALIGN_S) ? FUSION_KP_ALIGN : FUSION_KP, dt);
+            p_fusion->aligned_s += dt;
+        }
+
+        fusion_output(p_fusion, tm, &p_out[out_len++]);
+    }
+
+    /*acc newer than the last gyro sample is the latest for the next burst*/
+    if (ai < acc_len)
+    {
+        memcpy(p_fusion->acc, &p_acc[3 * (acc_len - 1)], sizeof(p_fusion->acc));
+        p_fusion->acc_tm = p_acc_tm[acc_len - 1];
+        p_fusion->has_acc = 1;
+    }
+
+    return out_len;
+}
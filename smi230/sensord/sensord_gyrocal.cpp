@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sensord_gyrocal.h"
+
+/*length of one stillness window*/
+#define GYROCAL_WIN_NS 500000000LL
+/*a window needs this many samples to say anything*/
+#define GYROCAL_WIN_MIN_N 10
+/*largest per axis variance of a still window, (m/s^2)^2 and (rad/s)^2*/
+#define GYROCAL_ACC_VAR_MAX 0.01f
+#define GYROCAL_GYR_VAR_MAX 0.0004f
+/*a window mean above this is rotation, not offset, rad/s*/
+#define GYROCAL_BIAS_MAX 0.1f
+/*depth of the recursive average once it has filled up*/
+#define GYROCAL_AVG_DEPTH 16
+
+void sensord_gyrocal_reset(SENSORD_GYROCAL *p_cal)
+{
+    memset(p_cal, 0, sizeof(*p_cal));
+}
+
+static inline void win_start(SENSORD_GYROCAL_WIN *p_win, const float *p_xyz, int64_t tm)
+{
+    memcpy(p_win->ref, p_xyz, sizeof(p_win->ref));
+    memset(p_win->sum, 0, sizeof(p_win->sum));
+    memset(p_win->sq, 0, sizeof(p_win->sq));
+    p_win->n = 0;
+    p_win->start_tm = tm;
+}
+
+/**
+ * add one sample
+ * @return 1 when the window is full and the sample was not taken, it opens the next one
+ */
+static inline int win_add(SENSORD_GYROCAL_WIN *p_win, const float *p_xyz, int64_t tm)
+{
+    float d;
+
+    if (0 == p_win->n || tm - p_win->last_tm > GYROCAL_WIN_NS)
+    {
+        /*first sample or stream restart, nothing to close*/
+        win_start(p_win, p_xyz, tm);
+    }
+    else if (tm - p_win->start_tm >= GYROCAL_WIN_NS)
+    {
+        return 1;
+    }
+
+    d = p_xyz[0] - p_win->ref[0];
+    p_win->sum[0] += d;
+    p_win->sq[0] += d * d;
+    d = p_xyz[1] - p_win->ref[1];
+    p_win->sum[1] += d;
+    p_win->sq[1] += d * d;
+    d = p_xyz[2] - p_win->ref[2];
+    p_win->sum[2] += d;
+    p_win->sq[2] += d * d;
+    p_win->n++;
+    p_win->last_tm = tm;
+
+    return 0;
+}
+
+/**
+ * largest axis variance of a closed window, window mean to @param p_mean
+ */
+static float win_finish(const SENSORD_GYROCAL_WIN *p_win, float *p_mean)
+{
+    uint32_t i;
+    float m;
+    float var;
+    float var_max = 0;
+
+    for (i = 0; i < 3; ++i)
+    {
+        m = p_win->sum[i] / p_win->n;
+        var = p_win->sq[i] / p_win->n - m * m;
+        if (var > var_max)
+        {
+            var_max = var;
+        }
+        if (p_mean)
+        {
+            p_mean[i] = p_win->ref[i] + m;
+        }
+    }
+
+    return var_max;
+}
+
+static void gyrocal_fold(SENSORD_GYROCAL *p_cal, const float *p_mean)
+{
+    uint32_t depth;
+
+    /*plain average over the first windows, then a fixed depth so the bias can follow temperature*/
+    depth = p_cal->updates + 1;
+    if (depth > GYROCAL_AVG_DEPTH)
+    {
+        depth = GYROCAL_AVG_DEPTH;
+    }
+    p_cal->bias[0] += (p_mean[0] - p_cal->bias[0]) / depth;
+    p_cal->bias[1] += (p_mean[1] - p_cal->bias[1]) / depth;
+    p_cal->bias[2] += (p_mean[2] - p_cal->bias[2]) / depth;
+    p_cal->updates++;
+}
+
+/**
+ * settle the pending gyro window once the closed acc windows tell.
+ * Windows close in time order, so no moving one after its start and a still one past its end
+ * means all acc windows over it were still
+ */
+static void gyrocal_pend_check(SENSORD_GYROCAL *p_cal)
+{
+    if (0 == p_cal->pend_end_tm)
+    {
+        return;
+    }
+
+    if (p_cal->acc_moving_tm && p_cal->acc_moving_tm >= p_cal->pend_start_tm)
+    {
+        p_cal->pend_end_tm = 0;
+    }
+    else if (p_cal->acc_still_tm >= p_cal->pend_end_tm)
+    {
+        gyrocal_fold(p_cal, p_cal->pend_mean);
+        p_cal->pend_end_tm = 0;
+    }
+}
+
+static void gyrocal_acc_closed(SENSORD_GYROCAL *p_cal)
+{
+    if (p_cal->acc.n >= GYROCAL_WIN_MIN_N &&
+            win_finish(&p_cal->acc, p_cal->acc_still_mean) <= GYROCAL_ACC_VAR_MAX)
+    {
+        p_cal->acc_still_tm = p_cal->acc.last_tm;
+    }
+    else
+    {
+        p_cal->acc_still_tm = 0;
+        p_cal->acc_moving_tm = p_cal->acc.last_tm;
+    }
+
+    gyrocal_pend_check(p_cal);
+}
+
+static void gyrocal_gyr_closed(SENSORD_GYROCAL *p_cal)
+{
+    SENSORD_GYROCAL_WIN *p_win = &p_cal->gyr;
+    float mean[3];
+
+    /*a window still pending is not settled by now, acc stopped under it*/
+    p_cal->pend_end_tm = 0;
+
+    if (p_win->n < GYROCAL_WIN_MIN_N)
+    {
+        return;
+    }
+
+    if (win_finish(p_win, mean) > GYROCAL_GYR_VAR_MAX)
+    {
+        return;
+    }
+
+    if (fabsf(mean[0]) > GYROCAL_BIAS_MAX || fabsf(mean[1]) > GYROCAL_BIAS_MAX ||
+            fabsf(mean[2]) > GYROCAL_BIAS_MAX)
+    {
+        return;
+    }
+
+    /*acc not running over this window, its own spread has to do*/
+    if (0 == p_cal->acc.n || p_cal->acc.last_tm < p_win->start_tm)
+    {
+        gyrocal_fold(p_cal, mean);
+        return;
+    }
+
+    memcpy(p_cal->pend_mean, mean, sizeof(p_cal->pend_mean));
+    p_cal->pend_start_tm = p_win->start_tm;
+    p_cal->pend_end_tm = p_win->last_tm;
+    gyrocal_pend_check(p_cal);
+}
+
+void sensord_gyrocal_run(SENSORD_GYROCAL *p_cal,
+        const float *p_acc, const int64_t *p_acc_tm, uint32_t acc_len,
+        const float *p_gyr, const int64_t *p_gyr_tm, uint32_t gyr_len)
+{
+    uint32_t i;
+
+    /*acc first, stillness of the burst is known before its gyro windows close*/
+    for (i = 0; i < acc_len; ++i)
+    {
+        if (win_add(&p_cal->acc, &p_acc[3 * i], p_acc_tm[i]))
+        {
+            gyrocal_acc_closed(p_cal);
+            win_start(&p_cal->acc, &p_acc[3 * i], p_acc_tm[i]);
+            win_add(&p_cal->acc, &p_acc[3 * i], p_acc_tm[i]);
+        }
+    }
+
+    for (i = 0; i < gyr_len; ++i)
+    {
+        if (win_add(&p_cal->gyr, &p_gyr[3 * i], p_gyr_tm[i]))
+        {
+            gyrocal_gyr_closed(p_cal);
+            win_start(&p_cal->gyr, &p_gyr[3 * i], p_gyr_tm[i]);
+            win_add(&p_cal->gyr, &p_gyr[3 * i], p_gyr_tm[i]);
+        }
+    }
+}
@@ -100,7 +100,7 @@ struct sensor_t bosch_all_sensors[SENSORLIST_INX_END] = {
 		.stringType = SENSOR_STRING_TYPE_ACCELEROMETER,
 		.requiredPermission = NULL,
 		.maxDelay = 200000,
-		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE | SENSOR_FLAG_DIRECT_REPORT_ASHMEM,
 		.reserved = { }
 	},
 	{	.name = "BOSCH Magnetic Field Sensor",
@@ -342,7 +342,7 @@ struct sensor_t bosch_all_sensors[SENSORLIST_INX_END] = {
 		.stringType = SENSOR_STRING_TYPE_GYROSCOPE_UNCALIBRATED,
 		.requiredPermission = NULL,
 		.maxDelay = 200000,
-		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE | SENSOR_FLAG_DIRECT_REPORT_ASHMEM,
 		.reserved = { }
 	},
 
@@ -1393,7 +1393,9 @@ int batch_configref_resort(int32_t bsx_list_index, int64_t sampling_period_ns, i
                     &(p_config_refers[i]->max_latency),
                     &(p_config_refers[i]->latency_unit));
             p_config_refers[i]->delay_onchange_Hz = delay_Hz;
-            p_config_refers[i]->fifo_data_len = max_report_latency_ns / sampling_period_ns;
+            /*on-change sensors come with no sampling period*/
+            p_config_refers[i]->fifo_data_len = sampling_period_ns ?
+                    MIN(max_report_latency_ns / sampling_period_ns, 0xFFFF) : 0;
             PDEBUG("i %d, fifo wm = %d)", i, p_config_refers[i]->fifo_data_len);
             return 1;
         }
@@ -1404,7 +1406,8 @@ int batch_configref_resort(int32_t bsx_list_index, int64_t sampling_period_ns, i
             &(p_config[bsx_list_index - bsx_listinx_base].max_latency),
             &(p_config[bsx_list_index - bsx_listinx_base].latency_unit));
     p_config[bsx_list_index - bsx_listinx_base].delay_onchange_Hz = delay_Hz;
-    p_config[bsx_list_index - bsx_listinx_base].fifo_data_len = max_report_latency_ns / sampling_period_ns;
+    p_config[bsx_list_index - bsx_listinx_base].fifo_data_len = sampling_period_ns ?
+            MIN(max_report_latency_ns / sampling_period_ns, 0xFFFF) : 0;
     PDEBUG("fifo wm = %d)", p_config[bsx_list_index - bsx_listinx_base].fifo_data_len);
 
     return 0;
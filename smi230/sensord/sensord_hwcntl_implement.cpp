@@ -26,7 +26,9 @@
 #include <sys/stat.h>
 #include <linux/input.h>
 #include <sys/timerfd.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
 #include <fcntl.h>
 #include <dirent.h>
 
@@ -44,6 +46,16 @@
 #include "sensord_pltf.h"
 #include "sensord_cfg.h"
 #include "sensord_algo.h"
+#include "sensord_convert.h"
+#include "sensord_arbiter.h"
+#include "sensord_step.h"
+#include "sensord_acccal.h"
+#include "sensord_wmctl.h"
+#include "sensord_input_frame.h"
+#include "sensord_iio_buffer.h"
+#ifdef SMI230_IO_URING
+#include "sensord_uring.h"
+#endif
 #include "util_misc.h"
 #include "sensord_hwcntl_iio.h"
 
@@ -188,6 +200,7 @@ EV_FF_STATUS        0x17 EV_MAX            0x1f EV_CNT            (EV_MAX+1)
 #define SMI230_GYRO_RANGE_2000DPS	2000
 
 #define SMI230_GYRO_MAX_FIFO_FRAME	100
+#define SMI230_GYRO_BYTES_PER_FIFO_SAMPLE	6
 
 #define BMA2X2_RANGE_2G     3
 #define BMA2X2_RANGE_4G     5
@@ -232,6 +245,53 @@ static int acc_input_num = 0;
 [[maybe_unused]] static int gyr_input_fd = -1;
 [[maybe_unused]] static int gyr_input_num = 0;
 
+#ifdef SMI230_IIO
+/*buffered capture in place of input events, NULL while input backend is in use*/
+static IIO_BUFFER smi230_acc_iio;
+[[maybe_unused]] static IIO_BUFFER smi230_gyr_iio;
+#endif
+static IIO_BUFFER *p_acc_iio = NULL;
+[[maybe_unused]] static IIO_BUFFER *p_gyr_iio = NULL;
+
+/*event sources of the hwcntl loop, tagged in epoll_event.data*/
+enum {
+    HWCNTL_SRC_ACC = 0,
+    HWCNTL_SRC_GYRO,
+    HWCNTL_SRC_TIMER,
+    HWCNTL_SRC_WAKE_TIMER,
+    HWCNTL_SRC_FLUSH,
+    HWCNTL_SRC_CMD,
+    HWCNTL_SRC_CTL,
+    HWCNTL_SRC_NUM,
+};
+
+/*sources whose readiness keeps the AP from suspending until the next epoll_wait*/
+#define HWCNTL_SRC_WAKEUP_MASK ((1U << HWCNTL_SRC_ACC) | (1U << HWCNTL_SRC_GYRO) | (1U << HWCNTL_SRC_WAKE_TIMER))
+
+static int hwcntl_epoll_fd = -1;
+static int hwcntl_cmd_evtfd = -1;
+/*SENSORD_ACCCAL_CTL_FIFO, -1 when the storage dir is not there*/
+static int hwcntl_ctl_fd = -1;
+/*a control write is a few words, echo writes them in one go*/
+#define HWCNTL_CTL_BUF_LEN 128
+
+#ifdef SMI230_IIO
+/*IIO buffer length in scans, holds a full hardware FIFO with room to spare*/
+#define SMI230_IIO_BUFFER_LEN 1024
+
+/*timestamp has to stay last, see ap_hw_poll_smi230_iio()*/
+static const char *const smi230_acc_iio_channels[] = {
+        "accel_x", "accel_y", "accel_z",
+#ifdef SMI230_DATA_SYNC
+        "anglvel_x", "anglvel_y", "anglvel_z",
+#endif
+        "timestamp"
+};
+[[maybe_unused]] static const char *const smi230_gyr_iio_channels[] = {
+        "anglvel_x", "anglvel_y", "anglvel_z", "timestamp"
+};
+#endif
+
 static char mag_input_dir_name[128] = {0};
 static char acc_input_dir_name[128] = {0};
 static char gyr_input_dir_name[128] = {0};
@@ -389,11 +449,19 @@ uint32_t ap_get_sensorlist(struct sensor_t const** p_sSensorList)
             bosch_all_sensors[SENSORLIST_INX_MAGNETIC_ROTATION_VECTOR].minDelay = 20000;
         }
 
+        /*wakeup variants are served from the same physical stream*/
 #ifdef SMI230_DATA_SYNC
-        avail_sens_regval = (1 << SENSORLIST_INX_ACCELEROMETER);
+        avail_sens_regval = ( (1ULL << SENSORLIST_INX_ACCELEROMETER) | (1ULL << SENSORLIST_INX_WAKEUP_ACCELEROMETER) );
 #else
-        avail_sens_regval = ( (1 << SENSORLIST_INX_ACCELEROMETER) | (1 << SENSORLIST_INX_GYROSCOPE_UNCALIBRATED) );
+        avail_sens_regval = ( (1ULL << SENSORLIST_INX_ACCELEROMETER) | (1ULL << SENSORLIST_INX_GYROSCOPE_UNCALIBRATED) |
+                (1ULL << SENSORLIST_INX_GYROSCOPE) |
+                (1ULL << SENSORLIST_INX_WAKEUP_ACCELEROMETER) | (1ULL << SENSORLIST_INX_WAKEUP_GYROSCOPE) );
 #endif
+        /*fused in sensord from acc + gyro*/
+        avail_sens_regval |= ( (1ULL << SENSORLIST_INX_GRAVITY) | (1ULL << SENSORLIST_INX_LINEAR_ACCELERATION) |
+                (1ULL << SENSORLIST_INX_GAME_ROTATION_VECTOR) );
+        /*step detector and counter from acc in sensord*/
+        avail_sens_regval |= ( (1ULL << SENSORLIST_INX_STEP_DETECTOR) | (1ULL << SENSORLIST_INX_STEP_COUNTER) );
 
         sensor_amount = sensord_popcount_64(avail_sens_regval);
 
@@ -610,6 +678,44 @@ static inline int32_t SMI230_convert_ODR(int32_t bsx_list_inx, float Hz)
 
     return 0;
 }
+
+/**
+ * @return rate SMI230 really runs at for a request of @param Hz, same buckets as SMI230_convert_ODR
+ */
+static float SMI230_physical_Hz(uint32_t input_id, float Hz)
+{
+    static const float acc_Hz[] = { 1600, 800, 400, 200, 100, 50, 25, 12.5 };
+    static const float gyr_Hz[] = { 2000, 1000, 400, 200, 100 };
+    const float *p_Hz;
+    uint32_t n;
+    uint32_t i;
+
+    if (BSX_INPUT_ID_ACCELERATION == input_id)
+    {
+        p_Hz = acc_Hz;
+        n = ARRAY_ELEMENTS(acc_Hz);
+    }
+    else if (BSX_INPUT_ID_ANGULARRATE == input_id)
+    {
+        p_Hz = gyr_Hz;
+        n = ARRAY_ELEMENTS(gyr_Hz);
+    }
+    else
+    {
+        return Hz;
+    }
+
+    for (i = 0; i + 1 < n; ++i)
+    {
+        if (Hz > p_Hz[i + 1])
+        {
+            break;
+        }
+    }
+
+    return p_Hz[i];
+}
+
 /**
  * @param Hz
  * @param p_bandwith
@@ -689,13 +795,43 @@ static int32_t is_gyr_open = 0;
 static int32_t is_mag_open = 0;
 
 
+#ifdef SMI230_FIFO
+/**
+ * watermark controller writes through here
+ * @param fifo WMCTL_FIFO_ACC or WMCTL_FIFO_GYRO
+ * @param frames
+ * @return
+ */
+static int32_t SMI230_write_fifo_wm(int32_t fifo, uint32_t frames)
+{
+    /*IIO buffer wakes the reader once a hardware FIFO worth of scans is in*/
+    if (WMCTL_FIFO_ACC == fifo)
+    {
+        PDEBUG("write acc wm as %u samples, in %u bytes", frames, frames * SMI230_ACCEL_BYTES_PER_FIFO_SAMPLE);
+        if (p_acc_iio)
+        {
+            (void) iio_buffer_set_watermark(p_acc_iio, frames);
+        }
+        return wr_sysfs_oneint("fifo_wm", acc_input_dir_name, frames * SMI230_ACCEL_BYTES_PER_FIFO_SAMPLE);
+    }
+
+    PDEBUG("write gyro wm as %u", frames);
+    if (p_gyr_iio)
+    {
+        (void) iio_buffer_set_watermark(p_gyr_iio, frames);
+    }
+    return wr_sysfs_oneint("fifo_wm", gyr_input_dir_name, frames);
+}
+#endif
+
 static void ap_config_phyACC(bsx_f32_t sample_rate, uint16_t fifo_data_len)
 {
     int32_t ret = 0;
     int32_t odr_Hz;
     int32_t bandwidth = 0;
     int32_t fifo_data_sel_regval;
-    int32_t fifo_data_len_in_bytes;
+    [[maybe_unused]] uint32_t budget_frames;
+    [[maybe_unused]] uint32_t fifo_wm;
     float physical_Hz = 0;
 
 #ifdef SMI230_DATA_SYNC
@@ -781,6 +917,9 @@ static void ap_config_phyACC(bsx_f32_t sample_rate, uint16_t fifo_data_len)
                 ret = wr_sysfs_oneint("pwr_cfg", acc_input_dir_name, SENSOR_PM_SUSPEND);
 #ifdef SMI230_DATA_SYNC
                 ret = wr_sysfs_oneint("pwr_cfg", gyr_input_dir_name, SENSOR_PM_SUSPEND);
+#endif
+#ifdef SMI230_FIFO
+                (void) sensord_wmctl_configure(WMCTL_FIFO_ACC, 0, 0, 0, 0);
 #endif
         }
 	    else
@@ -800,16 +939,12 @@ static void ap_config_phyACC(bsx_f32_t sample_rate, uint16_t fifo_data_len)
         ret = wr_sysfs_oneint("odr", acc_input_dir_name, odr_Hz);
 #endif
 #ifdef SMI230_FIFO
-        if (fifo_data_len > SMI230_ACC_MAX_FIFO_FRAME)
-            fifo_data_len = SMI230_ACC_MAX_FIFO_FRAME;
-
-        if (fifo_data_len < 1)
-            fifo_data_len = 1;
-
-        fifo_data_len_in_bytes = SMI230_ACCEL_BYTES_PER_FIFO_SAMPLE * fifo_data_len;
-
-		PINFO("write acc wm as %d samples, in %d bytes", fifo_data_len, fifo_data_len_in_bytes);
-        ret = wr_sysfs_oneint("fifo_wm", acc_input_dir_name, fifo_data_len_in_bytes);
+        /*client watermark counts samples at requested rate, FIFO fills at physical rate*/
+        physical_Hz = SMI230_physical_Hz(BSX_INPUT_ID_ACCELERATION, sample_rate);
+        budget_frames = (uint32_t)(fifo_data_len * physical_Hz / sample_rate);
+        fifo_wm = sensord_wmctl_configure(WMCTL_FIFO_ACC, physical_Hz, budget_frames,
+                SMI230_ACC_MAX_FIFO_FRAME, SMI230_ACCEL_BYTES_PER_FIFO_SAMPLE);
+		PINFO("acc wm budget %u samples, start at %u", budget_frames, fifo_wm);
 #endif
         }
 
@@ -824,6 +959,8 @@ static void ap_config_phyGYR(bsx_f32_t sample_rate, uint16_t fifo_data_len)
     int32_t odr_Hz;
     int32_t bandwidth = 0;
     int32_t fifo_data_sel_regval;
+    [[maybe_unused]] uint32_t budget_frames;
+    [[maybe_unused]] uint32_t fifo_wm;
     float physical_Hz = 0;
 
     PINFO("set physical GYRO rate %f", sample_rate);
@@ -903,6 +1040,9 @@ static void ap_config_phyGYR(bsx_f32_t sample_rate, uint16_t fifo_data_len)
                 PDEBUG("shutdown gyro");
 
                 ret = wr_sysfs_oneint("pwr_cfg", gyr_input_dir_name, SENSOR_GYRO_PM_SUSPEND);
+#ifdef SMI230_FIFO
+                (void) sensord_wmctl_configure(WMCTL_FIFO_GYRO, 0, 0, 0, 0);
+#endif
         }else
         {
                 PDEBUG("set gyro active");
@@ -916,13 +1056,11 @@ static void ap_config_phyGYR(bsx_f32_t sample_rate, uint16_t fifo_data_len)
 		ret = wr_sysfs_oneint("bw_odr", gyr_input_dir_name, odr_Hz);
 #endif
 #ifdef SMI230_FIFO
-        if (fifo_data_len > SMI230_GYRO_MAX_FIFO_FRAME)
-            fifo_data_len = SMI230_GYRO_MAX_FIFO_FRAME;
-        if (fifo_data_len < 1)
-            fifo_data_len = 1;
-
-		PINFO("write gyro wm as %d", fifo_data_len);
-        ret = wr_sysfs_oneint("fifo_wm", gyr_input_dir_name, fifo_data_len);
+        physical_Hz = SMI230_physical_Hz(BSX_INPUT_ID_ANGULARRATE, sample_rate);
+        budget_frames = (uint32_t)(fifo_data_len * physical_Hz / sample_rate);
+        fifo_wm = sensord_wmctl_configure(WMCTL_FIFO_GYRO, physical_Hz, budget_frames,
+                SMI230_GYRO_MAX_FIFO_FRAME, SMI230_GYRO_BYTES_PER_FIFO_SAMPLE);
+		PINFO("gyro wm budget %u samples, start at %u", budget_frames, fifo_wm);
 #endif
         }
 
@@ -1081,6 +1219,53 @@ static void ap_config_physensor(bsx_u32_t input_id, bsx_f32_t sample_rate, uint1
 
 
 
+/**
+ * hand the request of one handle to the arbiter, once per physical sensor feeding it,
+ * and program a physical sensor only if its arbitrated rate or watermark changed
+ */
+static void ap_arbitrate_physensor(int32_t bsx_list_inx, bsx_f32_t sample_rate, uint16_t fifo_data_len)
+{
+    uint32_t i;
+    uint32_t input_id;
+    float phy_req_Hz;
+    uint16_t phy_fifo_data_len;
+    int found = 0;
+    int ret;
+
+    for (i = 0; i < SENSORD_ARBITER_CONSUMER_NUM; ++i)
+    {
+        if (bsx_list_inx != sensord_arbiter_consumer(i, &input_id))
+        {
+            continue;
+        }
+        found = 1;
+
+        ret = sensord_arbiter_request(i, sample_rate, fifo_data_len,
+                &input_id, &phy_req_Hz, &phy_fifo_data_len);
+        if (ret <= 0)
+        {
+            PDEBUG("physical config %u unchanged for list index %d", input_id, bsx_list_inx);
+            continue;
+        }
+
+        ap_config_physensor(input_id, phy_req_Hz, phy_fifo_data_len);
+
+        if (SAMPLE_RATE_DISABLED != phy_req_Hz &&
+                ((BSX_INPUT_ID_ACCELERATION == input_id && ACC_CHIP_SMI230 == accl_chip) ||
+                (BSX_INPUT_ID_ANGULARRATE == input_id && GYR_CHIP_SMI230 == gyro_chip)))
+        {
+            sensord_arbiter_set_phy_rate(input_id, SMI230_physical_Hz(input_id, phy_req_Hz));
+        }
+    }
+
+    if (0 == found)
+    {
+        PERR("wrong list index: %d", bsx_list_inx);
+    }
+
+    return;
+}
+
 /**
  *
  */
@@ -1091,7 +1276,7 @@ static void ap_send_config(int32_t bsx_list_inx)
     bsx_sensor_configuration_t bsx_config_output[2];
     int32_t bsx_supplier_id;
     int32_t list_inx_base;
-    bsx_u32_t input_id;
+    uint16_t fifo_data_len;
 
     if (bsx_list_inx <= SENSORLIST_INX_AMBIENT_IAQ)
     {
@@ -1134,25 +1319,17 @@ static void ap_send_config(int32_t bsx_list_inx)
         }
     }
 
-    {
-        switch (bsx_list_inx) {
-            case SENSORLIST_INX_ACCELEROMETER:
-                input_id = BSX_INPUT_ID_ACCELERATION;
-                break;
-            case SENSORLIST_INX_MAGNETIC_FIELD_UNCALIBRATED:
-                input_id = BSX_INPUT_ID_MAGNETICFIELD;
-                break;
-            case SENSORLIST_INX_GYROSCOPE_UNCALIBRATED:
-                input_id = BSX_INPUT_ID_ANGULARRATE;
-                break;
-            default:
-                PERR("wrong list index: %d", bsx_list_inx);
-                return;
-        }
+    fifo_data_len = p_config[bsx_list_inx - list_inx_base].fifo_data_len;
 
-        ap_config_physensor(input_id, bsx_config_output[0].sample_rate, p_config[bsx_list_inx - list_inx_base].fifo_data_len);
+    /*step pipeline wants its acc rate whatever the framework asked, and tolerates some lag*/
+    if (SENSORLIST_INX_STEP_DETECTOR == bsx_list_inx || SENSORLIST_INX_STEP_COUNTER == bsx_list_inx)
+    {
+        bsx_config_output[0].sample_rate = SENSORD_STEP_ACC_HZ;
+        fifo_data_len = SENSORD_STEP_ACC_WM;
     }
 
+    ap_arbitrate_physensor(bsx_list_inx, bsx_config_output[0].sample_rate, fifo_data_len);
+
     return;
 }
 
@@ -1163,7 +1340,6 @@ static void ap_send_config(int32_t bsx_list_inx)
 static void ap_send_disable_config(int32_t bsx_list_inx)
 {
     int32_t bsx_supplier_id;
-    bsx_u32_t input_id;
 
     bsx_supplier_id = convert_BSX_ListInx(bsx_list_inx);
     if (BSX_VIRTUAL_SENSOR_ID_INVALID == bsx_supplier_id)
@@ -1172,28 +1348,12 @@ static void ap_send_disable_config(int32_t bsx_list_inx)
         return;
     }
 
-    {
-        switch (bsx_list_inx) {
-            case SENSORLIST_INX_ACCELEROMETER:
-                input_id = BSX_INPUT_ID_ACCELERATION;
-                break;
-            case SENSORLIST_INX_MAGNETIC_FIELD_UNCALIBRATED:
-                input_id = BSX_INPUT_ID_MAGNETICFIELD;
-                break;
-            case SENSORLIST_INX_GYROSCOPE_UNCALIBRATED:
-                input_id = BSX_INPUT_ID_ANGULARRATE;
-                break;
-            default:
-                PERR("wrong list index: %d", bsx_list_inx);
-                return;
-        }
-
-        ap_config_physensor(input_id, SAMPLE_RATE_DISABLED, 0);
-    }
+    /*physical sensor only goes off when no other consumer still needs it*/
+    ap_arbitrate_physensor(bsx_list_inx, SAMPLE_RATE_DISABLED, 0);
     return;
 }
 
-int32_t ap_activate(int32_t handle, int32_t enabled)
+static int32_t hwcntl_do_activate(int32_t handle, int32_t enabled)
 {
     struct sensor_t *p_sensor;
     int32_t bsx_list_inx;
@@ -1232,7 +1392,7 @@ int32_t ap_activate(int32_t handle, int32_t enabled)
     return 0;
 }
 
-int32_t ap_batch(int32_t handle, int32_t flags, int64_t sampling_period_ns, int64_t max_report_latency_ns)
+static int32_t hwcntl_do_batch(int32_t handle, int32_t flags, int64_t sampling_period_ns, int64_t max_report_latency_ns)
 {
 
     (void) flags; //Deprecated in SENSORS_DEVICE_API_VERSION_1_3
@@ -1314,6 +1474,173 @@ int32_t ap_batch(int32_t handle, int32_t flags, int64_t sampling_period_ns, int6
     return 0;
 }
 
+/**
+ * activate/batch come from framework threads, but the sysfs writes they end in
+ * are carried out on the hwcntl thread between two FIFO reads.
+ * Command lives on the caller's stack, the caller sleeps until it's done
+ * or the thread is shut down, whichever comes first.
+ */
+typedef enum {
+    HWCNTL_CMD_ACTIVATE = 0,
+    HWCNTL_CMD_BATCH,
+} HWCNTL_CMD_TYPE;
+
+typedef struct hwcntl_cmd {
+    HWCNTL_CMD_TYPE type;
+    int32_t handle;
+    int32_t enabled;
+    int32_t flags;
+    int64_t sampling_period_ns;
+    int64_t max_report_latency_ns;
+    int32_t ret;
+    int32_t done;
+    struct hwcntl_cmd *next;
+} HWCNTL_CMD;
+
+static pthread_mutex_t hwcntl_cmd_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hwcntl_cmd_cond = PTHREAD_COND_INITIALIZER;
+static HWCNTL_CMD *hwcntl_cmd_head = NULL;
+static HWCNTL_CMD *hwcntl_cmd_tail = NULL;
+/// set before hwcntl thread is killed, nobody is left to complete a command after that
+static uint8_t hwcntl_cmd_shutdown = 0;
+
+static int32_t hwcntl_cmd_run(HWCNTL_CMD *p_cmd)
+{
+    switch (p_cmd->type)
+    {
+        case HWCNTL_CMD_ACTIVATE:
+            return hwcntl_do_activate(p_cmd->handle, p_cmd->enabled);
+        case HWCNTL_CMD_BATCH:
+            return hwcntl_do_batch(p_cmd->handle, p_cmd->flags,
+                    p_cmd->sampling_period_ns, p_cmd->max_report_latency_ns);
+        default:
+            return -EINVAL;
+    }
+}
+
+/*runs on hwcntl thread*/
+static void hwcntl_cmd_process()
+{
+    HWCNTL_CMD *p_cmd;
+    HWCNTL_CMD cmd;
+    uint64_t count;
+    int32_t ret;
+
+    (void) read(hwcntl_cmd_evtfd, &count, sizeof(count));
+
+    pthread_mutex_lock(&hwcntl_cmd_mutex);
+    while (NULL != (p_cmd = hwcntl_cmd_head))
+    {
+        hwcntl_cmd_head = p_cmd->next;
+        if (NULL == hwcntl_cmd_head)
+        {
+            hwcntl_cmd_tail = NULL;
+        }
+
+        /*arbiter and config string have own locks, queue lock only keeps commands in order.
+         Run on a copy, a caller let go by shutdown takes its command with it*/
+        cmd = *p_cmd;
+        pthread_mutex_unlock(&hwcntl_cmd_mutex);
+        ret = hwcntl_cmd_run(&cmd);
+        pthread_mutex_lock(&hwcntl_cmd_mutex);
+
+        if (hwcntl_cmd_shutdown)
+        {
+            break;
+        }
+        p_cmd->ret = ret;
+        p_cmd->done = 1;
+        pthread_cond_broadcast(&hwcntl_cmd_cond);
+    }
+    pthread_mutex_unlock(&hwcntl_cmd_mutex);
+}
+
+/*runs on framework thread, returns result of the command, -ESHUTDOWN once hwcntl thread is going away*/
+static int32_t hwcntl_cmd_post(HWCNTL_CMD *p_cmd)
+{
+    uint64_t one = 1;
+    int32_t ret;
+
+    if (hwcntl_cmd_evtfd < 0)
+    {
+        /*no hwcntl loop to hand over to*/
+        return hwcntl_cmd_run(p_cmd);
+    }
+
+    p_cmd->done = 0;
+    p_cmd->next = NULL;
+
+    pthread_mutex_lock(&hwcntl_cmd_mutex);
+    if (hwcntl_cmd_shutdown)
+    {
+        pthread_mutex_unlock(&hwcntl_cmd_mutex);
+        return -ESHUTDOWN;
+    }
+    if (hwcntl_cmd_tail)
+    {
+        hwcntl_cmd_tail->next = p_cmd;
+    }
+    else
+    {
+        hwcntl_cmd_head = p_cmd;
+    }
+    hwcntl_cmd_tail = p_cmd;
+
+    if (write(hwcntl_cmd_evtfd, &one, sizeof(one)) < 0)
+    {
+        PERR("write command eventfd fail, errno = %d(%s)", errno, strerror(errno));
+    }
+
+    while (!p_cmd->done && !hwcntl_cmd_shutdown)
+    {
+        pthread_cond_wait(&hwcntl_cmd_cond, &hwcntl_cmd_mutex);
+    }
+    ret = p_cmd->done ? p_cmd->ret : -ESHUTDOWN;
+    pthread_mutex_unlock(&hwcntl_cmd_mutex);
+
+    return ret;
+}
+
+/**
+ * called before hwcntl thread is killed. Commands still queued or running are
+ * given up, their callers and any later one get -ESHUTDOWN
+ */
+void hwcntl_shutdown(void)
+{
+    pthread_mutex_lock(&hwcntl_cmd_mutex);
+    hwcntl_cmd_shutdown = 1;
+    hwcntl_cmd_head = NULL;
+    hwcntl_cmd_tail = NULL;
+    pthread_cond_broadcast(&hwcntl_cmd_cond);
+    pthread_mutex_unlock(&hwcntl_cmd_mutex);
+}
+
+int32_t ap_activate(int32_t handle, int32_t enabled)
+{
+    HWCNTL_CMD cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = HWCNTL_CMD_ACTIVATE;
+    cmd.handle = handle;
+    cmd.enabled = enabled;
+
+    return hwcntl_cmd_post(&cmd);
+}
+
+int32_t ap_batch(int32_t handle, int32_t flags, int64_t sampling_period_ns, int64_t max_report_latency_ns)
+{
+    HWCNTL_CMD cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = HWCNTL_CMD_BATCH;
+    cmd.handle = handle;
+    cmd.flags = flags;
+    cmd.sampling_period_ns = sampling_period_ns;
+    cmd.max_report_latency_ns = max_report_latency_ns;
+
+    return hwcntl_cmd_post(&cmd);
+}
+
 int32_t ap_flush(BoschSensor *boschsensor, int32_t handle)
 {
     struct sensor_t *p_sensor;
@@ -1336,9 +1663,9 @@ int32_t ap_flush(BoschSensor *boschsensor, int32_t handle)
         return -EINVAL;
     }
 
-
-    //Now the driver can not support this specification, so has to work around
-    (void) boschsensor->send_flush_event(handle);
+    /*samples the driver already reported are drained by hwcntl and delivered
+     by sensord before the flush complete event*/
+    (void) boschsensor->request_flush(handle);
 
     /*If the specified sensor has no FIFO (no buffering possible),
      or if the FIFO was empty at the time of the call,
@@ -1351,202 +1678,456 @@ int32_t ap_flush(BoschSensor *boschsensor, int32_t handle)
 }
 
 #ifdef SMI230_DATA_SYNC
-static void ap_hw_poll_smi230acc(BoschSimpleList *dest_list_acc, BoschSimpleList *dest_list_gyro)
+#define INPUT_FRAME_VALUES_ACC 11
+#else
+#define INPUT_FRAME_VALUES_ACC 5
+#endif
+#define INPUT_FRAME_VALUES_GYRO 5
+
+/*bulk read size, a burst of 100+ FIFO frames then costs a handful of syscalls*/
+#define INPUT_EVENTS_PER_READ 512
+
+static struct input_event input_event_buf[INPUT_EVENTS_PER_READ];
+static INPUT_FRAME_PARSER acc_frame_parser;
+[[maybe_unused]] static INPUT_FRAME_PARSER gyr_frame_parser;
+
+#ifdef SMI230_DATA_SYNC
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_parse_smi230acc(BoschSamplePool *pool, BoschSampleRing *dest_ring_acc, BoschSampleRing *dest_ring_gyro,
+        const struct input_event *p_ev, uint32_t n, WMCTL_READ *p_read)
 {
-    int32_t ret;
-    struct input_event event[12];
+    uint32_t i;
+    const int32_t *p_value = acc_frame_parser.value;
     HW_DATA_UNION *p_hwdata;
+    uint32_t pushed = 0;
+    int64_t timestamp;
 
-    while( (ret = read(acc_input_fd, event, sizeof(event))) > 0)
-    {
-        if(EV_SYN != event[11].type)
-        {
-            PWARN("0: %d, %d, %d;", event[0].type, event[0].code, event[0].value);
-            PWARN("1: %d, %d, %d;", event[1].type, event[1].code, event[1].value);
-            PWARN("2: %d, %d, %d;", event[2].type, event[2].code, event[2].value);
-            PWARN("3: %d, %d, %d;", event[3].type, event[3].code, event[3].value);
-            PWARN("4: %d, %d, %d;", event[4].type, event[4].code, event[4].value);
-            PWARN("5: %d, %d, %d;", event[5].type, event[5].code, event[5].value);
-            PWARN("6: %d, %d, %d;", event[6].type, event[6].code, event[6].value);
-            PWARN("7: %d, %d, %d;", event[7].type, event[7].code, event[7].value);
-            PWARN("8: %d, %d, %d;", event[8].type, event[8].code, event[8].value);
-            PWARN("9: %d, %d, %d;", event[9].type, event[9].code, event[9].value);
-            PWARN("10: %d, %d, %d;", event[10].type, event[10].code, event[10].value);
-            PWARN("11: %d, %d, %d;", event[11].type, event[11].code, event[11].value);
+    for (i = 0; i < n; ++i)
+    {
+        if (0 == input_frame_feed(&acc_frame_parser, &p_ev[i], INPUT_FRAME_VALUES_ACC, "acc"))
+        {
             continue;
         }
 
-        p_hwdata = (HW_DATA_UNION *) calloc(1, sizeof(HW_DATA_UNION));
+        //use sync event timestamp for all data
+        timestamp = p_value[0] * 1000000000LL + p_value[1];
+
+        /*frame left the FIFO whether or not the pool can take it*/
+        wmctl_read_add(p_read, timestamp);
+
+        p_hwdata = pool->alloc();
         if (NULL == p_hwdata)
         {
-            PERR("malloc fail");
+            /*pool exhausted, counted by the pool and reported once per pass*/
             continue;
         }
 
         p_hwdata->id = SENSOR_TYPE_ACCELEROMETER;
-        p_hwdata->x = event[2].value;
-        p_hwdata->y = event[3].value;
-        p_hwdata->z = event[4].value;
-	//use sync event timestamp for all data
-        p_hwdata->timestamp = event[0].value * 1000000000LL +  event[1].value;
-
-        ret = dest_list_acc->list_add_rear((void *) p_hwdata);
-        if (ret)
-        {
-            PERR("list_add_rear() fail, ret = %d", ret);
-            if(-1 == ret){
-                free(p_hwdata);
-            }
-        }
+        p_hwdata->x = p_value[2];
+        p_hwdata->y = p_value[3];
+        p_hwdata->z = p_value[4];
+        p_hwdata->timestamp = timestamp;
+
+        /*if ring is full, the oldest sample is handed back to the pool*/
+        pool->recycle(dest_ring_acc->push(p_hwdata));
+        pushed++;
 
-        p_hwdata = (HW_DATA_UNION *) calloc(1, sizeof(HW_DATA_UNION));
+        p_hwdata = pool->alloc();
         if (NULL == p_hwdata)
         {
-            PERR("malloc fail");
             continue;
         }
 
         p_hwdata->id = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
-        p_hwdata->x_uncalib = event[5].value;
-        p_hwdata->y_uncalib = event[6].value;
-        p_hwdata->z_uncalib = event[7].value;
-	//use sync event timestamp for all data
-        p_hwdata->timestamp = event[0].value * 1000000000LL +  event[1].value;
-
-        ret = dest_list_gyro->list_add_rear((void *) p_hwdata);
-        if (ret)
-        {
-            PERR("list_add_rear() fail, ret = %d", ret);
-            if(-1 == ret){
-                free(p_hwdata);
-            }
+        p_hwdata->x_uncalib = p_value[5];
+        p_hwdata->y_uncalib = p_value[6];
+        p_hwdata->z_uncalib = p_value[7];
+        p_hwdata->timestamp = timestamp;
+
+        pool->recycle(dest_ring_gyro->push(p_hwdata));
+        pushed++;
+    }
+
+    return pushed;
+}
+
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_poll_smi230acc(BoschSamplePool *pool, BoschSampleRing *dest_ring_acc, BoschSampleRing *dest_ring_gyro,
+        WMCTL_READ *p_read)
+{
+    int32_t ret;
+    uint32_t n;
+    uint32_t pushed = 0;
+
+    while( (ret = read(acc_input_fd, input_event_buf, sizeof(input_event_buf))) > 0)
+    {
+        n = ret / sizeof(struct input_event);
+        pushed += ap_hw_parse_smi230acc(pool, dest_ring_acc, dest_ring_gyro, input_event_buf, n, p_read);
+
+        /*short read means evdev buffer is empty, spare the EAGAIN round trip*/
+        if (n < INPUT_EVENTS_PER_READ)
+        {
+            break;
         }
     }
 
-    return;
+    return pushed;
 }
 
 #else
 
-static void ap_hw_poll_smi230acc(BoschSimpleList *dest_list_acc)
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_parse_smi230acc(BoschSamplePool *pool, BoschSampleRing *dest_ring_acc,
+        const struct input_event *p_ev, uint32_t n, WMCTL_READ *p_read)
 {
-    int32_t ret;
-    struct input_event event[6];
+    uint32_t i;
+    const int32_t *p_value = acc_frame_parser.value;
     HW_DATA_UNION *p_hwdata;
+    uint32_t pushed = 0;
+    int64_t timestamp;
 
-    while( (ret = read(acc_input_fd, event, sizeof(event))) > 0)
+    for (i = 0; i < n; ++i)
     {
-        if(EV_SYN != event[5].type)
+        if (0 == input_frame_feed(&acc_frame_parser, &p_ev[i], INPUT_FRAME_VALUES_ACC, "acc"))
         {
-            PWARN("0: %d, %d, %d;", event[0].type, event[0].code, event[0].value);
-            PWARN("1: %d, %d, %d;", event[1].type, event[1].code, event[1].value);
-            PWARN("2: %d, %d, %d;", event[2].type, event[2].code, event[2].value);
-            PWARN("3: %d, %d, %d;", event[3].type, event[3].code, event[3].value);
-            PWARN("4: %d, %d, %d;", event[4].type, event[4].code, event[4].value);
-            PWARN("5: %d, %d, %d;", event[5].type, event[5].code, event[5].value);
             continue;
         }
-        if(event[0].value == 0)
+
+        if (0 == p_value[0])
         {
-            PWARN("0: %d, %d, %d;", event[0].type, event[0].code, event[0].value);
-            PWARN("1: %d, %d, %d;", event[1].type, event[1].code, event[1].value);
-            PWARN("2: %d, %d, %d;", event[2].type, event[2].code, event[2].value);
-            PWARN("3: %d, %d, %d;", event[3].type, event[3].code, event[3].value);
-            PWARN("4: %d, %d, %d;", event[4].type, event[4].code, event[4].value);
-            PWARN("5: %d, %d, %d;", event[5].type, event[5].code, event[5].value);
+            PDEBUG("acc frame without timestamp: %d, %d, %d", p_value[2], p_value[3], p_value[4]);
             continue;
         }
 
-        p_hwdata = (HW_DATA_UNION *) calloc(1, sizeof(HW_DATA_UNION));
+        timestamp = p_value[0] * 1000000000LL + p_value[1];
+
+        /*frame left the FIFO whether or not the pool can take it*/
+        wmctl_read_add(p_read, timestamp);
+
+        p_hwdata = pool->alloc();
         if (NULL == p_hwdata)
         {
-            PERR("malloc fail");
+            /*pool exhausted, counted by the pool and reported once per pass*/
             continue;
         }
 
         p_hwdata->id = SENSOR_TYPE_ACCELEROMETER;
-        p_hwdata->x = event[2].value;
-        p_hwdata->y = event[3].value;
-        p_hwdata->z = event[4].value;
-        p_hwdata->timestamp = event[0].value * 1000000000LL +  event[1].value;
+        p_hwdata->x = p_value[2];
+        p_hwdata->y = p_value[3];
+        p_hwdata->z = p_value[4];
+        p_hwdata->timestamp = timestamp;
+
+        /*if ring is full, the oldest sample is handed back to the pool*/
+        pool->recycle(dest_ring_acc->push(p_hwdata));
+        pushed++;
+    }
+
+    return pushed;
+}
+
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_poll_smi230acc(BoschSamplePool *pool, BoschSampleRing *dest_ring_acc, WMCTL_READ *p_read)
+{
+    int32_t ret;
+    uint32_t n;
+    uint32_t pushed = 0;
+
+    while( (ret = read(acc_input_fd, input_event_buf, sizeof(input_event_buf))) > 0)
+    {
+        n = ret / sizeof(struct input_event);
+        pushed += ap_hw_parse_smi230acc(pool, dest_ring_acc, input_event_buf, n, p_read);
 
-        ret = dest_list_acc->list_add_rear((void *) p_hwdata);
-        if (ret)
+        /*short read means evdev buffer is empty, spare the EAGAIN round trip*/
+        if (n < INPUT_EVENTS_PER_READ)
         {
-            PERR("list_add_rear() fail, ret = %d", ret);
-            if(-1 == ret){
-                free(p_hwdata);
-            }
+            break;
         }
     }
 
-    return;
+    return pushed;
 }
 #endif
 
 #ifndef SMI230_DATA_SYNC
-static void ap_hw_poll_smi230gyro(BoschSimpleList *dest_list)
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_parse_smi230gyro(BoschSamplePool *pool, BoschSampleRing *dest_ring,
+        const struct input_event *p_ev, uint32_t n, WMCTL_READ *p_read)
 {
-    int32_t ret;
-    struct input_event event[6];
+    uint32_t i;
+    const int32_t *p_value = gyr_frame_parser.value;
     HW_DATA_UNION *p_hwdata;
+    uint32_t pushed = 0;
+    int64_t timestamp;
 
-    while( (ret = read(gyr_input_fd, event, sizeof(event))) > 0)
+    for (i = 0; i < n; ++i)
     {
-        if(EV_SYN != event[5].type)
+        if (0 == input_frame_feed(&gyr_frame_parser, &p_ev[i], INPUT_FRAME_VALUES_GYRO, "gyro"))
         {
-            PWARN("0: %d, %d, %d;", event[0].type, event[0].code, event[0].value);
-            PWARN("1: %d, %d, %d;", event[1].type, event[1].code, event[1].value);
-            PWARN("2: %d, %d, %d;", event[2].type, event[2].code, event[2].value);
-            PWARN("3: %d, %d, %d;", event[3].type, event[3].code, event[3].value);
-            PWARN("4: %d, %d, %d;", event[4].type, event[4].code, event[4].value);
-            PWARN("5: %d, %d, %d;", event[5].type, event[5].code, event[5].value);
             continue;
         }
 
-        p_hwdata = (HW_DATA_UNION *) calloc(1, sizeof(HW_DATA_UNION));
+        timestamp = p_value[0] * 1000000000LL + p_value[1];
+
+        /*frame left the FIFO whether or not the pool can take it*/
+        wmctl_read_add(p_read, timestamp);
+
+        p_hwdata = pool->alloc();
         if (NULL == p_hwdata)
         {
-            PERR("malloc fail");
+            /*pool exhausted, counted by the pool and reported once per pass*/
             continue;
         }
 
         p_hwdata->id = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
-        p_hwdata->x_uncalib = event[2].value;
-        p_hwdata->y_uncalib = event[3].value;
-        p_hwdata->z_uncalib = event[4].value;
-        p_hwdata->timestamp = event[0].value * 1000000000LL +  event[1].value;
+        p_hwdata->x_uncalib = p_value[2];
+        p_hwdata->y_uncalib = p_value[3];
+        p_hwdata->z_uncalib = p_value[4];
+        p_hwdata->timestamp = timestamp;
+
+        /*if ring is full, the oldest sample is handed back to the pool*/
+        pool->recycle(dest_ring->push(p_hwdata));
+        pushed++;
+    }
+
+    return pushed;
+}
+
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_poll_smi230gyro(BoschSamplePool *pool, BoschSampleRing *dest_ring, WMCTL_READ *p_read)
+{
+    int32_t ret;
+    uint32_t n;
+    uint32_t pushed = 0;
 
-        hw_remap_sensor_data(&(p_hwdata->x_uncalib), &(p_hwdata->y_uncalib), &(p_hwdata->z_uncalib), g_place_g);
+    while( (ret = read(gyr_input_fd, input_event_buf, sizeof(input_event_buf))) > 0)
+    {
+        n = ret / sizeof(struct input_event);
+        pushed += ap_hw_parse_smi230gyro(pool, dest_ring, input_event_buf, n, p_read);
 
-        ret = dest_list->list_add_rear((void *) p_hwdata);
-        if (ret)
+        /*short read means evdev buffer is empty, spare the EAGAIN round trip*/
+        if (n < INPUT_EVENTS_PER_READ)
         {
-            PERR("list_add_rear() fail, ret = %d", ret);
-            if(-1 == ret){
-                free(p_hwdata);
-            }
+            break;
         }
     }
 
-    return;
+    return pushed;
 }
 #endif
 
-
-/*
-static void dump_samples(BoschSimpleList *al, BoschSimpleList *gl, BoschSimpleList *ml)
+/**
+ * packed scans of the IIO backend: x, y, z (gyro x, y, z in data sync mode), timestamp last
+ * @param dest_ring_gyro NULL unless scans carry the gyro half of a data sync frame
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_push_smi230_iio(const IIO_BUFFER *p_iio, const uint8_t *p_scans, int32_t n,
+        BoschSamplePool *pool, int32_t id, BoschSampleRing *dest_ring, BoschSampleRing *dest_ring_gyro,
+        WMCTL_READ *p_read)
 {
+    int32_t i;
+    const uint8_t *p_scan;
+    const IIO_CHANNEL *const *p_ch = p_iio->p_req;
+    const IIO_CHANNEL *p_ts = p_iio->p_req[p_iio->channel_num - 1];
     HW_DATA_UNION *p_hwdata;
-    struct list_node *pnode;
-    uint32_t i;
+    uint32_t pushed = 0;
+    int64_t timestamp;
 
-    pnode = al->head;
-    for (i = 0; i < al->list_len; ++i) {
-        p_hwdata = (HW_DATA_UNION *)(pnode->p_data);
-        PNOTE("**ACCL tm = %lld", p_hwdata->timestamp);
-        pnode = pnode->next;
-    }
+    for (i = 0; i < n; ++i)
+    {
+        p_scan = p_scans + (uint32_t)i * p_iio->scan_size;
+        timestamp = iio_channel_value(p_ts, p_scan);
+
+        wmctl_read_add(p_read, timestamp);
+
+        p_hwdata = pool->alloc();
+        if (NULL == p_hwdata)
+        {
+            /*pool exhausted, counted by the pool and reported once per pass*/
+            continue;
+        }
+
+        p_hwdata->id = id;
+        p_hwdata->x = (int32_t)iio_channel_value(p_ch[0], p_scan);
+        p_hwdata->y = (int32_t)iio_channel_value(p_ch[1], p_scan);
+        p_hwdata->z = (int32_t)iio_channel_value(p_ch[2], p_scan);
+        p_hwdata->timestamp = timestamp;
+
+        /*if ring is full, the oldest sample is handed back to the pool*/
+        pool->recycle(dest_ring->push(p_hwdata));
+        pushed++;
+
+        if (NULL == dest_ring_gyro)
+        {
+            continue;
+        }
+
+        p_hwdata = pool->alloc();
+        if (NULL == p_hwdata)
+        {
+            continue;
+        }
+
+        p_hwdata->id = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
+        p_hwdata->x_uncalib = (int32_t)iio_channel_value(p_ch[3], p_scan);
+        p_hwdata->y_uncalib = (int32_t)iio_channel_value(p_ch[4], p_scan);
+        p_hwdata->z_uncalib = (int32_t)iio_channel_value(p_ch[5], p_scan);
+        p_hwdata->timestamp = timestamp;
+
+        pool->recycle(dest_ring_gyro->push(p_hwdata));
+        pushed++;
+    }
+
+    return pushed;
+}
+
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_poll_smi230_iio(IIO_BUFFER *p_iio, BoschSamplePool *pool, int32_t id,
+        BoschSampleRing *dest_ring, BoschSampleRing *dest_ring_gyro, WMCTL_READ *p_read)
+{
+    int32_t n;
+    uint32_t pushed = 0;
+
+    while ((n = iio_buffer_read(p_iio)) > 0)
+    {
+        pushed += ap_hw_push_smi230_iio(p_iio, p_iio->p_scans, n, pool, id, dest_ring, dest_ring_gyro, p_read);
+
+        if (n < IIO_SCANS_PER_READ)
+        {
+            break;
+        }
+    }
+
+    if (n < 0)
+    {
+        PERR("read IIO buffer fail, ret = %d", n);
+    }
+
+    return pushed;
+}
+
+/**
+ * read acc (and gyro in data sync mode) from whichever backend is open
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_read_smi230acc(BoschSensor *boschsensor, WMCTL_READ *p_read)
+{
+#ifdef SMI230_DATA_SYNC
+    if (p_acc_iio)
+    {
+        return ap_hw_poll_smi230_iio(p_acc_iio, boschsensor->sample_pool, SENSOR_TYPE_ACCELEROMETER,
+                boschsensor->ring_acclraw, boschsensor->ring_gyroraw, p_read);
+    }
+
+    return ap_hw_poll_smi230acc(boschsensor->sample_pool, boschsensor->ring_acclraw, boschsensor->ring_gyroraw, p_read);
+#else
+    if (p_acc_iio)
+    {
+        return ap_hw_poll_smi230_iio(p_acc_iio, boschsensor->sample_pool, SENSOR_TYPE_ACCELEROMETER,
+                boschsensor->ring_acclraw, NULL, p_read);
+    }
+
+    return ap_hw_poll_smi230acc(boschsensor->sample_pool, boschsensor->ring_acclraw, p_read);
+#endif
+}
+
+#ifndef SMI230_DATA_SYNC
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_read_smi230gyro(BoschSensor *boschsensor, WMCTL_READ *p_read)
+{
+    if (p_gyr_iio)
+    {
+        return ap_hw_poll_smi230_iio(p_gyr_iio, boschsensor->sample_pool, SENSOR_TYPE_GYROSCOPE_UNCALIBRATED,
+                boschsensor->ring_gyroraw, NULL, p_read);
+    }
+
+    return ap_hw_poll_smi230gyro(boschsensor->sample_pool, boschsensor->ring_gyroraw, p_read);
+}
+#endif
+
+#ifdef SMI230_IO_URING
+static URING_READER hwcntl_uring;
+/*a fd was given up by the ring, the loop goes back to epoll after this pass*/
+static int hwcntl_uring_stopped = 0;
+
+static int32_t IMU_hwcntl_epoll_init(BoschSensor *boschsensor);
+static uint32_t IMU_hw_deliver_sensordata(BoschSensor *boschsensor);
+
+/**
+ * bytes of one io_uring read of the acc node, to whichever parser the backend needs
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_feed_smi230acc(BoschSensor *boschsensor, const uint8_t *p_data, int32_t len,
+        WMCTL_READ *p_read)
+{
+#ifdef SMI230_DATA_SYNC
+    BoschSampleRing *ring_gyro = boschsensor->ring_gyroraw;
+#else
+    BoschSampleRing *ring_gyro = NULL;
+#endif
+
+    if (p_acc_iio)
+    {
+        return ap_hw_push_smi230_iio(p_acc_iio, p_data, len / (int32_t)p_acc_iio->scan_size, boschsensor->sample_pool,
+                SENSOR_TYPE_ACCELEROMETER, boschsensor->ring_acclraw, ring_gyro, p_read);
+    }
+
+#ifdef SMI230_DATA_SYNC
+    return ap_hw_parse_smi230acc(boschsensor->sample_pool, boschsensor->ring_acclraw, ring_gyro,
+            (const struct input_event *)p_data, len / sizeof(struct input_event), p_read);
+#else
+    return ap_hw_parse_smi230acc(boschsensor->sample_pool, boschsensor->ring_acclraw,
+            (const struct input_event *)p_data, len / sizeof(struct input_event), p_read);
+#endif
+}
+
+#ifndef SMI230_DATA_SYNC
+/**
+ * @return number of samples pushed
+ */
+static uint32_t ap_hw_feed_smi230gyro(BoschSensor *boschsensor, const uint8_t *p_data, int32_t len,
+        WMCTL_READ *p_read)
+{
+    if (p_gyr_iio)
+    {
+        return ap_hw_push_smi230_iio(p_gyr_iio, p_data, len / (int32_t)p_gyr_iio->scan_size, boschsensor->sample_pool,
+                SENSOR_TYPE_GYROSCOPE_UNCALIBRATED, boschsensor->ring_gyroraw, NULL, p_read);
+    }
+
+    return ap_hw_parse_smi230gyro(boschsensor->sample_pool, boschsensor->ring_gyroraw,
+            (const struct input_event *)p_data, len / sizeof(struct input_event), p_read);
+}
+#endif
+#endif
+
+/*
+static void dump_samples(BoschSimpleList *al, BoschSimpleList *gl, BoschSimpleList *ml)
+{
+    HW_DATA_UNION *p_hwdata;
+    struct list_node *pnode;
+    uint32_t i;
+
+    pnode = al->head;
+    for (i = 0; i < al->list_len; ++i) {
+        p_hwdata = (HW_DATA_UNION *)(pnode->p_data);
+        PNOTE("**ACCL tm = %lld", p_hwdata->timestamp);
+        pnode = pnode->next;
+    }
 
     pnode = gl->head;
     for (i = 0; i < gl->list_len; ++i) {
@@ -1570,85 +2151,469 @@ static void dump_samples(BoschSimpleList *al, BoschSimpleList *gl, BoschSimpleLi
 
 
 
+/*ring drops and pool exhaustion, logged once per change*/
+static void IMU_hw_report_loss(BoschSensor *boschsensor)
+{
+    static uint64_t last_drop_count = 0;
+    static uint64_t last_exhausted_count = 0;
+    uint64_t drop_count;
+    uint64_t exhausted_count;
+
+    drop_count = boschsensor->ring_acclraw->get_drop_count() + boschsensor->ring_gyroraw->get_drop_count();
+    if (drop_count != last_drop_count)
+    {
+        PWARN("sample ring full, %llu samples dropped in total", (unsigned long long)drop_count);
+        last_drop_count = drop_count;
+    }
+
+    exhausted_count = boschsensor->sample_pool->get_exhausted_count();
+    if (exhausted_count != last_exhausted_count)
+    {
+        PWARN("sample pool exhausted, %llu samples lost in total, high water %u/%u",
+                (unsigned long long)exhausted_count,
+                boschsensor->sample_pool->get_high_water(),
+                boschsensor->sample_pool->get_capacity());
+        last_exhausted_count = exhausted_count;
+    }
+}
+
+/**
+ * acc calibration control FIFO, opened read-write so it never reads EOF when a writer goes away.
+ * Without it only the control path is lost
+ */
+static void hwcntl_ctl_open(void)
+{
+    struct stat st;
+
+    if (mkfifo(SENSORD_ACCCAL_CTL_FIFO, 0660) && EEXIST != errno)
+    {
+        PWARN("create %s fail, errno = %d(%s), no acc cal control", SENSORD_ACCCAL_CTL_FIFO, errno, strerror(errno));
+        return;
+    }
+
+    hwcntl_ctl_fd = open(SENSORD_ACCCAL_CTL_FIFO, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (hwcntl_ctl_fd < 0)
+    {
+        PWARN("open %s fail, errno = %d(%s), no acc cal control", SENSORD_ACCCAL_CTL_FIFO, errno, strerror(errno));
+        return;
+    }
+
+    /*a plain file left at the path can't be polled*/
+    if (fstat(hwcntl_ctl_fd, &st) || !S_ISFIFO(st.st_mode))
+    {
+        PWARN("%s is not a FIFO, no acc cal control", SENSORD_ACCCAL_CTL_FIFO);
+        close(hwcntl_ctl_fd);
+        hwcntl_ctl_fd = -1;
+    }
+
+    return;
+}
+
+static void hwcntl_ctl_read(void)
+{
+    char buf[HWCNTL_CTL_BUF_LEN];
+    ssize_t len;
+
+    while ((len = read(hwcntl_ctl_fd, buf, sizeof(buf))) > 0)
+    {
+        (void) sensord_algo_acc_cal_text(buf, (int32_t)len);
+    }
+
+    return;
+}
+
 static uint32_t IMU_hw_deliver_sensordata(BoschSensor *boschsensor)
 {
     int32_t ret;
-    uint32_t j;
-#ifdef SMI230_DATA_SYNC
-    struct pollfd poll_fds[1];
-#else
-    struct pollfd poll_fds[2];
-#endif
+    int32_t i;
+    uint32_t ready = 0;
+    uint32_t pushed = 0;
+    uint64_t expirations;
+    WMCTL_READ wm_read;
+    struct epoll_event events[HWCNTL_SRC_NUM];
 
-    if(ACC_CHIP_SMI230 == accl_chip)
+    ret = epoll_wait(hwcntl_epoll_fd, events, ARRAY_ELEMENTS(events), -1);
+    if (ret <= 0)
     {
-        poll_fds[0].fd = acc_input_fd;
-        poll_fds[0].events = POLLIN;
+        if (ret < 0 && EINTR != errno)
+        {
+            PERR("epoll_wait in error: errno = %d(%s)", errno, strerror(errno));
+        }
+        return 0;
+    }
+
+    for (i = 0; i < ret; ++i)
+    {
+        ready |= 1U << events[i].data.u32;
+    }
+
+    /*every ready FIFO is read before sensord gets one wakeup for all of them*/
+    if (ready & (1U << HWCNTL_SRC_ACC))
+    {
+        memset(&wm_read, 0, sizeof(wm_read));
+        pushed += ap_hw_read_smi230acc(boschsensor, &wm_read);
+        sensord_wmctl_note_read(WMCTL_FIFO_ACC, &wm_read, sensord_get_tmstmp_ns());
     }
 
 #ifndef SMI230_DATA_SYNC
-    if(GYR_CHIP_SMI230 == gyro_chip)
+    if (ready & (1U << HWCNTL_SRC_GYRO))
     {
-        poll_fds[1].fd = gyr_input_fd;
-        poll_fds[1].events = POLLIN;
+        memset(&wm_read, 0, sizeof(wm_read));
+        pushed += ap_hw_read_smi230gyro(boschsensor, &wm_read);
+        sensord_wmctl_note_read(WMCTL_FIFO_GYRO, &wm_read, sensord_get_tmstmp_ns());
     }
 #endif
 
-    ret = poll(poll_fds, ARRAY_ELEMENTS(poll_fds), -1);
-    if (ret <= 0)
+    if (ready & (1U << HWCNTL_SRC_TIMER))
     {
-        PERR("poll in error: ret=%d", ret);
-        return 0;
+        /*sensord owns the deadlines, it only needs to be woken*/
+        if (read(boschsensor->deliver_timer_fd, &expirations, sizeof(expirations)) > 0)
+        {
+            boschsensor->sensord_notify_wakeup();
+        }
+    }
+
+    if (ready & (1U << HWCNTL_SRC_WAKE_TIMER))
+    {
+        if (read(boschsensor->wake_timer_fd, &expirations, sizeof(expirations)) > 0)
+        {
+            /*AP may be up only for this alarm, held until sensord wrote the due events*/
+            boschsensor->hwcntl_wake_hold(1);
+            boschsensor->sensord_notify_wakeup();
+        }
+    }
+
+    if (ready & (1U << HWCNTL_SRC_FLUSH))
+    {
+        (void) read(boschsensor->flush_evtfd, &expirations, sizeof(expirations));
+        /*whatever the driver has reported up to now goes ahead of the flush complete.
+         not an interrupt driven read, kept out of watermark statistics*/
+        memset(&wm_read, 0, sizeof(wm_read));
+        pushed += ap_hw_read_smi230acc(boschsensor, &wm_read);
+        sensord_wmctl_note_drain(WMCTL_FIFO_ACC, &wm_read);
+#ifndef SMI230_DATA_SYNC
+        memset(&wm_read, 0, sizeof(wm_read));
+        pushed += ap_hw_read_smi230gyro(boschsensor, &wm_read);
+        sensord_wmctl_note_drain(WMCTL_FIFO_GYRO, &wm_read);
+#endif
+        boschsensor->hwcntl_flush_drained();
+    }
+
+    if (pushed)
+    {
+        boschsensor->hwcntl_wake_hold(0);
+        boschsensor->sensord_notify_rawdata();
+    }
+
+    /*reconfiguration only between reads, so sysfs and FIFO reader never overlap*/
+    if (ready & (1U << HWCNTL_SRC_CMD))
+    {
+        hwcntl_cmd_process();
     }
 
-    for (j = 0; j < ARRAY_ELEMENTS(poll_fds); j++)
+    if (ready & (1U << HWCNTL_SRC_CTL))
     {
-        if (POLLIN != poll_fds[j].revents)
+        hwcntl_ctl_read();
+    }
+
+    IMU_hw_report_loss(boschsensor);
+
+    return 0;
+
+}
+
+#ifdef SMI230_IO_URING
+/**
+ * take every completion off the ring: samples go to the rings, control sources come back as bits
+ * @param note_wm 0 for reads not driven by a FIFO interrupt
+ * @return number of samples pushed
+ */
+static uint32_t IMU_hw_reap_uring(BoschSensor *boschsensor, uint32_t *p_ready, int note_wm)
+{
+    URING_COMPLETION comp;
+    WMCTL_READ wm_read;
+    uint32_t pushed = 0;
+
+    while (uring_reader_next(&hwcntl_uring, &comp))
+    {
+        if (comp.stopped)
         {
+            hwcntl_uring_stopped = 1;
+        }
+
+        if (comp.len <= 0)
+        {
+            PERR("io_uring read of source %u fail, ret = %d", comp.tag, comp.len);
             continue;
         }
 
-        switch (j)
+        memset(&wm_read, 0, sizeof(wm_read));
+        switch (comp.tag)
         {
-            case 0:
-#ifdef SMI230_DATA_SYNC
-                ap_hw_poll_smi230acc(boschsensor->tmplist_hwcntl_acclraw, boschsensor->tmplist_hwcntl_gyroraw);
-#else
-                ap_hw_poll_smi230acc(boschsensor->tmplist_hwcntl_acclraw);
-#endif
+            case HWCNTL_SRC_ACC:
+                pushed += ap_hw_feed_smi230acc(boschsensor, comp.p_data, comp.len, &wm_read);
+                if (note_wm)
+                {
+                    sensord_wmctl_note_read(WMCTL_FIFO_ACC, &wm_read, sensord_get_tmstmp_ns());
+                }
                 break;
 
-            case 1:
 #ifndef SMI230_DATA_SYNC
-		/* this is an undefined place holder */
-                ap_hw_poll_smi230gyro(boschsensor->tmplist_hwcntl_gyroraw);
+            case HWCNTL_SRC_GYRO:
+                pushed += ap_hw_feed_smi230gyro(boschsensor, comp.p_data, comp.len, &wm_read);
+                if (note_wm)
+                {
+                    sensord_wmctl_note_read(WMCTL_FIFO_GYRO, &wm_read, sensord_get_tmstmp_ns());
+                }
+                break;
 #endif
+
+            case HWCNTL_SRC_CTL:
+                (void) sensord_algo_acc_cal_text((const char *)comp.p_data, comp.len);
+                break;
+
+            default:
+                /*eventfd and timerfd counters are already consumed by the read*/
+                *p_ready |= 1U << comp.tag;
                 break;
         }
+    }
+
+    return pushed;
+}
+
+/**
+ * io_uring flavour of IMU_hw_deliver_sensordata(): re-arms of the last wakeup
+ * are submitted with the wait, so a wakeup costs one syscall however many sources fired
+ */
+static uint32_t IMU_hw_deliver_sensordata_uring(BoschSensor *boschsensor)
+{
+    int32_t ret;
+    uint32_t ready = 0;
+    uint32_t pushed;
+    WMCTL_READ wm_read;
+
+    ret = uring_reader_wait(&hwcntl_uring);
+    if (ret < 0)
+    {
+        PERR("io_uring wait in error: ret = %d", ret);
+        return 0;
+    }
 
+    pushed = IMU_hw_reap_uring(boschsensor, &ready, 1);
+
+    while (ready & (1U << HWCNTL_SRC_FLUSH))
+    {
+        ready &= ~(1U << HWCNTL_SRC_FLUSH);
+        /*a read parked in the ring only runs on a later syscall, so drain by hand.
+         Completions before the drain hold older samples, the ones after it newer*/
+        pushed += IMU_hw_reap_uring(boschsensor, &ready, 0);
+        memset(&wm_read, 0, sizeof(wm_read));
+        pushed += ap_hw_read_smi230acc(boschsensor, &wm_read);
+        sensord_wmctl_note_drain(WMCTL_FIFO_ACC, &wm_read);
+#ifndef SMI230_DATA_SYNC
+        memset(&wm_read, 0, sizeof(wm_read));
+        pushed += ap_hw_read_smi230gyro(boschsensor, &wm_read);
+        sensord_wmctl_note_drain(WMCTL_FIFO_GYRO, &wm_read);
+#endif
+        pushed += IMU_hw_reap_uring(boschsensor, &ready, 0);
+        boschsensor->hwcntl_flush_drained();
     }
 
-#if 1
-    if (boschsensor->tmplist_hwcntl_acclraw->list_len + boschsensor->tmplist_hwcntl_gyroraw->list_len)
+    if (ready & (1U << HWCNTL_SRC_WAKE_TIMER))
     {
-        pthread_mutex_lock(&(boschsensor->shmem_hwcntl.mutex));
+        boschsensor->hwcntl_wake_hold(1);
+    }
 
-        ret = boschsensor->shmem_hwcntl.p_list->list_mount_rear(boschsensor->tmplist_hwcntl_acclraw);
-        if(ret){
-            PWARN("list mount fail");
-        }
+    if (ready & ((1U << HWCNTL_SRC_TIMER) | (1U << HWCNTL_SRC_WAKE_TIMER)))
+    {
+        boschsensor->sensord_notify_wakeup();
+    }
+
+    if (pushed)
+    {
+        boschsensor->hwcntl_wake_hold(0);
+        boschsensor->sensord_notify_rawdata();
+    }
 
-        ret = boschsensor->shmem_hwcntl.p_list->list_mount_rear(boschsensor->tmplist_hwcntl_gyroraw);
-        if(ret){
-            PWARN("list mount fail");
+    if (ready & (1U << HWCNTL_SRC_CMD))
+    {
+        hwcntl_cmd_process();
+    }
+
+    IMU_hw_report_loss(boschsensor);
+
+    if (hwcntl_uring_stopped)
+    {
+        /*closing the ring cancels the reads still armed, their fds keep the data for epoll*/
+        uring_reader_close(&hwcntl_uring);
+        hwcntl_uring_stopped = 0;
+        if (IMU_hwcntl_epoll_init(boschsensor))
+        {
+            PERR("epoll setup fail, sensor data delivery stopped");
+            return 0;
         }
+        PWARN("io_uring gave up a source, hwcntl back on epoll");
+        boschsensor->pfun_hw_deliver_sensordata = IMU_hw_deliver_sensordata;
+    }
+
+    return 0;
+}
 
-        pthread_cond_signal(&(boschsensor->shmem_hwcntl.cond));
-        pthread_mutex_unlock(&(boschsensor->shmem_hwcntl.mutex));
+static int32_t hwcntl_uring_add(int fd, uint32_t src, uint32_t buf_len)
+{
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    return uring_reader_add(&hwcntl_uring, fd, src, buf_len);
+}
+
+/**
+ * @return 0 when the io_uring loop took over, -errno to stay on epoll
+ */
+static int32_t IMU_hwcntl_uring_init(BoschSensor *boschsensor)
+{
+    int32_t ret;
+
+    ret = uring_reader_open(&hwcntl_uring);
+    if (ret)
+    {
+        PINFO("io_uring not available, ret = %d, hwcntl stays on epoll", ret);
+        return ret;
+    }
+
+    if(ACC_CHIP_SMI230 == accl_chip)
+    {
+        ret += hwcntl_uring_add(p_acc_iio ? p_acc_iio->fd : acc_input_fd, HWCNTL_SRC_ACC,
+                p_acc_iio ? IIO_SCANS_PER_READ * p_acc_iio->scan_size : sizeof(input_event_buf));
+    }
+#ifndef SMI230_DATA_SYNC
+    if(GYR_CHIP_SMI230 == gyro_chip)
+    {
+        ret += hwcntl_uring_add(p_gyr_iio ? p_gyr_iio->fd : gyr_input_fd, HWCNTL_SRC_GYRO,
+                p_gyr_iio ? IIO_SCANS_PER_READ * p_gyr_iio->scan_size : sizeof(input_event_buf));
     }
 #endif
+    ret += hwcntl_uring_add(boschsensor->deliver_timer_fd, HWCNTL_SRC_TIMER, sizeof(uint64_t));
+    ret += hwcntl_uring_add(boschsensor->wake_timer_fd, HWCNTL_SRC_WAKE_TIMER, sizeof(uint64_t));
+    ret += hwcntl_uring_add(boschsensor->flush_evtfd, HWCNTL_SRC_FLUSH, sizeof(uint64_t));
+    ret += hwcntl_uring_add(hwcntl_cmd_evtfd, HWCNTL_SRC_CMD, sizeof(uint64_t));
+    ret += hwcntl_uring_add(hwcntl_ctl_fd, HWCNTL_SRC_CTL, HWCNTL_CTL_BUF_LEN);
+    if (0 == ret)
+    {
+        ret = uring_reader_start(&hwcntl_uring);
+    }
+
+    if (ret)
+    {
+        PWARN("io_uring setup fail, ret = %d, hwcntl stays on epoll", ret);
+        uring_reader_close(&hwcntl_uring);
+        return ret;
+    }
+
+    PINFO("hwcntl on io_uring, %s buffers", hwcntl_uring.fixed_buf ? "registered" : "plain");
+    boschsensor->pfun_hw_deliver_sensordata = IMU_hw_deliver_sensordata_uring;
+
     return 0;
+}
+#endif
+
+/**
+ * @param src HWCNTL_SRC_*, comes back in epoll_event.data
+ */
+static int32_t hwcntl_epoll_add(int fd, uint32_t src)
+{
+    struct epoll_event event;
+
+    if (fd < 0)
+    {
+        return 0;
+    }
 
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    /*kernel drops EPOLLWAKEUP silently without CAP_BLOCK_SUSPEND*/
+    if (HWCNTL_SRC_WAKEUP_MASK & (1U << src))
+    {
+        event.events |= EPOLLWAKEUP;
+    }
+    event.data.u32 = src;
+
+    if (epoll_ctl(hwcntl_epoll_fd, EPOLL_CTL_ADD, fd, &event))
+    {
+        PERR("add fd of source %u to epoll fail, errno = %d(%s)", src, errno, strerror(errno));
+        return -errno;
+    }
+
+    return 0;
+}
+
+/**
+ * FIFO fds, delivery timers, flush requests and command queue all in one epoll set,
+ * registered once instead of rebuilt every pass
+ */
+static int32_t IMU_hwcntl_epoll_init(BoschSensor *boschsensor)
+{
+    int32_t ret = 0;
+
+    hwcntl_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (hwcntl_epoll_fd < 0)
+    {
+        ret = -errno;
+        PERR("epoll_create1 fail, errno = %d(%s)", errno, strerror(errno));
+        return ret;
+    }
+
+    if(ACC_CHIP_SMI230 == accl_chip)
+    {
+        ret += hwcntl_epoll_add(p_acc_iio ? p_acc_iio->fd : acc_input_fd, HWCNTL_SRC_ACC);
+    }
+#ifndef SMI230_DATA_SYNC
+    if(GYR_CHIP_SMI230 == gyro_chip)
+    {
+        ret += hwcntl_epoll_add(p_gyr_iio ? p_gyr_iio->fd : gyr_input_fd, HWCNTL_SRC_GYRO);
+    }
+#endif
+    ret += hwcntl_epoll_add(boschsensor->deliver_timer_fd, HWCNTL_SRC_TIMER);
+    ret += hwcntl_epoll_add(boschsensor->wake_timer_fd, HWCNTL_SRC_WAKE_TIMER);
+    ret += hwcntl_epoll_add(boschsensor->flush_evtfd, HWCNTL_SRC_FLUSH);
+    ret += hwcntl_epoll_add(hwcntl_cmd_evtfd, HWCNTL_SRC_CMD);
+    ret += hwcntl_epoll_add(hwcntl_ctl_fd, HWCNTL_SRC_CTL);
+
+    return ret;
+}
+
+static int32_t IMU_hwcntl_loop_init(BoschSensor *boschsensor)
+{
+    int32_t ret = 0;
+
+    hwcntl_cmd_evtfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (hwcntl_cmd_evtfd < 0)
+    {
+        PERR("create command eventfd fail, errno = %d(%s)", errno, strerror(errno));
+        return -errno;
+    }
+
+    hwcntl_ctl_open();
+
+#ifdef SMI230_IO_URING
+    if (0 == IMU_hwcntl_uring_init(boschsensor))
+    {
+        return 0;
+    }
+#endif
+
+    ret = IMU_hwcntl_epoll_init(boschsensor);
+    if (ret)
+    {
+        /*commands then run on the caller, there is no loop to pick them up*/
+        close(hwcntl_cmd_evtfd);
+        hwcntl_cmd_evtfd = -1;
+    }
+
+    return ret;
 }
 
 
@@ -1946,15 +2911,34 @@ static int32_t ap_hwcntl_init_ACC()
     {
         accl_device_name = "SMI230ACC";
 
-        open_input_by_name(accl_device_name, &acc_input_fd, &acc_input_num);
-        if (-1 == acc_input_fd)
+#ifdef SMI230_IIO
+        ret = iio_buffer_open(&smi230_acc_iio, accl_device_name, smi230_acc_iio_channels,
+                ARRAY_ELEMENTS(smi230_acc_iio_channels), SMI230_IIO_BUFFER_LEN);
+        if (0 == ret)
         {
-            PERR("Failed to open input event\n");
-            return -ENODEV;
+            /*driver attributes live in IIO device dir then*/
+            p_acc_iio = &smi230_acc_iio;
+            snprintf(acc_input_dir_name, sizeof(acc_input_dir_name), "%s", smi230_acc_iio.dev_dir_name);
         }
+        else
+        {
+            PWARN("no IIO buffer for %s, ret = %d, using input events", accl_device_name, ret);
+            ret = 0;
+        }
+#endif
 
-        PDEBUG("acc input_num = %d", acc_input_num);
-        sprintf(acc_input_dir_name, "/sys/class/input/SMI230ACC");
+        if (NULL == p_acc_iio)
+        {
+            open_input_by_name(accl_device_name, &acc_input_fd, &acc_input_num);
+            if (-1 == acc_input_fd)
+            {
+                PERR("Failed to open input event\n");
+                return -ENODEV;
+            }
+
+            PDEBUG("acc input_num = %d", acc_input_num);
+            sprintf(acc_input_dir_name, "/sys/class/input/SMI230ACC");
+        }
 
         driver_show_ver(acc_input_dir_name);
 
@@ -1982,10 +2966,52 @@ static int32_t ap_hwcntl_init_ACC()
         }
     }
 
+    /*scale factor is resolved here once, not per sample in the algo path*/
+    (void)sensord_convert_set_acc_range(accl_range);
+
     return 0;
 }
 
 
+/**
+ * write the configured gyro range to the SMI230 gyro at @param dir_name and
+ * resolve the conversion scale from it
+ */
+static int32_t ap_hwcntl_set_gyro_range(char *dir_name)
+{
+    int32_t ret = 0;
+
+    PINFO("gyro range config %d", gyro_range);
+    switch(gyro_range){
+        case GYRO_CHIP_RANGCONF_125DPS:
+            ret += wr_sysfs_oneint("range", dir_name, SMI230_GYRO_RANGE_125DPS);
+            break;
+        case GYRO_CHIP_RANGCONF_250DPS:
+            ret += wr_sysfs_oneint("range", dir_name, SMI230_GYRO_RANGE_250DPS);
+            break;
+        case GYRO_CHIP_RANGCONF_500DPS:
+            ret += wr_sysfs_oneint("range", dir_name, SMI230_GYRO_RANGE_500DPS);
+            break;
+        case GYRO_CHIP_RANGCONF_1000DPS:
+            ret += wr_sysfs_oneint("range", dir_name, SMI230_GYRO_RANGE_1000DPS);
+            break;
+        case GYRO_CHIP_RANGCONF_2000DPS:
+            ret += wr_sysfs_oneint("range", dir_name, SMI230_GYRO_RANGE_2000DPS);
+            break;
+        default:
+            break;
+    }
+    if (ret < 0)
+    {
+        PERR("write_sysfs() fail, ret = %d", ret);
+        return ret;
+    }
+
+    (void)sensord_convert_set_gyro_range(gyro_range);
+
+    return 0;
+}
+
 static int32_t ap_hwcntl_init_GYRO()
 {
     int32_t ret = 0;
@@ -2058,43 +3084,39 @@ static int32_t ap_hwcntl_init_GYRO()
     {
         gyro_device_name = "SMI230GYRO";
 
-        open_input_by_name(gyro_device_name, &gyr_input_fd, &gyr_input_num);
-        if (-1 == gyr_input_fd)
+#if defined(SMI230_IIO) && !defined(SMI230_DATA_SYNC)
+        ret = iio_buffer_open(&smi230_gyr_iio, gyro_device_name, smi230_gyr_iio_channels,
+                ARRAY_ELEMENTS(smi230_gyr_iio_channels), SMI230_IIO_BUFFER_LEN);
+        if (0 == ret)
         {
-            PERR("Failed to open input event\n");
-            return -ENODEV;
+            p_gyr_iio = &smi230_gyr_iio;
+            snprintf(gyr_input_dir_name, sizeof(gyr_input_dir_name), "%s", smi230_gyr_iio.dev_dir_name);
         }
-
-        PDEBUG("gyr input_num = %d", gyr_input_num);
-        sprintf(gyr_input_dir_name, "/sys/class/input/SMI230GYRO");
-
-        PINFO("gyro range config %d", gyro_range);
-        switch(gyro_range){
-            case GYRO_CHIP_RANGCONF_125DPS:
-                ret += wr_sysfs_oneint("range", gyr_input_dir_name, SMI230_GYRO_RANGE_125DPS);
-		break;
-            case GYRO_CHIP_RANGCONF_250DPS:
-                ret += wr_sysfs_oneint("range", gyr_input_dir_name, SMI230_GYRO_RANGE_250DPS);
-                break;
-            case GYRO_CHIP_RANGCONF_500DPS:
-                ret += wr_sysfs_oneint("range", gyr_input_dir_name, SMI230_GYRO_RANGE_500DPS);
-                break;
-            case GYRO_CHIP_RANGCONF_1000DPS:
-                ret += wr_sysfs_oneint("range", gyr_input_dir_name, SMI230_GYRO_RANGE_1000DPS);
-                break;
-            case GYRO_CHIP_RANGCONF_2000DPS:
-                ret += wr_sysfs_oneint("range", gyr_input_dir_name, SMI230_GYRO_RANGE_2000DPS);
-                break;
-            default:
-                break;
+        else
+        {
+            PWARN("no IIO buffer for %s, ret = %d, using input events", gyro_device_name, ret);
+            ret = 0;
         }
-        if (ret < 0)
+#endif
+
+        if (NULL == p_gyr_iio)
         {
-            PERR("write_sysfs() fail, ret = %d", ret);
-            return ret;
+            open_input_by_name(gyro_device_name, &gyr_input_fd, &gyr_input_num);
+            if (-1 == gyr_input_fd)
+            {
+                PERR("Failed to open input event\n");
+                return -ENODEV;
+            }
+
+            PDEBUG("gyr input_num = %d", gyr_input_num);
+            sprintf(gyr_input_dir_name, "/sys/class/input/SMI230GYRO");
         }
+
+        return ap_hwcntl_set_gyro_range(gyr_input_dir_name);
     }
 
+    (void)sensord_convert_set_gyro_range(gyro_range);
+
     return 0;
 
 }
@@ -2114,7 +3136,11 @@ int32_t hwcntl_init(BoschSensor *boschsensor)
     {
         boschsensor->pfun_hw_deliver_sensordata = IMU_hw_deliver_sensordata;
         ret = ap_hwcntl_init_ACC();
-#ifndef SMI230_DATA_SYNC
+#ifdef SMI230_DATA_SYNC
+        /*gyro samples come in the acc frames, range and scale are still the gyro's own*/
+        snprintf(gyr_input_dir_name, sizeof(gyr_input_dir_name), "/sys/class/input/SMI230GYRO");
+        ret = ap_hwcntl_set_gyro_range(gyr_input_dir_name);
+#else
         ret = ap_hwcntl_init_GYRO();
 #endif
     }else
@@ -2122,6 +3148,20 @@ int32_t hwcntl_init(BoschSensor *boschsensor)
         PERR("Unkown solution type: %d", solution_type);
     }
 
+#ifdef SMI230_FIFO
+    sensord_wmctl_init(SMI230_write_fifo_wm);
+#endif
+
+    /*mounting remap is resolved once here and applied per drained batch in the algo path*/
+    if(axis_remap_init(&g_remap_a, g_place_a, g_matrix_a) < 0)
+    {
+        PERR("invalid acc placement %d, using P0", g_place_a);
+    }
+    if(axis_remap_init(&g_remap_g, g_place_g, g_matrix_g) < 0)
+    {
+        PERR("invalid gyro placement %d, using P0", g_place_g);
+    }
+
     if(MAG_CHIP_BMM150 == magn_chip || MAG_CHIP_AKM09912 == magn_chip || MAG_CHIP_AKM09911 == magn_chip ||
                     MAG_CHIP_YAS537 ==  magn_chip || MAG_CHIP_YAS532 ==  magn_chip)
     {
@@ -2133,6 +3173,10 @@ int32_t hwcntl_init(BoschSensor *boschsensor)
         }
     }
 
+    if (0 == ret && SOLUTION_IMU == solution_type)
+    {
+        ret = IMU_hwcntl_loop_init(boschsensor);
+    }
 
     return ret;
 }
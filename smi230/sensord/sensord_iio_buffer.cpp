@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "sensord_pltf.h"
+#include "sensord_iio_buffer.h"
+#include "sensord_hwcntl_iio.h"
+#include "util_misc.h"
+
+static const char *iio_buffer_dir = "/sys/bus/iio/devices/";
+
+int iio_channel_parse_type(IIO_CHANNEL *p_ch, const char *type)
+{
+    char endian;
+    char sign;
+    uint32_t storage_bits;
+
+    if (5 != sscanf(type, "%ce:%c%u/%u>>%u", &endian, &sign, &p_ch->real_bits, &storage_bits, &p_ch->shift) &&
+            5 != sscanf(type, "%ce:%c%u/%uX%*u>>%u", &endian, &sign, &p_ch->real_bits, &storage_bits, &p_ch->shift))
+    {
+        return -EINVAL;
+    }
+
+    if (0 == p_ch->real_bits || 0 == storage_bits || storage_bits > 64 || storage_bits % 8 || p_ch->real_bits > storage_bits)
+    {
+        return -EINVAL;
+    }
+
+    p_ch->is_be = ('b' == endian);
+    p_ch->is_signed = ('s' == sign);
+    p_ch->storage_bytes = storage_bits / 8;
+
+    return 0;
+}
+
+static int setup_channel(IIO_CHANNEL *p_ch, const char *scan_dir_name, const char *name)
+{
+    char fname[64];
+    char type[32];
+    int index;
+    int ret;
+
+    snprintf(p_ch->name, sizeof(p_ch->name), "%s", name);
+
+    snprintf(fname, sizeof(fname), "in_%s_en", name);
+    ret = wr_sysfs_oneint(fname, (char *)scan_dir_name, 1);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    snprintf(fname, sizeof(fname), "in_%s_index", name);
+    ret = rd_sysfs_oneint(fname, (char *)scan_dir_name, &index);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    p_ch->index = index;
+
+    snprintf(fname, sizeof(fname), "in_%s_type", name);
+    ret = rd_sysfs_str(fname, scan_dir_name, type, sizeof(type));
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    return iio_channel_parse_type(p_ch, type);
+}
+
+void iio_buffer_layout(IIO_BUFFER *p_buf)
+{
+    IIO_CHANNEL tmp;
+    uint32_t i;
+    uint32_t j;
+    uint32_t offset = 0;
+    uint32_t align = 1;
+
+    for (i = 1; i < p_buf->channel_num; ++i)
+    {
+        for (j = i; j > 0 && p_buf->channel[j - 1].index > p_buf->channel[j].index; --j)
+        {
+            tmp = p_buf->channel[j];
+            p_buf->channel[j] = p_buf->channel[j - 1];
+            p_buf->channel[j - 1] = tmp;
+        }
+    }
+
+    for (i = 0; i < p_buf->channel_num; ++i)
+    {
+        offset = (offset + p_buf->channel[i].storage_bytes - 1) / p_buf->channel[i].storage_bytes *
+                p_buf->channel[i].storage_bytes;
+        p_buf->channel[i].offset = offset;
+        offset += p_buf->channel[i].storage_bytes;
+        align = MAX(align, p_buf->channel[i].storage_bytes);
+    }
+
+    p_buf->scan_size = (offset + align - 1) / align * align;
+}
+
+int iio_buffer_open(IIO_BUFFER *p_buf, const char *dev_name,
+        const char *const *channel_names, uint32_t channel_num, uint32_t length)
+{
+    char scan_dir_name[IIO_DIR_NAME_LEN + sizeof("/scan_elements")];
+    char dev_node[64];
+    int dev_num;
+    uint32_t i;
+    uint32_t j;
+    int ret;
+
+    memset(p_buf, 0, sizeof(IIO_BUFFER));
+    p_buf->fd = -1;
+
+    if (0 == channel_num || channel_num > IIO_CHANNEL_MAX)
+    {
+        return -EINVAL;
+    }
+
+    dev_num = get_IIOnum_by_name(dev_name, iio_buffer_dir);
+    if (dev_num < 0)
+    {
+        return -ENODEV;
+    }
+
+    snprintf(p_buf->dev_dir_name, sizeof(p_buf->dev_dir_name), "%siio:device%d", iio_buffer_dir, dev_num);
+    snprintf(p_buf->buf_dir_name, sizeof(p_buf->buf_dir_name), "%s/buffer", p_buf->dev_dir_name);
+    snprintf(scan_dir_name, sizeof(scan_dir_name), "%s/scan_elements", p_buf->dev_dir_name);
+
+    /*scan elements can only change while buffer is off*/
+    (void) wr_sysfs_oneint("enable", p_buf->buf_dir_name, 0);
+
+    for (i = 0; i < channel_num; ++i)
+    {
+        ret = setup_channel(&p_buf->channel[i], scan_dir_name, channel_names[i]);
+        if (ret < 0)
+        {
+            PERR("%s: scan element %s not usable, ret = %d", dev_name, channel_names[i], ret);
+            return ret;
+        }
+    }
+    p_buf->channel_num = channel_num;
+
+    iio_buffer_layout(p_buf);
+
+    for (i = 0; i < channel_num; ++i)
+    {
+        for (j = 0; j < channel_num; ++j)
+        {
+            if (0 == strcmp(channel_names[i], p_buf->channel[j].name))
+            {
+                p_buf->p_req[i] = &p_buf->channel[j];
+                break;
+            }
+        }
+    }
+
+    /*event timestamps of the HAL are CLOCK_BOOTTIME*/
+    ret = wr_sysfs_str("current_timestamp_clock", p_buf->dev_dir_name, "boottime");
+    if (ret < 0)
+    {
+        PWARN("%s: can't select boottime for timestamps, ret = %d", dev_name, ret);
+    }
+
+    ret = wr_sysfs_oneint("length", p_buf->buf_dir_name, length);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = wr_sysfs_oneint("enable", p_buf->buf_dir_name, 1);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    p_buf->p_scans = (uint8_t *) calloc(IIO_SCANS_PER_READ, p_buf->scan_size);
+    if (NULL == p_buf->p_scans)
+    {
+        iio_buffer_close(p_buf);
+        return -ENOMEM;
+    }
+
+    snprintf(dev_node, sizeof(dev_node), "/dev/iio:device%d", dev_num);
+    p_buf->fd = open(dev_node, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (p_buf->fd < 0)
+    {
+        ret = -errno;
+        PERR("Failed to open %s", dev_node);
+        iio_buffer_close(p_buf);
+        return ret;
+    }
+
+    PINFO("%s: %u channels in %u byte scans from %s", dev_name, channel_num, p_buf->scan_size, dev_node);
+
+    return 0;
+}
+
+void iio_buffer_close(IIO_BUFFER *p_buf)
+{
+    if (p_buf->fd >= 0)
+    {
+        close(p_buf->fd);
+        p_buf->fd = -1;
+    }
+
+    if (p_buf->buf_dir_name[0])
+    {
+        (void) wr_sysfs_oneint("enable", p_buf->buf_dir_name, 0);
+    }
+
+    free(p_buf->p_scans);
+    p_buf->p_scans = NULL;
+}
+
+int iio_buffer_set_watermark(IIO_BUFFER *p_buf, uint32_t scans)
+{
+    return wr_sysfs_oneint("watermark", p_buf->buf_dir_name, scans);
+}
+
+int32_t iio_buffer_read(IIO_BUFFER *p_buf)
+{
+    ssize_t ret;
+
+    ret = read(p_buf->fd, p_buf->p_scans, (size_t)p_buf->scan_size * IIO_SCANS_PER_READ);
+    if (ret < 0)
+    {
+        return (EAGAIN == errno) ? 0 : -errno;
+    }
+
+    return (int32_t)(ret / p_buf->scan_size);
+}
+
+int64_t iio_channel_value(const IIO_CHANNEL *p_ch, const uint8_t *p_scan)
+{
+    const uint8_t *p = p_scan + p_ch->offset;
+    uint64_t raw = 0;
+    uint32_t i;
+
+    for (i = 0; i < p_ch->storage_bytes; ++i)
+    {
+        if (p_ch->is_be)
+        {
+            raw = (raw << 8) | p[i];
+        }
+        else
+        {
+            raw |= (uint64_t)p[i] << (8 * i);
+        }
+    }
+
+    raw >>= p_ch->shift;
+    if (p_ch->real_bits < 64)
+    {
+        raw &= (1ULL << p_ch->real_bits) - 1;
+        if (p_ch->is_signed && (raw >> (p_ch->real_bits - 1)) & 1)
+        {
+            raw |= ~((1ULL << p_ch->real_bits) - 1);
+        }
+    }
+
+    return (int64_t)raw;
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "sensord_pltf.h"
+#include "sensord_input_frame.h"
+
+int input_frame_feed(INPUT_FRAME_PARSER *p_parser, const struct input_event *p_ev,
+        uint32_t expected_len, const char *name)
+{
+    int complete;
+
+    if (EV_SYN != p_ev->type)
+    {
+        if (p_parser->len < expected_len)
+        {
+            p_parser->value[p_parser->len] = p_ev->value;
+        }
+        else
+        {
+            p_parser->bad = 1;
+        }
+        p_parser->len++;
+        return 0;
+    }
+
+    if (SYN_DROPPED == p_ev->code)
+    {
+        /*evdev lost events, everything up to next SYN_REPORT is incomplete*/
+        p_parser->bad = 1;
+        return 0;
+    }
+
+    if (SYN_REPORT != p_ev->code)
+    {
+        return 0;
+    }
+
+    complete = (0 == p_parser->bad && expected_len == p_parser->len);
+    if (0 == complete)
+    {
+        p_parser->drop_count++;
+        /*only powers of 2, a misbehaving driver must not flood the log*/
+        if (0 == (p_parser->drop_count & (p_parser->drop_count - 1)))
+        {
+            PWARN("%s input frame of %u values dropped, %llu in total", name, p_parser->len,
+                    (unsigned long long)p_parser->drop_count);
+        }
+    }
+
+    p_parser->len = 0;
+    p_parser->bad = 0;
+
+    return complete;
+}
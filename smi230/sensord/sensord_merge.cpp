@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "sensord_merge.h"
+
+static const int8_t merge_stream_flag[MERGE_STREAM_NUM] = { HAS_ACC, HAS_MAG, HAS_GYR };
+
+void merge_iter_init(SAMPLE_MERGE_ITER *p_iter,
+        HW_DATA_UNION **pp_ACC_hwdata, uint32_t ACC_hwdata_len,
+        HW_DATA_UNION **pp_MAG_hwdata, uint32_t MAG_hwdata_len,
+        HW_DATA_UNION **pp_GYRO_hwdata, uint32_t GYRO_hwdata_len,
+        int64_t tolerance_ns)
+{
+    p_iter->pp_data[MERGE_STREAM_ACC] = pp_ACC_hwdata;
+    p_iter->len[MERGE_STREAM_ACC] = ACC_hwdata_len;
+    p_iter->pp_data[MERGE_STREAM_MAG] = pp_MAG_hwdata;
+    p_iter->len[MERGE_STREAM_MAG] = MAG_hwdata_len;
+    p_iter->pp_data[MERGE_STREAM_GYR] = pp_GYRO_hwdata;
+    p_iter->len[MERGE_STREAM_GYR] = GYRO_hwdata_len;
+    memset(p_iter->pos, 0, sizeof(p_iter->pos));
+
+    if(tolerance_ns < 0)
+    {
+        tolerance_ns = 0;
+    }
+    p_iter->tolerance_ns = tolerance_ns;
+}
+
+int8_t merge_iter_next(SAMPLE_MERGE_ITER *p_iter, HW_DATA_UNION *pp_out[MERGE_STREAM_NUM])
+{
+    int64_t base_tm = 0;
+    int base_found = 0;
+    int8_t mask = 0;
+    int i;
+    HW_DATA_UNION *p_head;
+
+    for (i = 0; i < MERGE_STREAM_NUM; ++i)
+    {
+        pp_out[i] = NULL;
+        if(p_iter->pos[i] < p_iter->len[i])
+        {
+            p_head = p_iter->pp_data[i][p_iter->pos[i]];
+            if(0 == base_found || p_head->timestamp < base_tm)
+            {
+                base_tm = p_head->timestamp;
+                base_found = 1;
+            }
+        }
+    }
+
+    if(0 == base_found)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < MERGE_STREAM_NUM; ++i)
+    {
+        if(p_iter->pos[i] < p_iter->len[i])
+        {
+            p_head = p_iter->pp_data[i][p_iter->pos[i]];
+            if(p_head->timestamp - base_tm <= p_iter->tolerance_ns)
+            {
+                pp_out[i] = p_head;
+                p_iter->pos[i]++;
+                mask |= merge_stream_flag[i];
+            }
+        }
+    }
+
+    return mask;
+}
@@ -0,0 +1,360 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "sensord_pltf.h"
+#include "sensord_resample.h"
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+    uint32_t t;
+
+    while (b)
+    {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+int sensord_resample_init(SENSORD_RESAMPLER *p_rs, uint32_t in_rate, uint32_t out_rate)
+{
+    uint32_t g;
+    uint32_t i;
+
+    if(0 == in_rate || 0 == out_rate)
+    {
+        PERR("invalid resample rate %u -> %u", in_rate, out_rate);
+        return -EINVAL;
+    }
+
+    g = gcd_u32(in_rate, out_rate);
+    if(out_rate / g > SENSORD_RESAMPLE_MAX_PHASE)
+    {
+        PERR("resample %u -> %u needs %u phases, max %d",
+                in_rate, out_rate, out_rate / g, SENSORD_RESAMPLE_MAX_PHASE);
+        return -EINVAL;
+    }
+
+    p_rs->up = out_rate / g;
+    p_rs->down = in_rate / g;
+    for (i = 0; i < p_rs->up; ++i)
+    {
+        p_rs->frac[i] = (float)i / (float)p_rs->up;
+    }
+
+    sensord_resample_reset(p_rs);
+
+    return 0;
+}
+
+void sensord_resample_reset(SENSORD_RESAMPLER *p_rs)
+{
+    p_rs->pos = 0;
+    memset(p_rs->carry_xyz, 0, sizeof(p_rs->carry_xyz));
+    p_rs->carry_tm = 0;
+    p_rs->primed = 0;
+}
+
+uint32_t sensord_resample_out_max(const SENSORD_RESAMPLER *p_rs, uint32_t in_count)
+{
+    /*outputs are the positions below in_count * up, starting at pos*/
+    uint64_t end = (uint64_t)in_count * p_rs->up;
+
+    if(p_rs->pos >= end)
+    {
+        return 0;
+    }
+
+    return (uint32_t)((end - p_rs->pos + p_rs->down - 1) / p_rs->down);
+}
+
+/**
+ * prime the carry with the very first sample of the stream
+ * @return number of input samples consumed, 0 or 1
+ */
+static uint32_t resample_prime(SENSORD_RESAMPLER *p_rs, const int32_t *p_in, const int64_t *p_in_tm, uint32_t in_count)
+{
+    if(p_rs->primed || 0 == in_count)
+    {
+        return 0;
+    }
+
+    p_rs->carry_xyz[0] = p_in[0];
+    p_rs->carry_xyz[1] = p_in[1];
+    p_rs->carry_xyz[2] = p_in[2];
+    p_rs->carry_tm = (NULL != p_in_tm) ? p_in_tm[0] : 0;
+    p_rs->primed = 1;
+
+    return 1;
+}
+
+static inline int64_t resample_tm(const SENSORD_RESAMPLER *p_rs, int64_t t0, int64_t t1, uint32_t phase)
+{
+    return t0 + ((t1 - t0) * (int64_t)phase + p_rs->up / 2) / (int64_t)p_rs->up;
+}
+
+/*the virtual input sequence is carry, p_in[0] ... p_in[in_count - 1]*/
+#define RESAMPLE_SAMPLE(p_rs, p_in, i) ((0 == (i)) ? (p_rs)->carry_xyz : (p_in) + 3 * ((i) - 1))
+#define RESAMPLE_TM(p_rs, p_in_tm, i) ((0 == (i)) ? (p_rs)->carry_tm : (p_in_tm)[(i) - 1])
+
+static inline void resample_frame_scalar(const SENSORD_RESAMPLER *p_rs,
+        const int32_t *p_in, const int64_t *p_in_tm, uint32_t i, uint32_t phase,
+        int32_t *p_out, int64_t *p_out_tm)
+{
+    const int32_t *s0 = RESAMPLE_SAMPLE(p_rs, p_in, i);
+    const int32_t *s1 = p_in + 3 * i;
+    float f = p_rs->frac[phase];
+    uint32_t c;
+
+    for (c = 0; c < 3; ++c)
+    {
+        p_out[c] = (int32_t)lrintf((float)s0[c] + (float)(s1[c] - s0[c]) * f);
+    }
+
+    if(NULL != p_in_tm && NULL != p_out_tm)
+    {
+        *p_out_tm = resample_tm(p_rs, RESAMPLE_TM(p_rs, p_in_tm, i), p_in_tm[i], phase);
+    }
+}
+
+/**
+ * consume the batch: keep the last input as carry and move pos back by the inputs used
+ */
+static void resample_advance(SENSORD_RESAMPLER *p_rs, const int32_t *p_in, const int64_t *p_in_tm, uint32_t in_count)
+{
+    uint64_t end;
+
+    if(0 == in_count)
+    {
+        return;
+    }
+
+    p_rs->carry_xyz[0] = p_in[3 * (in_count - 1)];
+    p_rs->carry_xyz[1] = p_in[3 * (in_count - 1) + 1];
+    p_rs->carry_xyz[2] = p_in[3 * (in_count - 1) + 2];
+    if(NULL != p_in_tm)
+    {
+        p_rs->carry_tm = p_in_tm[in_count - 1];
+    }
+
+    end = (uint64_t)in_count * p_rs->up;
+
+    /*positions of outputs lost to out_capacity are skipped*/
+    if(p_rs->pos < end)
+    {
+        p_rs->pos += (end - p_rs->pos + p_rs->down - 1) / p_rs->down * p_rs->down;
+    }
+
+    p_rs->pos -= end;
+}
+
+uint32_t sensord_resample_xyz_scalar(SENSORD_RESAMPLER *p_rs,
+        const int32_t *p_in, const int64_t *p_in_tm, uint32_t in_count,
+        int32_t *p_out, int64_t *p_out_tm, uint32_t out_capacity)
+{
+    uint32_t used;
+    uint32_t out_count = 0;
+    uint64_t end;
+    uint32_t i;
+
+    used = resample_prime(p_rs, p_in, p_in_tm, in_count);
+    p_in += 3 * used;
+    p_in_tm = (NULL != p_in_tm) ? p_in_tm + used : NULL;
+    in_count -= used;
+
+    end = (uint64_t)in_count * p_rs->up;
+    while (p_rs->pos < end && out_count < out_capacity)
+    {
+        i = (uint32_t)(p_rs->pos / p_rs->up);
+        resample_frame_scalar(p_rs, p_in, p_in_tm, i, (uint32_t)(p_rs->pos % p_rs->up),
+                p_out + 3 * out_count, (NULL != p_out_tm) ? p_out_tm + out_count : NULL);
+        out_count++;
+        p_rs->pos += p_rs->down;
+    }
+
+    resample_advance(p_rs, p_in, p_in_tm, in_count);
+
+    return out_count;
+}
+
+uint32_t sensord_resample_xyz(SENSORD_RESAMPLER *p_rs,
+        const int32_t *p_in, const int64_t *p_in_tm, uint32_t in_count,
+        int32_t *p_out, int64_t *p_out_tm, uint32_t out_capacity)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint32_t used;
+    uint32_t out_count = 0;
+    uint64_t end;
+    uint32_t i;
+    uint32_t phase;
+    const int32_t *s0;
+    const int32_t *s1;
+
+    used = resample_prime(p_rs, p_in, p_in_tm, in_count);
+    p_in += 3 * used;
+    p_in_tm = (NULL != p_in_tm) ? p_in_tm + used : NULL;
+    in_count -= used;
+
+    end = (uint64_t)in_count * p_rs->up;
+    while (p_rs->pos < end && out_count < out_capacity)
+    {
+        i = (uint32_t)(p_rs->pos / p_rs->up);
+        phase = (uint32_t)(p_rs->pos % p_rs->up);
+
+        /*one frame per vector, the 4th lane reads the next frame's x and writes
+         * the next output's x, which is overwritten later. So both samples must
+         * come from p_in with one more frame behind, and one more output must fit*/
+        if(i >= 1 && i + 1 < in_count && out_count + 1 < out_capacity)
+        {
+            s0 = p_in + 3 * (i - 1);
+            s1 = p_in + 3 * i;
+#if defined(__SSE2__)
+            __m128i v0 = _mm_loadu_si128((const __m128i *)s0);
+            __m128i v1 = _mm_loadu_si128((const __m128i *)s1);
+            __m128 vd = _mm_cvtepi32_ps(_mm_sub_epi32(v1, v0));
+            __m128 vr = _mm_add_ps(_mm_cvtepi32_ps(v0), _mm_mul_ps(vd, _mm_set1_ps(p_rs->frac[phase])));
+            _mm_storeu_si128((__m128i *)(p_out + 3 * out_count), _mm_cvtps_epi32(vr));
+#else
+            int32x4_t v0 = vld1q_s32(s0);
+            int32x4_t v1 = vld1q_s32(s1);
+            float32x4_t vd = vcvtq_f32_s32(vsubq_s32(v1, v0));
+            float32x4_t vr = vaddq_f32(vcvtq_f32_s32(v0), vmulq_n_f32(vd, p_rs->frac[phase]));
+#if defined(__aarch64__)
+            vst1q_s32(p_out + 3 * out_count, vcvtnq_s32_f32(vr));
+#else
+            /*armv7 NEON only truncates, round half away from zero instead*/
+            float32x4_t vh = vbslq_f32(vcltq_f32(vr, vdupq_n_f32(0.0f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+            vst1q_s32(p_out + 3 * out_count, vcvtq_s32_f32(vaddq_f32(vr, vh)));
+#endif
+#endif
+            if(NULL != p_in_tm && NULL != p_out_tm)
+            {
+                p_out_tm[out_count] = resample_tm(p_rs, p_in_tm[i - 1], p_in_tm[i], phase);
+            }
+        }
+        else
+        {
+            resample_frame_scalar(p_rs, p_in, p_in_tm, i, phase,
+                    p_out + 3 * out_count, (NULL != p_out_tm) ? p_out_tm + out_count : NULL);
+        }
+
+        out_count++;
+        p_rs->pos += p_rs->down;
+    }
+
+    resample_advance(p_rs, p_in, p_in_tm, in_count);
+
+    return out_count;
+#else
+    return sensord_resample_xyz_scalar(p_rs, p_in, p_in_tm, in_count, p_out, p_out_tm, out_capacity);
+#endif
+}
+
+void sensord_decimate_init(SENSORD_DECIMATOR *p_dec, uint32_t factor)
+{
+    memset(p_dec, 0, sizeof(SENSORD_DECIMATOR));
+    p_dec->factor = (0 == factor) ? 1 : factor;
+}
+
+/**
+ * load the comb history as if the stream had been constant at p_in forever,
+ * so the first output is already settled instead of ramping up from 0
+ */
+static void decimate_prime(SENSORD_DECIMATOR *p_dec, const int32_t p_in[3])
+{
+    uint64_t r = p_dec->factor;
+    uint32_t c;
+
+    for (c = 0; c < 3; ++c)
+    {
+        p_dec->integ1[c] = 0;
+        p_dec->integ2[c] = 0;
+        p_dec->comb1[c] = 0;
+        p_dec->comb2[c] = (uint64_t)(-(int64_t)(r * (r - 1) / 2) * (int64_t)p_in[c]);
+    }
+
+    p_dec->phase = 0;
+    p_dec->primed = 1;
+}
+
+int sensord_decimate_xyz(SENSORD_DECIMATOR *p_dec, const int32_t p_in[3], int64_t tm,
+        float scale, float p_out[3], int64_t *p_out_tm)
+{
+    uint64_t c1;
+    double gain;
+    uint32_t c;
+
+    if(1 == p_dec->factor)
+    {
+        p_out[0] = (float)p_in[0] * scale;
+        p_out[1] = (float)p_in[1] * scale;
+        p_out[2] = (float)p_in[2] * scale;
+        *p_out_tm = tm;
+        return 1;
+    }
+
+    if(0 == p_dec->primed)
+    {
+        decimate_prime(p_dec, p_in);
+    }
+
+    if(0 == p_dec->phase)
+    {
+        p_dec->center_tm = tm;
+    }
+
+    for (c = 0; c < 3; ++c)
+    {
+        p_dec->integ1[c] += (uint64_t)(int64_t)p_in[c];
+        p_dec->integ2[c] += p_dec->integ1[c];
+    }
+
+    if(++p_dec->phase < p_dec->factor)
+    {
+        return 0;
+    }
+
+    p_dec->phase = 0;
+    gain = (double)p_dec->factor * (double)p_dec->factor;
+
+    for (c = 0; c < 3; ++c)
+    {
+        c1 = p_dec->integ2[c] - p_dec->comb1[c];
+        p_dec->comb1[c] = p_dec->integ2[c];
+        p_out[c] = (float)((double)(int64_t)(c1 - p_dec->comb2[c]) / gain) * scale;
+        p_dec->comb2[c] = c1;
+    }
+
+    *p_out_tm = p_dec->center_tm;
+
+    return 1;
+}
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sensord_state.h"
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t payload_len;
+} STATE_HDR;
+
+/*largest file accepted, anything bigger is not ours*/
+#define STATE_FILE_MAX 512
+
+static uint32_t state_crc32(const uint8_t *p_buf, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < len; ++i)
+    {
+        crc ^= p_buf[i];
+        for (k = 0; k < 8; ++k)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * fsync the directory @param path lives in
+ */
+static int state_dir_sync(const char *path)
+{
+    char dir[256];
+    char *p_slash;
+    int fd;
+    int ret = 0;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    p_slash = strrchr(dir, '/');
+    if (NULL == p_slash)
+    {
+        snprintf(dir, sizeof(dir), ".");
+    }
+    else if (p_slash == dir)
+    {
+        dir[1] = 0;
+    }
+    else
+    {
+        *p_slash = 0;
+    }
+
+    fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+    if (fsync(fd))
+    {
+        ret = -errno;
+    }
+    close(fd);
+
+    return ret;
+}
+
+int sensord_state_load(const char *path, SENSORD_STATE *p_state)
+{
+    uint8_t buf[STATE_FILE_MAX];
+    STATE_HDR hdr;
+    uint32_t crc;
+    ssize_t len;
+    int fd;
+    int ret;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+
+    len = read(fd, buf, sizeof(buf));
+    ret = -errno;
+    close(fd);
+    if (len < 0)
+    {
+        return ret;
+    }
+
+    if ((size_t)len < sizeof(hdr) + sizeof(crc))
+    {
+        return -EINVAL;
+    }
+
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (SENSORD_STATE_MAGIC != hdr.magic || 0 == hdr.version || hdr.version > SENSORD_STATE_VERSION ||
+            (size_t)len != sizeof(hdr) + hdr.payload_len + sizeof(crc))
+    {
+        return -EINVAL;
+    }
+
+    memcpy(&crc, buf + sizeof(hdr) + hdr.payload_len, sizeof(crc));
+    if (crc != state_crc32(buf, sizeof(hdr) + hdr.payload_len))
+    {
+        return -EINVAL;
+    }
+
+    memcpy(p_state, buf + sizeof(hdr),
+            (hdr.payload_len < sizeof(*p_state)) ? hdr.payload_len : sizeof(*p_state));
+
+    return 0;
+}
+
+int sensord_state_save(const char *path, const SENSORD_STATE *p_state)
+{
+    uint8_t buf[sizeof(STATE_HDR) + sizeof(SENSORD_STATE) + sizeof(uint32_t)];
+    char tmp_path[256];
+    STATE_HDR hdr;
+    uint32_t crc;
+    ssize_t len;
+    int fd;
+    int ret = 0;
+
+    hdr.magic = SENSORD_STATE_MAGIC;
+    hdr.version = SENSORD_STATE_VERSION;
+    hdr.payload_len = sizeof(*p_state);
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), p_state, sizeof(*p_state));
+    crc = state_crc32(buf, sizeof(hdr) + sizeof(*p_state));
+    memcpy(buf + sizeof(hdr) + sizeof(*p_state), &crc, sizeof(crc));
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+
+    len = write(fd, buf, sizeof(buf));
+    if (len < 0)
+    {
+        ret = -errno;
+    }
+    else if ((size_t)len != sizeof(buf))
+    {
+        ret = -EIO;
+    }
+    else if (fsync(fd))
+    {
+        ret = -errno;
+    }
+    close(fd);
+
+    if (0 == ret && rename(tmp_path, path))
+    {
+        ret = -errno;
+    }
+    if (ret)
+    {
+        unlink(tmp_path);
+        return ret;
+    }
+
+    /*the rename is only durable once the directory entry is on disk too*/
+    return state_dir_sync(path);
+}
+
+int sensord_state_boot_id(const char *path, char p_id[SENSORD_STATE_BOOT_ID_LEN])
+{
+    ssize_t len;
+    int fd;
+    int ret;
+
+    memset(p_id, 0, SENSORD_STATE_BOOT_ID_LEN);
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -errno;
+    }
+
+    len = read(fd, p_id, SENSORD_STATE_BOOT_ID_LEN - 1);
+    ret = -errno;
+    close(fd);
+    if (len < 0)
+    {
+        memset(p_id, 0, SENSORD_STATE_BOOT_ID_LEN);
+        return ret;
+    }
+
+    while (len > 0 && ('\n' == p_id[len - 1] || ' ' == p_id[len - 1]))
+    {
+        p_id[--len] = 0;
+    }
+
+    return len ? 0 : -EINVAL;
+}
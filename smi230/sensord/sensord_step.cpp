@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sensord_step.h"
+
+/*walking band, cadence runs about 1 to 3 steps per second*/
+#define STEP_HP_RC (1.0f / (2.0f * (float)M_PI * 0.6f))
+#define STEP_LP_RC (1.0f / (2.0f * (float)M_PI * 3.0f))
+/*least rise of a step over its valley, m/s^2, and share of the running average it must reach*/
+#define STEP_AMP_MIN 1.2f
+#define STEP_AMP_RATIO 0.5f
+#define STEP_AMP_ALPHA 0.25f
+/*no faster than 4 steps per second*/
+#define STEP_MIN_INTERVAL_NS 250000000LL
+/*walk has ended after this long without a step, threshold falls back to the floor*/
+#define STEP_IDLE_NS 2000000000LL
+/*a gap longer than this restarts the filters*/
+#define STEP_GAP_NS 500000000LL
+
+void sensord_step_reset(SENSORD_STEP *p_step)
+{
+    memset(p_step, 0, sizeof(*p_step));
+}
+
+uint32_t sensord_step_run(SENSORD_STEP *p_step, const float *p_acc, const int64_t *p_tm,
+        uint32_t len, int64_t *p_step_tm, uint32_t step_max)
+{
+    uint32_t i;
+    uint32_t n = 0;
+    float mag;
+    float dt;
+    float prev;
+    float amp;
+    float thr;
+    int64_t tm;
+
+    for (i = 0; i < len; ++i)
+    {
+        tm = p_tm[i];
+        mag = sqrtf(p_acc[3 * i] * p_acc[3 * i] + p_acc[3 * i + 1] * p_acc[3 * i + 1] +
+                p_acc[3 * i + 2] * p_acc[3 * i + 2]);
+
+        if (0 == p_step->primed || tm - p_step->last_tm > STEP_GAP_NS || tm <= p_step->last_tm)
+        {
+            p_step->hp_in = mag;
+            p_step->hp_out = 0;
+            p_step->lp_out = 0;
+            p_step->valley = 0;
+            p_step->rising = 0;
+            p_step->last_tm = tm;
+            p_step->primed = 1;
+            continue;
+        }
+
+        dt = (float)(tm - p_step->last_tm) * 1e-9f;
+        p_step->last_tm = tm;
+
+        p_step->hp_out = STEP_HP_RC / (STEP_HP_RC + dt) * (p_step->hp_out + mag - p_step->hp_in);
+        p_step->hp_in = mag;
+        prev = p_step->lp_out;
+        p_step->lp_out += dt / (STEP_LP_RC + dt) * (p_step->hp_out - p_step->lp_out);
+
+        if (p_step->step_tm && tm - p_step->step_tm > STEP_IDLE_NS)
+        {
+            p_step->amp_avg = 0;
+        }
+
+        if (p_step->lp_out > prev)
+        {
+            p_step->rising = 1;
+        }
+        else if (p_step->rising)
+        {
+            /*prev was a local maximum*/
+            p_step->rising = 0;
+            amp = prev - p_step->valley;
+            thr = STEP_AMP_RATIO * p_step->amp_avg;
+            if (thr < STEP_AMP_MIN)
+            {
+                thr = STEP_AMP_MIN;
+            }
+
+            if (prev > 0 && amp >= thr &&
+                    (0 == p_step->step_tm || tm - p_step->step_tm >= STEP_MIN_INTERVAL_NS))
+            {
+                p_step->amp_avg = (0 == p_step->amp_avg) ? amp :
+                        p_step->amp_avg + STEP_AMP_ALPHA * (amp - p_step->amp_avg);
+                p_step->step_tm = tm;
+                p_step->valley = prev;
+                if (n < step_max)
+                {
+                    p_step_tm[n++] = tm;
+                }
+            }
+        }
+
+        if (p_step->lp_out < p_step->valley)
+        {
+            p_step->valley = p_step->lp_out;
+        }
+    }
+
+    return n;
+}
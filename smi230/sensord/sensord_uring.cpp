@@ -0,0 +1,407 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "sensord_pltf.h"
+#include "sensord_uring.h"
+
+/*poll and read of one slot, plus room for a re-arm queued while the pair is in flight*/
+#define URING_ENTRIES (URING_SLOT_MAX * 4)
+
+/*user_data: slot index, low bit set on the read, poll completions are skipped*/
+#define URING_UD_READ 1ULL
+#define URING_UD_SLOT(ud) ((uint32_t)((ud) >> 1))
+
+static int uring_setup(uint32_t entries, struct io_uring_params *p_params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p_params);
+}
+
+static int uring_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+    return (int) syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, uint32_t opcode, const void *arg, uint32_t nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static struct io_uring_sqe *uring_get_sqe(URING_READER *p_reader)
+{
+    uint32_t head = __atomic_load_n(p_reader->sq_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = p_reader->sq_local_tail;
+    uint32_t inx;
+    struct io_uring_sqe *p_sqe;
+
+    if (tail - head >= URING_ENTRIES)
+    {
+        return NULL;
+    }
+
+    inx = tail & *p_reader->sq_mask;
+    p_sqe = &p_reader->p_sqes[inx];
+    memset(p_sqe, 0, sizeof(*p_sqe));
+    p_reader->sq_array[inx] = inx;
+    p_reader->sq_local_tail++;
+
+    return p_sqe;
+}
+
+/**
+ * queue poll -> read of slot @param inx, submitted on next uring_reader_wait()
+ */
+static int32_t uring_arm(URING_READER *p_reader, uint32_t inx)
+{
+    URING_SLOT *p_slot = &p_reader->slot[inx];
+    struct io_uring_sqe *p_sqe;
+
+    p_sqe = uring_get_sqe(p_reader);
+    if (NULL == p_sqe)
+    {
+        return -EBUSY;
+    }
+
+    /*read only runs once the fd is readable, so a nonblocking fd never gets parked*/
+    p_sqe->opcode = IORING_OP_POLL_ADD;
+    p_sqe->fd = p_slot->fd;
+    p_sqe->poll32_events = POLLIN;
+    p_sqe->flags = IOSQE_IO_LINK;
+    p_sqe->user_data = (uint64_t)inx << 1;
+
+    p_sqe = uring_get_sqe(p_reader);
+    if (NULL == p_sqe)
+    {
+        /*ring is sized for every slot, cannot happen*/
+        return -EBUSY;
+    }
+
+    p_sqe->opcode = p_reader->fixed_buf ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    p_sqe->fd = p_slot->fd;
+    p_sqe->addr = (uint64_t)(uintptr_t)p_slot->p_buf;
+    p_sqe->len = p_slot->buf_len;
+    p_sqe->buf_index = 0;
+    p_sqe->user_data = ((uint64_t)inx << 1) | URING_UD_READ;
+
+    return 0;
+}
+
+static uint32_t uring_pending(URING_READER *p_reader)
+{
+    return p_reader->sq_local_tail - __atomic_load_n(p_reader->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static int32_t uring_submit(URING_READER *p_reader, uint32_t min_complete)
+{
+    int ret;
+    uint32_t flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+    __atomic_store_n(p_reader->sq_tail, p_reader->sq_local_tail, __ATOMIC_RELEASE);
+
+    do
+    {
+        /*whatever the kernel did not take last time is still published and goes again*/
+        ret = uring_enter(p_reader->ring_fd, uring_pending(p_reader), min_complete, flags);
+    } while (ret < 0 && EINTR == errno);
+
+    if (ret < 0)
+    {
+        return -errno;
+    }
+
+    return 0;
+}
+
+int32_t uring_reader_open(URING_READER *p_reader)
+{
+    struct io_uring_params params;
+    int ret;
+
+    memset(p_reader, 0, sizeof(*p_reader));
+    memset(&params, 0, sizeof(params));
+
+    p_reader->ring_fd = uring_setup(URING_ENTRIES, &params);
+    if (p_reader->ring_fd < 0)
+    {
+        ret = -errno;
+        p_reader->ring_fd = -1;
+        return ret;
+    }
+
+    p_reader->sq_map_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    p_reader->cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (p_reader->cq_map_len > p_reader->sq_map_len)
+        {
+            p_reader->sq_map_len = p_reader->cq_map_len;
+        }
+        p_reader->cq_map_len = 0;
+    }
+
+    p_reader->p_sq_map = mmap(NULL, p_reader->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            p_reader->ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == p_reader->p_sq_map)
+    {
+        p_reader->p_sq_map = NULL;
+        goto fail;
+    }
+
+    p_reader->p_cq_map = p_reader->p_sq_map;
+    if (p_reader->cq_map_len)
+    {
+        p_reader->p_cq_map = mmap(NULL, p_reader->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                p_reader->ring_fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == p_reader->p_cq_map)
+        {
+            p_reader->p_cq_map = NULL;
+            goto fail;
+        }
+    }
+
+    p_reader->sqe_map_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    p_reader->p_sqes = (struct io_uring_sqe *) mmap(NULL, p_reader->sqe_map_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, p_reader->ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == (void *) p_reader->p_sqes)
+    {
+        p_reader->p_sqes = NULL;
+        goto fail;
+    }
+
+    p_reader->sq_head = (uint32_t *)((uint8_t *)p_reader->p_sq_map + params.sq_off.head);
+    p_reader->sq_tail = (uint32_t *)((uint8_t *)p_reader->p_sq_map + params.sq_off.tail);
+    p_reader->sq_mask = (uint32_t *)((uint8_t *)p_reader->p_sq_map + params.sq_off.ring_mask);
+    p_reader->sq_array = (uint32_t *)((uint8_t *)p_reader->p_sq_map + params.sq_off.array);
+    p_reader->cq_head = (uint32_t *)((uint8_t *)p_reader->p_cq_map + params.cq_off.head);
+    p_reader->cq_tail = (uint32_t *)((uint8_t *)p_reader->p_cq_map + params.cq_off.tail);
+    p_reader->cq_mask = (uint32_t *)((uint8_t *)p_reader->p_cq_map + params.cq_off.ring_mask);
+    p_reader->p_cqes = (struct io_uring_cqe *)((uint8_t *)p_reader->p_cq_map + params.cq_off.cqes);
+
+    return 0;
+
+fail:
+    ret = -errno;
+    uring_reader_close(p_reader);
+    return ret;
+}
+
+int32_t uring_reader_add(URING_READER *p_reader, int fd, uint32_t tag, uint32_t buf_len)
+{
+    URING_SLOT *p_slot;
+
+    if (fd < 0 || 0 == buf_len || p_reader->slot_num >= URING_SLOT_MAX || p_reader->p_arena)
+    {
+        return -EINVAL;
+    }
+
+    p_slot = &p_reader->slot[p_reader->slot_num++];
+    p_slot->fd = fd;
+    p_slot->tag = tag;
+    /*keep every buffer 8 byte aligned, IIO scans carry s64 timestamps*/
+    p_slot->buf_len = (buf_len + 7) & ~7U;
+    p_slot->p_buf = NULL;
+    p_slot->fail_count = 0;
+    p_slot->stopped = 0;
+
+    return 0;
+}
+
+int32_t uring_reader_start(URING_READER *p_reader)
+{
+    struct iovec iov;
+    uint32_t i;
+    size_t offset = 0;
+    int32_t ret;
+
+    for (i = 0; i < p_reader->slot_num; ++i)
+    {
+        p_reader->arena_len += p_reader->slot[i].buf_len;
+    }
+
+    if (0 == p_reader->arena_len)
+    {
+        return -EINVAL;
+    }
+
+    p_reader->p_arena = (uint8_t *) calloc(1, p_reader->arena_len);
+    if (NULL == p_reader->p_arena)
+    {
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < p_reader->slot_num; ++i)
+    {
+        p_reader->slot[i].p_buf = p_reader->p_arena + offset;
+        offset += p_reader->slot[i].buf_len;
+    }
+
+    /*pinned once, kernel skips per read page lookups. Plain reads if memlock limit says no*/
+    iov.iov_base = p_reader->p_arena;
+    iov.iov_len = p_reader->arena_len;
+    if (0 == uring_register(p_reader->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1))
+    {
+        p_reader->fixed_buf = 1;
+    }
+    else
+    {
+        PWARN("register io_uring buffers fail, errno = %d(%s), using plain reads", errno, strerror(errno));
+    }
+
+    for (i = 0; i < p_reader->slot_num; ++i)
+    {
+        ret = uring_arm(p_reader, i);
+        if (ret)
+        {
+            return ret;
+        }
+    }
+
+    return uring_submit(p_reader, 0);
+}
+
+int32_t uring_reader_wait(URING_READER *p_reader)
+{
+    uint32_t head = *p_reader->cq_head;
+    uint32_t tail = __atomic_load_n(p_reader->cq_tail, __ATOMIC_ACQUIRE);
+
+    /*completions already there, only hand over the re-arms*/
+    if (head != tail)
+    {
+        return uring_pending(p_reader) ? uring_submit(p_reader, 0) : 0;
+    }
+
+    return uring_submit(p_reader, 1);
+}
+
+int32_t uring_reader_next(URING_READER *p_reader, URING_COMPLETION *p_comp)
+{
+    uint32_t head;
+    uint32_t inx;
+    const struct io_uring_cqe *p_cqe;
+    URING_SLOT *p_slot;
+    uint64_t user_data;
+    int32_t res;
+
+    while (1)
+    {
+        head = *p_reader->cq_head;
+        if (head == __atomic_load_n(p_reader->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            return 0;
+        }
+
+        p_cqe = &p_reader->p_cqes[head & *p_reader->cq_mask];
+        user_data = p_cqe->user_data;
+        res = p_cqe->res;
+        __atomic_store_n(p_reader->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        if (0 == (user_data & URING_UD_READ))
+        {
+            /*poll done, its linked read follows. A failed poll cancels the read*/
+            continue;
+        }
+
+        inx = URING_UD_SLOT(user_data);
+        if (inx >= p_reader->slot_num)
+        {
+            continue;
+        }
+
+        p_slot = &p_reader->slot[inx];
+        if (res > 0)
+        {
+            p_slot->fail_count = 0;
+        }
+        else if (-EAGAIN != res && -ECANCELED != res && -EINTR != res)
+        {
+            /*EOF or a real error, a fd that keeps failing would spin the loop*/
+            p_slot->fail_count++;
+        }
+
+        /*buffer is refilled only after the re-arm is submitted, i.e. next uring_reader_wait()*/
+        if (p_slot->fail_count < URING_FAIL_MAX)
+        {
+            if (uring_arm(p_reader, inx))
+            {
+                PERR("re-arm io_uring read of fd %d fail", p_slot->fd);
+                p_slot->stopped = 1;
+            }
+        }
+        else
+        {
+            PERR("io_uring read of fd %d failed %u times in a row, ret = %d, giving it up",
+                    p_slot->fd, p_slot->fail_count, res);
+            p_slot->stopped = 1;
+        }
+
+        if ((-EAGAIN == res || -ECANCELED == res || -EINTR == res) && 0 == p_slot->stopped)
+        {
+            /*fd was drained by someone else or poll was torn down, nothing to report*/
+            continue;
+        }
+
+        p_comp->tag = p_slot->tag;
+        p_comp->p_data = p_slot->p_buf;
+        p_comp->len = res;
+        p_comp->stopped = p_slot->stopped;
+
+        return 1;
+    }
+}
+
+void uring_reader_close(URING_READER *p_reader)
+{
+    if (p_reader->p_sqes)
+    {
+        munmap(p_reader->p_sqes, p_reader->sqe_map_len);
+        p_reader->p_sqes = NULL;
+    }
+
+    if (p_reader->p_cq_map && p_reader->p_cq_map != p_reader->p_sq_map)
+    {
+        munmap(p_reader->p_cq_map, p_reader->cq_map_len);
+    }
+    p_reader->p_cq_map = NULL;
+
+    if (p_reader->p_sq_map)
+    {
+        munmap(p_reader->p_sq_map, p_reader->sq_map_len);
+        p_reader->p_sq_map = NULL;
+    }
+
+    /*closing the ring cancels whatever is still in flight and unpins the arena*/
+    if (p_reader->ring_fd >= 0)
+    {
+        close(p_reader->ring_fd);
+        p_reader->ring_fd = -1;
+    }
+
+    free(p_reader->p_arena);
+    p_reader->p_arena = NULL;
+    p_reader->slot_num = 0;
+}
@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2021 Robert Bosch GmbH. All rights reserved. 
+ * Copyright (C) 2011~2015 Bosch Sensortec GmbH All Rights Reserved
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sensord_pltf.h"
+#include "sensord_wmctl.h"
+#include "util_misc.h"
+
+typedef struct
+{
+    int active;
+    int64_t period_ns;
+    uint32_t budget_frames;
+    uint32_t max_frames;
+    uint32_t frame_bytes;
+    uint32_t wm;
+    uint32_t clean_windows;
+
+    /*current window*/
+    int64_t window_start_ns;
+    uint32_t irq_cnt;
+    uint32_t frame_cnt;
+    uint32_t excess_max;    /// most frames read beyond watermark, i.e. what arrived while serving the interrupt
+    uint32_t overflow_cnt;
+    uint32_t lost_frames;
+    int64_t prev_last_tm;
+} WMCTL_FIFO;
+
+static WMCTL_FIFO wmctl_fifo[WMCTL_FIFO_NUM];
+static int32_t (*wmctl_write_wm)(int32_t fifo, uint32_t frames) = NULL;
+static pthread_mutex_t wmctl_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *wmctl_name[WMCTL_FIFO_NUM] = { "acc", "gyro" };
+
+/**
+ * latency driven target: what the client allows, minus what the hardware can't hold
+ * while the input path is getting to the interrupt
+ */
+static uint32_t latency_target(const WMCTL_FIFO *p_fifo)
+{
+    uint32_t headroom;
+    uint32_t target;
+
+    headroom = MAX(p_fifo->excess_max, (uint32_t)WMCTL_HEADROOM_MIN);
+    target = p_fifo->budget_frames;
+    if (p_fifo->max_frames > headroom && target > p_fifo->max_frames - headroom)
+    {
+        target = p_fifo->max_frames - headroom;
+    }
+
+    return MAX(target, 1U);
+}
+
+/**
+ * CPU driven target: fewest frames per interrupt keeping under WMCTL_IRQ_HZ_MAX
+ */
+static uint32_t cpu_target(const WMCTL_FIFO *p_fifo)
+{
+    int64_t irq_period_ns = 1000000000LL / WMCTL_IRQ_HZ_MAX;
+
+    return (uint32_t)((irq_period_ns + p_fifo->period_ns - 1) / p_fifo->period_ns);
+}
+
+static void write_wm(int32_t fifo, uint32_t wm)
+{
+    int32_t ret;
+
+    if (NULL == wmctl_write_wm)
+    {
+        return;
+    }
+
+    ret = wmctl_write_wm(fifo, wm);
+    if (ret < 0)
+    {
+        PERR("write %s fifo wm %u fail, ret = %d", wmctl_name[fifo], wm, ret);
+    }
+}
+
+static void reset_window(WMCTL_FIFO *p_fifo, int64_t now_ns)
+{
+    p_fifo->window_start_ns = now_ns;
+    p_fifo->irq_cnt = 0;
+    p_fifo->frame_cnt = 0;
+    p_fifo->overflow_cnt = 0;
+    p_fifo->lost_frames = 0;
+}
+
+/**
+ * wmctl_mutex held
+ * @return new watermark, same as p_fifo->wm if nothing to change
+ */
+static uint32_t decide_wm(int32_t fifo, WMCTL_FIFO *p_fifo, int64_t elapsed_ns)
+{
+    uint32_t lat_wm = latency_target(p_fifo);
+    uint32_t cpu_wm = MIN(cpu_target(p_fifo), lat_wm);
+    uint32_t wm = p_fifo->wm;
+    float irq_Hz = (float)p_fifo->irq_cnt * 1e9f / (float)elapsed_ns;
+
+    if (p_fifo->overflow_cnt)
+    {
+        /*frames got lost, interrupt was served too late for this fill level*/
+        wm = MAX(wm * 3 / 4, 1U);
+        p_fifo->clean_windows = 0;
+        PWARN("%s fifo: %u frames lost in %u overflows, wm %u -> %u",
+                wmctl_name[fifo], p_fifo->lost_frames, p_fifo->overflow_cnt, p_fifo->wm, wm);
+    }
+    else
+    {
+        p_fifo->clean_windows++;
+        if (wm < cpu_wm && irq_Hz > WMCTL_IRQ_HZ_MAX)
+        {
+            wm = cpu_wm;
+        }
+        else if (wm < lat_wm && p_fifo->clean_windows >= WMCTL_CLEAN_WINDOWS)
+        {
+            wm += MAX(wm / 8, 1U);
+            p_fifo->clean_windows = 0;
+        }
+    }
+
+    /*latency budget of the client is never exceeded*/
+    wm = MIN(wm, lat_wm);
+
+    if (wm != p_fifo->wm)
+    {
+        PINFO("%s fifo: %.1f irq/s, %u bytes/read, wm %u -> %u (latency target %u, cpu target %u)",
+                wmctl_name[fifo], irq_Hz,
+                p_fifo->irq_cnt ? p_fifo->frame_cnt * p_fifo->frame_bytes / p_fifo->irq_cnt : 0,
+                p_fifo->wm, wm, lat_wm, cpu_wm);
+    }
+
+    return wm;
+}
+
+void sensord_wmctl_init(int32_t (*pfun_write_wm)(int32_t fifo, uint32_t frames))
+{
+    pthread_mutex_lock(&wmctl_mutex);
+    memset(wmctl_fifo, 0, sizeof(wmctl_fifo));
+    wmctl_write_wm = pfun_write_wm;
+    pthread_mutex_unlock(&wmctl_mutex);
+}
+
+uint32_t sensord_wmctl_configure(int32_t fifo, float odr_Hz, uint32_t budget_frames,
+        uint32_t max_frames, uint32_t frame_bytes)
+{
+    WMCTL_FIFO *p_fifo;
+    uint32_t wm;
+
+    if (fifo < 0 || fifo >= WMCTL_FIFO_NUM)
+    {
+        return 0;
+    }
+
+    p_fifo = &wmctl_fifo[fifo];
+
+    pthread_mutex_lock(&wmctl_mutex);
+
+    if (odr_Hz <= 0 || 0 == max_frames)
+    {
+        memset(p_fifo, 0, sizeof(WMCTL_FIFO));
+        pthread_mutex_unlock(&wmctl_mutex);
+        return 0;
+    }
+
+    p_fifo->active = 1;
+    p_fifo->period_ns = (int64_t)(1e9f / odr_Hz);
+    p_fifo->budget_frames = budget_frames;
+    p_fifo->max_frames = max_frames;
+    p_fifo->frame_bytes = frame_bytes;
+    p_fifo->clean_windows = 0;
+    p_fifo->excess_max = 0;
+    p_fifo->prev_last_tm = 0;
+    reset_window(p_fifo, 0);
+
+    wm = latency_target(p_fifo);
+    p_fifo->wm = wm;
+    write_wm(fifo, wm);
+
+    pthread_mutex_unlock(&wmctl_mutex);
+
+    return wm;
+}
+
+void sensord_wmctl_note_read(int32_t fifo, const WMCTL_READ *p_read, int64_t now_ns)
+{
+    WMCTL_FIFO *p_fifo;
+    int64_t gap_ns;
+    uint32_t lost;
+    uint32_t wm;
+
+    if (fifo < 0 || fifo >= WMCTL_FIFO_NUM || 0 == p_read->frames)
+    {
+        return;
+    }
+
+    p_fifo = &wmctl_fifo[fifo];
+
+    pthread_mutex_lock(&wmctl_mutex);
+
+    if (0 == p_fifo->active)
+    {
+        pthread_mutex_unlock(&wmctl_mutex);
+        return;
+    }
+
+    if (0 == p_fifo->window_start_ns)
+    {
+        p_fifo->window_start_ns = now_ns;
+    }
+
+    p_fifo->irq_cnt++;
+    p_fifo->frame_cnt += p_read->frames;
+    if (p_read->frames > p_fifo->wm && p_read->frames - p_fifo->wm > p_fifo->excess_max)
+    {
+        p_fifo->excess_max = p_read->frames - p_fifo->wm;
+    }
+
+    /*a hole of more than half a period between two reads is frames the FIFO dropped*/
+    if (p_fifo->prev_last_tm)
+    {
+        gap_ns = p_read->first_tm - p_fifo->prev_last_tm;
+        if (gap_ns > p_fifo->period_ns + p_fifo->period_ns / 2)
+        {
+            lost = (uint32_t)((gap_ns + p_fifo->period_ns / 2) / p_fifo->period_ns) - 1;
+            p_fifo->overflow_cnt++;
+            p_fifo->lost_frames += lost;
+        }
+    }
+    p_fifo->prev_last_tm = p_read->last_tm;
+
+    if (now_ns - p_fifo->window_start_ns >= WMCTL_WINDOW_NS)
+    {
+        wm = decide_wm(fifo, p_fifo, now_ns - p_fifo->window_start_ns);
+        if (wm != p_fifo->wm)
+        {
+            p_fifo->wm = wm;
+            write_wm(fifo, wm);
+        }
+        reset_window(p_fifo, now_ns);
+    }
+
+    pthread_mutex_unlock(&wmctl_mutex);
+}
+
+void sensord_wmctl_note_drain(int32_t fifo, const WMCTL_READ *p_read)
+{
+    if (fifo < 0 || fifo >= WMCTL_FIFO_NUM || 0 == p_read->frames)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&wmctl_mutex);
+    if (wmctl_fifo[fifo].active)
+    {
+        wmctl_fifo[fifo].prev_last_tm = p_read->last_tm;
+    }
+    pthread_mutex_unlock(&wmctl_mutex);
+}
+
+uint32_t sensord_wmctl_get_wm(int32_t fifo)
+{
+    uint32_t wm;
+
+    if (fifo < 0 || fifo >= WMCTL_FIFO_NUM)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&wmctl_mutex);
+    wm = wmctl_fifo[fifo].wm;
+    pthread_mutex_unlock(&wmctl_mutex);
+
+    return wm;
+}